@@ -11,6 +11,12 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+
+#if __linux__ && !__ANDROID__
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#endif
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -22,6 +28,19 @@
 #include <OpenGL/gl3.h>
 #endif
 
+#ifdef _WIN32
+typedef HANDLE TestThread;
+#define TEST_THREAD_FUNC(name, arg) DWORD WINAPI name(LPVOID arg)
+#define TEST_THREAD_START(t, func, arg) (t = CreateThread(NULL, 0, func, arg, 0, NULL))
+#define TEST_THREAD_JOIN(t) (WaitForSingleObject(t, INFINITE), CloseHandle(t))
+#else
+#include <pthread.h>
+typedef pthread_t TestThread;
+#define TEST_THREAD_FUNC(name, arg) void* name(void* arg)
+#define TEST_THREAD_START(t, func, arg) (pthread_create(&t, NULL, func, arg) == 0)
+#define TEST_THREAD_JOIN(t) pthread_join(t, NULL)
+#endif
+
 void windowWithFlags(int flags) {
     Tigr* win = tigrWindow(100, 100, "CI", flags);
     tigrFill(win, 0, 0, win->w, win->h, tigrRGB(flags >> 1, 64, flags >> 1));
@@ -276,6 +295,1340 @@ void verifyDrawing() {
     assertBitmapsEqual(bmp, loaded);
 }
 
+typedef struct {
+    Tigr* bmp;
+    int rows;
+} RowCheck;
+
+static int checkRows(void* user, int y, int rows, int w, const TPixel* pix) {
+    RowCheck* check = (RowCheck*)user;
+    assert(y == check->rows);
+    assert(w == check->bmp->w);
+    assert(memcmp(pix, check->bmp->pix + y * w, rows * w * sizeof(TPixel)) == 0);
+    check->rows += rows;
+    return 1;
+}
+
+void streamingLoad() {
+    RowCheck check = { tigrLoadImage("../tigr.png"), 0 };
+    assert(check.bmp != 0);
+    assert(tigrLoadImageRows("../tigr.png", 7, checkRows, &check));
+    assert(check.rows == check.bmp->h);
+    tigrFree(check.bmp);
+}
+
+void loadInto() {
+    int w = 0, h = 0, colorType = 0;
+    assert(tigrImageInfo("../tigr.png", &w, &h, &colorType));
+    assert(w == 192 && h == 192 && colorType == 6);
+    assert(!tigrImageInfo("missing.png", &w, &h, &colorType));
+
+    Tigr* img = tigrLoadImage("../tigr.png");
+    Tigr* ref = tigrBitmap(100, 120);
+    Tigr* bmp = tigrBitmap(100, 120);
+    tigrClip(ref, 5, 0, 80, 110);
+    tigrClip(bmp, 5, 0, 80, 110);
+    tigrBlit(ref, img, -10, 20, 0, 0, img->w, img->h);
+    assert(tigrLoadImageInto(bmp, -10, 20, "../tigr.png"));
+    assertBitmapsEqual(bmp, ref);
+
+    tigrClip(ref, 0, 0, -1, -1);
+    tigrClip(bmp, 0, 0, -1, -1);
+    tigrBlit(ref, img, 0, 0, 0, 0, img->w, img->h);
+    assert(tigrLoadImageInto(bmp, 0, 0, "../tigr.png"));
+    assertBitmapsEqual(bmp, ref);
+
+    Tigr* atlas = tigrBitmap(200, 200);
+    assert(tigrLoadImageInto(atlas, 4, 4, "../tigr.png"));
+    for (int y = 0; y < img->h; y++) {
+        assert(memcmp(&atlas->pix[(y + 4) * atlas->w + 4], &img->pix[y * img->w], img->w * sizeof(TPixel)) == 0);
+    }
+    tigrFree(atlas);
+
+    // Sizes whose rows or pixel count would overflow are rejected up front.
+    int len;
+    unsigned char* png = (unsigned char*)tigrSaveImageMem(bmp, 1, &len);
+    const unsigned sizes[][2] = { { 134217768, 1 }, { 100000, 100000 }, { 0x80000000u, 1 } };
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            png[16 + j] = (unsigned char)(sizes[i][0] >> (24 - j * 8));
+            png[20 + j] = (unsigned char)(sizes[i][1] >> (24 - j * 8));
+        }
+        errno = 0;
+        assert(!tigrImageInfoMem(png, len, &w, &h, &colorType) && errno == EINVAL);
+        assert(tigrLoadImageMem(png, len) == 0 && errno == EINVAL);
+    }
+    free(png);
+
+    tigrFree(img);
+    tigrFree(ref);
+    tigrFree(bmp);
+}
+
+void fileMapping() {
+    int mappedLen, readLen;
+    const void* mapped = tigrMapFile("../tigr.png", &mappedLen);
+    void* read = tigrReadFile("../tigr.png", &readLen);
+    assert(mapped != 0 && read != 0);
+    assert(mappedLen == readLen);
+    assert(memcmp(mapped, read, readLen) == 0);
+    tigrUnmapFile(mapped, mappedLen);
+    free(read);
+
+    assert(tigrMapFile("missing.png", &mappedLen) == 0);
+}
+
+void batchLoad() {
+    const char* files[] = { "../tigr.png", "5x7.png", "ch.png", "missing.png" };
+    TigrBatch* batch = tigrLoadImages(files, 4, 2, 0, 0);
+    assert(batch != 0);
+    for (int i = 0; i < 3; i++) {
+        Tigr* loaded = tigrBatchWait(batch, i);
+        Tigr* ref = tigrLoadImage(files[i]);
+        assert(loaded != 0);
+        assertBitmapsEqual(loaded, ref);
+        tigrFree(loaded);
+        tigrFree(ref);
+    }
+    assert(tigrBatchWait(batch, 3) == 0);
+    assert(tigrBatchReady(batch, 3));
+    tigrBatchFree(batch);
+}
+
+static long fileSize(const char* fileName) {
+    int len = 0;
+    void* data = tigrReadFile(fileName, &len);
+    free(data);
+    return data ? len : -1;
+}
+
+static int stopWriting(void* user, const void* data, int length) {
+    int* calls = (int*)user;
+    return ++*calls < 2;
+}
+
+void saveLevels() {
+    Tigr* bmp = tigrBitmap(300, 200);
+    drawTestPattern(bmp);
+    // Some noise, to get past the easy matches.
+    unsigned seed = 1;
+    for (int i = 0; i < 300 * 40; i++) {
+        seed = seed * 1103515245 + 12345;
+        bmp->pix[i].r = seed >> 24;
+    }
+
+    long sizes[10];
+    for (int level = 0; level <= 9; level++) {
+        assert(tigrSaveImageLevel("save_test.png", bmp, level));
+        sizes[level] = fileSize("save_test.png");
+        Tigr* loaded = tigrLoadImage("save_test.png");
+        assert(loaded != 0);
+        assertBitmapsEqual(bmp, loaded);
+        tigrFree(loaded);
+    }
+    assert(sizes[9] < sizes[1] && sizes[1] < sizes[0]);
+    assert(!tigrSaveImageLevel("save_test.png", bmp, 10));
+
+    // Memory output matches the file.
+    int memLen = 0, fileLen = 0;
+    void* mem = tigrSaveImageMem(bmp, 0, &memLen);
+    assert(tigrSaveImageLevel("save_test.png", bmp, 0));
+    void* file = tigrReadFile("save_test.png", &fileLen);
+    assert(mem != 0 && file != 0);
+    assert(memLen == fileLen && memcmp(mem, file, memLen) == 0);
+    free(mem);
+    free(file);
+    remove("save_test.png");
+
+    int calls = 0;
+    errno = 0;
+    assert(!tigrSaveImageFunc(bmp, 6, stopWriting, &calls));
+    assert(calls == 2 && errno == ECANCELED);
+    tigrFree(bmp);
+}
+
+void saveColorTypes() {
+    // Grey, grey+alpha, RGB and RGBA.
+    const TPixel colors[4][2] = { { { 10, 10, 10, 255 }, { 200, 200, 200, 255 } },
+                                  { { 10, 10, 10, 255 }, { 200, 200, 200, 100 } },
+                                  { { 10, 20, 30, 255 }, { 200, 200, 200, 255 } },
+                                  { { 10, 20, 30, 255 }, { 200, 200, 200, 100 } } };
+    const int colorTypes[4] = { 0, 4, 2, 6 };
+
+    for (int i = 0; i < 4; i++) {
+        Tigr* bmp = tigrBitmap(97, 61);
+        for (int y = 0; y < bmp->h; y++) {
+            for (int x = 0; x < bmp->w; x++) {
+                TPixel c = colors[i][(x / 7 + y / 5) & 1];
+                c.r += x + y;
+                c.g += x + y;
+                c.b += x + y;
+                bmp->pix[y * bmp->w + x] = c;
+            }
+        }
+        for (int level = 0; level <= 9; level += 3) {
+            int len = 0, w, h, colorType = -1;
+            void* png = tigrSaveImageMem(bmp, level, &len);
+            assert(png != 0);
+            assert(tigrImageInfoMem(png, len, &w, &h, &colorType));
+            assert(colorType == colorTypes[i]);
+            Tigr* loaded = tigrLoadImageMem(png, len);
+            assertBitmapsEqual(bmp, loaded);
+            tigrFree(loaded);
+            free(png);
+        }
+        tigrFree(bmp);
+    }
+}
+
+// A small reference inflater, written straight from RFC 1951 and sharing
+// nothing with tigr's, to check what the PNG saver writes.
+typedef struct {
+    const unsigned char* in;
+    int inLen, pos, bit, err;
+    unsigned char* out;
+    int outLen, outPos;
+} RefInflate;
+
+typedef struct {
+    short count[16];
+    short symbol[288];
+} RefHuff;
+
+static const short refLenBase[29] = { 3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short refLenExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                       2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const short refDistBase[30] = { 1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                       193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const short refDistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static int refBits(RefInflate* r, int n) {
+    int v = 0;
+    for (int i = 0; i < n; i++) {
+        if (r->pos >= r->inLen) {
+            r->err = 1;
+            return 0;
+        }
+        v |= ((r->in[r->pos] >> r->bit) & 1) << i;
+        if (++r->bit == 8) {
+            r->bit = 0;
+            r->pos++;
+        }
+    }
+    return v;
+}
+
+static void refBuild(RefHuff* h, const unsigned char* lens, int n) {
+    short offs[16];
+    memset(h->count, 0, sizeof(h->count));
+    for (int i = 0; i < n; i++)
+        h->count[lens[i]]++;
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++)
+        offs[len + 1] = offs[len] + h->count[len];
+    for (int i = 0; i < n; i++) {
+        if (lens[i])
+            h->symbol[offs[lens[i]]++] = i;
+    }
+}
+
+// Codes are read a bit at a time, most significant bit first.
+static int refDecode(RefInflate* r, const RefHuff* h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        code |= refBits(r, 1);
+        if (code - h->count[len] < first)
+            return h->symbol[index + code - first];
+        index += h->count[len];
+        first = (first + h->count[len]) << 1;
+        code <<= 1;
+    }
+    r->err = 1;
+    return 0;
+}
+
+static void refCodes(RefInflate* r, const RefHuff* lit, const RefHuff* dist) {
+    while (!r->err) {
+        int sym = refDecode(r, lit);
+        if (sym < 256) {
+            if (r->outPos >= r->outLen)
+                r->err = 1;
+            else
+                r->out[r->outPos++] = sym;
+        } else if (sym == 256) {
+            return;
+        } else if (sym - 257 >= 29) {
+            r->err = 1;
+        } else {
+            int len = refLenBase[sym - 257] + refBits(r, refLenExtra[sym - 257]);
+            int dsym = refDecode(r, dist);
+            int d = dsym < 30 ? refDistBase[dsym] + refBits(r, refDistExtra[dsym]) : 1 << 30;
+            if (d > r->outPos || r->outPos + len > r->outLen) {
+                r->err = 1;
+                return;
+            }
+            for (; len > 0; len--, r->outPos++)
+                r->out[r->outPos] = r->out[r->outPos - d];
+        }
+    }
+}
+
+// Returns the number of bytes inflated, or -1.
+static int refInflate(unsigned char* out, int outLen, const unsigned char* in, int inLen) {
+    static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    RefInflate r = { in, inLen, 0, 0, 0, out, outLen, 0 };
+    RefHuff lit, dist;
+    unsigned char lens[288 + 32];
+    int last;
+
+    do {
+        last = refBits(&r, 1);
+        switch (refBits(&r, 2)) {
+            case 0: {
+                int len;
+                if (r.bit) {
+                    r.bit = 0;
+                    r.pos++;
+                }
+                len = refBits(&r, 16);
+                if (refBits(&r, 16) != (~len & 0xffff) || r.pos + len > inLen || r.outPos + len > outLen)
+                    return -1;
+                memcpy(out + r.outPos, in + r.pos, len);
+                r.pos += len;
+                r.outPos += len;
+                break;
+            }
+            case 1:
+                for (int i = 0; i < 288; i++)
+                    lens[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+                refBuild(&lit, lens, 288);
+                memset(lens, 5, 30);
+                refBuild(&dist, lens, 30);
+                refCodes(&r, &lit, &dist);
+                break;
+            case 2: {
+                int nlen = refBits(&r, 5) + 257, ndist = refBits(&r, 5) + 1, ncode = refBits(&r, 4) + 4;
+                memset(lens, 0, 19);
+                for (int i = 0; i < ncode; i++)
+                    lens[order[i]] = refBits(&r, 3);
+                refBuild(&lit, lens, 19);
+                for (int i = 0; i < nlen + ndist && !r.err;) {
+                    int sym = refDecode(&r, &lit), rep = 1, value = 0;
+                    if (sym < 16) {
+                        value = sym;
+                    } else if (sym == 16) {
+                        if (i == 0)
+                            return -1;
+                        value = lens[i - 1];
+                        rep = 3 + refBits(&r, 2);
+                    } else {
+                        rep = sym == 17 ? 3 + refBits(&r, 3) : 11 + refBits(&r, 7);
+                    }
+                    if (i + rep > nlen + ndist)
+                        return -1;
+                    while (rep--)
+                        lens[i++] = value;
+                }
+                refBuild(&lit, lens, nlen);
+                refBuild(&dist, lens + nlen, ndist);
+                refCodes(&r, &lit, &dist);
+                break;
+            }
+            default:
+                return -1;
+        }
+        if (r.err)
+            return -1;
+    } while (!last);
+    return r.outPos;
+}
+
+static unsigned getBE32(const unsigned char* p) {
+    return (unsigned)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// Decodes an 8-bit, non-interlaced PNG with the reference inflater, and checks it against 'bmp'.
+static void assertPngMatches(const unsigned char* png, int len, Tigr* bmp) {
+    static const int channels[7] = { 1, 0, 3, 0, 2, 0, 4 };
+    unsigned char idat[1 << 16], raw[1 << 16];
+    int idatLen = 0, w = 0, h = 0, ctype = 0;
+
+    assert(len > 8 && memcmp(png, "\211PNG\r\n\032\n", 8) == 0);
+    for (int p = 8; p + 12 <= len;) {
+        int size = getBE32(png + p);
+        const unsigned char* data = png + p + 8;
+        assert(p + 12 + size <= len);
+        if (memcmp(png + p + 4, "IHDR", 4) == 0) {
+            w = getBE32(data);
+            h = getBE32(data + 4);
+            assert(data[8] == 8 && data[12] == 0);
+            ctype = data[9];
+        } else if (memcmp(png + p + 4, "IDAT", 4) == 0) {
+            assert(idatLen + size <= (int)sizeof(idat));
+            memcpy(idat + idatLen, data, size);
+            idatLen += size;
+        }
+        p += 12 + size;
+    }
+    assert(w == bmp->w && h == bmp->h && ctype <= 6 && channels[ctype]);
+
+    int bpp = channels[ctype], stride = w * bpp;
+    assert(h * (stride + 1) <= (int)sizeof(raw));
+    assert(refInflate(raw, sizeof(raw), idat + 2, idatLen - 2) == h * (stride + 1));
+
+    for (int y = 0; y < h; y++) {
+        unsigned char* row = raw + y * (stride + 1);
+        unsigned char* prev = y ? row - stride : NULL;
+        int filter = *row++;
+        for (int i = 0; i < stride; i++) {
+            int a = i >= bpp ? row[i - bpp] : 0, b = prev ? prev[i] : 0, c = prev && i >= bpp ? prev[i - bpp] : 0;
+            int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+            int pred = filter == 1 ? a
+                       : filter == 2 ? b
+                       : filter == 3 ? (a + b) / 2
+                       : filter == 4 ? (pa <= pb && pa <= pc ? a : pb <= pc ? b : c)
+                                     : 0;
+            assert(filter <= 4);
+            row[i] += pred;
+        }
+        for (int x = 0; x < w; x++) {
+            const unsigned char* s = row + x * bpp;
+            TPixel want = bmp->pix[y * w + x], got;
+            got.r = s[0];
+            got.g = bpp >= 3 ? s[1] : s[0];
+            got.b = bpp >= 3 ? s[2] : s[0];
+            got.a = bpp == 2 ? s[1] : bpp == 4 ? s[3] : 255;
+            assert(memcmp(&want, &got, sizeof(got)) == 0);
+        }
+    }
+}
+
+void saveRoundTrip() {
+    // Tiny images mostly come out as a single fixed-code block.
+    const int sizes[][2] = { { 1, 1 }, { 2, 1 }, { 3, 2 }, { 7, 5 }, { 16, 3 }, { 40, 30 } };
+    unsigned seed = 7;
+
+    for (int s = 0; s < 6; s++) {
+        for (int level = 0; level <= 9; level++) {
+            Tigr* bmp = tigrBitmap(sizes[s][0], sizes[s][1]);
+            for (int i = 0; i < bmp->w * bmp->h; i++) {
+                seed = seed * 1103515245 + 12345;
+                bmp->pix[i] = tigrRGBA(seed >> 24, seed >> 16, seed >> 8, seed);
+                // Some runs and repeats too, for the match finder.
+                if (i > 0 && (seed >> 13) % 3 == 0)
+                    bmp->pix[i] = bmp->pix[i - 1];
+            }
+            if (s == 0)
+                bmp->pix[0] = tigrRGBA(0xc6, 0x91, 0xf0, 0x80);
+
+            int len = 0;
+            unsigned char* png = (unsigned char*)tigrSaveImageMem(bmp, level, &len);
+            assert(png != 0);
+            assertPngMatches(png, len, bmp);
+            Tigr* loaded = tigrLoadImageMem(png, len);
+            assertBitmapsEqual(bmp, loaded);
+            tigrFree(loaded);
+            free(png);
+            tigrFree(bmp);
+        }
+    }
+}
+
+static void countSaved(void* user, const char* fileName, int ok) {
+    int* saved = (int*)user;
+    assert(ok);
+    (*saved)++;
+}
+
+void saveAsync() {
+    int saved = 0;
+    TigrSaver* saver = tigrSaverCreate(2, countSaved, &saved);
+    Tigr* bmp = tigrBitmap(320, 240);
+    char name[32];
+
+    for (int i = 0; i < 5; i++) {
+        // Keep drawing after queueing; the saver works from its own copy.
+        tigrClear(bmp, tigrRGB(i * 40, 255 - i * 40, 7));
+        snprintf(name, sizeof(name), "async_%d.png", i);
+        assert(tigrSaveImageAsync(saver, name, bmp, 1, 1));
+        assert(tigrSaverPending(saver) <= 2);
+    }
+    tigrClear(bmp, tigrRGB(0, 0, 0));
+    tigrSaverFree(saver);
+    assert(saved == 5);
+
+    for (int i = 0; i < 5; i++) {
+        snprintf(name, sizeof(name), "async_%d.png", i);
+        tigrClear(bmp, tigrRGB(i * 40, 255 - i * 40, 7));
+        Tigr* loaded = tigrLoadImage(name);
+        assertBitmapsEqual(bmp, loaded);
+        tigrFree(loaded);
+        remove(name);
+    }
+    tigrFree(bmp);
+}
+
+void qoi() {
+    Tigr* bmp = tigrLoadImage("../tigr.png");
+    int len = 0, w, h, colorType;
+    void* data = tigrSaveQoiMem(bmp, &len);
+    assert(data != 0);
+    assert(tigrImageInfoMem(data, len, &w, &h, &colorType));
+    assert(w == bmp->w && h == bmp->h && colorType == 6);
+    Tigr* loaded = tigrLoadImageMem(data, len);
+    assertBitmapsEqual(bmp, loaded);
+    tigrFree(loaded);
+
+    // Decoding into a bitmap clips and copies alpha, the same as for PNG.
+    int pngLen = 0;
+    void* png = tigrSaveImageMem(bmp, 1, &pngLen);
+    Tigr* ref = tigrBitmap(150, 160);
+    Tigr* into = tigrBitmap(150, 160);
+    tigrClip(ref, 7, 3, 120, 140);
+    tigrClip(into, 7, 3, 120, 140);
+    assert(tigrLoadImageMemInto(ref, -20, 30, png, pngLen));
+    assert(tigrLoadImageMemInto(into, -20, 30, data, len));
+    assertBitmapsEqual(ref, into);
+    tigrClip(ref, 0, 0, -1, -1);
+    tigrClip(into, 0, 0, -1, -1);
+    assert(tigrLoadImageMemInto(ref, 1, 2, png, pngLen));
+    assert(tigrLoadImageMemInto(into, 1, 2, data, len));
+    assertBitmapsEqual(ref, into);
+    free(png);
+    tigrFree(ref);
+    tigrFree(into);
+
+    // Truncated data fails cleanly.
+    assert(tigrLoadImageMem(data, len / 2) == 0);
+    free(data);
+
+    // Runs, diffs and an opaque image, through a file.
+    Tigr* pattern = tigrBitmap(200, 200);
+    drawTestPattern(pattern);
+    for (int i = 0; i < 200 * 200; i++)
+        pattern->pix[i].a = 255;
+    assert(tigrSaveQoi("qoi_test.qoi", pattern));
+    assert(tigrImageInfo("qoi_test.qoi", &w, &h, &colorType) && colorType == 2);
+    loaded = tigrLoadImage("qoi_test.qoi");
+    assertBitmapsEqual(pattern, loaded);
+    tigrFree(loaded);
+    remove("qoi_test.qoi");
+
+    tigrFree(pattern);
+    tigrFree(bmp);
+}
+
+void snapshot() {
+    Tigr* bmp = tigrBitmap(300, 200);
+    drawTestPattern(bmp);
+    assert(tigrSaveSnapshot("snapshot_test.snap", bmp));
+
+    Tigr* mapped = tigrLoadSnapshot("snapshot_test.snap", 0);
+    assert(mapped != 0);
+    assertBitmapsEqual(bmp, mapped);
+    tigrFree(mapped);
+
+    // Copy-on-write snapshots can be drawn to, without touching the file.
+    Tigr* cow = tigrLoadSnapshot("snapshot_test.snap", 1);
+    assert(cow != 0);
+    tigrClear(cow, tigrRGB(1, 2, 3));
+    tigrFree(cow);
+    mapped = tigrLoadSnapshot("snapshot_test.snap", 0);
+    assertBitmapsEqual(bmp, mapped);
+    tigrFree(mapped);
+
+    assert(tigrLoadSnapshot("../tigr.png", 0) == 0 && errno == EINVAL);
+    remove("snapshot_test.snap");
+    tigrFree(bmp);
+}
+
+void imageCache() {
+    TigrCacheStats stats;
+    Tigr* ref = tigrLoadImage("../tigr.png");
+    Tigr* font = tigrLoadImage("5x7.png");
+    int len = 0;
+    void* data = tigrReadFile("../tigr.png", &len);
+    // Memory blobs are kept along with their images.
+    long long budget = 2 * sizeof(Tigr) + (ref->w * ref->h + font->w * font->h) * sizeof(TPixel) + len;
+    TigrCache* cache = tigrCacheCreate(budget);
+
+    Tigr* a = tigrCacheLoad(cache, "../tigr.png");
+    Tigr* b = tigrCacheLoad(cache, "../tigr.png");
+    assert(a != 0 && a == b);
+    assertBitmapsEqual(ref, a);
+    tigrCacheRelease(cache, a);
+    tigrCacheRelease(cache, b);
+
+    Tigr* c = tigrCacheLoad(cache, "5x7.png");
+    assertBitmapsEqual(font, c);
+    tigrCacheRelease(cache, c);
+    assert(tigrCacheLoad(cache, "missing.png") == 0);
+
+    // Memory blobs are keyed by contents. This pushes the least recently used image out.
+    Tigr* d = tigrCacheLoadMem(cache, data, len);
+    assert(d != 0 && tigrCacheLoadMem(cache, data, len) == d);
+    tigrCacheRelease(cache, d);
+    tigrCacheRelease(cache, d);
+    free(data);
+
+    tigrCacheStats(cache, &stats);
+    assert(stats.hits == 2 && stats.misses == 3);
+    assert(stats.evictions == 1 && stats.images == 2);
+    assert(stats.bytes <= budget);
+
+    tigrCacheFree(cache);
+    tigrFree(ref);
+    tigrFree(font);
+}
+
+static void putZip(unsigned char* p, unsigned v, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        p[i] = (v >> (i * 8)) & 0xff;
+}
+
+// A plain bitwise CRC-32, to check tigr's against.
+static unsigned zipCrc(const void* data, int len) {
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned crc = 0xffffffff;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+    }
+    return ~crc;
+}
+
+// Writes a zip with the given entries, and the CRCs of their uncompressed contents.
+static void writeZip(const char* fileName,
+                     int count,
+                     const char* const* names,
+                     const void* const* data,
+                     const int* lengths,
+                     const int* sizes,
+                     const int* methods,
+                     const unsigned* crcs) {
+    unsigned char dir[4096], header[46];
+    int dirLen = 0, offset = 0;
+    FILE* out = fopen(fileName, "wb");
+    assert(out != 0);
+
+    for (int i = 0; i < count; i++) {
+        int nameLen = (int)strlen(names[i]);
+        memset(header, 0, sizeof(header));
+        putZip(header, 0x04034b50, 4);
+        putZip(header + 8, methods[i], 2);
+        putZip(header + 14, crcs[i], 4);
+        putZip(header + 18, lengths[i], 4);
+        putZip(header + 22, sizes[i], 4);
+        putZip(header + 26, nameLen, 2);
+        fwrite(header, 1, 30, out);
+        fwrite(names[i], 1, nameLen, out);
+        fwrite(data[i], 1, lengths[i], out);
+
+        memset(header, 0, sizeof(header));
+        putZip(header, 0x02014b50, 4);
+        putZip(header + 10, methods[i], 2);
+        putZip(header + 16, crcs[i], 4);
+        putZip(header + 20, lengths[i], 4);
+        putZip(header + 24, sizes[i], 4);
+        putZip(header + 28, nameLen, 2);
+        putZip(header + 42, offset, 4);
+        memcpy(dir + dirLen, header, 46);
+        memcpy(dir + dirLen + 46, names[i], nameLen);
+        dirLen += 46 + nameLen;
+        offset += 30 + nameLen + lengths[i];
+    }
+
+    memset(header, 0, sizeof(header));
+    putZip(header, 0x06054b50, 4);
+    putZip(header + 8, count, 2);
+    putZip(header + 10, count, 2);
+    putZip(header + 12, dirLen, 4);
+    putZip(header + 16, offset, 4);
+    fwrite(dir, 1, dirLen, out);
+    fwrite(header, 1, 22, out);
+    fclose(out);
+}
+
+void archive() {
+    // "tigr tigr tigr tigr archive\n", DEFLATEd.
+    const unsigned char text[] = { 0x2b, 0xc9, 0x4c, 0x2f, 0x52, 0x28, 0x41, 0x25, 0x12,
+                                   0x8b, 0x92, 0x33, 0x32, 0xcb, 0x52, 0xb9, 0x00 };
+    // A dynamic block whose code length repeats run past the 258 lengths it declares.
+    const unsigned char overrun[] = { 0x05, 0x00, 0x90, 0xe0, 0xff, 0xff, 0xff, 0x1f };
+    int pngLen = 0;
+    void* png = tigrReadFile("../tigr.png", &pngLen);
+    assert(png != 0);
+
+    const unsigned textCrc = zipCrc("tigr tigr tigr tigr archive\n", 28);
+    const char* names[] = { "images/tigr.png", "text/readme.txt", "empty/",      "text/empty.txt",
+                            "bad/overrun.bin", "bad/size.txt",    "bad/crc.txt" };
+    const void* data[] = { png, text, "", "", overrun, text, text };
+    const int lengths[] = { pngLen, sizeof(text), 0, 0, sizeof(overrun), sizeof(text), sizeof(text) };
+    const int sizes[] = { pngLen, 28, 0, 0, 300, 5000, 28 };
+    const int methods[] = { 0, 8, 0, 0, 8, 8, 8 };
+    const unsigned crcs[] = { zipCrc(png, pngLen), textCrc, 0, 0, 0, textCrc, textCrc ^ 1 };
+    writeZip("archive_test.zip", 7, names, data, lengths, sizes, methods, crcs);
+
+    TigrArchive* archive = tigrOpenArchive("archive_test.zip");
+    assert(archive != 0);
+
+    int len = 0;
+    const void* stored = tigrArchiveRead(archive, "images/tigr.png", &len);
+    assert(stored != 0 && len == pngLen && memcmp(stored, png, len) == 0);
+    tigrArchiveRelease(archive, stored);
+
+    const char* inflated = (const char*)tigrArchiveRead(archive, "./text/readme.txt", &len);
+    assert(inflated != 0 && len == 28 && strcmp(inflated, "tigr tigr tigr tigr archive\n") == 0);
+    tigrArchiveRelease(archive, inflated);
+
+    const void* empty = tigrArchiveRead(archive, "text/empty.txt", &len);
+    assert(empty != 0 && len == 0);
+    tigrArchiveRelease(archive, empty);
+
+    // Corrupt entries, or ones that inflate to less than their size or to the wrong CRC, are rejected.
+    const char* bad[] = { "bad/overrun.bin", "bad/size.txt", "bad/crc.txt" };
+    for (int i = 0; i < 3; i++) {
+        errno = 0;
+        assert(tigrArchiveRead(archive, bad[i], &len) == 0 && errno == EINVAL && len == 0);
+    }
+
+    errno = 0;
+    assert(tigrArchiveRead(archive, "empty/", &len) == 0 && errno == ENOENT);
+    assert(tigrArchiveRead(archive, "missing.png", &len) == 0);
+
+    // Mounted, the archive's files can be loaded like any other.
+    assert(tigrLoadImage("images/tigr.png") == 0);
+    tigrMountArchive(archive);
+    Tigr* ref = tigrLoadImage("../tigr.png");
+    Tigr* bmp = tigrLoadImage("images/tigr.png");
+    assert(ref != 0 && bmp != 0);
+    assertBitmapsEqual(ref, bmp);
+    int w = 0, h = 0;
+    assert(tigrImageInfo("images/tigr.png", &w, &h, 0) && w == ref->w && h == ref->h);
+    char* file = (char*)tigrReadFile("text/readme.txt", &len);
+    assert(file != 0 && len == 28 && file[len] == '\0');
+    free(file);
+
+    // So can the cache, which notices when they go away.
+    TigrCache* cache = tigrCacheCreate(1 << 24);
+    Tigr* cached = tigrCacheLoad(cache, "images/tigr.png");
+    assert(cached != 0 && tigrCacheLoad(cache, "images/tigr.png") == cached);
+    assertBitmapsEqual(ref, cached);
+    tigrCacheRelease(cache, cached);
+    tigrCacheRelease(cache, cached);
+    tigrFree(bmp);
+    tigrFree(ref);
+
+    tigrCloseArchive(archive);
+    assert(tigrReadFile("text/readme.txt", &len) == 0);
+    assert(tigrCacheLoad(cache, "images/tigr.png") == 0);
+    tigrCacheFree(cache);
+    remove("archive_test.zip");
+    free(png);
+
+    assert(tigrOpenArchive("../tigr.png") == 0 && errno == EINVAL);
+}
+
+static TigrGlyph* findGlyph(TigrFont* font, int code) {
+    for (int i = 0; i < font->numGlyphs; i++) {
+        if (font->glyphs[i].code == code)
+            return &font->glyphs[i];
+    }
+    return 0;
+}
+
+void glyphLookup() {
+    const char* files[] = { "5x7.png", "ch.png" };
+    const int codepages[] = { TCP_ASCII, TCP_UTF32 };
+    for (int f = 0; f < 2; f++) {
+        TigrFont* font = tigrLoadFont(tigrLoadImage(files[f]), codepages[f]);
+        assert(font != 0 && font->pages != 0);
+
+        // Every glyph is found through the table.
+        for (int i = 0; i < font->numGlyphs; i++) {
+            char text[8];
+            *tigrEncodeUTF8(text, font->glyphs[i].code) = 0;
+            assert(tigrTextWidth(font, text) == font->glyphs[i].w);
+        }
+
+        // Missing characters use '?', or the first glyph if there isn't one.
+        TigrGlyph* fallback = findGlyph(font, '?');
+        fallback = fallback ? fallback : &font->glyphs[0];
+        assert(font->fallback == fallback);
+        assert(tigrTextWidth(font, "\xee\x80\x80") == fallback->w);
+        assert(tigrTextWidth(font, "\xf4\x8f\xbf\xbf") == fallback->w);
+        tigrFreeFont(font);
+    }
+}
+
+void fontTable() {
+    TigrFont* font = tigrLoadFont(tigrLoadImage("ch.png"), TCP_UTF32);
+    assert(font != 0);
+    for (int i = 1; i < font->numGlyphs; i++)
+        assert(font->glyphs[i - 1].code < font->glyphs[i].code);
+    assert(tigrSaveFontTable(font, "font_test.glyphs"));
+
+    TigrFont* loaded = tigrLoadFontTable(tigrLoadImage("ch.png"), "font_test.glyphs");
+    assert(loaded != 0 && loaded->numGlyphs == font->numGlyphs);
+    assert(memcmp(loaded->glyphs, font->glyphs, font->numGlyphs * sizeof(TigrGlyph)) == 0);
+    assert(tigrTextWidth(loaded, "你好") == tigrTextWidth(font, "你好"));
+    tigrFreeFont(loaded);
+
+    // The table has to match the sheet it was made from.
+    errno = 0;
+    assert(tigrLoadFontTable(tigrLoadImage("5x7.png"), "font_test.glyphs") == 0 && errno == EINVAL);
+    assert(tigrLoadFontTable(tigrLoadImage("5x7.png"), "missing.glyphs") == 0);
+
+    remove("font_test.glyphs");
+    tigrFreeFont(font);
+}
+
+void textBlending() {
+    TigrFont* fonts[] = { tfont, tigrLoadFont(tigrLoadImage("5x7.png"), TCP_ASCII),
+                          tigrLoadFont(tigrLoadImage("ch.png"), TCP_UTF32) };
+    const TPixel tints[] = { tigrRGBA(255, 255, 255, 255), tigrRGBA(200, 100, 50, 255), tigrRGBA(30, 220, 90, 128),
+                             tigrRGBA(255, 0, 255, 0) };
+    Tigr* a = tigrBitmap(64, 64);
+    Tigr* b = tigrBitmap(64, 64);
+    unsigned seed = 1;
+
+    tigrTextWidth(tfont, "");
+    for (int f = 0; f < 3; f++) {
+        TigrFont* font = fonts[f];
+        assert(font != 0 && font->atlas != 0);
+        for (int i = 0; i < font->numGlyphs && i < 300; i++) {
+            TigrGlyph* g = &font->glyphs[i];
+            char text[8];
+            *tigrEncodeUTF8(text, g->code) = 0;
+            // Where a code point has several glyphs, the last one is used.
+            if (g->code == '%' || (i + 1 < font->numGlyphs && g[1].code == g->code))
+                continue;
+
+            for (int p = 0; p < a->w * a->h; p++) {
+                seed = seed * 1103515245 + 12345;
+                a->pix[p] = b->pix[p] = tigrRGBA(seed >> 24, seed >> 16, seed >> 8, seed);
+            }
+            TPixel tint = tints[i % 4];
+            int mode = (i / 4) % 2;
+            tigrBlitMode(a, mode);
+            tigrBlitMode(b, mode);
+            // Part of the glyph is clipped off the left edge.
+            tigrPrint(a, font, -1, 3, tint, text);
+            tigrBlitTint(b, font->bitmap, -1, 3, g->x, g->y, g->w, g->h, tint);
+            assert(memcmp(a->pix, b->pix, a->w * a->h * sizeof(TPixel)) == 0);
+        }
+    }
+
+    tigrFreeFont(fonts[1]);
+    tigrFreeFont(fonts[2]);
+    tigrFree(a);
+    tigrFree(b);
+}
+
+void textLayout() {
+    const char* text = "Hello\nTIGR \xc3\x84\xe2\x82\xac\n\nlayout\n";
+    Tigr* a = tigrBitmap(120, 80);
+    Tigr* b = tigrBitmap(120, 80);
+
+    tigrClear(a, tigrRGB(20, 40, 60));
+    tigrClear(b, tigrRGB(20, 40, 60));
+    tigrPrint(a, tfont, 3, 4, tigrRGB(255, 200, 0), "%s", text);
+    tigrPrintText(b, tfont, 3, 4, tigrRGB(255, 200, 0), text, -1);
+    assertBitmapsEqual(a, b);
+
+    // Drawing a layout matches printing, with or without clipping.
+    TigrTextLayout* layout = tigrLayoutText(tfont, text, (int)strlen(text));
+    assert(layout != 0);
+    int w, h;
+    tigrLayoutSize(layout, &w, &h);
+    assert(w == tigrTextWidth(tfont, text) && h == tigrTextHeight(tfont, text));
+    for (int clip = 0; clip < 2; clip++) {
+        tigrClip(a, 0, clip * 20, 120, 15);
+        tigrClip(b, 0, clip * 20, 120, 15);
+        tigrClear(a, tigrRGB(20, 40, 60));
+        tigrClear(b, tigrRGB(20, 40, 60));
+        tigrPrintText(a, tfont, 3, 4, tigrRGBA(0, 255, 200, 150), text, -1);
+        tigrDrawLayout(b, layout, 3, 4, tigrRGBA(0, 255, 200, 150));
+        assertBitmapsEqual(a, b);
+    }
+    tigrFreeLayout(layout);
+
+    // Text isn't limited to 1024 bytes, and stops where the length says.
+    char longText[3000];
+    memset(longText, 'x', sizeof(longText));
+    longText[sizeof(longText) - 1] = 0;
+    layout = tigrLayoutText(tfont, longText, -1);
+    tigrLayoutSize(layout, &w, &h);
+    assert(w == tigrTextWidth(tfont, longText) && w > 1024 * tigrTextWidth(tfont, "x"));
+    tigrFreeLayout(layout);
+    layout = tigrLayoutText(tfont, "ab\xc3\x84", 3);
+    tigrLayoutSize(layout, &w, &h);
+    assert(w == tigrTextWidth(tfont, "ab\xef\xbf\xbd"));
+    tigrFreeLayout(layout);
+
+    tigrFree(a);
+    tigrFree(b);
+}
+
+void textCache() {
+    TigrFont* small = tigrLoadFont(tigrLoadImage("5x7.png"), TCP_ASCII);
+    TigrTextCache* cache = tigrTextCacheCreate(1 << 20);
+    const char* labels[] = { "Score: 1200", "  Lives\n  3", "", "FPS 60 \xc3\xa9" };
+    Tigr* a = tigrBitmap(100, 40);
+    Tigr* b = tigrBitmap(100, 40);
+    TigrCacheStats stats;
+
+    for (int pass = 0; pass < 3; pass++) {
+        // The last pass draws without the atlas, through the untinted label.
+        struct TigrFontAtlas* atlas = small->atlas;
+        if (pass == 2)
+            small->atlas = 0;
+        for (int i = 0; i < 4; i++) {
+            TigrFont* font = i % 2 ? small : tfont;
+            TPixel color = tigrRGBA(40 * i, 255 - pass * 50, 90, 255 - 60 * pass);
+            tigrClear(a, tigrRGB(10, 20, 30));
+            tigrClear(b, tigrRGB(10, 20, 30));
+            tigrClip(a, 5, 3, 60, 30);
+            tigrClip(b, 5, 3, 60, 30);
+            tigrPrintText(a, font, 2, 1, color, labels[i], -1);
+            tigrPrintCached(cache, b, font, 2, 1, color, labels[i], -1);
+            assertBitmapsEqual(a, b);
+        }
+        small->atlas = atlas;
+        if (pass == 1) {
+            // Empty the cache before drawing without the atlas.
+            tigrTextCacheFree(cache);
+            cache = tigrTextCacheCreate(1 << 20);
+        }
+    }
+    tigrTextCacheStats(cache, &stats);
+    assert(stats.misses == 4 && stats.hits == 0 && stats.images == 4);
+    tigrTextCacheFree(cache);
+
+    // With a tiny budget, only the label drawn last is kept.
+    cache = tigrTextCacheCreate(1);
+    for (int i = 0; i < 8; i++)
+        tigrPrintCached(cache, a, tfont, 0, 0, tigrRGB(255, 255, 255), labels[i % 2], -1);
+    tigrTextCacheStats(cache, &stats);
+    assert(stats.images == 1 && stats.evictions == 7 && stats.hits == 0);
+    tigrPrintCached(cache, a, tfont, 0, 0, tigrRGB(255, 255, 255), labels[1], -1);
+    tigrTextCacheStats(cache, &stats);
+    assert(stats.hits == 1);
+    tigrTextCacheFree(cache);
+
+    tigrFreeFont(small);
+    tigrFree(a);
+    tigrFree(b);
+}
+
+void textBox() {
+    const char* words[] = { "The ", "quick brown ", "fox jumps over the ", "lazy dog.", "\n",
+                            "Supercalifragilisticexpialidocious", "\n\n", "  indented", " ", "\n" };
+    const int width = 60;
+    TigrTextBox* whole = tigrTextBoxCreate(tfont, width, TIGR_ALIGN_LEFT);
+    TigrTextBox* parts = tigrTextBoxCreate(tfont, width, TIGR_ALIGN_LEFT);
+    char text[256] = "";
+    for (int i = 0; i < 10; i++) {
+        strcat(text, words[i]);
+        assert(tigrTextBoxAppend(parts, words[i], -1));
+    }
+    assert(tigrTextBoxAppend(whole, text, (int)strlen(text)));
+
+    // Appending piece by piece wraps the same as all at once.
+    assert(tigrTextBoxLines(whole) == tigrTextBoxLines(parts));
+    assert(tigrTextBoxLines(whole) > 5);
+    assert(tigrTextBoxHeight(whole) == tigrTextBoxLines(whole) * tigrTextHeight(tfont, ""));
+
+    Tigr* a = tigrBitmap(100, 200);
+    Tigr* b = tigrBitmap(100, 200);
+    tigrClear(a, tigrRGB(0, 0, 0));
+    tigrClear(b, tigrRGB(0, 0, 0));
+    tigrDrawTextBox(a, whole, 10, 5, tigrRGB(255, 255, 255));
+    tigrDrawTextBox(b, parts, 10, 5, tigrRGB(255, 255, 255));
+    assertBitmapsEqual(a, b);
+
+    // Nothing goes past the width, even the word too long to fit on a line.
+    assert(tigrTextWidth(tfont, "Supercalifragilisticexpialidocious") > width);
+    for (int y = 0; y < a->h; y++) {
+        for (int x = 10 + width; x < a->w; x++)
+            assert(tigrGet(a, x, y).r == 0);
+    }
+
+    // Drawing with a clip rect matches drawing everything and clipping afterwards.
+    int rowh = tigrTextHeight(tfont, "");
+    tigrClear(b, tigrRGB(0, 0, 0));
+    tigrClip(b, 0, 5 + rowh, 100, rowh * 2);
+    tigrDrawTextBox(b, parts, 10, 5, tigrRGB(255, 255, 255));
+    for (int y = 0; y < a->h; y++) {
+        for (int x = 0; x < a->w; x++) {
+            int inside = y >= 5 + rowh && y < 5 + 3 * rowh;
+            assert(tigrGet(b, x, y).r == (inside ? tigrGet(a, x, y).r : 0));
+        }
+    }
+
+    // Without a width, nothing wraps.
+    assert(tigrTextBoxSetWidth(whole, 0));
+    assert(tigrTextBoxLines(whole) == 4);
+    tigrTextBoxClear(whole);
+    assert(tigrTextBoxLines(whole) == 0);
+
+    tigrTextBoxFree(whole);
+    tigrTextBoxFree(parts);
+    tigrFree(a);
+    tigrFree(b);
+}
+
+void console() {
+    const TPixel fg = tigrRGB(200, 255, 200), bg = tigrRGB(0, 40, 0), hi = tigrRGB(255, 255, 0);
+    TigrConsole* con = tigrConsoleCreate(tfont, 20, 6);
+    assert(con != 0);
+    int w, h;
+    tigrConsoleSize(con, &w, &h);
+    Tigr* a = tigrBitmap(w + 10, h + 10);
+    Tigr* b = tigrBitmap(w + 10, h + 10);
+
+    // Draw a scrolling log a line at a time.
+    tigrConsoleClear(con, fg, bg);
+    for (int i = 0; i < 10; i++) {
+        char line[32];
+        snprintf(line, sizeof(line), "line %d: \xc3\xa9t\xc3\xa9", i);
+        if (i >= 6)
+            tigrConsoleScroll(con, 1, fg, bg);
+        int col = tigrConsolePrint(con, 0, i < 6 ? i : 5, fg, bg, line, -1);
+        tigrConsolePut(con, col, i < 6 ? i : 5, '!', hi, bg);
+        tigrDrawConsole(a, con, 5, 5);
+    }
+
+    // It ends up the same as drawing the final cells in one go.
+    TigrConsole* fresh = tigrConsoleCreate(tfont, 20, 6);
+    tigrConsoleClear(fresh, fg, bg);
+    for (int i = 4; i < 10; i++) {
+        char line[32];
+        snprintf(line, sizeof(line), "line %d: \xc3\xa9t\xc3\xa9", i);
+        int col = tigrConsolePrint(fresh, 0, i - 4, fg, bg, line, -1);
+        tigrConsolePut(fresh, col, i - 4, '!', hi, bg);
+    }
+    tigrDrawConsole(b, fresh, 5, 5);
+    assertBitmapsEqual(a, b);
+    tigrConsoleFree(fresh);
+
+    // Nothing is drawn when nothing has changed.
+    tigrPlot(a, 6, 6, hi);
+    tigrDrawConsole(a, con, 5, 5);
+    assertPixelsEqual(tigrGet(a, 6, 6), hi);
+    tigrConsoleInvalidate(con);
+    tigrDrawConsole(a, con, 5, 5);
+    assertBitmapsEqual(a, b);
+
+    // The clip rect is respected, and cells it cuts off are drawn once it's lifted.
+    tigrClear(a, tigrGet(b, 0, 0));
+    tigrConsoleInvalidate(con);
+    tigrClip(a, 10, 8, w / 2, h / 2);
+    tigrDrawConsole(a, con, 5, 5);
+    for (int y = 0; y < a->h; y++) {
+        for (int x = 0; x < a->w; x++) {
+            int inside = x >= 10 && x < 10 + w / 2 && y >= 8 && y < 8 + h / 2;
+            assertPixelsEqual(tigrGet(a, x, y), inside ? tigrGet(b, x, y) : tigrGet(b, 0, 0));
+        }
+    }
+    assert(a->cx == 10 && a->cy == 8 && a->cw == w / 2 && a->ch == h / 2);
+    tigrClip(a, 0, 0, -1, -1);
+    tigrDrawConsole(a, con, 5, 5);
+    assertBitmapsEqual(a, b);
+
+    tigrConsoleFree(con);
+    tigrFree(a);
+    tigrFree(b);
+}
+
+void utf8Array() {
+    char text[4096 + 1];
+    int expect[4096], got[4096];
+    unsigned seed = 12345;
+
+    // Random bytes, mostly ASCII runs with some multi-byte and invalid sequences mixed in,
+    // decode the same in bulk as one codepoint at a time.
+    for (int i = 0; i < 4096; i++) {
+        seed = seed * 1103515245 + 12345;
+        int r = (seed >> 16) & 0xff;
+        text[i] = (char)(r < 200 ? 'a' + r % 26 : r);
+    }
+    memset(text + 4092, 'z', 4);  // so the last sequence isn't cut short
+    text[4096] = 0;
+
+    int n = 0;
+    for (const char* p = text; p < text + 4096;)
+        p = tigrDecodeUTF8(p, &expect[n++]);
+
+    const char* next;
+    assert(tigrDecodeUTF8Array(text, 4096, got, 4096, &next) == n);
+    assert(next == text + 4096);
+    assert(memcmp(got, expect, n * sizeof(int)) == 0);
+
+    // Decoding in pieces gives the same codepoints.
+    int total = 0;
+    for (const char* p = text; *p;) {
+        int count = tigrDecodeUTF8Array(p, -1, got + total, 7, &p);
+        assert(count > 0 && count <= 7);
+        total += count;
+    }
+    assert(total == n);
+    assert(memcmp(got, expect, n * sizeof(int)) == 0);
+
+    // A sequence cut short by the end of the text is replaced.
+    const char* cut = "ab\xe2\x82";
+    assert(tigrDecodeUTF8Array(cut, 4, got, 4096, &next) == 3);
+    assert(got[2] == 0xfffd && next == cut + 4);
+}
+
+void sdfFont() {
+    const char* text = "Hello, world!\nSDF 123";
+    TigrSdfFont* sdf = tigrCreateSdfFont(tfont, 4);
+    assert(sdf != 0);
+    assert(tigrSdfTextWidth(sdf, 1, text) == tigrTextWidth(tfont, text));
+    assert(tigrSdfTextHeight(sdf, 1, text) == tigrTextHeight(tfont, text));
+    assert(tigrSdfTextWidth(sdf, 3, text) == 3 * tigrTextWidth(tfont, text));
+
+    // At the original size, it covers the bright pixels of the font, without the shadow.
+    Tigr* a = tigrBitmap(120, 40);
+    Tigr* b = tigrBitmap(120, 40);
+    tigrClear(a, tigrRGB(0, 0, 0));
+    tigrClear(b, tigrRGB(0, 0, 0));
+    tigrPrintSdf(a, sdf, 3, 4, 1, tigrRGB(255, 255, 255), text, -1);
+    tigrPrint(b, tfont, 3, 4, tigrRGB(255, 255, 255), text);
+    int lit = 0;
+    for (int i = 0; i < a->w * a->h; i++) {
+        assert((a->pix[i].r > 127) == (b->pix[i].r > 127));
+        lit += a->pix[i].r > 127;
+    }
+    assert(lit > 50);
+
+    // Scaled up, it stays inside its box, with smooth edges.
+    Tigr* big = tigrBitmap(400, 120);
+    int w = tigrSdfTextWidth(sdf, 3.5f, text), h = tigrSdfTextHeight(sdf, 3.5f, text);
+    int partial = 0;
+    tigrClear(big, tigrRGB(0, 0, 0));
+    tigrPrintSdf(big, sdf, 10, 10, 3.5f, tigrRGB(255, 255, 255), text, -1);
+    for (int y = 0; y < big->h; y++) {
+        for (int x = 0; x < big->w; x++) {
+            int r = tigrGet(big, x, y).r;
+            if (x < 10 - 4 || y < 10 - 4 || x >= 10 + w + 4 || y >= 10 + h + 4)
+                assert(r == 0);
+            partial += r > 0 && r < 255;
+        }
+    }
+    assert(partial > 0);
+
+    // A saved font draws the same once loaded again.
+    Tigr* again = tigrBitmap(400, 120);
+    assert(tigrSaveSdfFont(sdf, "sdf_test.sdf"));
+    TigrSdfFont* loaded = tigrLoadSdfFont("sdf_test.sdf");
+    assert(loaded != 0);
+    tigrClear(again, tigrRGB(0, 0, 0));
+    tigrPrintSdf(again, loaded, 10, 10, 3.5f, tigrRGB(255, 255, 255), text, -1);
+    assertBitmapsEqual(big, again);
+    remove("sdf_test.sdf");
+
+    tigrFreeSdfFont(sdf);
+    tigrFreeSdfFont(loaded);
+    tigrFree(a);
+    tigrFree(b);
+    tigrFree(big);
+    tigrFree(again);
+}
+
+typedef struct {
+    int seed;
+    TigrTextCache* cache;
+    TigrSdfFont* sdf;
+    Tigr* bmp;
+    int mismatches;
+} DrawJob;
+
+// Draws a scene that depends only on the seed, using shared fonts and caches.
+void drawScene(DrawJob* job, Tigr* bmp) {
+    char text[64];
+    snprintf(text, sizeof(text), "Thread %d\n\xc3\xa9t\xc3\xa9 %d", job->seed, job->seed * 7);
+    tigrClear(bmp, tigrRGB(job->seed * 20, 30, 60));
+    tigrFill(bmp, job->seed, 4, 40, 30, tigrRGBA(255, 128, 0, 160));
+    tigrLine(bmp, 0, 0, bmp->w - 1, bmp->h - 1, tigrRGB(0, 255, job->seed * 30));
+    tigrPrint(bmp, tfont, 5, 5, tigrRGB(255, 255, 255), "%s", text);
+    tigrPrintCached(job->cache, bmp, tfont, 5, 40, tigrRGB(200, 200, 255), text, -1);
+    tigrPrintCached(job->cache, bmp, tfont, 5, 60, tigrRGB(255, 200, 200), "Shared label", -1);
+    tigrPrintSdf(bmp, job->sdf, 5, 80, 1.5f + job->seed * 0.25f, tigrRGB(255, 255, 0), text, -1);
+}
+
+TEST_THREAD_FUNC(drawThread, arg) {
+    DrawJob* job = (DrawJob*)arg;
+    Tigr* bmp = tigrBitmap(job->bmp->w, job->bmp->h);
+    for (int i = 0; i < 20; i++) {
+        drawScene(job, bmp);
+        job->mismatches += memcmp(bmp->pix, job->bmp->pix, bmp->w * bmp->h * sizeof(TPixel)) != 0;
+    }
+    tigrFree(bmp);
+    return 0;
+}
+
+typedef struct {
+    Tigr* bmp;
+    int width;
+} FirstUseJob;
+
+TEST_THREAD_FUNC(firstUseThread, arg) {
+    FirstUseJob* job = (FirstUseJob*)arg;
+    job->width = tigrTextWidth(tfont, "First use \xc3\xa9t\xc3\xa9");
+    tigrPrint(job->bmp, tfont, 2, 2, tigrRGB(255, 255, 255), "First use \xc3\xa9t\xc3\xa9");
+    return 0;
+}
+
+void stockFontFirstUse() {
+    enum { THREADS = 8 };
+    FirstUseJob jobs[THREADS];
+    TestThread threads[THREADS];
+
+    // This runs before any other test, so the threads race to load the stock font.
+    assert(tfont->bitmap == 0);
+    for (int i = 0; i < THREADS; i++) {
+        jobs[i].bmp = tigrBitmap(120, 20);
+        assert(TEST_THREAD_START(threads[i], firstUseThread, &jobs[i]));
+    }
+    for (int i = 0; i < THREADS; i++)
+        TEST_THREAD_JOIN(threads[i]);
+
+    Tigr* expect = tigrBitmap(120, 20);
+    tigrPrint(expect, tfont, 2, 2, tigrRGB(255, 255, 255), "First use \xc3\xa9t\xc3\xa9");
+    for (int i = 0; i < THREADS; i++) {
+        assert(jobs[i].width == tigrTextWidth(tfont, "First use \xc3\xa9t\xc3\xa9"));
+        assertBitmapsEqual(jobs[i].bmp, expect);
+        tigrFree(jobs[i].bmp);
+    }
+    tigrFree(expect);
+}
+
+void threadedDrawing() {
+    enum { THREADS = 8 };
+    DrawJob jobs[THREADS];
+    TestThread threads[THREADS];
+    TigrTextCache* cache = tigrTextCacheCreate(4096);
+    TigrSdfFont* sdf = tigrCreateSdfFont(tfont, 3);
+
+    // Every thread draws its own bitmap, and has to match drawing it alone.
+    for (int i = 0; i < THREADS; i++) {
+        jobs[i].seed = i;
+        jobs[i].cache = cache;
+        jobs[i].sdf = sdf;
+        jobs[i].bmp = tigrBitmap(160, 120);
+        jobs[i].mismatches = 0;
+        drawScene(&jobs[i], jobs[i].bmp);
+    }
+    for (int i = 0; i < THREADS; i++)
+        assert(TEST_THREAD_START(threads[i], drawThread, &jobs[i]));
+    for (int i = 0; i < THREADS; i++)
+        TEST_THREAD_JOIN(threads[i]);
+    for (int i = 0; i < THREADS; i++) {
+        assert(jobs[i].mismatches == 0);
+        tigrFree(jobs[i].bmp);
+    }
+
+    tigrFreeSdfFont(sdf);
+    tigrTextCacheFree(cache);
+}
+
+typedef struct {
+    int* visits;
+    int nested;
+} VisitJob;
+
+void visitRange(void* ctx, int begin, int end) {
+    VisitJob* job = (VisitJob*)ctx;
+    for (int i = begin; i < end; i++)
+        job->visits[i]++;
+}
+
+void visitNested(void* ctx, int begin, int end) {
+    VisitJob* job = (VisitJob*)ctx;
+    // This runs inside another tigrParallelFor, so it stays on this thread.
+    tigrParallelFor(begin * 10, end * 10, 3, visitRange, job);
+}
+
+// Draws into a bitmap large enough to be split across threads.
+void drawLarge(Tigr* bmp, Tigr* src) {
+    tigrClear(bmp, tigrRGB(10, 20, 30));
+    tigrFill(bmp, 13, 17, bmp->w - 40, bmp->h - 50, tigrRGBA(200, 100, 50, 128));
+    tigrBlit(bmp, src, -5, 30, 0, 0, src->w, src->h);
+    tigrBlitTint(bmp, src, 40, -20, 0, 0, src->w, src->h, tigrRGBA(255, 128, 64, 200));
+    tigrBlitAlpha(bmp, src, 100, 100, 10, 10, src->w - 10, src->h - 10, 0.5f);
+}
+
+void parallelFor() {
+    enum { COUNT = 100000 };
+    VisitJob job;
+    job.visits = (int*)calloc(COUNT * 10, sizeof(int));
+
+    // Every index is visited exactly once, however the range is split.
+    tigrSetThreads(4);
+    assert(tigrGetThreads() == 4);
+    tigrParallelFor(0, COUNT, 7, visitRange, &job);
+    tigrParallelFor(5, 6, 100, visitRange, &job);
+    for (int i = 0; i < COUNT; i++)
+        assert(job.visits[i] == (i == 5 ? 2 : 1));
+
+    memset(job.visits, 0, COUNT * 10 * sizeof(int));
+    tigrParallelFor(0, COUNT, 1000, visitNested, &job);
+    for (int i = 0; i < COUNT * 10; i++)
+        assert(job.visits[i] == 1);
+    free(job.visits);
+
+    // Large drawing and saving give the same results on one thread or several.
+    Tigr* src = tigrBitmap(700, 600);
+    for (int y = 0; y < src->h; y++) {
+        for (int x = 0; x < src->w; x++)
+            src->pix[y * src->w + x] = tigrRGBA(x, y, x ^ y, (x + y) & 0xff);
+    }
+    Tigr* a = tigrBitmap(800, 700);
+    Tigr* b = tigrBitmap(800, 700);
+    drawLarge(a, src);
+    tigrSetThreads(1);
+    drawLarge(b, src);
+    assertBitmapsEqual(a, b);
+
+    tigrSetThreads(0);
+    int length;
+    void* png = tigrSaveImageMem(a, 1, &length);
+    assert(png != 0);
+    Tigr* loaded = tigrLoadImageMem(png, length);
+    assertBitmapsEqual(a, loaded);
+    free(png);
+
+    tigrSetThreads(1);
+    tigrFree(src);
+    tigrFree(a);
+    tigrFree(b);
+    tigrFree(loaded);
+}
+
+void saveThreads() {
+    Tigr* bmp = tigrBitmap(640, 480);
+    unsigned seed = 7;
+    for (int i = 0; i < bmp->w * bmp->h; i++) {
+        seed = seed * 1103515245 + 12345;
+        bmp->pix[i] = tigrRGBA(i / 640, seed >> 28, (i % 640) / 3, 255);
+    }
+    const int levels[] = { 0, 1, 6 };
+    for (int i = 0; i < 3; i++) {
+        assert(tigrSaveImageThreads("save_test.png", bmp, levels[i], 4));
+        Tigr* loaded = tigrLoadImage("save_test.png");
+        assert(loaded != 0);
+        assertBitmapsEqual(bmp, loaded);
+        tigrFree(loaded);
+    }
+    remove("save_test.png");
+    tigrFree(bmp);
+}
+
 void directOpenGL() {
     Tigr* win = tigrWindow(100, 100, "CI", 0);
     assert(tigrBeginOpenGL(win));
@@ -314,6 +1667,41 @@ void timing() {
     assert(elapsed > 0 && elapsed < 1);
 }
 
+#if __linux__ && !__ANDROID__
+// Sends a key press and release, then a wheel notch, to the window as if from the user.
+void sendInput(Tigr* win) {
+    Display* dpy = XOpenDisplay(NULL);
+    Window xwin = (Window)win->handle;
+    XEvent ev;
+
+    assert(dpy != 0);
+    memset(&ev, 0, sizeof(ev));
+    ev.xkey.type = KeyPress;
+    ev.xkey.display = dpy;
+    ev.xkey.window = xwin;
+    ev.xkey.root = DefaultRootWindow(dpy);
+    ev.xkey.same_screen = True;
+    ev.xkey.keycode = XKeysymToKeycode(dpy, XK_a);
+    ev.xkey.time = 1000;
+    XSendEvent(dpy, xwin, False, KeyPressMask, &ev);
+    ev.xkey.type = KeyRelease;
+    ev.xkey.time = 1250;
+    XSendEvent(dpy, xwin, False, KeyReleaseMask, &ev);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.xbutton.type = ButtonPress;
+    ev.xbutton.display = dpy;
+    ev.xbutton.window = xwin;
+    ev.xbutton.root = DefaultRootWindow(dpy);
+    ev.xbutton.same_screen = True;
+    ev.xbutton.button = Button4;
+    ev.xbutton.time = 1300;
+    XSendEvent(dpy, xwin, False, ButtonPressMask, &ev);
+    XSync(dpy, False);
+    XCloseDisplay(dpy);
+}
+#endif
+
 void input() {
     Tigr* win = tigrWindow(100, 100, "CI", 0);
     tigrUpdate(win);
@@ -333,6 +1721,43 @@ void input() {
     TigrTouchPoint point;
     int touches = tigrTouch(win, &point, 1);
     assert(touches <= 1);
+
+    // Whatever got queued comes out in order, and then the queue is empty.
+    TigrEvent event;
+    double last = 0;
+    tigrUpdate(win);
+    while (tigrPollEvent(win, &event)) {
+        assert(event.type > TIGR_EVENT_NONE && event.type <= TIGR_EVENT_CLOSE);
+        assert(event.time >= last);
+        last = event.time;
+    }
+    assert(event.type == TIGR_EVENT_NONE);
+    assert(tigrPollEvent(win, &event) == 0);
+
+#if __linux__ && !__ANDROID__
+    // Typing and scrolling come out as events, in order, with times that match.
+    // Anything else the window manager or pointer happens to send is skipped.
+    TigrEvent seen[8];
+    int count = 0;
+    sendInput(win);
+    for (int tries = 0; tries < 100 && count < 4; tries++) {
+        tigrUpdate(win);
+        while (count < 8 && tigrPollEvent(win, &seen[count])) {
+            int type = seen[count].type;
+            if (type == TIGR_EVENT_KEY_DOWN || type == TIGR_EVENT_KEY_UP || type == TIGR_EVENT_CHAR ||
+                type == TIGR_EVENT_WHEEL)
+                count++;
+        }
+    }
+    assert(count == 4);
+    assert(seen[0].type == TIGR_EVENT_KEY_DOWN && seen[0].key == 'A');
+    assert(seen[1].type == TIGR_EVENT_CHAR && seen[1].key == 'a');
+    assert(seen[2].type == TIGR_EVENT_KEY_UP && seen[2].key == 'A');
+    assert(seen[3].type == TIGR_EVENT_WHEEL && seen[3].dy == 1.0f && seen[3].dx == 0.0f);
+    assert(seen[0].time >= last && seen[1].time == seen[0].time);
+    assert(seen[2].time >= seen[1].time && seen[3].time >= seen[2].time);
+#endif
+    tigrFree(win);
 }
 
 void unicode() {
@@ -368,8 +1793,33 @@ int main(int argc, char* argv[]) {
         limit = atoi(argv[1]);
     }
 
-    Test tests[] = { { "Create offscreen", offscreen, 0 },
+    Test tests[] = { { "Stock font first use", stockFontFirstUse, 0 },
+                     { "Create offscreen", offscreen, 0 },
                      { "Drawing API", verifyDrawing, 0 },
+                     { "Streaming PNG load", streamingLoad, 0 },
+                     { "File mapping", fileMapping, 0 },
+                     { "Header probe and load into bitmap", loadInto, 0 },
+                     { "PNG save levels", saveLevels, 0 },
+                     { "PNG save color types", saveColorTypes, 0 },
+                     { "PNG save round trip", saveRoundTrip, 0 },
+                     { "Parallel PNG save", saveThreads, 0 },
+                     { "Async PNG save", saveAsync, 0 },
+                     { "QOI load and save", qoi, 0 },
+                     { "Bitmap snapshots", snapshot, 0 },
+                     { "Image cache", imageCache, 0 },
+                     { "Asset archive", archive, 0 },
+                     { "Glyph lookup", glyphLookup, 0 },
+                     { "Font glyph tables", fontTable, 0 },
+                     { "Text blending", textBlending, 0 },
+                     { "Text layout", textLayout, 0 },
+                     { "Text cache", textCache, 0 },
+                     { "Text box", textBox, 0 },
+                     { "Console", console, 0 },
+                     { "UTF8 decoding", utf8Array, 0 },
+                     { "SDF font", sdfFont, 0 },
+                     { "Threaded drawing", threadedDrawing, 0 },
+                     { "Parallel for", parallelFor, 0 },
+                     { "Batch image load", batchLoad, 0 },
                      { "Window basics", windowBasics, 1 },
                      { "Unicode", unicode, 0 },
                      { "Timing", timing, 1 },
@@ -8,8 +8,19 @@
 #include "tigr_bitmaps.c"
 #include "tigr_loadpng.c"
 #include "tigr_savepng.c"
+#include "tigr_loadqoi.c"
+#include "tigr_saveqoi.c"
+#include "tigr_snapshot.c"
+#include "tigr_cache.c"
+#include "tigr_archive.c"
 #include "tigr_inflate.c"
+#include "tigr_batch.c"
+#include "tigr_saver.c"
 #include "tigr_print.c"
+#include "tigr_textcache.c"
+#include "tigr_textbox.c"
+#include "tigr_console.c"
+#include "tigr_sdf.c"
 #include "tigr_win.c"
 #include "tigr_osx.c"
 #include "tigr_ios.c"
@@ -18,4 +29,6 @@
 #include "tigr_android.c"
 #include "tigr_switch.c"
 #include "tigr_gl.c"
-#include "tigr_utils.c"
\ No newline at end of file
+#include "tigr_utils.c"
+#include "tigr_thread.c"
+#include "tigr_pool.c"
\ No newline at end of file
@@ -695,7 +695,7 @@ void tigrFree(Tigr* bmp) {
 
         win->context = EGL_NO_CONTEXT;
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -755,6 +755,13 @@ void tigrMouseWheel(Tigr* bmp, float* x, float* y) {
 }
 
 void* tigrReadFile(const char* fileName, int* length) {
+    TigrArchive* archive = tigrFindMounted(fileName);
+    if (archive) {
+        void* data = tigrReadMountedFile(archive, fileName, length);
+        tigrReleaseMounted(archive);
+        return data;
+    }
+
     if (length != 0) {
         *length = 0;
     }
@@ -0,0 +1,359 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Zip archives, mapped once and indexed by name. Entries are found through the
+// central directory at the end of the file, and inflated only when they're read.
+#define ARCHIVE_END_SIG 0x06054b50
+#define ARCHIVE_DIR_SIG 0x02014b50
+#define ARCHIVE_LOCAL_SIG 0x04034b50
+#define ARCHIVE_END_SIZE 22
+#define ARCHIVE_DIR_SIZE 46
+#define ARCHIVE_LOCAL_SIZE 30
+#define ARCHIVE_STORED 0
+#define ARCHIVE_DEFLATED 8
+
+typedef struct {
+    const char* name;  // points into the mapping, not NUL terminated
+    unsigned nameLen, hash;
+    unsigned method, compSize, size, offset;
+    unsigned modified;  // DOS date and time
+    unsigned crc;
+} ArchiveEntry;
+
+struct TigrArchive {
+    const unsigned char* data;
+    int length;
+    int count;
+    ArchiveEntry* entries;
+    unsigned* slots;  // open addressing, entry index + 1, or zero if empty
+    unsigned mask;
+    unsigned serial;  // tells archives apart in tigrMountedInfo
+    TigrArchive* nextMount;
+    int refs, closing;  // from tigrFindMounted, and a pending tigrCloseArchive
+};
+
+// What empty entries read as, so they never point at the end of the mapping.
+static const unsigned char archiveEmpty[1] = { 0 };
+
+// Archives searched by tigrFindMounted, most recently mounted first.
+static TigrArchive* archiveMounts;
+static TigrMutex archiveLock = TIGR_MUTEX_INIT;
+static unsigned archiveSerial;
+
+static unsigned archiveGet16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+// FNV-1a.
+static unsigned archiveHash(const char* name, unsigned len) {
+    unsigned h = 2166136261u;
+    while (len--)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return h;
+}
+
+static ArchiveEntry* archiveFind(TigrArchive* archive, const char* name) {
+    unsigned len, h, i, slot;
+
+    // Archive names are relative, with forward slashes.
+    while (name[0] == '.' && (name[1] == '/' || name[1] == '\\'))
+        name += 2;
+    len = (unsigned)strlen(name);
+    h = archiveHash(name, len);
+    for (i = h & archive->mask; (slot = archive->slots[i]) != 0; i = (i + 1) & archive->mask) {
+        ArchiveEntry* e = &archive->entries[slot - 1];
+        if (e->hash == h && e->nameLen == len && memcmp(e->name, name, len) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+// Finds the end of central directory record, which is followed by a comment of up to 64kB.
+static const unsigned char* archiveEnd(const unsigned char* data, int length) {
+    const unsigned char* p;
+    const unsigned char* stop;
+
+    if (length < ARCHIVE_END_SIZE)
+        return NULL;
+    p = data + length - ARCHIVE_END_SIZE;
+    stop = length > 0xffff + ARCHIVE_END_SIZE ? data + length - 0xffff - ARCHIVE_END_SIZE : data;
+    for (; p >= stop; p--) {
+        if (tigrGet32LE(p) == ARCHIVE_END_SIG && p + ARCHIVE_END_SIZE + archiveGet16(p + 20) == data + length)
+            return p;
+    }
+    return NULL;
+}
+
+// Builds the name index from the central directory.
+static int archiveIndex(TigrArchive* archive) {
+    const unsigned char *end, *p, *dirEnd;
+    unsigned total, dirSize, dirOffset, slots, slot, i;
+
+    end = archiveEnd(archive->data, archive->length);
+    if (!end)
+        return 0;
+    total = archiveGet16(end + 10);
+    dirSize = tigrGet32LE(end + 12);
+    dirOffset = tigrGet32LE(end + 16);
+    // Zip64 and multi-disk archives aren't supported.
+    if (archiveGet16(end + 4) != 0 || total == 0xffff || dirOffset == 0xffffffff ||
+        dirOffset > (unsigned)(end - archive->data) || dirSize > (unsigned)(end - archive->data) - dirOffset)
+        return 0;
+
+    for (slots = 16; slots < total * 2; slots *= 2)
+        ;
+    archive->entries = (ArchiveEntry*)malloc((total ? total : 1) * sizeof(ArchiveEntry));
+    archive->slots = (unsigned*)calloc(slots, sizeof(unsigned));
+    if (!archive->entries || !archive->slots) {
+        errno = ENOMEM;
+        return 0;
+    }
+    archive->mask = slots - 1;
+
+    p = archive->data + dirOffset;
+    dirEnd = p + dirSize;
+    for (i = 0; i < total; i++) {
+        ArchiveEntry* e = &archive->entries[archive->count];
+        unsigned flags, nameLen, skip;
+
+        if (dirEnd - p < ARCHIVE_DIR_SIZE || tigrGet32LE(p) != ARCHIVE_DIR_SIG)
+            return 0;
+        flags = archiveGet16(p + 8);
+        nameLen = archiveGet16(p + 28);
+        skip = ARCHIVE_DIR_SIZE + nameLen + archiveGet16(p + 30) + archiveGet16(p + 32);
+        if ((unsigned)(dirEnd - p) < skip)
+            return 0;
+
+        e->name = (const char*)p + ARCHIVE_DIR_SIZE;
+        e->nameLen = nameLen;
+        e->method = archiveGet16(p + 10);
+        e->modified = tigrGet32LE(p + 12);
+        e->crc = tigrGet32LE(p + 16);
+        e->compSize = tigrGet32LE(p + 20);
+        e->size = tigrGet32LE(p + 24);
+        e->offset = tigrGet32LE(p + 42);
+        p += skip;
+
+        // Leave out directories, encrypted entries and anything we can't decompress.
+        if (nameLen == 0 || e->name[nameLen - 1] == '/' || (flags & 1) ||
+            (e->method != ARCHIVE_STORED && e->method != ARCHIVE_DEFLATED) || e->size > 0x7ffffffe)
+            continue;
+
+        e->hash = archiveHash(e->name, nameLen);
+        slot = e->hash & archive->mask;
+        while (archive->slots[slot])
+            slot = (slot + 1) & archive->mask;
+        archive->slots[slot] = ++archive->count;
+    }
+    return 1;
+}
+
+TigrArchive* tigrOpenArchive(const char* fileName) {
+    TigrArchive* archive = (TigrArchive*)calloc(1, sizeof(TigrArchive));
+    if (!archive) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    archive->data = (const unsigned char*)tigrMapFile(fileName, &archive->length);
+    if (!archive->data) {
+        free(archive);
+        return NULL;
+    }
+
+    errno = EINVAL;
+    if (!archiveIndex(archive)) {
+        tigrCloseArchive(archive);
+        return NULL;
+    }
+    return archive;
+}
+
+const void* tigrArchiveRead(TigrArchive* archive, const char* name, int* length) {
+    ArchiveEntry* e = archiveFind(archive, name);
+    const unsigned char* local;
+    unsigned start, written;
+    unsigned char* out;
+
+    if (length)
+        *length = 0;
+    if (!e) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    // The local header can have a different extra field, so find the data through it.
+    local = archive->data + e->offset;
+    if ((long long)e->offset + ARCHIVE_LOCAL_SIZE > archive->length || tigrGet32LE(local) != ARCHIVE_LOCAL_SIG) {
+        errno = EINVAL;
+        return NULL;
+    }
+    start = e->offset + ARCHIVE_LOCAL_SIZE + archiveGet16(local + 26) + archiveGet16(local + 28);
+    if ((long long)start + e->compSize > archive->length) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (e->method == ARCHIVE_STORED) {
+        if (e->compSize != e->size) {
+            errno = EINVAL;
+            return NULL;
+        }
+        if (length)
+            *length = (int)e->size;
+        return e->size ? archive->data + start : archiveEmpty;
+    }
+
+    if (e->size >= 0x7fffffff) {
+        errno = EINVAL;
+        return NULL;
+    }
+    out = (unsigned char*)malloc(e->size + 1);
+    if (!out) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    // The whole entry has to be there, and match the directory's CRC.
+    if (!tigrInflateSize(out, e->size, archive->data + start, e->compSize, &written) || written != e->size ||
+        tigrCrc32(0, out, written) != e->crc) {
+        free(out);
+        errno = EINVAL;
+        return NULL;
+    }
+    out[e->size] = '\0';
+    if (length)
+        *length = (int)e->size;
+    return out;
+}
+
+// Stored entries point straight into the mapping.
+static int archiveMapped(TigrArchive* archive, const void* data) {
+    const unsigned char* p = (const unsigned char*)data;
+    return p == archiveEmpty || (p >= archive->data && p < archive->data + archive->length);
+}
+
+void tigrArchiveRelease(TigrArchive* archive, const void* data) {
+    if (!archiveMapped(archive, data))
+        free((void*)data);
+}
+
+void tigrMountArchive(TigrArchive* archive) {
+    tigrUnmountArchive(archive);
+    tigrMutexLock(&archiveLock);
+    archive->serial = ++archiveSerial;
+    archive->nextMount = archiveMounts;
+    archiveMounts = archive;
+    tigrMutexUnlock(&archiveLock);
+}
+
+void tigrUnmountArchive(TigrArchive* archive) {
+    TigrArchive** link;
+
+    tigrMutexLock(&archiveLock);
+    for (link = &archiveMounts; *link; link = &(*link)->nextMount) {
+        if (*link == archive) {
+            *link = archive->nextMount;
+            break;
+        }
+    }
+    archive->nextMount = NULL;
+    tigrMutexUnlock(&archiveLock);
+}
+
+TigrArchive* tigrFindMounted(const char* fileName) {
+    TigrArchive* archive;
+
+    tigrMutexLock(&archiveLock);
+    for (archive = archiveMounts; archive; archive = archive->nextMount) {
+        if (archiveFind(archive, fileName))
+            break;
+    }
+    if (archive)
+        archive->refs++;
+    tigrMutexUnlock(&archiveLock);
+    return archive;
+}
+
+static void archiveDestroy(TigrArchive* archive) {
+    if (archive->data)
+        tigrUnmapFile(archive->data, archive->length);
+    free(archive->entries);
+    free(archive->slots);
+    free(archive);
+}
+
+void tigrReleaseMounted(TigrArchive* archive) {
+    int destroy;
+
+    tigrMutexLock(&archiveLock);
+    destroy = --archive->refs == 0 && archive->closing;
+    tigrMutexUnlock(&archiveLock);
+    if (destroy)
+        archiveDestroy(archive);
+}
+
+int tigrMountedInfo(const char* fileName, long long* size, long long* stamp) {
+    TigrArchive* archive;
+    ArchiveEntry* e = NULL;
+
+    tigrMutexLock(&archiveLock);
+    for (archive = archiveMounts; archive && !e; archive = archive->nextMount) {
+        e = archiveFind(archive, fileName);
+        if (e) {
+            *size = e->size;
+            *stamp = (long long)archive->serial << 32 | e->modified;
+        }
+    }
+    tigrMutexUnlock(&archiveLock);
+    return e != NULL;
+}
+
+void* tigrReadMountedFile(TigrArchive* archive, const char* fileName, int* length) {
+    int len;
+    const void* data = tigrArchiveRead(archive, fileName, &len);
+    char* copy;
+
+    if (length)
+        *length = 0;
+    if (!data)
+        return NULL;
+    if (!archiveMapped(archive, data)) {
+        copy = (char*)data;  // already inflated, with a NUL terminator
+    } else if ((copy = (char*)malloc(len + 1)) != NULL) {
+        memcpy(copy, data, len);
+        copy[len] = '\0';
+    } else {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (length)
+        *length = len;
+    return copy;
+}
+
+void tigrCloseArchive(TigrArchive* archive) {
+    int inUse;
+
+    if (!archive)
+        return;
+    tigrUnmountArchive(archive);
+
+    // Files still being read through the mount keep it open until they're done.
+    tigrMutexLock(&archiveLock);
+    inUse = archive->refs > 0;
+    archive->closing = 1;
+    tigrMutexUnlock(&archiveLock);
+    if (!inUse)
+        archiveDestroy(archive);
+}
+
+#undef ARCHIVE_END_SIG
+#undef ARCHIVE_DIR_SIG
+#undef ARCHIVE_LOCAL_SIG
+#undef ARCHIVE_END_SIZE
+#undef ARCHIVE_DIR_SIZE
+#undef ARCHIVE_LOCAL_SIZE
+#undef ARCHIVE_STORED
+#undef ARCHIVE_DEFLATED
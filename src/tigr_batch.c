@@ -0,0 +1,198 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+struct TigrBatch {
+    TigrMutex lock;
+    TigrCond cond;
+    int count, next;
+
+    // Either file names or memory blobs.
+    char** fileNames;
+    const void** data;
+    int* lengths;
+
+    Tigr** results;
+    unsigned char *ready, *claimed;
+
+    TigrBatchFunc func;
+    void* user;
+
+    int numThreads;
+    TigrThread* threads;
+};
+
+static void batchWorker(void* arg) {
+    TigrBatch* batch = (TigrBatch*)arg;
+    TigrInflateState* state = tigrInflateState();
+
+    for (;;) {
+        int index;
+        Tigr* bmp;
+
+        tigrMutexLock(&batch->lock);
+        index = batch->next++;
+        tigrMutexUnlock(&batch->lock);
+        if (index >= batch->count)
+            break;
+
+        if (batch->fileNames) {
+            bmp = tigrDecodeImageFile(batch->fileNames[index], state);
+        } else {
+            bmp = tigrDecodeImage(batch->data[index], batch->lengths[index], state);
+        }
+
+        tigrMutexLock(&batch->lock);
+        batch->results[index] = bmp;
+        batch->ready[index] = 1;
+        tigrCondBroadcast(&batch->cond);
+        tigrMutexUnlock(&batch->lock);
+
+        if (batch->func)
+            batch->func(batch->user, index, bmp);
+    }
+
+    tigrInflateFree(state);
+}
+
+// Frees a batch's memory, once no workers are left.
+static void freeBatch(TigrBatch* batch) {
+    if (batch->fileNames) {
+        for (int i = 0; i < batch->count; i++)
+            free(batch->fileNames[i]);
+    }
+    free(batch->fileNames);
+    free(batch->data);
+    free(batch->lengths);
+    free(batch->results);
+    free(batch->ready);
+    free(batch->claimed);
+    free(batch->threads);
+    free(batch);
+}
+
+static TigrBatch* startBatch(TigrBatch* batch, int count, int threads, TigrBatchFunc func, void* user) {
+    if (threads <= 0)
+        threads = tigrCpuCount();
+    if (threads > count)
+        threads = count;
+    if (threads < 1)
+        threads = 1;
+
+    batch->func = func;
+    batch->user = user;
+    batch->results = (Tigr**)calloc(count + 1, sizeof(Tigr*));
+    batch->ready = (unsigned char*)calloc(count + 1, 1);
+    batch->claimed = (unsigned char*)calloc(count + 1, 1);
+    batch->threads = (TigrThread*)calloc(threads, sizeof(TigrThread));
+    if (!batch->results || !batch->ready || !batch->claimed || !batch->threads) {
+        freeBatch(batch);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    tigrMutexInit(&batch->lock);
+    tigrCondInit(&batch->cond);
+
+    for (int i = 0; i < threads; i++) {
+        if (!tigrThreadStart(&batch->threads[i], batchWorker, batch))
+            break;
+        batch->numThreads++;
+    }
+
+    // Fall back to decoding on the calling thread if no workers could be started.
+    if (batch->numThreads == 0)
+        batchWorker(batch);
+
+    return batch;
+}
+
+TigrBatch* tigrLoadImages(const char* const* fileNames, int count, int threads, TigrBatchFunc func, void* user) {
+    TigrBatch* batch = (TigrBatch*)calloc(1, sizeof(TigrBatch));
+    if (!batch || !(batch->fileNames = (char**)calloc(count + 1, sizeof(char*)))) {
+        free(batch);
+        errno = ENOMEM;
+        return NULL;
+    }
+    batch->count = count;
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(fileNames[i]) + 1;
+        batch->fileNames[i] = (char*)malloc(len);
+        if (!batch->fileNames[i]) {
+            freeBatch(batch);
+            errno = ENOMEM;
+            return NULL;
+        }
+        memcpy(batch->fileNames[i], fileNames[i], len);
+    }
+    return startBatch(batch, count, threads, func, user);
+}
+
+TigrBatch* tigrLoadImagesMem(const void* const* data,
+                             const int* lengths,
+                             int count,
+                             int threads,
+                             TigrBatchFunc func,
+                             void* user) {
+    TigrBatch* batch = (TigrBatch*)calloc(1, sizeof(TigrBatch));
+    if (!batch) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    batch->count = count;
+    batch->data = (const void**)calloc(count + 1, sizeof(void*));
+    batch->lengths = (int*)calloc(count + 1, sizeof(int));
+    if (!batch->data || !batch->lengths) {
+        freeBatch(batch);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        batch->data[i] = data[i];
+        batch->lengths[i] = lengths[i];
+    }
+    return startBatch(batch, count, threads, func, user);
+}
+
+int tigrBatchReady(TigrBatch* batch, int index) {
+    int ready;
+    if (index < 0 || index >= batch->count)
+        return 0;
+    tigrMutexLock(&batch->lock);
+    ready = batch->ready[index];
+    tigrMutexUnlock(&batch->lock);
+    return ready;
+}
+
+Tigr* tigrBatchWait(TigrBatch* batch, int index) {
+    Tigr* bmp;
+    if (index < 0 || index >= batch->count)
+        return NULL;
+    tigrMutexLock(&batch->lock);
+    while (!batch->ready[index])
+        tigrCondWait(&batch->cond, &batch->lock);
+    bmp = batch->claimed[index] ? NULL : batch->results[index];
+    batch->claimed[index] = 1;
+    tigrMutexUnlock(&batch->lock);
+    return bmp;
+}
+
+void tigrBatchFree(TigrBatch* batch) {
+    // Skip anything that hasn't been started yet.
+    tigrMutexLock(&batch->lock);
+    batch->next = batch->count;
+    tigrMutexUnlock(&batch->lock);
+
+    for (int i = 0; i < batch->numThreads; i++)
+        tigrThreadJoin(batch->threads[i]);
+
+    for (int i = 0; i < batch->count; i++) {
+        if (batch->results[i] && !batch->claimed[i])
+            tigrFree(batch->results[i]);
+    }
+
+    tigrCondDestroy(&batch->cond);
+    tigrMutexDestroy(&batch->lock);
+    freeBatch(batch);
+}
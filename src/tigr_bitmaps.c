@@ -44,7 +44,7 @@ Tigr* tigrBitmap(int w, int h) {
 
 #ifdef TIGR_HEADLESS
 void tigrFree(Tigr* bmp) {
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 #endif // TIGR_HEADLESS
@@ -64,7 +64,7 @@ void tigrResize(Tigr* bmp, int w, int h) {
     for (y = 0; y < ch; y++)
         memcpy(newpix + y * w, bmp->pix + y * bmp->w, cw * sizeof(TPixel));
 
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     bmp->pix = newpix;
     bmp->w = w;
     bmp->h = h;
@@ -108,16 +108,52 @@ void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]) {
     out[3] = out[1] + bmp->h * scale;
 }
 
+// Operations on at least this many pixels are split into bands of rows on the thread pool,
+// in pieces of about PARALLEL_GRAIN pixels. Anything smaller isn't worth waking threads for.
+#define PARALLEL_PIXELS (1 << 18)
+#define PARALLEL_GRAIN (1 << 14)
+
+typedef struct {
+    Tigr *dst, *src;
+    int dx, dy, sx, sy, w;
+    TPixel color;
+} RowJob;
+
+static void setRows(RowJob* job, Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, TPixel color) {
+    job->dst = dst;
+    job->src = src;
+    job->dx = dx;
+    job->dy = dy;
+    job->sx = sx;
+    job->sy = sy;
+    job->w = w;
+    job->color = color;
+}
+
+// Runs func over rows [0, h), across the thread pool if there are enough pixels.
+// Blits of a bitmap onto itself always go in order, top to bottom.
+static void runRows(RowJob* job, int h, TigrRangeFunc func) {
+    if (job->src != job->dst && (long long)job->w * h >= PARALLEL_PIXELS)
+        tigrParallelFor(0, h, PARALLEL_GRAIN / job->w + 1, func, job);
+    else
+        func(job, 0, h);
+}
+
+static void fillRows(void* ctx, int y0, int y1) {
+    RowJob* job = (RowJob*)ctx;
+    for (int y = y0; y < y1; y++) {
+        TPixel* td = &job->dst->pix[(job->dy + y) * job->dst->w + job->dx];
+        for (int i = 0; i < job->w; i++)
+            td[i] = job->color;
+    }
+}
+
 void tigrClear(Tigr* bmp, TPixel color) {
-    int count = bmp->w * bmp->h;
-    int n;
-    for (n = 0; n < count; n++)
-        bmp->pix[n] = color;
+    tigrFill(bmp, 0, 0, bmp->w, bmp->h, color);
 }
 
 void tigrFill(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
-    TPixel* td;
-    int dt, i;
+    RowJob job;
 
     if (x < 0) {
         w += x;
@@ -136,13 +172,8 @@ void tigrFill(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
     if (w <= 0 || h <= 0)
         return;
 
-    td = &bmp->pix[y * bmp->w + x];
-    dt = bmp->w;
-    do {
-        for (i = 0; i < w; i++)
-            td[i] = color;
-        td += dt;
-    } while (--h);
+    setRows(&job, bmp, NULL, x, y, 0, 0, w, color);
+    runRows(&job, h, fillRows);
 }
 
 void tigrLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
@@ -343,21 +374,47 @@ void tigrClip(Tigr* bmp, int cx, int cy, int cw, int ch) {
     bmp->ch = ch;
 }
 
+static void blitRows(void* ctx, int y0, int y1) {
+    RowJob* job = (RowJob*)ctx;
+    for (int y = y0; y < y1; y++) {
+        TPixel* ts = &job->src->pix[(job->sy + y) * job->src->w + job->sx];
+        memcpy(&job->dst->pix[(job->dy + y) * job->dst->w + job->dx], ts, job->w * sizeof(TPixel));
+    }
+}
+
 void tigrBlit(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h) {
     int cw = dst->cw >= 0 ? dst->cw : dst->w;
     int ch = dst->ch >= 0 ? dst->ch : dst->h;
 
     CLIP();
 
-    TPixel* ts = &src->pix[sy * src->w + sx];
-    TPixel* td = &dst->pix[dy * dst->w + dx];
-    int st = src->w;
-    int dt = dst->w;
-    do {
-        memcpy(td, ts, w * sizeof(TPixel));
-        ts += st;
-        td += dt;
-    } while (--h);
+    RowJob job;
+    setRows(&job, dst, src, dx, dy, sx, sy, w, tigrRGBA(0, 0, 0, 0));
+    runRows(&job, h, blitRows);
+}
+
+static void tintRows(void* ctx, int y0, int y1) {
+    RowJob* job = (RowJob*)ctx;
+    Tigr* dst = job->dst;
+    int xr = EXPAND(job->color.r);
+    int xg = EXPAND(job->color.g);
+    int xb = EXPAND(job->color.b);
+    int xa = EXPAND(job->color.a);
+
+    for (int y = y0; y < y1; y++) {
+        TPixel* ts = &job->src->pix[(job->sy + y) * job->src->w + job->sx];
+        TPixel* td = &dst->pix[(job->dy + y) * dst->w + job->dx];
+        for (int x = 0; x < job->w; x++) {
+            unsigned r = (xr * ts[x].r) >> 8;
+            unsigned g = (xg * ts[x].g) >> 8;
+            unsigned b = (xb * ts[x].b) >> 8;
+            unsigned a = xa * EXPAND(ts[x].a);
+            td[x].r += (unsigned char)((r - td[x].r) * a >> 16);
+            td[x].g += (unsigned char)((g - td[x].g) * a >> 16);
+            td[x].b += (unsigned char)((b - td[x].b) * a >> 16);
+            td[x].a += (dst->blitMode) * (unsigned char)((ts[x].a - td[x].a) * a >> 16);
+        }
+    }
 }
 
 void tigrBlitTint(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint) {
@@ -366,25 +423,75 @@ void tigrBlitTint(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, i
 
     CLIP();
 
+    RowJob job;
+    setRows(&job, dst, src, dx, dy, sx, sy, w, tint);
+    runRows(&job, h, tintRows);
+}
+
+void tigrTintTable(TigrTintTable* table, const TPixel* palette, int numColors, TPixel tint) {
     int xr = EXPAND(tint.r);
     int xg = EXPAND(tint.g);
     int xb = EXPAND(tint.b);
     int xa = EXPAND(tint.a);
 
-    TPixel* ts = &src->pix[sy * src->w + sx];
+    for (int i = 0; i < numColors; i++) {
+        table->r[i] = (unsigned char)((xr * palette[i].r) >> 8);
+        table->g[i] = (unsigned char)((xg * palette[i].g) >> 8);
+        table->b[i] = (unsigned char)((xb * palette[i].b) >> 8);
+        table->a[i] = palette[i].a;
+        table->blend[i] = xa * EXPAND(palette[i].a);
+    }
+}
+
+void tigrBlitIndexed(Tigr* dst,
+                     Tigr* src,
+                     const unsigned char* index,
+                     const TigrTintTable* table,
+                     int dx,
+                     int dy,
+                     int sx,
+                     int sy,
+                     int w,
+                     int h) {
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    CLIP();
+
+    const unsigned char* ts = &index[sy * src->w + sx];
     TPixel* td = &dst->pix[dy * dst->w + dx];
     int st = src->w;
     int dt = dst->w;
+    int mode = dst->blitMode;
     do {
         for (int x = 0; x < w; x++) {
-            unsigned r = (xr * ts[x].r) >> 8;
-            unsigned g = (xg * ts[x].g) >> 8;
-            unsigned b = (xb * ts[x].b) >> 8;
-            unsigned a = xa * EXPAND(ts[x].a);
-            td[x].r += (unsigned char)((r - td[x].r) * a >> 16);
-            td[x].g += (unsigned char)((g - td[x].g) * a >> 16);
-            td[x].b += (unsigned char)((b - td[x].b) * a >> 16);
-            td[x].a += (dst->blitMode) * (unsigned char)((ts[x].a - td[x].a) * a >> 16);
+            unsigned i = ts[x], r, g, b, a;
+            if (i == 0) {
+                // Skip transparent pixels, four at a time where we can.
+                unsigned quad;
+                if (x + 4 <= w) {
+                    memcpy(&quad, ts + x, sizeof(quad));
+                    if (quad == 0)
+                        x += 3;
+                }
+                continue;
+            }
+
+            r = table->r[i];
+            g = table->g[i];
+            b = table->b[i];
+            a = table->blend[i];
+            if (a == 65536) {
+                // Opaque, so the blend would just give the tinted color.
+                td[x].r = (unsigned char)r;
+                td[x].g = (unsigned char)g;
+                td[x].b = (unsigned char)b;
+            } else {
+                td[x].r += (unsigned char)((r - td[x].r) * a >> 16);
+                td[x].g += (unsigned char)((g - td[x].g) * a >> 16);
+                td[x].b += (unsigned char)((b - td[x].b) * a >> 16);
+            }
+            td[x].a += mode * (unsigned char)((table->a[i] - td[x].a) * a >> 16);
         }
         ts += st;
         td += dt;
@@ -403,3 +510,5 @@ void tigrBlitMode(Tigr* dst, int mode) {
 #undef CLIP0
 #undef CLIP1
 #undef CLIP
+#undef PARALLEL_PIXELS
+#undef PARALLEL_GRAIN
@@ -0,0 +1,365 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+typedef struct CacheEntry {
+    char* fileName;           // NULL for images loaded from memory
+    void* data;               // a copy of the memory contents, to compare against
+    unsigned long long hash;  // of the file name, or the memory contents
+    long long size, mtime;    // file size and time, or memory length
+    Tigr* bmp;
+    long long bytes;
+    int refs, stale;
+
+    struct CacheEntry *nextKey, *nextBmp;  // hash chains
+    struct CacheEntry *newer, *older;      // unused images, most recently released first
+} CacheEntry;
+
+struct TigrCache {
+    TigrMutex lock;
+    long long budget;
+    int count, numBuckets;
+    CacheEntry **byKey, **byBmp;
+    CacheEntry *newest, *oldest;
+    TigrCacheStats stats;
+};
+
+// FNV-1a.
+static unsigned long long cacheHash(const void* data, size_t len, unsigned long long h) {
+    const unsigned char* p = (const unsigned char*)data;
+    while (len--)
+        h = (h ^ *p++) * 0x100000001b3ULL;
+    return h;
+}
+
+static unsigned cacheBucket(TigrCache* cache, unsigned long long h) {
+    return (unsigned)(h ^ (h >> 32)) & (cache->numBuckets - 1);
+}
+
+static unsigned cacheBmpBucket(TigrCache* cache, Tigr* bmp) {
+    return cacheBucket(cache, (unsigned long long)(size_t)bmp * 0x9e3779b97f4a7c15ULL >> 16);
+}
+
+static int cacheFileInfo(const char* fileName, long long* size, long long* mtime) {
+    // Files in mounted archives are found first, just like tigrReadFile does.
+    if (tigrMountedInfo(fileName, size, mtime))
+        return 1;
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(fileName, &st) != 0)
+        return 0;
+#else
+    struct stat st;
+    if (stat(fileName, &st) != 0)
+        return 0;
+#endif
+    *size = (long long)st.st_size;
+    *mtime = (long long)st.st_mtime;
+    return 1;
+}
+
+// Finds the entry for a file name, or for memory contents if 'fileName' is NULL.
+static CacheEntry* cacheFind(TigrCache* cache,
+                             const char* fileName,
+                             const void* data,
+                             unsigned long long h,
+                             long long size) {
+    CacheEntry* e;
+    for (e = cache->byKey[cacheBucket(cache, h)]; e; e = e->nextKey) {
+        if (e->hash != h)
+            continue;
+        if (fileName ? (e->fileName && strcmp(e->fileName, fileName) == 0)
+                     : (!e->fileName && e->size == size && memcmp(e->data, data, (size_t)size) == 0))
+            return e;
+    }
+    return NULL;
+}
+
+static void cacheUnlinkKey(TigrCache* cache, CacheEntry* e) {
+    CacheEntry** link = &cache->byKey[cacheBucket(cache, e->hash)];
+    while (*link != e)
+        link = &(*link)->nextKey;
+    *link = e->nextKey;
+}
+
+static void cacheUnlinkBmp(TigrCache* cache, CacheEntry* e) {
+    CacheEntry** link = &cache->byBmp[cacheBmpBucket(cache, e->bmp)];
+    while (*link != e)
+        link = &(*link)->nextBmp;
+    *link = e->nextBmp;
+}
+
+static void cacheUnlinkUnused(TigrCache* cache, CacheEntry* e) {
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        cache->newest = e->older;
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        cache->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void cacheDestroy(TigrCache* cache, CacheEntry* e) {
+    if (!e->stale)
+        cacheUnlinkKey(cache, e);
+    cacheUnlinkBmp(cache, e);
+    cache->count--;
+    cache->stats.images--;
+    cache->stats.bytes -= e->bytes;
+    tigrFree(e->bmp);
+    free(e->fileName);
+    free(e->data);
+    free(e);
+}
+
+// Frees unused images, oldest first, until the cache is within its budget.
+static void cacheEvict(TigrCache* cache) {
+    while (cache->stats.bytes > cache->budget && cache->oldest) {
+        CacheEntry* e = cache->oldest;
+        cacheUnlinkUnused(cache, e);
+        cacheDestroy(cache, e);
+        cache->stats.evictions++;
+    }
+}
+
+static void cacheGrow(TigrCache* cache) {
+    int oldBuckets = cache->numBuckets, i;
+    CacheEntry **oldKey = cache->byKey, **oldBmp = cache->byBmp;
+    CacheEntry **byKey = (CacheEntry**)calloc(oldBuckets * 2, sizeof(CacheEntry*));
+    CacheEntry **byBmp = (CacheEntry**)calloc(oldBuckets * 2, sizeof(CacheEntry*));
+    if (!byKey || !byBmp) {
+        free(byKey);
+        free(byBmp);
+        return;
+    }
+
+    cache->numBuckets = oldBuckets * 2;
+    cache->byKey = byKey;
+    cache->byBmp = byBmp;
+    for (i = 0; i < oldBuckets; i++) {
+        while (oldKey[i]) {
+            CacheEntry* e = oldKey[i];
+            unsigned b = cacheBucket(cache, e->hash);
+            oldKey[i] = e->nextKey;
+            e->nextKey = byKey[b];
+            byKey[b] = e;
+        }
+        while (oldBmp[i]) {
+            CacheEntry* e = oldBmp[i];
+            unsigned b = cacheBmpBucket(cache, e->bmp);
+            oldBmp[i] = e->nextBmp;
+            e->nextBmp = byBmp[b];
+            byBmp[b] = e;
+        }
+    }
+    free(oldKey);
+    free(oldBmp);
+}
+
+// Drops an out of date entry. It's freed once it's unused.
+static void cacheDrop(TigrCache* cache, CacheEntry* e) {
+    if (e->refs == 0) {
+        cacheUnlinkUnused(cache, e);
+        cacheDestroy(cache, e);
+    } else {
+        cacheUnlinkKey(cache, e);
+        e->stale = 1;
+    }
+}
+
+// Takes a reference to a cached image. Called with the lock held.
+static Tigr* cacheUse(TigrCache* cache, CacheEntry* e) {
+    if (e->refs++ == 0)
+        cacheUnlinkUnused(cache, e);
+    return e->bmp;
+}
+
+// Adds a freshly decoded image, unless another thread got there first.
+static Tigr* cacheAdd(TigrCache* cache,
+                      const char* fileName,
+                      const void* data,
+                      unsigned long long h,
+                      long long size,
+                      long long mtime,
+                      Tigr* bmp) {
+    CacheEntry* e;
+    unsigned b;
+
+    tigrMutexLock(&cache->lock);
+    e = cacheFind(cache, fileName, data, h, size);
+    if (e && e->mtime == mtime && e->size == size) {
+        tigrFree(bmp);
+        bmp = cacheUse(cache, e);
+        tigrMutexUnlock(&cache->lock);
+        return bmp;
+    }
+    if (e)
+        cacheDrop(cache, e);
+
+    e = (CacheEntry*)calloc(1, sizeof(CacheEntry));
+    if (e && fileName) {
+        e->fileName = (char*)malloc(strlen(fileName) + 1);
+        if (e->fileName)
+            strcpy(e->fileName, fileName);
+    } else if (e) {
+        e->data = malloc(size ? (size_t)size : 1);
+        if (e->data)
+            memcpy(e->data, data, (size_t)size);
+    }
+    if (!e || (fileName ? !e->fileName : !e->data)) {
+        // Can't cache it, so hand it out uncached.
+        free(e);
+        tigrMutexUnlock(&cache->lock);
+        return bmp;
+    }
+
+    e->hash = h;
+    e->size = size;
+    e->mtime = mtime;
+    e->bmp = bmp;
+    e->bytes = sizeof(Tigr) + (long long)bmp->w * bmp->h * sizeof(TPixel) + (fileName ? 0 : size);
+    e->refs = 1;
+
+    if (cache->count >= cache->numBuckets)
+        cacheGrow(cache);
+    b = cacheBucket(cache, h);
+    e->nextKey = cache->byKey[b];
+    cache->byKey[b] = e;
+    b = cacheBmpBucket(cache, bmp);
+    e->nextBmp = cache->byBmp[b];
+    cache->byBmp[b] = e;
+
+    cache->count++;
+    cache->stats.images++;
+    cache->stats.bytes += e->bytes;
+    cacheEvict(cache);
+    tigrMutexUnlock(&cache->lock);
+    return bmp;
+}
+
+// Looks up an image, dropping it if it's out of date.
+static Tigr* cacheLookup(TigrCache* cache,
+                         const char* fileName,
+                         const void* data,
+                         unsigned long long h,
+                         long long size,
+                         long long mtime) {
+    CacheEntry* e;
+    Tigr* bmp = NULL;
+
+    tigrMutexLock(&cache->lock);
+    e = cacheFind(cache, fileName, data, h, size);
+    if (e && (e->mtime != mtime || e->size != size)) {
+        cacheDrop(cache, e);
+        e = NULL;
+    }
+    if (e) {
+        bmp = cacheUse(cache, e);
+        cache->stats.hits++;
+    } else {
+        cache->stats.misses++;
+    }
+    tigrMutexUnlock(&cache->lock);
+    return bmp;
+}
+
+TigrCache* tigrCacheCreate(long long budget) {
+    TigrCache* cache = (TigrCache*)calloc(1, sizeof(TigrCache));
+    if (!cache)
+        return NULL;
+    cache->budget = budget;
+    cache->numBuckets = 64;
+    cache->byKey = (CacheEntry**)calloc(cache->numBuckets, sizeof(CacheEntry*));
+    cache->byBmp = (CacheEntry**)calloc(cache->numBuckets, sizeof(CacheEntry*));
+    if (!cache->byKey || !cache->byBmp) {
+        free(cache->byKey);
+        free(cache->byBmp);
+        free(cache);
+        return NULL;
+    }
+    tigrMutexInit(&cache->lock);
+    return cache;
+}
+
+Tigr* tigrCacheLoad(TigrCache* cache, const char* fileName) {
+    unsigned long long h = cacheHash(fileName, strlen(fileName), 0xcbf29ce484222325ULL);
+    long long size, mtime;
+    Tigr* bmp;
+
+    if (!cacheFileInfo(fileName, &size, &mtime))
+        return NULL;
+    bmp = cacheLookup(cache, fileName, NULL, h, size, mtime);
+    if (bmp)
+        return bmp;
+
+    bmp = tigrLoadImage(fileName);
+    return bmp ? cacheAdd(cache, fileName, NULL, h, size, mtime, bmp) : NULL;
+}
+
+Tigr* tigrCacheLoadMem(TigrCache* cache, const void* data, int length) {
+    unsigned long long h = cacheHash(data, length, 0xcbf29ce484222325ULL);
+    Tigr* bmp = cacheLookup(cache, NULL, data, h, length, 0);
+    if (bmp)
+        return bmp;
+
+    bmp = tigrLoadImageMem(data, length);
+    return bmp ? cacheAdd(cache, NULL, data, h, length, 0, bmp) : NULL;
+}
+
+void tigrCacheRelease(TigrCache* cache, Tigr* bmp) {
+    CacheEntry* e;
+
+    tigrMutexLock(&cache->lock);
+    for (e = cache->byBmp[cacheBmpBucket(cache, bmp)]; e && e->bmp != bmp; e = e->nextBmp)
+        ;
+    if (!e) {
+        // Wasn't cached after all.
+        tigrMutexUnlock(&cache->lock);
+        tigrFree(bmp);
+        return;
+    }
+
+    if (--e->refs == 0) {
+        if (e->stale) {
+            cacheDestroy(cache, e);
+        } else {
+            e->older = cache->newest;
+            if (cache->newest)
+                cache->newest->newer = e;
+            else
+                cache->oldest = e;
+            cache->newest = e;
+            cacheEvict(cache);
+        }
+    }
+    tigrMutexUnlock(&cache->lock);
+}
+
+void tigrCacheStats(TigrCache* cache, TigrCacheStats* stats) {
+    tigrMutexLock(&cache->lock);
+    *stats = cache->stats;
+    tigrMutexUnlock(&cache->lock);
+}
+
+void tigrCacheFree(TigrCache* cache) {
+    int i;
+    for (i = 0; i < cache->numBuckets; i++) {
+        while (cache->byBmp[i]) {
+            CacheEntry* e = cache->byBmp[i];
+            cache->byBmp[i] = e->nextBmp;
+            tigrFree(e->bmp);
+            free(e->fileName);
+            free(e->data);
+            free(e);
+        }
+    }
+    tigrMutexDestroy(&cache->lock);
+    free(cache->byKey);
+    free(cache->byBmp);
+    free(cache);
+}
@@ -0,0 +1,254 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+typedef struct {
+    int code;
+    TPixel fg, bg;
+} ConsoleCell;
+
+struct TigrConsole {
+    TigrFont* font;
+    int cols, rows;
+    int cellW, cellH;
+    ConsoleCell* cells;
+    unsigned char* dirty;     // per cell
+    unsigned char* dirtyRow;  // any cell in the row is dirty
+    int anyDirty;
+
+    // Rows scrolled since the last draw, and where that was, so the
+    // pixels already drawn can be moved instead of drawn again.
+    int scrolled;
+    Tigr* lastDest;
+    int lastX, lastY;
+};
+
+static void consoleDirtyAll(TigrConsole* con) {
+    memset(con->dirty, 1, (size_t)con->cols * con->rows);
+    memset(con->dirtyRow, 1, con->rows);
+    con->anyDirty = 1;
+}
+
+static void consoleSet(TigrConsole* con, int col, int row, int code, TPixel fg, TPixel bg) {
+    int i = row * con->cols + col;
+    ConsoleCell* cell = &con->cells[i];
+    if (cell->code == code && memcmp(&cell->fg, &fg, sizeof(fg)) == 0 && memcmp(&cell->bg, &bg, sizeof(bg)) == 0)
+        return;
+    cell->code = code;
+    cell->fg = fg;
+    cell->bg = bg;
+    con->dirty[i] = 1;
+    con->dirtyRow[row] = 1;
+    con->anyDirty = 1;
+}
+
+TigrConsole* tigrConsoleCreate(TigrFont* font, int cols, int rows) {
+    TigrConsole* con;
+    TPixel black = { 0, 0, 0, 255 }, white = { 255, 255, 255, 255 };
+
+    if (cols <= 0 || rows <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    con = (TigrConsole*)calloc(1, sizeof(TigrConsole));
+    if (con) {
+        con->cells = (ConsoleCell*)malloc((size_t)cols * rows * sizeof(ConsoleCell));
+        con->dirty = (unsigned char*)malloc((size_t)cols * rows);
+        con->dirtyRow = (unsigned char*)malloc(rows);
+    }
+    if (!con || !con->cells || !con->dirty || !con->dirtyRow) {
+        tigrConsoleFree(con);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    tigrSetupFont(font);
+    con->font = font;
+    con->cols = cols;
+    con->rows = rows;
+
+    // Cells fit the widest ASCII glyph.
+    for (int c = 32; c < 127; c++) {
+        TigrGlyph* g = tigrGlyph(font, c);
+        con->cellW = g->w > con->cellW ? g->w : con->cellW;
+    }
+    con->cellH = tigrGlyph(font, 0)->h;
+
+    for (int i = 0; i < cols * rows; i++) {
+        con->cells[i].code = ' ';
+        con->cells[i].fg = white;
+        con->cells[i].bg = black;
+    }
+    consoleDirtyAll(con);
+    return con;
+}
+
+void tigrConsoleSize(TigrConsole* con, int* w, int* h) {
+    if (w)
+        *w = con->cols * con->cellW;
+    if (h)
+        *h = con->rows * con->cellH;
+}
+
+void tigrConsolePut(TigrConsole* con, int col, int row, int code, TPixel fg, TPixel bg) {
+    if (col >= 0 && col < con->cols && row >= 0 && row < con->rows)
+        consoleSet(con, col, row, code, fg, bg);
+}
+
+int tigrConsolePrint(TigrConsole* con, int col, int row, TPixel fg, TPixel bg, const char* text, int length) {
+    const char* end = text + (length < 0 ? strlen(text) : (size_t)length);
+    int c;
+
+    while (text < end) {
+        text = tigrDecodeUTF8N(text, end, &c);
+        if (c == '\r')
+            continue;
+        if (c == '\n') {
+            col = 0;
+            row++;
+            continue;
+        }
+        tigrConsolePut(con, col++, row, c, fg, bg);
+    }
+    return col;
+}
+
+void tigrConsoleClear(TigrConsole* con, TPixel fg, TPixel bg) {
+    for (int row = 0; row < con->rows; row++) {
+        for (int col = 0; col < con->cols; col++)
+            consoleSet(con, col, row, ' ', fg, bg);
+    }
+}
+
+void tigrConsoleScroll(TigrConsole* con, int lines, TPixel fg, TPixel bg) {
+    int keep;
+
+    if (lines <= 0)
+        return;
+    if (lines > con->rows)
+        lines = con->rows;
+    keep = con->rows - lines;
+
+    memmove(con->cells, con->cells + lines * con->cols, (size_t)keep * con->cols * sizeof(ConsoleCell));
+    memmove(con->dirty, con->dirty + lines * con->cols, (size_t)keep * con->cols);
+    memmove(con->dirtyRow, con->dirtyRow + lines, keep);
+    con->scrolled += lines;
+
+    // The new rows at the bottom get drawn from scratch.
+    for (int row = keep; row < con->rows; row++) {
+        for (int col = 0; col < con->cols; col++) {
+            ConsoleCell* cell = &con->cells[row * con->cols + col];
+            cell->code = ' ';
+            cell->fg = fg;
+            cell->bg = bg;
+        }
+        memset(con->dirty + row * con->cols, 1, con->cols);
+        con->dirtyRow[row] = 1;
+    }
+    con->anyDirty = 1;
+}
+
+// Finds dest's clip rect, clamped to the bitmap.
+static void consoleClipRect(Tigr* dest, int clip[4]) {
+    int x0 = dest->cx > 0 ? dest->cx : 0, y0 = dest->cy > 0 ? dest->cy : 0;
+    int x1 = dest->cw >= 0 ? dest->cx + dest->cw : dest->w;
+    int y1 = dest->ch >= 0 ? dest->cy + dest->ch : dest->h;
+    clip[0] = x0;
+    clip[1] = y0;
+    clip[2] = x1 < dest->w ? x1 : dest->w;
+    clip[3] = y1 < dest->h ? y1 : dest->h;
+}
+
+// Moves the pixels already on screen up, to match rows scrolled since the last draw.
+// Returns zero if they have to be drawn again instead.
+static int consoleMovePixels(Tigr* dest, TigrConsole* con, int x, int y, const int clip[4]) {
+    int w = con->cols * con->cellW, h = con->rows * con->cellH;
+    int shift = con->scrolled * con->cellH;
+
+    if (dest != con->lastDest || x != con->lastX || y != con->lastY || con->scrolled >= con->rows)
+        return 0;
+    if (x < clip[0] || y < clip[1] || x + w > clip[2] || y + h > clip[3])
+        return 0;
+
+    for (int row = y; row < y + h - shift; row++)
+        memmove(dest->pix + row * dest->w + x, dest->pix + (row + shift) * dest->w + x, w * sizeof(TPixel));
+    return 1;
+}
+
+void tigrDrawConsole(Tigr* dest, TigrConsole* con, int x, int y) {
+    TigrFont* font = con->font;
+    TigrTintTable tint;
+    TPixel tinted;
+    int haveTint = 0, clip[4];
+
+    consoleClipRect(dest, clip);
+    if (con->scrolled && !consoleMovePixels(dest, con, x, y, clip))
+        consoleDirtyAll(con);
+    else if (dest != con->lastDest || x != con->lastX || y != con->lastY)
+        consoleDirtyAll(con);
+    con->scrolled = 0;
+    con->lastDest = dest;
+    con->lastX = x;
+    con->lastY = y;
+    if (!con->anyDirty)
+        return;
+
+    // Cells outside the clip rect stay dirty, and get drawn once they're inside it.
+    con->anyDirty = 0;
+    for (int row = 0; row < con->rows; row++) {
+        int py = y + row * con->cellH, rowDirty = 0;
+        if (!con->dirtyRow[row])
+            continue;
+        for (int col = 0; col < con->cols; col++) {
+            int i = row * con->cols + col;
+            ConsoleCell* cell = &con->cells[i];
+            TigrGlyph* g;
+            int px = x + col * con->cellW, gw;
+            int fx0 = px > clip[0] ? px : clip[0], fy0 = py > clip[1] ? py : clip[1];
+            int fx1 = px + con->cellW < clip[2] ? px + con->cellW : clip[2];
+            int fy1 = py + con->cellH < clip[3] ? py + con->cellH : clip[3];
+
+            if (!con->dirty[i])
+                continue;
+            if (fx0 >= fx1 || fy0 >= fy1) {
+                rowDirty = 1;
+                continue;
+            }
+            if (fx1 - fx0 < con->cellW || fy1 - fy0 < con->cellH)
+                rowDirty = 1;  // only partly drawn
+            else
+                con->dirty[i] = 0;
+            tigrFill(dest, fx0, fy0, fx1 - fx0, fy1 - fy0, cell->bg);
+
+            // Glyphs wider than a cell are cut off, so they don't spill into the next one.
+            g = tigrGlyph(font, cell->code);
+            gw = g->w < con->cellW ? g->w : con->cellW;
+            if (font->atlas) {
+                if (!haveTint || memcmp(&tinted, &cell->fg, sizeof(tinted)) != 0) {
+                    tigrTintTable(&tint, font->atlas->palette, font->atlas->numColors, cell->fg);
+                    tinted = cell->fg;
+                    haveTint = 1;
+                }
+                tigrBlitIndexed(dest, font->bitmap, font->atlas->index, &tint, px, py, g->x, g->y, gw, g->h);
+            } else {
+                tigrBlitTint(dest, font->bitmap, px, py, g->x, g->y, gw, g->h, cell->fg);
+            }
+        }
+        con->dirtyRow[row] = rowDirty;
+        con->anyDirty |= rowDirty;
+    }
+}
+
+void tigrConsoleInvalidate(TigrConsole* con) {
+    consoleDirtyAll(con);
+}
+
+void tigrConsoleFree(TigrConsole* con) {
+    if (!con)
+        return;
+    free(con->cells);
+    free(con->dirty);
+    free(con->dirtyRow);
+    free(con);
+}
@@ -1,14 +1,21 @@
 #include "tigr_internal.h"
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <setjmp.h>
 
-typedef struct {
+typedef struct TigrInflateState {
     unsigned bits, count;
     const unsigned char *in, *inend;
-    unsigned char *out, *outend;
+    unsigned char *out, *outbegin, *outend, *flushed;
+    TigrInflateSource more;
+    TigrInflateSink sink;
+    void* ctx;
     jmp_buf jmp;
     unsigned litcodes[288], distcodes[32], lencodes[19];
     int tlit, tdist, tlen;
+    unsigned char* window;
+    unsigned windowSize;
 } State;
 
 #define FAIL() longjmp(s->jmp, 1)
@@ -41,19 +48,41 @@ static unsigned rev16(unsigned n) {
     return (reverseTable[n & 0xff] << 8) | reverseTable[(n >> 8) & 0xff];
 }
 
+static void refill(State* s) {
+    unsigned len = 0;
+    while (len == 0) {
+        CHECK(s->more && s->more(s->ctx, &s->in, &len));
+    }
+    s->inend = s->in + len;
+}
+
 static int bits(State* s, int n) {
     int v = s->bits & ((1 << n) - 1);
     s->bits >>= n;
     s->count -= n;
     while (s->count < 16) {
-        CHECK(s->in != s->inend);
+        if (s->in == s->inend)
+            refill(s);
         s->bits |= (*s->in++) << s->count;
         s->count += 8;
     }
     return v;
 }
 
+static void slide(State* s) {
+    // Hand finished output to the sink, keeping the last 32kB around for back-references.
+    unsigned keep = (unsigned)(s->out - s->outbegin);
+    CHECK(s->sink(s->ctx, s->flushed, (unsigned)(s->out - s->flushed)));
+    if (keep > 32768)
+        keep = 32768;
+    memmove(s->outbegin, s->out - keep, keep);
+    s->out = s->outbegin + keep;
+    s->flushed = s->out;
+}
+
 static unsigned char* emit(State* s, int len) {
+    if (s->sink && s->out + len > s->outend)
+        slide(s);
     s->out += len;
     CHECK(s->out <= s->outend);
     return s->out - len;
@@ -116,7 +145,12 @@ static void run(State* s, int sym) {
     int length = bits(s, lenBits[sym]) + lenBase[sym];
     int dsym = decode(s, s->distcodes, s->tdist);
     int offs = bits(s, distBits[dsym]) + distBase[dsym];
-    copy(s, s->out - offs, length);
+    // Emit first, since that may slide the window.
+    unsigned char* dest = emit(s, length);
+    const unsigned char* src = dest - offs;
+    CHECK(src >= s->outbegin);
+    while (length--)
+        *dest++ = *src++;
 }
 
 static void block(State* s) {
@@ -137,10 +171,19 @@ static void stored(State* s) {
     bits(s, s->count & 7);
     len = bits(s, 16);
     CHECK(((len ^ s->bits) & 0xffff) == 0xffff);
-    CHECK(s->in + len <= s->inend);
-
-    copy(s, s->in, len);
-    s->in += len;
+    CHECK(s->more || s->in + len <= s->inend);
+
+    // Copy in pieces that fit both the input and a streaming window.
+    while (len > 0) {
+        int n = len < 32768 ? len : 32768;
+        if (s->in == s->inend)
+            refill(s);
+        if (n > s->inend - s->in)
+            n = (int)(s->inend - s->in);
+        copy(s, s->in, n);
+        s->in += n;
+        len -= n;
+    }
     bits(s, 16);
 }
 
@@ -176,20 +219,27 @@ static void dynamic(State* s) {
     // Build the tree for decoding code lengths.
     s->tlen = build(s, s->lencodes, lenlens, 19);
 
-    // Decode code lengths.
+    // Decode code lengths. Repeats can't run past the end, or copy a length that isn't there.
     for (n = 0; n < nlit + ndist;) {
         int sym = decode(s, s->lencodes, s->tlen);
         switch (sym) {
             case 16:
-                for (i = 3 + bits(s, 2); i; i--, n++)
+                CHECK(n > 0);
+                i = 3 + bits(s, 2);
+                CHECK(n + i <= nlit + ndist);
+                for (; i; i--, n++)
                     lens[n] = lens[n - 1];
                 break;
             case 17:
-                for (i = 3 + bits(s, 3); i; i--, n++)
+                i = 3 + bits(s, 3);
+                CHECK(n + i <= nlit + ndist);
+                for (; i; i--, n++)
                     lens[n] = 0;
                 break;
             case 18:
-                for (i = 11 + bits(s, 7); i; i--, n++)
+                i = 11 + bits(s, 7);
+                CHECK(n + i <= nlit + ndist);
+                for (; i; i--, n++)
                     lens[n] = 0;
                 break;
             default:
@@ -203,24 +253,24 @@ static void dynamic(State* s) {
     s->tdist = build(s, s->distcodes, lens + nlit, ndist);
 }
 
-int tigrInflate(void* out, unsigned outlen, const void* in, unsigned inlen) {
+static int decompress(State* s, void* out, unsigned outlen, const void* in, unsigned inlen) {
     int last;
-    State* s = (State*)calloc(1, sizeof(State));
 
-    // We assume we can buffer 2 extra bytes from off the end of 'in'.
+    // We assume we can buffer 2 extra bytes from off the end of 'in',
+    // unless there is a source to read further input from.
     s->in = (unsigned char*)in;
-    s->inend = s->in + inlen + 2;
-    s->out = (unsigned char*)out;
+    s->inend = s->in + inlen + (s->more ? 0 : 2);
+    s->out = s->outbegin = s->flushed = (unsigned char*)out;
     s->outend = s->out + outlen;
     s->bits = 0;
     s->count = 0;
-    bits(s, 0);
 
     if (setjmp(s->jmp) == 1) {
-        free(s);
         return 0;
     }
 
+    bits(s, 0);
+
     do {
         last = bits(s, 1);
         switch (bits(s, 2)) {
@@ -240,9 +290,74 @@ int tigrInflate(void* out, unsigned outlen, const void* in, unsigned inlen) {
         }
     } while (!last);
 
-    free(s);
+    if (s->sink && s->out != s->flushed) {
+        return s->sink(s->ctx, s->flushed, (unsigned)(s->out - s->flushed));
+    }
     return 1;
 }
 
+int tigrInflateSize(void* out, unsigned outlen, const void* in, unsigned inlen, unsigned* written) {
+    State* s = (State*)calloc(1, sizeof(State));
+    int ok;
+
+    *written = 0;
+    if (!s)
+        return 0;
+    ok = decompress(s, out, outlen, in, inlen);
+    if (ok)
+        *written = (unsigned)(s->out - s->outbegin);
+    free(s);
+    return ok;
+}
+
+int tigrInflate(void* out, unsigned outlen, const void* in, unsigned inlen) {
+    unsigned written;
+    return tigrInflateSize(out, outlen, in, inlen, &written);
+}
+
+TigrInflateState* tigrInflateState(void) {
+    return (State*)calloc(1, sizeof(State));
+}
+
+void tigrInflateFree(TigrInflateState* state) {
+    if (state)
+        free(state->window);
+    free(state);
+}
+
+int tigrInflateStream(TigrInflateState* state,
+                      unsigned outlen,
+                      const void* in,
+                      unsigned inlen,
+                      TigrInflateSource more,
+                      TigrInflateSink sink,
+                      void* ctx) {
+    State* s = state ? state : tigrInflateState();
+    unsigned size = outlen < TIGR_INFLATE_WINDOW ? outlen : TIGR_INFLATE_WINDOW;
+    int ok = 0;
+    if (!s)
+        return 0;
+
+    // The window never needs to be bigger than the whole output.
+    if (s->windowSize < size) {
+        unsigned char* window = (unsigned char*)realloc(s->window, size);
+        if (!window) {
+            errno = ENOMEM;
+            goto done;
+        }
+        s->window = window;
+        s->windowSize = size;
+    }
+    s->more = more;
+    s->sink = sink;
+    s->ctx = ctx;
+    ok = decompress(s, s->window, size, in, inlen);
+
+done:
+    if (!state)
+        tigrInflateFree(s);
+    return ok;
+}
+
 #undef CHECK
 #undef FAIL
@@ -3,6 +3,7 @@
 #define __TIGR_INTERNAL_H__
 
 #define _CRT_SECURE_NO_WARNINGS NOPE
+#include <stdio.h>
 
 // Graphics configuration.
 #ifndef TIGR_HEADLESS
@@ -15,21 +16,185 @@ int tigrCalcScale(int bmpW, int bmpH, int areaW, int areaH);
 // Creates a new bitmap, with extra payload bytes.
 Tigr* tigrBitmap2(int w, int h, int extra);
 
+// The most pixels an image loader will allocate a bitmap for.
+#define TIGR_MAX_PIXELS 400000000
+
 // Resizes an existing bitmap.
 void tigrResize(Tigr* bmp, int w, int h);
 
+// Frees a bitmap's pixels, which may be mapped from a snapshot file.
+void tigrFreePixels(Tigr* bmp);
+
+// A font sheet with each pixel replaced by an index into a palette of at most 256 colors.
+// Index 0 is fully transparent.
+typedef struct TigrFontAtlas {
+    unsigned char* index;
+    TPixel palette[256];
+    int numColors;
+} TigrFontAtlas;
+
+// Palette colors with a tint applied, ready for tigrBlitIndexed.
+typedef struct {
+    unsigned char r[256], g[256], b[256], a[256];
+    unsigned blend[256];  // tint alpha * color alpha, 0 to 65536
+} TigrTintTable;
+
+// Tints a palette, the same way tigrBlitTint tints each source pixel.
+void tigrTintTable(TigrTintTable* table, const TPixel* palette, int numColors, TPixel tint);
+
+// Same as tigrBlitTint, but the source pixels are read from 'index', an 8-bit
+// image the size of 'src', through a tinted palette. Gives identical results.
+void tigrBlitIndexed(Tigr* dst,
+                     Tigr* src,
+                     const unsigned char* index,
+                     const TigrTintTable* table,
+                     int dx,
+                     int dy,
+                     int sx,
+                     int sy,
+                     int w,
+                     int h);
+
+// Loads the stock font the first time it's used.
+void tigrSetupFont(TigrFont* font);
+
+// Looks up the glyph for a code point, or the font's fallback glyph.
+TigrGlyph* tigrGlyph(TigrFont* font, int code);
+
+// Decodes a single UTF8 codepoint like tigrDecodeUTF8, without reading past 'end'.
+// If 'end' is NULL, the text must be NUL terminated instead.
+const char* tigrDecodeUTF8N(const char* text, const char* end, int* cp);
+
+// Decodes up to 'max' codepoints from *text, without reading past 'end', and advances *text.
+// Returns the number of codepoints written to 'cps'.
+int tigrDecodeUTF8Run(const char** text, const char* end, int* cps, int max);
+
 // Calculates a new scale, taking minimum-scale flags into account.
 int tigrEnforceScale(int scale, int flags);
 
+// Opens a file like fopen. (fileName is UTF-8)
+// POSIX platforms can open UTF-8 names directly, without going through this.
+FILE* tigrOpenFile(const char* fileName, const char* mode);
+
+// Writes and reads little-endian 32-bit values, as used by tigr's own file formats.
+void tigrPut32LE(unsigned char* p, unsigned v);
+unsigned tigrGet32LE(const unsigned char* p);
+
+// Continues a CRC-32, as used by PNG and zip. Start with a crc of 0.
+unsigned tigrCrc32(unsigned crc, const void* data, size_t len);
+
 // Calculates the correct position for a bitmap to fit into a window.
 void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]);
 
+// Supplies more compressed input to tigrInflateStream.
+// Returns zero if there is none.
+typedef int (*TigrInflateSource)(void* ctx, const unsigned char** in, unsigned* len);
+
+// Receives decompressed data from tigrInflateStream.
+// Returns non-zero to continue.
+typedef int (*TigrInflateSink)(void* ctx, const unsigned char* data, unsigned len);
+
+// Largest window needed: the 32kB history plus a full block of new output.
+#define TIGR_INFLATE_WINDOW 65536
+
+// Like tigrInflate, but also returns how many bytes were written to 'out'.
+int tigrInflateSize(void* out, unsigned outlen, const void* in, unsigned inlen, unsigned* written);
+
+// Inflate state, including a streaming window, that can be reused between calls.
+typedef struct TigrInflateState TigrInflateState;
+
+// Allocates reusable inflate state. Free it with tigrInflateFree.
+TigrInflateState* tigrInflateState(void);
+void tigrInflateFree(TigrInflateState* state);
+
+// Decompresses DEFLATEd data through a sliding window, handing output to 'sink'
+// as the window fills up. Input continues from 'more' (if not NULL) once 'in' runs out.
+// 'outlen' is the expected size of the output, which bounds the window size.
+// Uses a temporary state if 'state' is NULL.
+// Returns non-zero on success.
+int tigrInflateStream(TigrInflateState* state,
+                      unsigned outlen,
+                      const void* in,
+                      unsigned inlen,
+                      TigrInflateSource more,
+                      TigrInflateSink sink,
+                      void* ctx);
+
+// Decodes an image from memory or a file, using 'state' (which may be NULL) for decompression.
+Tigr* tigrDecodeImage(const void* data, int length, TigrInflateState* state);
+Tigr* tigrDecodeImageFile(const char* fileName, TigrInflateState* state);
+
+// Decodes a QOI image, or reads its header.
+// On error, returns NULL/zero and sets errno.
+Tigr* tigrLoadQoi(const void* data, int length);
+int tigrQoiInfo(const void* data, int length, int* w, int* h, int* channels);
+
+// Decodes a QOI image a row at a time. 'target' returns where row y goes, and 'done'
+// (which may be NULL) is called once it's written; returning zero from it stops decoding.
+typedef TPixel* (*TigrQoiTarget)(void* user, int y);
+typedef int (*TigrQoiDone)(void* user, int y);
+int tigrLoadQoiRows(const void* data, int length, TigrQoiTarget target, TigrQoiDone done, void* user);
+
+// Returns the most recently mounted archive holding a file, or NULL.
+// The archive stays open until it's handed back with tigrReleaseMounted.
+TigrArchive* tigrFindMounted(const char* fileName);
+void tigrReleaseMounted(TigrArchive* archive);
+
+// Finds a file in the mounted archives, for tigrCacheLoad. 'stamp' changes when
+// the file does, or when a different archive provides it.
+// Returns zero if no mounted archive has it.
+int tigrMountedInfo(const char* fileName, long long* size, long long* stamp);
+
+// Reads a file from an archive into a NUL terminated copy, like tigrReadFile.
+void* tigrReadMountedFile(TigrArchive* archive, const char* fileName, int* length);
+
 // ----------------------------------------------------------
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Threads.
+#ifdef _WIN32
+typedef SRWLOCK TigrMutex;
+typedef CONDITION_VARIABLE TigrCond;
+typedef HANDLE TigrThread;
+typedef INIT_ONCE TigrOnce;
+#define TIGR_MUTEX_INIT SRWLOCK_INIT
+#define TIGR_ONCE_INIT INIT_ONCE_STATIC_INIT
+#else
+typedef pthread_mutex_t TigrMutex;
+typedef pthread_cond_t TigrCond;
+typedef pthread_t TigrThread;
+typedef pthread_once_t TigrOnce;
+#define TIGR_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define TIGR_ONCE_INIT PTHREAD_ONCE_INIT
 #endif
 
+// Mutexes can also be set up statically with TIGR_MUTEX_INIT.
+void tigrMutexInit(TigrMutex* mutex);
+void tigrMutexDestroy(TigrMutex* mutex);
+void tigrMutexLock(TigrMutex* mutex);
+void tigrMutexUnlock(TigrMutex* mutex);
+
+void tigrCondInit(TigrCond* cond);
+void tigrCondDestroy(TigrCond* cond);
+void tigrCondWait(TigrCond* cond, TigrMutex* mutex);
+void tigrCondBroadcast(TigrCond* cond);
+
+// Calls func exactly once, however many threads get here at the same time.
+// None of them return until it has finished. 'once' must start as TIGR_ONCE_INIT.
+void tigrOnce(TigrOnce* once, void (*func)(void));
+
+// Starts a thread running func(arg). Returns non-zero on success.
+int tigrThreadStart(TigrThread* thread, void (*func)(void*), void* arg);
+void tigrThreadJoin(TigrThread thread);
+
+// Returns the number of CPU cores available.
+int tigrCpuCount(void);
+
 #if !defined(TIGR_HEADLESS) && __linux__ && !__ANDROID__
 #include <X11/X.h>
 #include <X11/Xlib.h>
@@ -89,6 +254,7 @@ typedef struct {
 #endif
 
 #define MAX_TOUCH_POINTS 10
+#define MAX_EVENTS 256
 
 typedef struct {
     int shown, closed;
@@ -126,6 +292,8 @@ typedef struct {
     int pos[4];
     int lastChar;
     int keys[256], prev[256];
+    TigrEvent events[MAX_EVENTS];
+    int firstEvent, numEvents;
 #if __ANDROID__
     int released[256];
 #endif  // __ANDROID__
@@ -147,11 +315,22 @@ typedef struct {
     float scrollDeltaX;
     float scrollDeltaY;
 #endif  // _WIN32 __linux__ __MACOS__
+#if __linux__ && !__ANDROID__
+    unsigned int prevButtons;
+    char prevKeys[32];
+    char eventKeys[32];  // keycodes held, as seen by events
+    int eventW, eventH;
+    double eventClock;   // from X server time to ours
+    double lastEventTime;
+#endif  // __linux__
 } TigrInternal;
 // ----------------------------------------------------------
 
 TigrInternal* tigrInternal(Tigr* bmp);
 
+// Adds an event to a window's queue, dropping the oldest one if it's full.
+void tigrPushEvent(TigrInternal* win, const TigrEvent* event);
+
 void tigrGAPICreate(Tigr* bmp);
 void tigrGAPIDestroy(Tigr* bmp);
 int tigrGAPIBegin(Tigr* bmp);
@@ -483,7 +483,7 @@ void tigrFree(Tigr* bmp) {
     if (bmp->handle) {
         TigrInternal* win = tigrInternal(bmp);
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -518,6 +518,13 @@ int tigrReadChar(Tigr* bmp) {
 extern void* _tigrReadFile(const char* fileName, int* length);
 
 void* tigrReadFile(const char* fileName, int* length) {
+    TigrArchive* archive = tigrFindMounted(fileName);
+    if (archive) {
+        void* data = tigrReadMountedFile(archive, fileName, length);
+        tigrReleaseMounted(archive);
+        return data;
+    }
+
     id mainBundle = objc_msgSend_id(class("NSBundle"), sel("mainBundle"));
     id resourcePath = objc_msgSend_id(mainBundle, sel("resourcePath"));
     resourcePath = joinNSStrings(resourcePath, makeNSString("/"));
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <sys/time.h>
+#include <time.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xlocale.h>
@@ -82,6 +83,9 @@ static void initX11Stuff() {
 
         wmDeleteMessage = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
 
+        // Held keys repeat as presses alone, rather than release/press pairs.
+        XkbSetDetectableAutoRepeat(dpy, True, NULL);
+
         atexit(tearDownX11Stuff);
 
         done = 1;
@@ -204,8 +208,10 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
         XResizeWindow(dpy, xwin, w * scale, h * scale);
     }
 
-    // Enable mouse events reporting (needed for mouse wheel events)
-    XSelectInput(dpy, xwin, ButtonPressMask);
+    // Enable input events, for tigrPollEvent and the mouse wheel.
+    XSelectInput(dpy, xwin,
+                 KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask |
+                     StructureNotifyMask);
 
     XTextProperty prop;
     int result = Xutf8TextListToTextProperty(dpy, (char**)&title, 1, XUTF8StringStyle, &prop);
@@ -255,6 +261,8 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
 
     memset(win->keys, 0, 256);
     memset(win->prev, 0, 256);
+    win->eventW = w * scale;
+    win->eventH = h * scale;
 
     if (flags & TIGR_NOCURSOR) {
         tigrHideCursor(win);
@@ -461,21 +469,148 @@ static void tigrUpdateModifiers(TigrInternal* win) {
     win->keys[TK_ALT] = win->keys[TK_LALT] || win->keys[TK_RALT];
 }
 
-static void tigrInterpretChar(TigrInternal* win, Window root, unsigned int keycode, unsigned int mask) {
-    XKeyEvent event;
-    memset(&event, 0, sizeof(event));
-    event.type = KeyPress;
-    event.display = win->dpy;
-    event.root = root;
-    event.window = win->win;
-    event.state = mask;
-    event.keycode = keycode;
-    char inputTextUTF8[10];
-    Status status = 0;
-    Xutf8LookupString(win->ic, &event, inputTextUTF8, sizeof(inputTextUTF8), NULL, &status);
-
-    if (status == XLookupChars) {
-        tigrDecodeUTF8(inputTextUTF8, &win->lastChar);
+static double tigrMonotonicTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// Maps an X server timestamp (milliseconds) onto our clock. Events can only
+// arrive after they happen, so the smallest gap seen so far is the best guess
+// at the offset between the two clocks. Events without one get the time now.
+static double tigrEventTime(TigrInternal* win, Time serverTime) {
+    double now = tigrMonotonicTime();
+    double t = now;
+
+    if (serverTime != CurrentTime) {
+        double gap = now - serverTime / 1000.0;
+        // Start over the first time, and when the server's 32-bit clock wraps.
+        if (win->eventClock == 0 || gap < win->eventClock || gap > win->eventClock + 60)
+            win->eventClock = gap;
+        t = serverTime / 1000.0 + win->eventClock;
+    }
+    if (t < win->lastEventTime)
+        t = win->lastEventTime;
+    win->lastEventTime = t;
+    return t;
+}
+
+static void tigrPushX11Event(TigrInternal* win, TigrEvent* ev, int type, Time serverTime, int x, int y) {
+    memset(ev, 0, sizeof(TigrEvent));
+    ev->type = type;
+    ev->time = tigrEventTime(win, serverTime);
+    ev->x = (x - win->pos[0]) / win->scale;
+    ev->y = (y - win->pos[1]) / win->scale;
+}
+
+static Bool tigrIsWindowEvent(Display* display, XEvent* event, XPointer arg) {
+    (void)display;
+    return event->xany.window == *(Window*)arg;
+}
+
+// Drains the X11 queue for this window into its event queue, in order.
+static void tigrProcessEvents(TigrInternal* win) {
+    XEvent event;
+    TigrEvent ev;
+    Window xwin = win->win;
+
+    while (XCheckIfEvent(win->dpy, &event, tigrIsWindowEvent, (XPointer)&xwin)) {
+        if (XFilterEvent(&event, None))
+            continue;
+
+        switch (event.type) {
+            case KeyPress:
+            case KeyRelease: {
+                int code = event.xkey.keycode;
+                int held = win->eventKeys[code / 8] & (1 << (code % 8));
+                int key = tigrKeyFromX11(XkbKeycodeToKeysym(win->dpy, code, 0, 0));
+
+                if (event.type == KeyRelease) {
+                    win->eventKeys[code / 8] &= ~(1 << (code % 8));
+                    if (key) {
+                        tigrPushX11Event(win, &ev, TIGR_EVENT_KEY_UP, event.xkey.time, event.xkey.x, event.xkey.y);
+                        ev.key = key;
+                        tigrPushEvent(win, &ev);
+                    }
+                    break;
+                }
+
+                // Auto-repeat sends more presses; only the first counts as a key down.
+                win->eventKeys[code / 8] |= 1 << (code % 8);
+                if (key && !held) {
+                    tigrPushX11Event(win, &ev, TIGR_EVENT_KEY_DOWN, event.xkey.time, event.xkey.x, event.xkey.y);
+                    ev.key = key;
+                    tigrPushEvent(win, &ev);
+                }
+
+                char text[32];
+                Status status = 0;
+                int len = Xutf8LookupString(win->ic, &event.xkey, text, sizeof(text), NULL, &status);
+                if (status == XLookupChars || status == XLookupBoth) {
+                    const char* p = text;
+                    while (p < text + len) {
+                        p = tigrDecodeUTF8N(p, text + len, &win->lastChar);
+                        tigrPushX11Event(win, &ev, TIGR_EVENT_CHAR, event.xkey.time, event.xkey.x, event.xkey.y);
+                        ev.key = win->lastChar;
+                        tigrPushEvent(win, &ev);
+                    }
+                }
+                break;
+            }
+
+            case ButtonPress:
+            case ButtonRelease: {
+                int button = event.xbutton.button;
+                int type = event.type == ButtonPress ? TIGR_EVENT_MOUSE_DOWN : TIGR_EVENT_MOUSE_UP;
+
+                tigrPushX11Event(win, &ev, type, event.xbutton.time, event.xbutton.x, event.xbutton.y);
+                if (button >= Button4 && button <= 7) {
+                    // Button4 = WheelUp / Button5 = WheelDown, 6 and 7 scroll sideways
+                    if (event.type == ButtonRelease)
+                        break;
+                    ev.type = TIGR_EVENT_WHEEL;
+                    ev.dy = button == Button4 ? 1.0f : button == Button5 ? -1.0f : 0.0f;
+                    ev.dx = button == 6 ? 1.0f : button == 7 ? -1.0f : 0.0f;
+                    win->scrollDeltaX += ev.dx;
+                    win->scrollDeltaY += ev.dy;
+                } else {
+                    ev.button = button == Button1 ? 1 : button == Button3 ? 2 : button == Button2 ? 4 : 0;
+                    if (!ev.button)
+                        break;
+                }
+                tigrPushEvent(win, &ev);
+                break;
+            }
+
+            case MotionNotify:
+                tigrPushX11Event(win, &ev, TIGR_EVENT_MOUSE_MOVE, event.xmotion.time, event.xmotion.x,
+                                 event.xmotion.y);
+                tigrPushEvent(win, &ev);
+                break;
+
+            case ConfigureNotify:
+                if (event.xconfigure.width != win->eventW || event.xconfigure.height != win->eventH) {
+                    win->eventW = event.xconfigure.width;
+                    win->eventH = event.xconfigure.height;
+                    tigrPushX11Event(win, &ev, TIGR_EVENT_RESIZE, CurrentTime, 0, 0);
+                    ev.x = win->eventW;
+                    ev.y = win->eventH;
+                    tigrPushEvent(win, &ev);
+                }
+                break;
+
+            case ClientMessage:
+                if (event.xclient.data.l[0] == (long)wmDeleteMessage) {
+                    tigrPushX11Event(win, &ev, TIGR_EVENT_CLOSE, CurrentTime, 0, 0);
+                    tigrPushEvent(win, &ev);
+                    glXMakeCurrent(win->dpy, None, NULL);
+                    glXDestroyContext(win->dpy, win->glc);
+                    XDestroyWindow(win->dpy, win->win);
+                    win->win = 0;
+                    return;
+                }
+                break;
+        }
     }
 }
 
@@ -499,54 +634,25 @@ static void tigrProcessInput(TigrInternal* win, int winWidth, int winHeight) {
     unsigned int mask;
 
     if (XQueryPointer(win->dpy, win->win, &root, &child, &rootX, &rootY, &winX, &winY, &mask)) {
-        static unsigned int prevButtons;
         unsigned int buttons = mask & (Button1Mask | Button2Mask | Button3Mask);
 
         win->mouseX = (winX - win->pos[0]) / win->scale;
         win->mouseY = (winY - win->pos[1]) / win->scale;
 
-        if (buttons != prevButtons && (winX > 0 && winX < winWidth) && (winY > 0 && winY < winHeight)) {
+        if (buttons != win->prevButtons && (winX > 0 && winX < winWidth) && (winY > 0 && winY < winHeight)) {
             win->mouseButtons = (buttons & Button1Mask)       ? 1
                                 : 0 | (buttons & Button3Mask) ? 2
                                 : 0 | (buttons & Button2Mask) ? 4
                                                               : 0;
         }
-        prevButtons = buttons;
+        win->prevButtons = buttons;
     }
 
-    // Retrieve mouse wheel events - Cannot be done in the XQueryPointer call
-    // -> https://comp.unix.programmer.narkive.com/eOnjkQ6L/xlib-xquerypointer-and-button4mask-button5mask#post2
-    // Button4 = WheelUp / Button5 = WheelDown
-    XEvent mouseButtonEvent;
-    while (XPending(win->dpy)) {
-        XPeekEvent(win->dpy, &mouseButtonEvent);
-        if (mouseButtonEvent.xany.type == ButtonPress) {
-            switch (mouseButtonEvent.xbutton.button) {
-                case Button4:
-                    win->scrollDeltaY += 1;
-                    break;
-                case Button5:
-                    win->scrollDeltaY -= 1;
-                    break;
-                case 6:
-                    win->scrollDeltaX += 1;
-                    break;
-                case 7:
-                    win->scrollDeltaX -= 1;
-                    break;
-            }
-            XNextEvent(win->dpy, &mouseButtonEvent);
-        } else {
-            break;
-        }
-    }
-
-    static char prevKeys[32];
     char keys[32];
     XQueryKeymap(win->dpy, keys);
     for (int i = 0; i < 32; i++) {
         char thisBlock = keys[i];
-        char prevBlock = prevKeys[i];
+        char prevBlock = win->prevKeys[i];
         if (thisBlock != prevBlock) {
             for (int j = 0; j < 8; j++) {
                 int thisBit = thisBlock & 1;
@@ -560,27 +666,12 @@ static void tigrProcessInput(TigrInternal* win, int winWidth, int winHeight) {
                         int key = tigrKeyFromX11(keySym);
                         win->keys[key] = thisBit;
                         tigrUpdateModifiers(win);
-
-                        if (thisBit) {
-                            tigrInterpretChar(win, root, keyCode, mask);
-                        }
                     }
                 }
             }
         }
     }
-    memcpy(prevKeys, keys, 32);
-
-    XEvent event;
-    while (XCheckTypedWindowEvent(win->dpy, win->win, ClientMessage, &event)) {
-        if (event.xclient.data.l[0] == wmDeleteMessage) {
-            glXMakeCurrent(win->dpy, None, NULL);
-            glXDestroyContext(win->dpy, win->glc);
-            XDestroyWindow(win->dpy, win->win);
-            win->win = 0;
-        }
-    }
-    XFlush(win->dpy);
+    memcpy(win->prevKeys, keys, 32);
 }
 
 void tigrUpdate(Tigr* bmp) {
@@ -604,7 +695,11 @@ void tigrUpdate(Tigr* bmp) {
     tigrGAPIPresent(bmp, gwa.width, gwa.height);
     glXSwapBuffers(win->dpy, win->win);
 
-    tigrProcessInput(win, gwa.width, gwa.height);
+    // Events first: the wheel only comes that way, and the window may get closed.
+    tigrProcessEvents(win);
+    if (win->win)
+        tigrProcessInput(win, gwa.width, gwa.height);
+    XFlush(win->dpy);
 }
 
 void tigrFree(Tigr* bmp) {
@@ -617,7 +712,7 @@ void tigrFree(Tigr* bmp) {
             win->win = 0;
         }
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
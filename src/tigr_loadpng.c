@@ -1,7 +1,9 @@
 #include "tigr_internal.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 typedef struct {
     const unsigned char *p, *end;
@@ -13,11 +15,13 @@ static unsigned get32(const unsigned char* v) {
 
 static const unsigned char* find(PNG* png, const char* chunk, unsigned minlen) {
     const unsigned char* start;
-    while (png->p < png->end) {
+    while (png->end - png->p >= 12) {
         unsigned len = get32(png->p + 0);
         start = png->p;
+        if (len > (size_t)(png->end - png->p) - 12)
+            break;
         png->p += len + 12;
-        if (memcmp(start + 4, chunk, 4) == 0 && len >= minlen && png->p <= png->end)
+        if (memcmp(start + 4, chunk, 4) == 0 && len >= minlen)
             return start + 8;
     }
 
@@ -35,37 +39,29 @@ static int rowBytes(int w, int bipp) {
     return rowBits / 8 + ((rowBits % 8) ? 1 : 0);
 }
 
-static int unfilter(int w, int h, int bipp, unsigned char* raw) {
-    int len = rowBytes(w, bipp);
-    int bpp = rowBytes(1, bipp);
-    int x, y;
-    unsigned char* first = (unsigned char*)malloc(len + 1);
-    memset(first, 0, len + 1);
-    unsigned char* prev = first;
-    for (y = 0; y < h; y++, prev = raw, raw += len) {
+static int unfilter(int len, int bpp, unsigned char* raw, const unsigned char* prev) {
+    int x;
 #define LOOP(A, B)            \
     for (x = 0; x < bpp; x++) \
         raw[x] += A;          \
     for (; x < len; x++)      \
         raw[x] += B;          \
     break
-        switch (*raw++) {
-            case 0:
-                break;
-            case 1:
-                LOOP(0, raw[x - bpp]);
-            case 2:
-                LOOP(prev[x], prev[x]);
-            case 3:
-                LOOP(prev[x] / 2, (raw[x - bpp] + prev[x]) / 2);
-            case 4:
-                LOOP(prev[x], paeth(raw[x - bpp], prev[x], prev[x - bpp]));
-            default:
-                return 0;
-        }
-#undef LOOP
+    switch (*raw++) {
+        case 0:
+            break;
+        case 1:
+            LOOP(0, raw[x - bpp]);
+        case 2:
+            LOOP(prev[x], prev[x]);
+        case 3:
+            LOOP(prev[x] / 2, (raw[x - bpp] + prev[x]) / 2);
+        case 4:
+            LOOP(prev[x], paeth(raw[x - bpp], prev[x], prev[x - bpp]));
+        default:
+            return 0;
     }
-    free(first);
+#undef LOOP
     return 1;
 }
 
@@ -164,126 +160,486 @@ static void depalette(int w,
     if (!(X))    \
     FAIL()
 
-static int outsize(Tigr* bmp, int bipp) {
-    return (rowBytes(bmp->w, bipp) + 1) * bmp->h;
-}
-
-static Tigr* tigrLoadPng(PNG* png) {
-    const unsigned char *ihdr, *idat, *plte, *trns, *first;
-    int trnsSize = 0;
-    int depth, ctype, bipp;
-    int datalen = 0;
-    unsigned char *data = NULL, *out;
-    Tigr* bmp = NULL;
-
-    CHECK(memcmp(png->p, "\211PNG\r\n\032\n", 8) == 0);  // PNG signature
+// Decoder state for one PNG, unfiltering and converting a row at a time.
+typedef struct PngRows {
+    int w, h, depth, ctype, bipp;
+    const unsigned char *plte, *trns;
+    int trnsSize;
+    int len, bpp;
+    unsigned char *cur, *prev;
+    int fill, y;
+    PNG* png;
+    TigrInflateState* inflate;
+
+    // Returns where row y should be converted to, and is told when it's done.
+    TPixel* (*target)(struct PngRows* rows, int y);
+    int (*done)(struct PngRows* rows, int y);
+    void* user;
+} PngRows;
+
+static int pngHeader(PNG* png, PngRows* rows) {
+    const unsigned char* ihdr;
+
+    CHECK(png->end - png->p >= 8 && memcmp(png->p, "\211PNG\r\n\032\n", 8) == 0);  // PNG signature
     png->p += 8;
-    first = png->p;
 
     // Read IHDR
     ihdr = find(png, "IHDR", 13);
     CHECK(ihdr);
-    depth = ihdr[8];
-    ctype = ihdr[9];
-    switch (ctype) {
+    rows->w = get32(ihdr + 0);
+    rows->h = get32(ihdr + 4);
+    rows->depth = ihdr[8];
+    rows->ctype = ihdr[9];
+    switch (rows->ctype) {
         case 0:
-            bipp = depth;
+            rows->bipp = rows->depth;
             break;  // greyscale
         case 2:
-            bipp = 3 * depth;
+            rows->bipp = 3 * rows->depth;
             break;  // RGB
         case 3:
-            bipp = depth;
+            rows->bipp = rows->depth;
             break;  // paletted
         case 4:
-            bipp = 2 * depth;
+            rows->bipp = 2 * rows->depth;
             break;  // grey+alpha
         case 6:
-            bipp = 4 * depth;
+            rows->bipp = 4 * rows->depth;
             break;  // RGBA
         default:
             FAIL();
     }
 
-    // Allocate bitmap (+1 width to save room for stupid PNG filter bytes)
-    bmp = tigrBitmap(get32(ihdr + 0) + 1, get32(ihdr + 4));
-    CHECK(bmp);
-    bmp->w--;
-
     // We support 8-bit color components and 1, 2, 4 and 8 bit palette formats.
     // No interlacing, or wacky filter types.
-    CHECK((depth != 16) && ihdr[10] == 0 && ihdr[11] == 0 && ihdr[12] == 0);
+    CHECK((rows->depth != 16) && ihdr[10] == 0 && ihdr[11] == 0 && ihdr[12] == 0);
 
-    // Join IDAT chunks.
-    for (idat = find(png, "IDAT", 0); idat; idat = find(png, "IDAT", 0)) {
-        unsigned len = get32(idat - 8);
-        data = (unsigned char*)realloc(data, datalen + len);
-        if (!data)
-            break;
+    // Row lengths and the bitmap size have to fit in an int.
+    CHECK(rows->w > 0 && rows->h > 0 && rows->bipp > 0);
+    CHECK(rows->w <= INT_MAX / 4 / rows->bipp && (size_t)rows->w * rows->h <= TIGR_MAX_PIXELS);
+    return 1;
 
-        memcpy(data + datalen, idat, len);
-        datalen += len;
+err:
+    return 0;
+}
+
+static int pngRow(PngRows* rows) {
+    unsigned char* tmp;
+    TPixel* dest;
+
+    if (rows->y >= rows->h || !unfilter(rows->len, rows->bpp, rows->cur, rows->prev + 1))
+        return 0;
+
+    dest = rows->target(rows, rows->y);
+    if (rows->ctype == 3) {
+        depalette(rows->w, 1, rows->cur, dest, rows->bipp, rows->plte, rows->trns, rows->trnsSize);
+    } else {
+        convert(rows->bipp / 8, rows->w, 1, rows->cur, dest, rows->trns);
     }
+    if (rows->done && !rows->done(rows, rows->y))
+        return 0;
+
+    tmp = rows->prev;
+    rows->prev = rows->cur;
+    rows->cur = tmp;
+    rows->fill = 0;
+    rows->y++;
+    return 1;
+}
+
+static int pngSink(void* ctx, const unsigned char* data, unsigned len) {
+    PngRows* rows = (PngRows*)ctx;
+    while (len > 0) {
+        unsigned n = rows->len + 1 - rows->fill;
+        if (n > len)
+            n = len;
+        memcpy(rows->cur + rows->fill, data, n);
+        rows->fill += n;
+        data += n;
+        len -= n;
+        if (rows->fill == rows->len + 1 && !pngRow(rows))
+            return 0;
+    }
+    return 1;
+}
+
+static int pngSource(void* ctx, const unsigned char** in, unsigned* len) {
+    PngRows* rows = (PngRows*)ctx;
+    const unsigned char* idat = find(rows->png, "IDAT", 0);
+    if (!idat)
+        return 0;
+    *in = idat;
+    *len = get32(idat - 8);
+    return 1;
+}
+
+// Decodes image data, after pngHeader has been called.
+static int pngDecode(PNG* png, PngRows* rows) {
+    const unsigned char *idat, *first;
+    unsigned char* buf = NULL;
+    unsigned outlen;
+
+    first = png->p;
+    rows->png = png;
 
     // Find palette.
-    png->p = first;
-    plte = find(png, "PLTE", 0);
+    rows->plte = find(png, "PLTE", 0);
 
     // Find transparency info.
     png->p = first;
-    trns = find(png, "tRNS", 0);
-    if (trns) {
-        trnsSize = get32(trns - 8);
+    rows->trns = find(png, "tRNS", 0);
+    if (rows->trns) {
+        rows->trnsSize = get32(rows->trns - 8);
     }
 
-    CHECK(data && datalen >= 6);
-    CHECK((data[0] & 0x0f) == 0x08     // compression method (RFC 1950)
-          && (data[0] & 0xf0) <= 0x70  // window size
-          && (data[1] & 0x20) == 0);   // preset dictionary present
+    // Image data is inflated straight out of the IDAT chunks, pulling in
+    // the following ones as needed.
+    png->p = first;
+    idat = find(png, "IDAT", 2);
+    CHECK(idat);
+    CHECK((idat[0] & 0x0f) == 0x08     // compression method (RFC 1950)
+          && (idat[0] & 0xf0) <= 0x70  // window size
+          && (idat[1] & 0x20) == 0);   // preset dictionary present
+    CHECK(rows->ctype == 3 ? rows->plte != NULL : rows->bipp % 8 == 0);
+
+    // Two raw rows for unfiltering.
+    rows->len = rowBytes(rows->w, rows->bipp);
+    rows->bpp = rowBytes(1, rows->bipp);
+    buf = (unsigned char*)calloc(2, rows->len + 1);
+    CHECK(buf);
+    rows->cur = buf;
+    rows->prev = buf + rows->len + 1;
+
+    outlen = rows->h > TIGR_INFLATE_WINDOW / (rows->len + 1) ? TIGR_INFLATE_WINDOW : (rows->len + 1) * rows->h;
+    errno = 0;
+    if (!tigrInflateStream(rows->inflate, outlen, idat + 2, get32(idat - 8) - 2, pngSource, pngSink, rows)) {
+        if (errno != ECANCELED && errno != ENOMEM)
+            errno = EINVAL;
+        goto err;
+    }
 
-    out = (unsigned char*)bmp->pix + outsize(bmp, 32) - outsize(bmp, bipp);
-    CHECK(tigrInflate(out, outsize(bmp, bipp), data + 2, datalen - 6));
-    CHECK(unfilter(bmp->w, bmp->h, bipp, out));
+    free(buf);
+    return 1;
 
-    if (ctype == 3) {
-        CHECK(plte);
-        depalette(bmp->w, bmp->h, out, bmp->pix, bipp, plte, trns, trnsSize);
-    } else {
-        CHECK(bipp % 8 == 0);
-        convert(bipp / 8, bmp->w, bmp->h, out, bmp->pix, trns);
-    }
+err:
+    free(buf);
+    return 0;
+}
 
-    free(data);
+static TPixel* bitmapTarget(PngRows* rows, int y) {
+    Tigr* bmp = (Tigr*)rows->user;
+    return bmp->pix + y * bmp->w;
+}
+
+static Tigr* tigrLoadPng(PNG* png, TigrInflateState* state) {
+    PngRows rows;
+    Tigr* bmp = NULL;
+
+    memset(&rows, 0, sizeof(rows));
+    rows.inflate = state;
+    CHECK(pngHeader(png, &rows));
+
+    bmp = tigrBitmap(rows.w, rows.h);
+    CHECK(bmp);
+
+    rows.target = bitmapTarget;
+    rows.user = bmp;
+    CHECK(pngDecode(png, &rows));
     return bmp;
 
 err:
-    if (data)
-        free(data);
     if (bmp)
         tigrFree(bmp);
     return NULL;
 }
 
+typedef struct {
+    TPixel* strip;
+    int stripRows;
+    TigrRowsFunc func;
+    void* user;
+} PngStrip;
+
+static TPixel* stripTarget(PngRows* rows, int y) {
+    PngStrip* strip = (PngStrip*)rows->user;
+    return strip->strip + (y % strip->stripRows) * rows->w;
+}
+
+static int stripDone(PngRows* rows, int y) {
+    PngStrip* strip = (PngStrip*)rows->user;
+    int count = y % strip->stripRows + 1;
+    if (count == strip->stripRows || y == rows->h - 1) {
+        if (!strip->func(strip->user, y + 1 - count, count, rows->w, strip->strip)) {
+            errno = ECANCELED;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Decodes rows of a 'w' pixels wide image straight into another bitmap, clipped like tigrBlit.
+// Rows that don't fit go through a scratch row first. PNG and QOI both use this.
+typedef struct {
+    Tigr* dest;
+    int dx, dy, w;
+    int x0, y0, x1, y1;
+    TPixel* row;
+} PngInto;
+
+static int intoStart(PngInto* into, Tigr* dest, int dx, int dy, int w) {
+    into->dest = dest;
+    into->dx = dx;
+    into->dy = dy;
+    into->w = w;
+    into->x0 = dest->cx > 0 ? dest->cx : 0;
+    into->y0 = dest->cy > 0 ? dest->cy : 0;
+    into->x1 = dest->cw >= 0 ? dest->cx + dest->cw : dest->w;
+    into->y1 = dest->ch >= 0 ? dest->cy + dest->ch : dest->h;
+    into->x1 = into->x1 < dest->w ? into->x1 : dest->w;
+    into->y1 = into->y1 < dest->h ? into->y1 : dest->h;
+    into->row = (TPixel*)malloc(w * sizeof(TPixel));
+    return into->row != NULL;
+}
+
+static int intoDirect(PngInto* into, int y) {
+    y += into->dy;
+    return y >= into->y0 && y < into->y1 && into->dx >= into->x0 && into->dx + into->w <= into->x1;
+}
+
+static TPixel* intoRow(void* user, int y) {
+    PngInto* into = (PngInto*)user;
+    if (intoDirect(into, y))
+        return into->dest->pix + (into->dy + y) * into->dest->w + into->dx;
+    return into->row;
+}
+
+static int intoRowDone(void* user, int y) {
+    PngInto* into = (PngInto*)user;
+    int x0 = into->dx, x1 = into->dx + into->w;
+
+    // Rows that were converted into the scratch row need clipping.
+    if (intoDirect(into, y) || into->dy + y < into->y0 || into->dy + y >= into->y1)
+        return 1;
+    x0 = x0 > into->x0 ? x0 : into->x0;
+    x1 = x1 < into->x1 ? x1 : into->x1;
+    if (x1 > x0) {
+        memcpy(into->dest->pix + (into->dy + y) * into->dest->w + x0, into->row + (x0 - into->dx),
+               (x1 - x0) * sizeof(TPixel));
+    }
+    return 1;
+}
+
+static TPixel* intoTarget(PngRows* rows, int y) {
+    return intoRow(rows->user, y);
+}
+
+static int intoDone(PngRows* rows, int y) {
+    return intoRowDone(rows->user, y);
+}
+
 #undef CHECK
 #undef FAIL
 
-Tigr* tigrLoadImageMem(const void* data, int length) {
+static int isQoi(const void* data, int length) {
+    return length >= 4 && memcmp(data, "qoif", 4) == 0;
+}
+
+Tigr* tigrDecodeImage(const void* data, int length, TigrInflateState* state) {
     PNG png;
+    if (isQoi(data, length))
+        return tigrLoadQoi(data, length);
     png.p = (unsigned char*)data;
     png.end = (unsigned char*)data + length;
-    return tigrLoadPng(&png);
+    return tigrLoadPng(&png, state);
 }
 
-Tigr* tigrLoadImage(const char* fileName) {
-    int len;
+Tigr* tigrLoadImageMem(const void* data, int length) {
+    return tigrDecodeImage(data, length, NULL);
+}
+
+// Maps or reads a whole file, from a mounted archive if it's in one, and decodes it with 'decode'.
+static int withFile(const char* fileName, int (*decode)(const void* data, int len, void* arg), void* arg) {
+    TigrArchive* archive = tigrFindMounted(fileName);
+    int len, ok;
+    const void* mapped;
     void* data;
-    Tigr* bmp;
+
+    if (archive) {
+        mapped = tigrArchiveRead(archive, fileName, &len);
+        ok = mapped && decode(mapped, len, arg);
+        if (mapped)
+            tigrArchiveRelease(archive, mapped);
+        tigrReleaseMounted(archive);
+        return ok;
+    }
+
+    mapped = tigrMapFile(fileName, &len);
+    if (mapped) {
+        ok = decode(mapped, len, arg);
+        tigrUnmapFile(mapped, len);
+        return ok;
+    }
 
     data = tigrReadFile(fileName, &len);
     if (!data)
-        return NULL;
+        return 0;
 
-    bmp = tigrLoadImageMem(data, len);
+    ok = decode(data, len, arg);
     free(data);
-    return bmp;
+    return ok;
+}
+
+typedef struct {
+    TigrInflateState* state;
+    Tigr* bmp;
+} FileLoad;
+
+static int decodeFile(const void* data, int len, void* arg) {
+    FileLoad* load = (FileLoad*)arg;
+    load->bmp = tigrDecodeImage(data, len, load->state);
+    return load->bmp != NULL;
+}
+
+Tigr* tigrDecodeImageFile(const char* fileName, TigrInflateState* state) {
+    FileLoad load = { state, NULL };
+    withFile(fileName, decodeFile, &load);
+    return load.bmp;
+}
+
+Tigr* tigrLoadImage(const char* fileName) {
+    return tigrDecodeImageFile(fileName, NULL);
+}
+
+int tigrLoadImageRowsMem(const void* data, int length, int stripRows, TigrRowsFunc func, void* user) {
+    PNG png;
+    PngRows rows;
+    PngStrip strip;
+    int ok;
+
+    png.p = (unsigned char*)data;
+    png.end = (unsigned char*)data + length;
+    memset(&rows, 0, sizeof(rows));
+    if (!pngHeader(&png, &rows))
+        return 0;
+
+    if (stripRows < 1)
+        stripRows = 1;
+    if (stripRows > rows.h)
+        stripRows = rows.h;
+
+    strip.strip = (TPixel*)malloc((size_t)stripRows * rows.w * sizeof(TPixel));
+    if (!strip.strip)
+        return 0;
+    strip.stripRows = stripRows;
+    strip.func = func;
+    strip.user = user;
+
+    rows.target = stripTarget;
+    rows.done = stripDone;
+    rows.user = &strip;
+    errno = 0;
+    ok = pngDecode(&png, &rows);
+
+    free(strip.strip);
+    return ok;
+}
+
+typedef struct {
+    int stripRows;
+    TigrRowsFunc func;
+    void* user;
+} FileRows;
+
+static int decodeFileRows(const void* data, int len, void* arg) {
+    FileRows* rows = (FileRows*)arg;
+    return tigrLoadImageRowsMem(data, len, rows->stripRows, rows->func, rows->user);
+}
+
+int tigrLoadImageRows(const char* fileName, int stripRows, TigrRowsFunc func, void* user) {
+    FileRows rows = { stripRows, func, user };
+    return withFile(fileName, decodeFileRows, &rows);
+}
+
+int tigrImageInfoMem(const void* data, int length, int* w, int* h, int* colorType) {
+    PNG png;
+    PngRows rows;
+    int channels;
+
+    if (isQoi(data, length)) {
+        if (!tigrQoiInfo(data, length, w, h, &channels))
+            return 0;
+        if (colorType)
+            *colorType = channels == 3 ? 2 : 6;
+        return 1;
+    }
+
+    png.p = (unsigned char*)data;
+    png.end = (unsigned char*)data + length;
+    memset(&rows, 0, sizeof(rows));
+    if (!pngHeader(&png, &rows))
+        return 0;
+
+    if (w)
+        *w = rows.w;
+    if (h)
+        *h = rows.h;
+    if (colorType)
+        *colorType = rows.ctype;
+    return 1;
+}
+
+static int decodeFileInfo(const void* data, int len, void* arg) {
+    int** out = (int**)arg;
+    return tigrImageInfoMem(data, len, out[0], out[1], out[2]);
+}
+
+int tigrImageInfo(const char* fileName, int* w, int* h, int* colorType) {
+    // Only the header gets read, so mapping the file touches just its first page.
+    int* out[3] = { w, h, colorType };
+    return withFile(fileName, decodeFileInfo, out);
+}
+
+int tigrLoadImageMemInto(Tigr* dest, int dx, int dy, const void* data, int length) {
+    PNG png;
+    PngRows rows;
+    PngInto into;
+    int ok;
+
+    if (isQoi(data, length)) {
+        int w;
+        if (!tigrQoiInfo(data, length, &w, NULL, NULL) || !intoStart(&into, dest, dx, dy, w))
+            return 0;
+        ok = tigrLoadQoiRows(data, length, intoRow, intoRowDone, &into);
+        free(into.row);
+        return ok;
+    }
+
+    png.p = (unsigned char*)data;
+    png.end = (unsigned char*)data + length;
+    memset(&rows, 0, sizeof(rows));
+    if (!pngHeader(&png, &rows) || !intoStart(&into, dest, dx, dy, rows.w))
+        return 0;
+
+    rows.target = intoTarget;
+    rows.done = intoDone;
+    rows.user = &into;
+    ok = pngDecode(&png, &rows);
+
+    free(into.row);
+    return ok;
+}
+
+typedef struct {
+    Tigr* dest;
+    int dx, dy;
+} FileInto;
+
+static int decodeFileInto(const void* data, int len, void* arg) {
+    FileInto* into = (FileInto*)arg;
+    return tigrLoadImageMemInto(into->dest, into->dx, into->dy, data, len);
+}
+
+int tigrLoadImageInto(Tigr* dest, int dx, int dy, const char* fileName) {
+    FileInto into = { dest, dx, dy };
+    return withFile(fileName, decodeFileInto, &into);
 }
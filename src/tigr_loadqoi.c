@@ -0,0 +1,139 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// QOI, the "Quite OK Image" format.
+#define QOI_HEADER 14
+#define QOI_PADDING 8
+#define QOI_HASH(p) (((p).r * 3 + (p).g * 5 + (p).b * 7 + (p).a * 11) & 63)
+
+static unsigned qoiGet32(const unsigned char* v) {
+    return (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+}
+
+int tigrQoiInfo(const void* data, int length, int* w, int* h, int* channels) {
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned width, height;
+
+    if (length < QOI_HEADER || memcmp(p, "qoif", 4) != 0)
+        goto err;
+    width = qoiGet32(p + 4);
+    height = qoiGet32(p + 8);
+    if (width == 0 || height == 0 || height >= TIGR_MAX_PIXELS / width)
+        goto err;
+    if ((p[12] != 3 && p[12] != 4) || p[13] > 1)
+        goto err;
+
+    if (w)
+        *w = (int)width;
+    if (h)
+        *h = (int)height;
+    if (channels)
+        *channels = p[12];
+    return 1;
+
+err:
+    errno = EINVAL;
+    return 0;
+}
+
+int tigrLoadQoiRows(const void* data, int length, TigrQoiTarget target, TigrQoiDone done, void* user) {
+    const unsigned char *p = (const unsigned char*)data, *end = p + length;
+    TPixel index[64], px;
+    int w, h, run = 0;
+
+    if (!tigrQoiInfo(data, length, &w, &h, NULL))
+        return 0;
+
+    memset(index, 0, sizeof(index));
+    px = tigrRGBA(0, 0, 0, 255);
+    p += QOI_HEADER;
+
+    for (int y = 0; y < h; y++) {
+        TPixel* out = target(user, y);
+        for (int x = 0; x < w; x++) {
+            int b1;
+            if (run > 0) {
+                run--;
+                out[x] = px;
+                continue;
+            }
+            if (end - p < 5)
+                goto err;
+
+            b1 = *p++;
+            if (b1 == 0xfe) {
+                px.r = p[0];
+                px.g = p[1];
+                px.b = p[2];
+                p += 3;
+            } else if (b1 == 0xff) {
+                px.r = p[0];
+                px.g = p[1];
+                px.b = p[2];
+                px.a = p[3];
+                p += 4;
+            } else {
+                switch (b1 & 0xc0) {
+                    case 0x00:  // index
+                        px = index[b1];
+                        break;
+                    case 0x40:  // small difference
+                        px.r += ((b1 >> 4) & 3) - 2;
+                        px.g += ((b1 >> 2) & 3) - 2;
+                        px.b += (b1 & 3) - 2;
+                        break;
+                    case 0x80: {  // difference, relative to green
+                        int b2 = *p++;
+                        int vg = (b1 & 0x3f) - 32;
+                        px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                        px.g += vg;
+                        px.b += vg - 8 + (b2 & 0x0f);
+                        break;
+                    }
+                    default:  // run, which can carry on into the next rows
+                        run = b1 & 0x3f;
+                        break;
+                }
+            }
+            index[QOI_HASH(px)] = px;
+            out[x] = px;
+        }
+        if (done && !done(user, y))
+            return 0;
+    }
+    if (run > 0)
+        goto err;
+    return 1;
+
+err:
+    errno = EINVAL;
+    return 0;
+}
+
+static TPixel* qoiBitmapRow(void* user, int y) {
+    Tigr* bmp = (Tigr*)user;
+    return bmp->pix + y * bmp->w;
+}
+
+Tigr* tigrLoadQoi(const void* data, int length) {
+    int w, h;
+    Tigr* bmp;
+
+    if (!tigrQoiInfo(data, length, &w, &h, NULL))
+        return NULL;
+    bmp = tigrBitmap(w, h);
+    if (!bmp)
+        return NULL;
+    if (!tigrLoadQoiRows(data, length, qoiBitmapRow, NULL, bmp)) {
+        tigrFree(bmp);
+        errno = EINVAL;
+        return NULL;
+    }
+    return bmp;
+}
+
+#undef QOI_HEADER
+#undef QOI_PADDING
+#undef QOI_HASH
@@ -473,7 +473,7 @@ void tigrFree(Tigr* bmp) {
         objc_msgSend_void((id)win->gl.glContext, sel("release"));
         objc_msgSend_void(window, sel("release"));
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
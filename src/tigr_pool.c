@@ -0,0 +1,230 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+
+// A pool of worker threads for tigrParallelFor. Each thread that joins in owns a
+// slice of the range and works through it a 'grain' at a time. When it runs out,
+// it steals the back half of whichever slice has the most left.
+#define POOL_MAX_THREADS 64
+
+typedef struct {
+    TigrMutex lock;
+    int next, end;
+} PoolSlice;
+
+typedef struct {
+    TigrRangeFunc func;
+    void* ctx;
+    int grain;
+    int numSlices;
+    PoolSlice slices[POOL_MAX_THREADS];
+} PoolJob;
+
+static TigrMutex poolLock = TIGR_MUTEX_INIT;
+static TigrCond poolWake, poolFinished;
+static int poolCondsReady;
+static int poolThreads = 1;  // wanted, counting the calling thread
+static int poolNumWorkers;
+static TigrThread poolWorkers[POOL_MAX_THREADS];
+static PoolJob* poolJob;
+static int poolGeneration, poolActive, poolBusy, poolQuit;
+
+static int poolTake(PoolSlice* slice, int grain, int* lo, int* hi) {
+    int ok = 0;
+    tigrMutexLock(&slice->lock);
+    if (slice->next < slice->end) {
+        *lo = slice->next;
+        *hi = slice->end - slice->next > grain ? slice->next + grain : slice->end;
+        slice->next = *hi;
+        ok = 1;
+    }
+    tigrMutexUnlock(&slice->lock);
+    return ok;
+}
+
+// Moves work from the fullest slice to 'self'. Returns zero if there's none left.
+static int poolSteal(PoolJob* job, int self) {
+    for (;;) {
+        int victim = -1, most = 0, lo, hi;
+
+        for (int i = 0; i < job->numSlices; i++) {
+            PoolSlice* s = &job->slices[i];
+            int left;
+            tigrMutexLock(&s->lock);
+            left = s->end - s->next;
+            tigrMutexUnlock(&s->lock);
+            if (i != self && left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim < 0)
+            return 0;
+
+        // Take the back half, or all of it if that's no more than a grain.
+        tigrMutexLock(&job->slices[victim].lock);
+        lo = job->slices[victim].next;
+        hi = job->slices[victim].end;
+        if (hi - lo > job->grain)
+            lo = hi - (hi - lo) / 2;
+        if (lo < hi)
+            job->slices[victim].end = lo;
+        tigrMutexUnlock(&job->slices[victim].lock);
+
+        // Someone else may have got there first, so look again.
+        if (lo < hi) {
+            tigrMutexLock(&job->slices[self].lock);
+            job->slices[self].next = lo;
+            job->slices[self].end = hi;
+            tigrMutexUnlock(&job->slices[self].lock);
+            return 1;
+        }
+    }
+}
+
+static void poolRun(PoolJob* job, int self) {
+    int lo, hi;
+    for (;;) {
+        if (poolTake(&job->slices[self], job->grain, &lo, &hi))
+            job->func(job->ctx, lo, hi);
+        else if (!poolSteal(job, self))
+            break;
+    }
+}
+
+static void poolWorker(void* arg) {
+    int self = (int)(size_t)arg;
+    int seen = 0;
+
+    tigrMutexLock(&poolLock);
+    for (;;) {
+        PoolJob* job;
+        while (!poolQuit && poolGeneration == seen)
+            tigrCondWait(&poolWake, &poolLock);
+        if (poolQuit)
+            break;
+        seen = poolGeneration;
+        job = poolJob;
+        tigrMutexUnlock(&poolLock);
+
+        if (self < job->numSlices)
+            poolRun(job, self);
+
+        tigrMutexLock(&poolLock);
+        if (--poolActive == 0)
+            tigrCondBroadcast(&poolFinished);
+    }
+    tigrMutexUnlock(&poolLock);
+}
+
+// Stops the workers. Called with poolLock held, and nothing running.
+static void poolStop(void) {
+    int numWorkers = poolNumWorkers;
+
+    poolQuit = 1;
+    tigrCondBroadcast(&poolWake);
+    tigrMutexUnlock(&poolLock);
+    for (int i = 0; i < numWorkers; i++)
+        tigrThreadJoin(poolWorkers[i]);
+    tigrMutexLock(&poolLock);
+    poolQuit = 0;
+    poolNumWorkers = 0;
+}
+
+// Starts any workers that are missing. Called with poolLock held.
+static void poolStart(void) {
+    if (!poolCondsReady) {
+        tigrCondInit(&poolWake);
+        tigrCondInit(&poolFinished);
+        poolCondsReady = 1;
+    }
+    while (poolNumWorkers < poolThreads - 1) {
+        // Worker i takes slice i + 1; the calling thread has slice 0.
+        if (!tigrThreadStart(&poolWorkers[poolNumWorkers], poolWorker, (void*)(size_t)(poolNumWorkers + 1)))
+            break;
+        poolNumWorkers++;
+    }
+}
+
+void tigrSetThreads(int threads) {
+    if (threads <= 0)
+        threads = tigrCpuCount();
+    if (threads > POOL_MAX_THREADS)
+        threads = POOL_MAX_THREADS;
+
+    tigrMutexLock(&poolLock);
+    while (poolBusy)
+        tigrCondWait(&poolFinished, &poolLock);
+    if (poolNumWorkers > threads - 1)
+        poolStop();
+    poolThreads = threads;
+    tigrMutexUnlock(&poolLock);
+}
+
+int tigrGetThreads(void) {
+    int threads;
+    tigrMutexLock(&poolLock);
+    threads = poolThreads;
+    tigrMutexUnlock(&poolLock);
+    return threads;
+}
+
+void tigrParallelFor(int begin, int end, int grain, TigrRangeFunc func, void* ctx) {
+    PoolJob job;
+    int count = end - begin, chunks;
+
+    if (count <= 0)
+        return;
+    if (grain < 1)
+        grain = 1;
+
+    // Small ranges, and calls made while the pool is already busy (including
+    // from inside another tigrParallelFor), just run here.
+    tigrMutexLock(&poolLock);
+    if (poolThreads <= 1 || count <= grain || poolBusy) {
+        tigrMutexUnlock(&poolLock);
+        func(ctx, begin, end);
+        return;
+    }
+    poolStart();
+    if (poolNumWorkers == 0) {
+        tigrMutexUnlock(&poolLock);
+        func(ctx, begin, end);
+        return;
+    }
+    poolBusy = 1;
+
+    // Hand out contiguous slices, one per thread.
+    chunks = (count + grain - 1) / grain;
+    job.func = func;
+    job.ctx = ctx;
+    job.grain = grain;
+    job.numSlices = chunks < poolNumWorkers + 1 ? chunks : poolNumWorkers + 1;
+    for (int i = 0; i < job.numSlices; i++) {
+        tigrMutexInit(&job.slices[i].lock);
+        job.slices[i].next = begin + (int)((long long)chunks * i / job.numSlices) * grain;
+        job.slices[i].end = begin + (int)((long long)chunks * (i + 1) / job.numSlices) * grain;
+        if (job.slices[i].end > end)
+            job.slices[i].end = end;
+    }
+
+    poolJob = &job;
+    poolActive = poolNumWorkers;
+    poolGeneration++;
+    tigrCondBroadcast(&poolWake);
+    tigrMutexUnlock(&poolLock);
+
+    poolRun(&job, 0);
+
+    tigrMutexLock(&poolLock);
+    while (poolActive > 0)
+        tigrCondWait(&poolFinished, &poolLock);
+    poolJob = NULL;
+    poolBusy = 0;
+    tigrCondBroadcast(&poolFinished);
+    tigrMutexUnlock(&poolLock);
+
+    for (int i = 0; i < job.numSlices; i++)
+        tigrMutexDestroy(&job.slices[i].lock);
+}
+
+#undef POOL_MAX_THREADS
@@ -1,6 +1,7 @@
 #include "tigr_internal.h"
 #include "tigr_font.h"
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <errno.h>
 #include <stdio.h>
@@ -10,7 +11,7 @@
 #endif
 
 TigrFont tigrStockFont;
-TigrFont* tfont = &tigrStockFont;
+TigrFont* const tfont = &tigrStockFont;
 
 // Converts 8-bit codepage entries into Unicode code points.
 static int cp1252[] = {
@@ -26,22 +27,83 @@ static int cp1252[] = {
     0x00f5, 0x00f6, 0x00f7, 0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x00fd, 0x00fe, 0x00ff,
 };
 
-static int border(Tigr* bmp, int x, int y) {
-    TPixel top = tigrGet(bmp, 0, 0);
-    TPixel c = tigrGet(bmp, x, y);
-    return (c.r == top.r && c.g == top.g && c.b == top.b) || x >= bmp->w || y >= bmp->h;
+// Glyphs are separated by pixels the same color as the top-left one (ignoring alpha).
+typedef struct {
+    const TPixel* pix;
+    int w, h;
+    unsigned key, mask;
+} Sheet;
+
+static unsigned rgbBits(const Sheet* sheet, const TPixel* p) {
+    unsigned v;
+    memcpy(&v, p, sizeof(v));
+    return v & sheet->mask;
 }
 
-static void scan(Tigr* bmp, int* x, int* y, int* rowh) {
-    while (*y < bmp->h) {
-        if (*x >= bmp->w) {
-            *x = 0;
+static void sheetInit(Sheet* sheet, Tigr* bmp) {
+    TPixel rgb = { 0xff, 0xff, 0xff, 0 };
+    sheet->pix = bmp->pix;
+    sheet->w = bmp->w;
+    sheet->h = bmp->h;
+    memcpy(&sheet->mask, &rgb, sizeof(sheet->mask));
+    sheet->key = rgbBits(sheet, bmp->pix);
+}
+
+// Finds the next glyph, skipping over border pixels a row at a time.
+static void scan(const Sheet* sheet, int* x, int* y, int* rowh) {
+    while (*y < sheet->h) {
+        const TPixel* row;
+        int px = *x;
+
+        if (px >= sheet->w) {
+            px = 0;
             (*y) += *rowh;
             *rowh = 1;
+            if (*y >= sheet->h) {
+                *x = px;
+                return;
+            }
         }
-        if (!border(bmp, *x, *y))
+        row = sheet->pix + *y * sheet->w;
+        while (px < sheet->w && rgbBits(sheet, row + px) == sheet->key)
+            px++;
+        *x = px;
+        if (px < sheet->w)
+            return;
+    }
+}
+
+// Measures a glyph, from its top-left pixel to the border on its right and below.
+static void measure(const Sheet* sheet, int x, int y, int* w, int* h) {
+    const TPixel* p = sheet->pix + y * sheet->w + x;
+    int n;
+
+    for (n = 0; x + n < sheet->w && rgbBits(sheet, p + n) != sheet->key; n++)
+        ;
+    *w = n;
+    for (n = 0; y + n < sheet->h && rgbBits(sheet, p) != sheet->key; n++)
+        p += sheet->w;
+    *h = n;
+}
+
+// Orders glyphs by code point, then by where they are on the sheet.
+static int compareGlyphs(const void* a, const void* b) {
+    const TigrGlyph* ga = (const TigrGlyph*)a;
+    const TigrGlyph* gb = (const TigrGlyph*)b;
+    if (ga->code != gb->code)
+        return ga->code < gb->code ? -1 : 1;
+    if (ga->y != gb->y)
+        return ga->y < gb->y ? -1 : 1;
+    return ga->x < gb->x ? -1 : ga->x > gb->x;
+}
+
+static void sortGlyphs(TigrFont* font) {
+    // Sheets are usually in code point order already.
+    for (int i = 1; i < font->numGlyphs; i++) {
+        if (font->glyphs[i - 1].code > font->glyphs[i].code) {
+            qsort(font->glyphs, font->numGlyphs, sizeof(TigrGlyph), compareGlyphs);
             return;
-        (*x)++;
+        }
     }
 }
 
@@ -71,6 +133,136 @@ static int readWatermark(Tigr* bmp, int x, int y, int* big, int* small) {
     return 1;
 }
 
+static TigrGlyph* search(TigrFont* font, int code) {
+    unsigned lo = 0, hi = font->numGlyphs;
+    while (lo < hi) {
+        unsigned guess = (lo + hi) / 2;
+        if (code < font->glyphs[guess].code)
+            hi = guess;
+        else
+            lo = guess + 1;
+    }
+    return (lo == 0 || font->glyphs[lo - 1].code != code) ? NULL : &font->glyphs[lo - 1];
+}
+
+static void freeIndex(TigrFont* font) {
+    for (int i = 0; i < font->numPages; i++)
+        free(font->pages[i]);
+    free(font->pages);
+    font->pages = NULL;
+    font->numPages = 0;
+}
+
+// Builds a two-level table from code points to glyphs, with a page for each
+// block of 256 code points that has any glyphs in it.
+static int indexGlyphs(TigrFont* font) {
+    TigrGlyph* g;
+    int numPages;
+
+    freeIndex(font);
+    if (font->numGlyphs <= 0) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    font->fallback = search(font, '?');
+    if (!font->fallback)
+        font->fallback = search(font, 0xfffd);
+    if (!font->fallback)
+        font->fallback = &font->glyphs[0];
+
+    // Glyphs are sorted, so the last one has the highest code point.
+    // Anything past the end of Unicode is left out.
+    numPages = font->glyphs[font->numGlyphs - 1].code;
+    numPages = (numPages < 0 ? 0 : numPages > 0x10ffff ? 0x10ffff : numPages) / 256 + 1;
+    font->pages = (TigrGlyph***)calloc(numPages, sizeof(TigrGlyph**));
+    if (!font->pages) {
+        errno = ENOMEM;
+        return 0;
+    }
+    font->numPages = numPages;
+
+    for (g = font->glyphs; g < font->glyphs + font->numGlyphs; g++) {
+        TigrGlyph** page;
+        if (g->code < 0 || g->code > 0x10ffff)
+            continue;
+        page = font->pages[g->code >> 8];
+        if (!page) {
+            page = font->pages[g->code >> 8] = (TigrGlyph**)malloc(256 * sizeof(TigrGlyph*));
+            if (!page) {
+                freeIndex(font);
+                errno = ENOMEM;
+                return 0;
+            }
+            for (int i = 0; i < 256; i++)
+                page[i] = font->fallback;
+        }
+        page[g->code & 0xff] = g;
+    }
+    return 1;
+}
+
+static void freeAtlas(TigrFont* font) {
+    if (font->atlas) {
+        free(font->atlas->index);
+        free(font->atlas);
+        font->atlas = NULL;
+    }
+}
+
+// Copies the glyphs into an 8-bit atlas, if they use few enough colors.
+// Fonts with more stay drawn with tigrBlitTint.
+static void buildAtlas(TigrFont* font) {
+    Tigr* bmp = font->bitmap;
+    TigrFontAtlas* atlas;
+    unsigned keys[512];
+    unsigned char slots[512];
+
+    freeAtlas(font);
+    atlas = (TigrFontAtlas*)calloc(1, sizeof(TigrFontAtlas));
+    if (!atlas)
+        return;
+    atlas->index = (unsigned char*)calloc((size_t)bmp->w * bmp->h, 1);
+    if (!atlas->index) {
+        free(atlas);
+        return;
+    }
+
+    // Index 0 is for transparent pixels, which blending leaves alone whatever their color.
+    atlas->numColors = 1;
+    memset(slots, 0, sizeof(slots));
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* g = &font->glyphs[i];
+        int x1 = g->x + g->w < bmp->w ? g->x + g->w : bmp->w;
+        int y1 = g->y + g->h < bmp->h ? g->y + g->h : bmp->h;
+        for (int y = g->y < 0 ? 0 : g->y; y < y1; y++) {
+            const TPixel* src = bmp->pix + y * bmp->w;
+            unsigned char* dst = atlas->index + y * bmp->w;
+            for (int x = g->x < 0 ? 0 : g->x; x < x1; x++) {
+                unsigned key, h;
+                if (src[x].a == 0)
+                    continue;
+                memcpy(&key, &src[x], sizeof(key));
+                h = (key * 0x9e3779b1u) >> 23;
+                while (slots[h] && keys[h] != key)
+                    h = (h + 1) & 511;
+                if (!slots[h]) {
+                    if (atlas->numColors == 256) {
+                        free(atlas->index);
+                        free(atlas);
+                        return;
+                    }
+                    keys[h] = key;
+                    slots[h] = (unsigned char)atlas->numColors;
+                    atlas->palette[atlas->numColors++] = src[x];
+                }
+                dst[x] = slots[h];
+            }
+        }
+    }
+    font->atlas = atlas;
+}
+
 int tigrLoadGlyphs(TigrFont* font, int codepage) {
     int x = 0;
     int y = 0;
@@ -79,6 +271,8 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
     int rowh = 1;
 
     TigrGlyph* g;
+    Sheet sheet;
+    sheetInit(&sheet, font->bitmap);
     switch (codepage) {
         case TCP_ASCII:
             font->numGlyphs = 128 - 32;
@@ -106,7 +300,7 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
 
         if (codepage != TCP_UTF32) {
             // Find the next glyph.
-            scan(font->bitmap, &x, &y, &rowh);
+            scan(&sheet, &x, &y, &rowh);
 
             if (y >= font->bitmap->h) {
                 errno = EINVAL;
@@ -114,14 +308,7 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
             }
 
             // Scan the width and height
-            w = h = 0;
-            while (!border(font->bitmap, x + w, y)) {
-                w++;
-            }
-
-            while (!border(font->bitmap, x, y + h)) {
-                h++;
-            }
+            measure(&sheet, x, y, &w, &h);
         }
 
         switch (codepage) {
@@ -165,68 +352,221 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
         }
     }
 
-    // Sort by code point.
-    for (int i = 1; i < font->numGlyphs; i++) {
-        int j = i;
-        TigrGlyph g = font->glyphs[i];
-        while (j > 0 && font->glyphs[j - 1].code > g.code) {
-            font->glyphs[j] = font->glyphs[j - 1];
-            j--;
-        }
-        font->glyphs[j] = g;
+    sortGlyphs(font);
+    buildAtlas(font);
+    return indexGlyphs(font);
+}
+
+TigrFont* tigrLoadFont(Tigr* bitmap, int codepage) {
+    TigrFont* font = (TigrFont*)calloc(1, sizeof(TigrFont));
+    font->bitmap = bitmap;
+    if (!tigrLoadGlyphs(font, codepage)) {
+        tigrFreeFont(font);
+        return NULL;
     }
+    return font;
+}
+
+// Glyph tables are "TIGRGLYF", then version, glyph count and sheet size,
+// then code, x, y, w, h for each glyph. All little-endian 32-bit values.
+#define GLYPH_TABLE_VERSION 1
+#define GLYPH_TABLE_HEADER 24
+
+int tigrSaveFontTable(TigrFont* font, const char* fileName) {
+    unsigned char header[GLYPH_TABLE_HEADER], entry[20];
+    FILE* out;
+    int ok;
+
+    memcpy(header, "TIGRGLYF", 8);
+    tigrPut32LE(header + 8, GLYPH_TABLE_VERSION);
+    tigrPut32LE(header + 12, font->numGlyphs);
+    tigrPut32LE(header + 16, font->bitmap->w);
+    tigrPut32LE(header + 20, font->bitmap->h);
+
+    out = tigrOpenFile(fileName, "wb");
+    if (!out)
+        return 0;
+
+    ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+    for (int i = 0; i < font->numGlyphs && ok; i++) {
+        TigrGlyph* g = &font->glyphs[i];
+        tigrPut32LE(entry, g->code);
+        tigrPut32LE(entry + 4, g->x);
+        tigrPut32LE(entry + 8, g->y);
+        tigrPut32LE(entry + 12, g->w);
+        tigrPut32LE(entry + 16, g->h);
+        ok = fwrite(entry, 1, sizeof(entry), out) == sizeof(entry);
+    }
+    ok = (fclose(out) == 0) && ok;
+    return ok;
+}
+
+// Reads a saved glyph table, checking it fits the font's bitmap.
+static int readTable(TigrFont* font, const unsigned char* data, int length) {
+    unsigned count;
+
+    errno = EINVAL;
+    if (length < GLYPH_TABLE_HEADER || memcmp(data, "TIGRGLYF", 8) != 0 ||
+        tigrGet32LE(data + 8) != GLYPH_TABLE_VERSION || tigrGet32LE(data + 16) != (unsigned)font->bitmap->w ||
+        tigrGet32LE(data + 20) != (unsigned)font->bitmap->h)
+        return 0;
+    count = tigrGet32LE(data + 12);
+    if (count == 0 || count > (unsigned)(length - GLYPH_TABLE_HEADER) / 20)
+        return 0;
 
+    font->glyphs = (TigrGlyph*)malloc(count * sizeof(TigrGlyph));
+    if (!font->glyphs) {
+        errno = ENOMEM;
+        return 0;
+    }
+    font->numGlyphs = (int)count;
+
+    data += GLYPH_TABLE_HEADER;
+    for (unsigned i = 0; i < count; i++, data += 20) {
+        TigrGlyph* g = &font->glyphs[i];
+        g->code = (int)tigrGet32LE(data);
+        g->x = (int)tigrGet32LE(data + 4);
+        g->y = (int)tigrGet32LE(data + 8);
+        g->w = (int)tigrGet32LE(data + 12);
+        g->h = (int)tigrGet32LE(data + 16);
+        if (g->x < 0 || g->y < 0 || g->w < 0 || g->h < 0 || g->w > font->bitmap->w - g->x ||
+            g->h > font->bitmap->h - g->y)
+            return 0;
+    }
     return 1;
 }
 
-TigrFont* tigrLoadFont(Tigr* bitmap, int codepage) {
+TigrFont* tigrLoadFontTable(Tigr* bitmap, const char* fileName) {
     TigrFont* font = (TigrFont*)calloc(1, sizeof(TigrFont));
+    int length, ok;
+    void* data;
+
+    if (!font) {
+        tigrFree(bitmap);
+        errno = ENOMEM;
+        return NULL;
+    }
     font->bitmap = bitmap;
-    if (!tigrLoadGlyphs(font, codepage)) {
+
+    data = tigrReadFile(fileName, &length);
+    if (!data) {
+        tigrFreeFont(font);
+        return NULL;
+    }
+    ok = readTable(font, (const unsigned char*)data, length);
+    free(data);
+    if (!ok) {
+        tigrFreeFont(font);
+        return NULL;
+    }
+
+    sortGlyphs(font);
+    buildAtlas(font);
+    if (!indexGlyphs(font)) {
         tigrFreeFont(font);
         return NULL;
     }
     return font;
 }
 
+#undef GLYPH_TABLE_VERSION
+#undef GLYPH_TABLE_HEADER
+
 void tigrFreeFont(TigrFont* font) {
+    freeIndex(font);
+    freeAtlas(font);
     tigrFree(font->bitmap);
     free(font->glyphs);
     free(font);
 }
 
 static TigrGlyph* get(TigrFont* font, int code) {
-    unsigned lo = 0, hi = font->numGlyphs;
-    while (lo < hi) {
-        unsigned guess = (lo + hi) / 2;
-        if (code < font->glyphs[guess].code)
-            hi = guess;
-        else
-            lo = guess + 1;
+    TigrGlyph* g;
+    if (font->pages) {
+        unsigned page = (unsigned)code >> 8;
+        return page < (unsigned)font->numPages && font->pages[page] ? font->pages[page][code & 0xff] : font->fallback;
     }
 
-    if (lo == 0 || font->glyphs[lo - 1].code != code)
-        return &font->glyphs['?' - 32];
-    else
-        return &font->glyphs[lo - 1];
+    // Fonts filled in by hand don't have a table.
+    g = search(font, code);
+    if (g)
+        return g;
+    g = search(font, '?');
+    return g ? g : &font->glyphs[0];
+}
+
+TigrGlyph* tigrGlyph(TigrFont* font, int code) {
+    return get(font, code);
+}
+
+static TigrOnce stockFontOnce = TIGR_ONCE_INIT;
+
+static void loadStockFont(void) {
+    tigrStockFont.bitmap = tigrLoadImageMem(tigr_font, tigr_font_size);
+    tigrLoadGlyphs(&tigrStockFont, 1252);
 }
 
 void tigrSetupFont(TigrFont* font) {
-    // Load the stock font if needed.
-    if (font == tfont && !tfont->bitmap) {
-        tfont->bitmap = tigrLoadImageMem(tigr_font, tigr_font_size);
-        tigrLoadGlyphs(tfont, 1252);
+    // Load the stock font the first time it's used, on whichever thread gets there first.
+    if (font == &tigrStockFont)
+        tigrOnce(&stockFontOnce, loadStockFont);
+}
+
+// Draws glyphs in the given color, through the atlas when the font has one.
+typedef struct {
+    Tigr* dest;
+    TigrFont* font;
+    TPixel color;
+    TigrTintTable tint;
+} GlyphPen;
+
+static void penInit(GlyphPen* pen, Tigr* dest, TigrFont* font, TPixel color) {
+    pen->dest = dest;
+    pen->font = font;
+    pen->color = color;
+    if (font->atlas)
+        tigrTintTable(&pen->tint, font->atlas->palette, font->atlas->numColors, color);
+}
+
+static void penDraw(GlyphPen* pen, TigrGlyph* g, int x, int y) {
+    TigrFont* font = pen->font;
+    if (font->atlas)
+        tigrBlitIndexed(pen->dest, font->bitmap, font->atlas->index, &pen->tint, x, y, g->x, g->y, g->w, g->h);
+    else
+        tigrBlitTint(pen->dest, font->bitmap, x, y, g->x, g->y, g->w, g->h, pen->color);
+}
+
+void tigrPrintText(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const char* text, int length) {
+    const char* end;
+    GlyphPen pen;
+    TigrGlyph* g;
+    int start = x, rowh, cps[256], n;
+
+    tigrSetupFont(font);
+    penInit(&pen, dest, font, color);
+    rowh = get(font, 0)->h;
+
+    // Print each glyph, decoding a block of text at a time.
+    end = text + (length < 0 ? strlen(text) : (size_t)length);
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\r')
+                continue;
+            if (cps[i] == '\n') {
+                x = start;
+                y += rowh;
+                continue;
+            }
+            g = get(font, cps[i]);
+            penDraw(&pen, g, x, y);
+            x += g->w;
+        }
     }
 }
 
 void tigrPrint(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const char* text, ...) {
     char tmp[1024];
-    TigrGlyph* g;
     va_list args;
-    const char* p;
-    int start = x, c;
-
-    tigrSetupFont(font);
 
     // Expand the formatting string.
     va_start(args, text);
@@ -234,48 +574,144 @@ void tigrPrint(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const cha
     tmp[sizeof(tmp) - 1] = 0;
     va_end(args);
 
-    // Print each glyph.
-    p = tmp;
-    while (*p) {
-        p = tigrDecodeUTF8(p, &c);
-        if (c == '\r')
-            continue;
-        if (c == '\n') {
-            x = start;
-            y += tigrTextHeight(font, "");
-            continue;
-        }
-        g = get(font, c);
-        tigrBlitTint(dest, font->bitmap, x, y, g->x, g->y, g->w, g->h, color);
-        x += g->w;
-    }
+    tigrPrintText(dest, font, x, y, color, tmp, -1);
 }
 
 int tigrTextWidth(TigrFont* font, const char* text) {
-    int x = 0, w = 0, c;
+    const char* end = text + strlen(text);
+    int x = 0, w = 0, cps[256], n;
     tigrSetupFont(font);
 
-    while (*text) {
-        text = tigrDecodeUTF8(text, &c);
-        if (c == '\n' || c == '\r') {
-            x = 0;
-        } else {
-            x += get(font, c)->w;
-            w = (x > w) ? x : w;
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n' || cps[i] == '\r') {
+                x = 0;
+            } else {
+                x += get(font, cps[i])->w;
+                w = (x > w) ? x : w;
+            }
         }
     }
     return w;
 }
 
 int tigrTextHeight(TigrFont* font, const char* text) {
-    int rowh, h, c;
+    const char* end = text + strlen(text);
+    int rowh, h, cps[256], n;
     tigrSetupFont(font);
 
     h = rowh = get(font, 0)->h;
-    while (*text) {
-        text = tigrDecodeUTF8(text, &c);
-        if (c == '\n' && *text)
-            h += rowh;
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n' && (i + 1 < n || text < end))
+                h += rowh;
+        }
     }
     return h;
 }
+
+typedef struct {
+    TigrGlyph* glyph;
+    int x, y;
+} PlacedGlyph;
+
+struct TigrTextLayout {
+    TigrFont* font;
+    int numGlyphs;
+    PlacedGlyph* glyphs;
+    int numLines;
+    int* lines;  // index of the first glyph on each line, plus one past the end
+    int rowh, w, h;
+};
+
+TigrTextLayout* tigrLayoutText(TigrFont* font, const char* text, int length) {
+    TigrTextLayout* layout;
+    const char *p, *end;
+    int x = 0, y = 0, cps[256], n, glyphs = 0, lines = 1;
+
+    tigrSetupFont(font);
+    end = text + (length < 0 ? strlen(text) : (size_t)length);
+
+    // Count first, so everything can be allocated up front.
+    for (p = text; (n = tigrDecodeUTF8Run(&p, end, cps, 256)) > 0;) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n')
+                lines++;
+            else if (cps[i] != '\r')
+                glyphs++;
+        }
+    }
+
+    layout = (TigrTextLayout*)calloc(1, sizeof(TigrTextLayout));
+    if (layout) {
+        layout->glyphs = (PlacedGlyph*)malloc((glyphs ? glyphs : 1) * sizeof(PlacedGlyph));
+        layout->lines = (int*)malloc((lines + 1) * sizeof(int));
+    }
+    if (!layout || !layout->glyphs || !layout->lines) {
+        tigrFreeLayout(layout);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    layout->font = font;
+    layout->rowh = get(font, 0)->h;
+    layout->lines[0] = 0;
+    for (p = text; (n = tigrDecodeUTF8Run(&p, end, cps, 256)) > 0;) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\r')
+                continue;
+            if (cps[i] == '\n') {
+                layout->lines[++layout->numLines] = layout->numGlyphs;
+                x = 0;
+                y += layout->rowh;
+                continue;
+            }
+            PlacedGlyph* g = &layout->glyphs[layout->numGlyphs++];
+            g->glyph = get(font, cps[i]);
+            g->x = x;
+            g->y = y;
+            x += g->glyph->w;
+            layout->w = x > layout->w ? x : layout->w;
+        }
+    }
+    layout->lines[++layout->numLines] = layout->numGlyphs;
+
+    // A trailing newline doesn't add a line, as in tigrTextHeight.
+    layout->h = layout->rowh * (layout->numLines - (lines > 1 && end[-1] == '\n'));
+    return layout;
+}
+
+void tigrDrawLayout(Tigr* dest, TigrTextLayout* layout, int x, int y, TPixel color) {
+    int cy = dest->ch >= 0 ? dest->cy : 0;
+    int ch = dest->ch >= 0 ? dest->ch : dest->h;
+    int first, last;
+    GlyphPen pen;
+
+    // Only lines that overlap the clip rect get drawn.
+    first = layout->rowh > 0 && cy > y ? (cy - y) / layout->rowh : 0;
+    last = layout->rowh > 0 ? (cy + ch - y + layout->rowh - 1) / layout->rowh : layout->numLines;
+    last = last < layout->numLines ? last : layout->numLines;
+    if (first >= last)
+        return;
+
+    penInit(&pen, dest, layout->font, color);
+    for (int i = layout->lines[first]; i < layout->lines[last]; i++) {
+        PlacedGlyph* g = &layout->glyphs[i];
+        penDraw(&pen, g->glyph, x + g->x, y + g->y);
+    }
+}
+
+void tigrLayoutSize(TigrTextLayout* layout, int* w, int* h) {
+    if (w)
+        *w = layout->w;
+    if (h)
+        *h = layout->h;
+}
+
+void tigrFreeLayout(TigrTextLayout* layout) {
+    if (!layout)
+        return;
+    free(layout->glyphs);
+    free(layout->lines);
+    free(layout);
+}
@@ -4,26 +4,152 @@
 #include <string.h>
 #include <errno.h>
 
+// DEFLATE compressor settings.
+#define WSIZE 32768
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define LOOKAHEAD (MAX_MATCH + MIN_MATCH + 1)
+#define MAX_SYMS 16384
+
+// LZ77 + Huffman compressor state, for compression lzLevels 2 and up.
 typedef struct {
-    unsigned crc, adler, bits, prev, runlen;
-    FILE* out;
-    unsigned crcTable[256];
+    unsigned char win[2 * WSIZE];
+    int head[HASH_SIZE];
+    int prev[WSIZE];
+    int pos, avail;
+    int chain, nice, lazy, good;
+    int nextLen, nextDist;  // match already found at pos, from lazy matching
+
+    // Symbols for the current block. Literals have a zero distance.
+    unsigned short lens[MAX_SYMS], dists[MAX_SYMS];
+    int numSyms;
+    unsigned litFreq[286], distFreq[30];
+
+    unsigned char lenCode[MAX_MATCH + 1], distCode[WSIZE + 1];
+} Deflate;
+
+// Compressed data is sent out in IDAT chunks of this size.
+#define IDAT_SIZE 65536
+
+typedef struct {
+    unsigned adler, bits, bitcount, prev, runlen;
+    int level, failed, raw, channels;
+    TigrWriteFunc write;
+    void* user;
+    Deflate* z;
+    unsigned char* stored;
+    int storedLen, idatLen;
+    unsigned char idat[IDAT_SIZE];
 } Save;
 
-static const unsigned crctable[16] = { 0,          0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
-                                       0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
-                                       0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c };
+// By compression level: chain length to search, length that ends the search early,
+// longest match to still look one byte further for a better one, and the match length
+// after which that second search is cut short.
+static const int lzLevels[10][4] = {
+    { 0, 0, 0, 0 },       { 0, 0, 0, 0 },        { 4, 16, 0, 0 },      { 8, 32, 0, 0 },
+    { 16, 16, 4, 4 },     { 32, 32, 16, 8 },     { 128, 128, 16, 8 },  { 256, 128, 32, 8 },
+    { 1024, 258, 128, 32 }, { 4096, 258, 258, 32 },
+};
+
+static const unsigned short lengthStart[29] = { 3,  4,  5,  6,  7,  8,  9,  10,  11,  13,  15,  17,  19,  23, 27,
+                                                31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                               2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distStart[30] = { 1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                              33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                              1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                             6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char lenOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static void output(Save* s, const void* data, int len) {
+    if (!s->failed && len > 0 && !s->write(s->user, data, len))
+        s->failed = 1;
+}
+
+static void store32(unsigned char* p, unsigned v) {
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static void writeChunk(Save* s, const char* id, const unsigned char* data, int len) {
+    unsigned char head[8], tail[4];
+    unsigned crc;
+    store32(head, len);
+    memcpy(head + 4, id, 4);
+    crc = tigrCrc32(0, head + 4, 4);
+    crc = tigrCrc32(crc, data, len);
+    store32(tail, crc);
+    output(s, head, 8);
+    output(s, data, len);
+    output(s, tail, 4);
+}
+
+// Sends out buffered compressed data, either as an IDAT chunk or as it is (for bands).
+static void flushIdat(Save* s) {
+    if (s->idatLen > 0 && s->raw)
+        output(s, s->idat, s->idatLen);
+    else if (s->idatLen > 0)
+        writeChunk(s, "IDAT", s->idat, s->idatLen);
+    s->idatLen = 0;
+}
 
 static void put(Save* s, unsigned v) {
-    fputc(v, s->out);
-    s->crc = (s->crc >> 4) ^ crctable[(s->crc & 15) ^ (v & 15)];
-    s->crc = (s->crc >> 4) ^ crctable[(s->crc & 15) ^ (v >> 4)];
+    s->idat[s->idatLen++] = (unsigned char)v;
+    if (s->idatLen == IDAT_SIZE)
+        flushIdat(s);
 }
 
-static void updateAdler(Save* s, unsigned v) {
+static void putBytes(Save* s, const unsigned char* data, int len) {
+    while (len > 0) {
+        int n = IDAT_SIZE - s->idatLen;
+        n = n < len ? n : len;
+        memcpy(s->idat + s->idatLen, data, n);
+        s->idatLen += n;
+        data += n;
+        len -= n;
+        if (s->idatLen == IDAT_SIZE)
+            flushIdat(s);
+    }
+}
+
+static void updateAdler(Save* s, const unsigned char* data, int len) {
     unsigned s1 = s->adler & 0xffff, s2 = (s->adler >> 16) & 0xffff;
-    s1 = (s1 + v) % 65521;
-    s2 = (s2 + s1) % 65521;
+    while (len > 0) {
+        // 5552 is the most bytes we can sum before s2 might overflow.
+        int n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n >= 8) {
+            s1 += data[0];
+            s2 += s1;
+            s1 += data[1];
+            s2 += s1;
+            s1 += data[2];
+            s2 += s1;
+            s1 += data[3];
+            s2 += s1;
+            s1 += data[4];
+            s2 += s1;
+            s1 += data[5];
+            s2 += s1;
+            s1 += data[6];
+            s2 += s1;
+            s1 += data[7];
+            s2 += s1;
+            data += 8;
+            n -= 8;
+        }
+        while (n--) {
+            s1 += *data++;
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+    }
     s->adler = (s2 << 16) + s1;
 }
 
@@ -34,35 +160,38 @@ static void put32(Save* s, unsigned v) {
     put(s, v & 0xff);
 }
 
-void putbits(Save* s, unsigned data, unsigned bitcount) {
+static void putbits(Save* s, unsigned data, unsigned bitcount) {
+    s->bits |= data << s->bitcount;
+    s->bitcount += bitcount;
+    while (s->bitcount >= 8) {
+        put(s, s->bits & 0xff);
+        s->bits >>= 8;
+        s->bitcount -= 8;
+    }
+}
+
+static unsigned reverseBits(unsigned data, unsigned bitcount) {
+    unsigned r = 0;
     while (bitcount--) {
-        unsigned prev = s->bits;
-        s->bits = (s->bits >> 1) | ((data & 1) << 7);
+        r = (r << 1) | (data & 1);
         data >>= 1;
-        if (prev & 1) {
-            put(s, s->bits);
-            s->bits = 0x80;
-        }
     }
+    return r;
 }
 
-void putbitsr(Save* s, unsigned data, unsigned bitcount) {
-    while (bitcount--)
-        putbits(s, data >> bitcount, 1);
+static void putbitsr(Save* s, unsigned data, unsigned bitcount) {
+    putbits(s, reverseBits(data, bitcount), bitcount);
 }
 
-static void begin(Save* s, const char* id, unsigned len) {
-    put32(s, len);
-    s->crc = 0xffffffff;
-    put(s, id[0]);
-    put(s, id[1]);
-    put(s, id[2]);
-    put(s, id[3]);
+static void flushbits(Save* s) {
+    if (s->bitcount > 0)
+        put(s, s->bits & 0xff);
+    s->bits = 0;
+    s->bitcount = 0;
 }
 
 static void literal(Save* s, unsigned v) {
     // Encode a literal/length using the built-in tables.
-    // Could do better with a custom table but whatever.
     if (v < 144)
         putbitsr(s, 0x030 + v - 0, 8);
     else if (v < 256)
@@ -75,7 +204,7 @@ static void literal(Save* s, unsigned v) {
 
 static void encodelen(Save* s, unsigned code, unsigned bits, unsigned len) {
     literal(s, code + (len >> bits));
-    putbits(s, len, bits);
+    putbits(s, len & ((1 << bits) - 1), bits);
     putbits(s, 0, 5);
 }
 
@@ -99,10 +228,7 @@ static void endrun(Save* s) {
 }
 
 static void encodeByte(Save* s, unsigned char v) {
-    updateAdler(s, v);
-
-    // Simple RLE compression. We could do better by doing a search
-    // to find matches, but this works pretty well TBH.
+    // Simple RLE compression, used for the fastest level.
     if (s->prev == v && s->runlen < 115) {
         s->runlen++;
     } else {
@@ -114,77 +240,865 @@ static void encodeByte(Save* s, unsigned char v) {
     }
 }
 
+// Uncompressed blocks, for level 0.
+static void storedBlock(Save* s, int last) {
+    putbits(s, last, 3);
+    flushbits(s);
+    put(s, s->storedLen & 0xff);
+    put(s, s->storedLen >> 8);
+    put(s, ~s->storedLen & 0xff);
+    put(s, (~s->storedLen >> 8) & 0xff);
+    putBytes(s, s->stored, s->storedLen);
+    s->storedLen = 0;
+}
+
+// Huffman code lengths -------------------------------------------------
+
+typedef struct {
+    unsigned freq;
+    int sym;
+} Leaf;
+
+static int compareLeaves(const void* a, const void* b) {
+    const Leaf* la = (const Leaf*)a;
+    const Leaf* lb = (const Leaf*)b;
+    if (la->freq != lb->freq)
+        return la->freq < lb->freq ? -1 : 1;
+    return la->sym - lb->sym;
+}
+
+// Builds Huffman code lengths of at most 'limit' bits for 'n' symbols.
+static void huffLengths(const unsigned* freqs, int n, int limit, unsigned char* lens) {
+    Leaf leaves[286];
+    unsigned weight[2 * 286], freq[286];
+    int parent[2 * 286], depth[2 * 286];
+    int count, i, j, k, maxlen;
+
+    memcpy(freq, freqs, n * sizeof(unsigned));
+
+    // Make sure there are always at least two codes, so that the code is complete.
+    for (i = 0, count = 0; i < n; i++)
+        count += freq[i] != 0;
+    for (i = 0; count < 2 && i < n; i++) {
+        if (!freq[i]) {
+            freq[i] = 1;
+            count++;
+        }
+    }
+
+    for (;;) {
+        for (i = 0, count = 0; i < n; i++) {
+            lens[i] = 0;
+            if (freq[i]) {
+                leaves[count].freq = freq[i];
+                leaves[count].sym = i;
+                count++;
+            }
+        }
+        qsort(leaves, count, sizeof(Leaf), compareLeaves);
+
+        // Two-queue Huffman: leaves in order, then internal nodes in creation order.
+        for (i = 0; i < count; i++)
+            weight[i] = leaves[i].freq;
+        i = 0;
+        j = count;
+        for (k = count; k < 2 * count - 1; k++) {
+            int a, b;
+            a = (i < count && (j >= k || weight[i] <= weight[j])) ? i++ : j++;
+            b = (i < count && (j >= k || weight[i] <= weight[j])) ? i++ : j++;
+            weight[k] = weight[a] + weight[b];
+            parent[a] = parent[b] = k;
+        }
+
+        depth[2 * count - 2] = 0;
+        maxlen = 0;
+        for (k = 2 * count - 3; k >= 0; k--) {
+            depth[k] = depth[parent[k]] + 1;
+            if (k < count && depth[k] > maxlen)
+                maxlen = depth[k];
+        }
+
+        if (maxlen <= limit) {
+            for (i = 0; i < count; i++)
+                lens[leaves[i].sym] = (unsigned char)depth[i];
+            return;
+        }
+
+        // Too deep, so flatten the distribution and try again.
+        for (i = 0; i < n; i++) {
+            if (freq[i])
+                freq[i] = (freq[i] >> 1) | 1;
+        }
+    }
+}
+
+// Turns code lengths into bit-reversed canonical codes, ready for putbits.
+static void huffCodes(const unsigned char* lens, int n, unsigned* codes) {
+    unsigned counts[16] = { 0 }, next[16];
+    int i;
+    for (i = 0; i < n; i++)
+        counts[lens[i]]++;
+    counts[0] = 0;
+    next[0] = 0;
+    for (i = 1; i < 16; i++)
+        next[i] = (next[i - 1] + counts[i - 1]) << 1;
+    for (i = 0; i < n; i++) {
+        if (lens[i])
+            codes[i] = reverseBits(next[lens[i]]++, lens[i]);
+    }
+}
+
+// LZ77 -----------------------------------------------------------------
+
+static Deflate* lzInit(int level) {
+    Deflate* z = (Deflate*)malloc(sizeof(Deflate));
+    int code, n;
+    if (!z)
+        return NULL;
+
+    memset(z->head, 0xff, sizeof(z->head));
+    z->pos = z->avail = 0;
+    z->numSyms = 0;
+    memset(z->litFreq, 0, sizeof(z->litFreq));
+    memset(z->distFreq, 0, sizeof(z->distFreq));
+    z->chain = lzLevels[level][0];
+    z->nice = lzLevels[level][1];
+    z->lazy = lzLevels[level][2];
+    z->good = lzLevels[level][3];
+    z->nextLen = -1;
+
+    for (code = 0; code < 29; code++) {
+        for (n = 0; n < (1 << lengthExtra[code]) && lengthStart[code] + n <= MAX_MATCH; n++)
+            z->lenCode[lengthStart[code] + n] = (unsigned char)code;
+    }
+    z->lenCode[MAX_MATCH] = 28;
+    for (code = 0; code < 30; code++) {
+        for (n = 0; n < (1 << distExtra[code]); n++)
+            z->distCode[distStart[code] + n] = (unsigned char)code;
+    }
+    return z;
+}
+
+static unsigned lzHash(const unsigned char* p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (HASH_SIZE - 1);
+}
+
+static void lzInsert(Deflate* z, int p) {
+    if (p + MIN_MATCH <= z->pos + z->avail) {
+        unsigned h = lzHash(z->win + p);
+        z->prev[p & (WSIZE - 1)] = z->head[h];
+        z->head[h] = p;
+    }
+}
+
+static int lzMatch(Deflate* z, int p, int chain, int* dist) {
+    const unsigned char* win = z->win;
+    int maxlen = z->pos + z->avail - p;
+    int best = MIN_MATCH - 1;
+    int cur;
+
+    if (maxlen > MAX_MATCH)
+        maxlen = MAX_MATCH;
+    if (maxlen < MIN_MATCH)
+        return 0;
+
+    for (cur = z->head[lzHash(win + p)]; cur >= 0 && cur > p - WSIZE && chain-- > 0;) {
+        int next;
+        if (win[cur + best] == win[p + best] && win[cur] == win[p] && win[cur + 1] == win[p + 1]) {
+            int len = 2;
+            while (len < maxlen && win[cur + len] == win[p + len])
+                len++;
+            if (len > best) {
+                best = len;
+                *dist = p - cur;
+                if (len >= z->nice || len >= maxlen)
+                    break;
+            }
+        }
+        next = z->prev[cur & (WSIZE - 1)];
+        if (next >= cur)
+            break;
+        cur = next;
+    }
+    return best >= MIN_MATCH ? best : 0;
+}
+
+static void lzBlock(Save* s, int last) {
+    Deflate* z = s->z;
+    unsigned char litLens[288], distLens[30], lens[286 + 30], clenLens[19];
+    unsigned litCodes[288], distCodes[30], clenCodes[19], clenFreq[19] = { 0 };
+    unsigned char rle[286 + 30], rleExtra[286 + 30];
+    unsigned long dynamicCost, fixedCost;
+    int hlit, hdist, hclen, numRle = 0, i, useFixed;
+
+    z->litFreq[256]++;
+    huffLengths(z->litFreq, 286, 15, litLens);
+    huffLengths(z->distFreq, 30, 15, distLens);
+
+    for (hlit = 286; hlit > 257 && !litLens[hlit - 1]; hlit--)
+        ;
+    for (hdist = 30; hdist > 1 && !distLens[hdist - 1]; hdist--)
+        ;
+
+    // Run-length encode the code lengths.
+    memcpy(lens, litLens, hlit);
+    memcpy(lens + hlit, distLens, hdist);
+    for (i = 0; i < hlit + hdist;) {
+        int run = 1;
+        while (i + run < hlit + hdist && lens[i + run] == lens[i])
+            run++;
+        if (lens[i] == 0 && run >= 3) {
+            run = run > 138 ? 138 : run;
+            rle[numRle] = run >= 11 ? 18 : 17;
+            rleExtra[numRle++] = (unsigned char)(run >= 11 ? run - 11 : run - 3);
+        } else if (run >= 4) {
+            run = run > 7 ? 7 : run;
+            rle[numRle] = lens[i];
+            rleExtra[numRle++] = 0;
+            rle[numRle] = 16;
+            rleExtra[numRle++] = (unsigned char)(run - 4);
+        } else {
+            run = 1;
+            rle[numRle] = lens[i];
+            rleExtra[numRle++] = 0;
+        }
+        i += run;
+    }
+    for (i = 0; i < numRle; i++)
+        clenFreq[rle[i]]++;
+    huffLengths(clenFreq, 19, 7, clenLens);
+    for (hclen = 19; hclen > 4 && !clenLens[lenOrder[hclen - 1]]; hclen--)
+        ;
+
+    // Pick whichever of the dynamic and fixed codes is smaller.
+    dynamicCost = 14 + 3 * hclen;
+    fixedCost = 0;
+    for (i = 0; i < 19; i++)
+        dynamicCost += clenFreq[i] * (clenLens[i] + (i == 16 ? 2 : i == 17 ? 3 : i == 18 ? 7 : 0));
+    for (i = 0; i < 286; i++) {
+        dynamicCost += z->litFreq[i] * litLens[i];
+        fixedCost += z->litFreq[i] * (i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+    }
+    for (i = 0; i < 30; i++) {
+        dynamicCost += z->distFreq[i] * distLens[i];
+        fixedCost += z->distFreq[i] * 5;
+    }
+    useFixed = fixedCost <= dynamicCost;
+
+    if (useFixed) {
+        // The fixed code covers 288 symbols, even though the last two are never used.
+        for (i = 0; i < 288; i++)
+            litLens[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        for (i = 0; i < 30; i++)
+            distLens[i] = 5;
+        putbits(s, last | (1 << 1), 3);
+    } else {
+        huffCodes(clenLens, 19, clenCodes);
+        putbits(s, last | (2 << 1), 3);
+        putbits(s, hlit - 257, 5);
+        putbits(s, hdist - 1, 5);
+        putbits(s, hclen - 4, 4);
+        for (i = 0; i < hclen; i++)
+            putbits(s, clenLens[lenOrder[i]], 3);
+        for (i = 0; i < numRle; i++) {
+            putbits(s, clenCodes[rle[i]], clenLens[rle[i]]);
+            if (rle[i] >= 16)
+                putbits(s, rleExtra[i], rle[i] == 16 ? 2 : rle[i] == 17 ? 3 : 7);
+        }
+    }
+    huffCodes(litLens, useFixed ? 288 : 286, litCodes);
+    huffCodes(distLens, 30, distCodes);
+
+    for (i = 0; i < z->numSyms; i++) {
+        unsigned len = z->lens[i], dist = z->dists[i];
+        if (dist == 0) {
+            putbits(s, litCodes[len], litLens[len]);
+        } else {
+            unsigned lc = z->lenCode[len], dc = z->distCode[dist];
+            putbits(s, litCodes[257 + lc], litLens[257 + lc]);
+            putbits(s, len - lengthStart[lc], lengthExtra[lc]);
+            putbits(s, distCodes[dc], distLens[dc]);
+            putbits(s, dist - distStart[dc], distExtra[dc]);
+        }
+    }
+    putbits(s, litCodes[256], litLens[256]);
+
+    z->numSyms = 0;
+    memset(z->litFreq, 0, sizeof(z->litFreq));
+    memset(z->distFreq, 0, sizeof(z->distFreq));
+}
+
+static void lzTally(Save* s, unsigned len, unsigned dist) {
+    Deflate* z = s->z;
+    z->lens[z->numSyms] = (unsigned short)len;
+    z->dists[z->numSyms] = (unsigned short)dist;
+    z->numSyms++;
+    if (dist == 0) {
+        z->litFreq[len]++;
+    } else {
+        z->litFreq[257 + z->lenCode[len]]++;
+        z->distFreq[z->distCode[dist]]++;
+    }
+    if (z->numSyms == MAX_SYMS)
+        lzBlock(s, 0);
+}
+
+// Finds matches in the window, until less than a full match of lookahead is left.
+static void lzWindow(Save* s, int flush) {
+    Deflate* z = s->z;
+    while (z->avail >= LOOKAHEAD || (flush && z->avail > 0)) {
+        int dist = z->nextDist, len = z->nextLen;
+        if (len < 0)
+            len = lzMatch(z, z->pos, z->chain, &dist);
+        z->nextLen = -1;
+        lzInsert(z, z->pos);
+
+        if (len && len < z->lazy) {
+            // Emit a literal instead if there's a longer match at the next byte.
+            int dist2 = 0, len2 = lzMatch(z, z->pos + 1, len >= z->good ? z->chain >> 2 : z->chain, &dist2);
+            if (len2 > len) {
+                z->nextLen = len2;
+                z->nextDist = dist2;
+                len = 0;
+            }
+        }
+
+        if (len) {
+            lzTally(s, len, dist);
+            for (int i = 1; i < len; i++)
+                lzInsert(z, z->pos + i);
+        } else {
+            lzTally(s, z->win[z->pos], 0);
+            len = 1;
+        }
+        z->pos += len;
+        z->avail -= len;
+    }
+}
+
+static void lzSlide(Deflate* z) {
+    int i;
+    memmove(z->win, z->win + WSIZE, WSIZE);
+    z->pos -= WSIZE;
+    for (i = 0; i < HASH_SIZE; i++)
+        z->head[i] = z->head[i] >= WSIZE ? z->head[i] - WSIZE : -1;
+    for (i = 0; i < WSIZE; i++)
+        z->prev[i] = z->prev[i] >= WSIZE ? z->prev[i] - WSIZE : -1;
+}
+
+// Compresses a piece of (filtered) image data.
+static void compressData(Save* s, const unsigned char* data, int len) {
+    updateAdler(s, data, len);
+
+    if (s->level == 0) {
+        while (len > 0) {
+            int n = 65535 - s->storedLen;
+            n = n < len ? n : len;
+            memcpy(s->stored + s->storedLen, data, n);
+            s->storedLen += n;
+            data += n;
+            len -= n;
+            if (s->storedLen == 65535)
+                storedBlock(s, 0);
+        }
+    } else if (s->level == 1) {
+        while (len--)
+            encodeByte(s, *data++);
+    } else {
+        Deflate* z = s->z;
+        while (len > 0) {
+            int n = 2 * WSIZE - (z->pos + z->avail);
+            if (n == 0) {
+                lzSlide(z);
+                n = WSIZE;
+            }
+            n = n < len ? n : len;
+            memcpy(z->win + z->pos + z->avail, data, n);
+            z->avail += n;
+            data += n;
+            len -= n;
+            lzWindow(s, 0);
+        }
+    }
+}
+
+static void startData(Save* s, int last) {
+    if (s->level == 1)
+        putbits(s, last | (1 << 1), 3);  // fixed dictionary
+}
+
+// Ends the compressed data. If it isn't the last part of the stream, it ends
+// byte aligned after an empty stored block, so that more can be appended.
+static void finishData(Save* s, int last) {
+    if (s->level == 0) {
+        storedBlock(s, last);
+    } else if (s->level == 1) {
+        endrun(s);
+        literal(s, 256);  // terminator
+    } else {
+        lzWindow(s, 1);
+        lzBlock(s, last);
+    }
+    if (!last && s->level != 0) {
+        putbits(s, 0, 3);
+        flushbits(s);
+        put32(s, 0x0000ffff);
+    }
+    flushbits(s);
+}
+
+typedef struct {
+    unsigned char* data;
+    int len, cap;
+} MemWriter;
+
+static int memWrite(void* user, const void* data, int len) {
+    MemWriter* m = (MemWriter*)user;
+    if (len > m->cap - m->len) {
+        int cap = m->cap ? m->cap : 65536;
+        unsigned char* grown;
+        while (cap - m->len < len)
+            cap *= 2;
+        grown = (unsigned char*)realloc(m->data, cap);
+        if (!grown)
+            return 0;
+        m->data = grown;
+        m->cap = cap;
+    }
+    memcpy(m->data + m->len, data, len);
+    m->len += len;
+    return 1;
+}
+
 static void savePngHeader(Save* s, Tigr* bmp) {
-    fwrite("\211PNG\r\n\032\n", 8, 1, s->out);
-    begin(s, "IHDR", 13);
-    put32(s, bmp->w);
-    put32(s, bmp->h);
-    put(s, 8);  // bit depth
-    put(s, 6);  // RGBA
-    put(s, 0);  // compression (deflate)
-    put(s, 0);  // filter (standard)
-    put(s, 0);  // interlace off
-    put32(s, ~s->crc);
-}
-
-static long savePngData(Save* s, Tigr* bmp, long dataPos) {
-    int x, y;
-    long dataSize;
-    begin(s, "IDAT", 0);
-    put(s, 0x08);      // zlib compression method
-    put(s, 0x1d);      // zlib compression flags
-    putbits(s, 3, 3);  // zlib last block + fixed dictionary
-    for (y = 0; y < bmp->h; y++) {
-        TPixel* row = &bmp->pix[y * bmp->w];
-        TPixel prev = tigrRGBA(0, 0, 0, 0);
-
-        encodeByte(s, 1);  // sub filter
-        for (x = 0; x < bmp->w; x++) {
-            encodeByte(s, row[x].r - prev.r);
-            encodeByte(s, row[x].g - prev.g);
-            encodeByte(s, row[x].b - prev.b);
-            encodeByte(s, row[x].a - prev.a);
-            prev = row[x];
-        }
-    }
-    endrun(s);
-    literal(s, 256);  // terminator
-    while (s->bits != 0x80)
-        putbits(s, 0, 1);
+    unsigned char ihdr[13];
+    store32(ihdr, bmp->w);
+    store32(ihdr + 4, bmp->h);
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = s->channels == 1 ? 0 : s->channels == 2 ? 4 : s->channels == 3 ? 2 : 6;  // color type
+    ihdr[10] = 0;  // compression (deflate)
+    ihdr[11] = 0;  // filter (standard)
+    ihdr[12] = 0;  // interlace off
+    output(s, "\211PNG\r\n\032\n", 8);
+    writeChunk(s, "IHDR", ihdr, 13);
+}
+
+static void zlibHeader(Save* s) {
+    if (s->level == 1) {
+        put(s, 0x08);  // zlib compression method, 256 byte window
+        put(s, 0x1d);  // zlib compression flags
+    } else {
+        put(s, 0x78);  // zlib compression method, 32k window
+        put(s, s->level == 0 ? 0x01 : s->level < 6 ? 0x5e : s->level == 6 ? 0x9c : 0xda);  // compression flags
+    }
+}
+
+// Picks the fewest channels that hold the image exactly: grey, grey+alpha, RGB or RGBA.
+static int pngChannels(Tigr* bmp) {
+    int opaque = 1, grey = 1;
+    TPixel* p = bmp->pix;
+    for (int i = bmp->w * bmp->h; i > 0 && (opaque || grey); i--, p++) {
+        opaque &= p->a == 255;
+        grey &= p->r == p->g && p->g == p->b;
+    }
+    return (grey ? 1 : 3) + !opaque;
+}
+
+static void packRow(unsigned char* out, const TPixel* src, int w, int channels) {
+    int x;
+    switch (channels) {
+        case 1:
+            for (x = 0; x < w; x++)
+                *out++ = src[x].r;
+            break;
+        case 2:
+            for (x = 0; x < w; x++) {
+                *out++ = src[x].r;
+                *out++ = src[x].a;
+            }
+            break;
+        case 3:
+            for (x = 0; x < w; x++) {
+                *out++ = src[x].r;
+                *out++ = src[x].g;
+                *out++ = src[x].b;
+            }
+            break;
+        default:
+            memcpy(out, src, w * sizeof(TPixel));
+            break;
+    }
+}
+
+static int predictPaeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+static unsigned absSum(const unsigned char* data, int len) {
+    unsigned sum = 0;
+    for (int i = 0; i < len; i++)
+        sum += abs((signed char)data[i]);
+    return sum;
+}
+
+// Filters a row, which has a spare byte before it for the filter type. Levels 2 and up
+// try every filter and keep the one with the smallest sum of absolute differences.
+static unsigned char* filterRow(unsigned char* out[5], unsigned char* cur, const unsigned char* prev, int len, int bpp,
+                                int level) {
+    unsigned char *sub = out[1] + 1, *up = out[2] + 1, *avg = out[3] + 1, *pae = out[4] + 1;
+    unsigned best, sum;
+    int i, f, pick;
+
+    if (level == 0) {
+        cur[-1] = 0;
+        return cur - 1;
+    }
+
+    out[1][0] = 1;
+    for (i = 0; i < bpp && i < len; i++)
+        sub[i] = cur[i];
+    for (; i < len; i++)
+        sub[i] = cur[i] - cur[i - bpp];
+    if (level == 1)
+        return out[1];
+
+    for (i = 0; i < bpp && i < len; i++) {
+        up[i] = cur[i] - prev[i];
+        avg[i] = cur[i] - (prev[i] >> 1);
+        pae[i] = cur[i] - prev[i];
+    }
+    for (; i < len; i++) {
+        up[i] = cur[i] - prev[i];
+        avg[i] = cur[i] - ((cur[i - bpp] + prev[i]) >> 1);
+        pae[i] = cur[i] - predictPaeth(cur[i - bpp], prev[i], prev[i - bpp]);
+    }
+
+    cur[-1] = 0;
+    best = absSum(cur, len);
+    pick = 0;
+    for (f = 1; f < 5; f++) {
+        sum = absSum(out[f] + 1, len);
+        if (sum < best) {
+            best = sum;
+            pick = f;
+        }
+    }
+    if (pick == 0)
+        return cur - 1;
+    out[pick][0] = (unsigned char)pick;
+    return out[pick];
+}
+
+// Filters and compresses rows [y0, y1).
+static int compressRows(Save* s, Tigr* bmp, int y0, int y1) {
+    int y, f, len = bmp->w * s->channels;
+    unsigned char *buf, *out[5], *cur, *prev;
+
+    buf = (unsigned char*)calloc(7, len + 1);
+    if (!buf)
+        return 0;
+    for (f = 0; f < 5; f++)
+        out[f] = buf + f * (len + 1);
+    cur = buf + 5 * (len + 1) + 1;
+    prev = buf + 6 * (len + 1) + 1;
+
+    // Bands start from the previous row, so Up/Average/Paeth still work across them.
+    if (y0 > 0)
+        packRow(prev, &bmp->pix[(y0 - 1) * bmp->w], bmp->w, s->channels);
+
+    for (y = y0; y < y1 && !s->failed; y++) {
+        unsigned char* row;
+        packRow(cur, &bmp->pix[y * bmp->w], bmp->w, s->channels);
+        row = filterRow(out, cur, prev, len, s->channels, s->level);
+        compressData(s, row, len + 1);
+
+        row = prev;
+        prev = cur;
+        cur = row;
+    }
+    free(buf);
+    return 1;
+}
+
+static Save* newSave(int level, TigrWriteFunc write, void* user) {
+    Save* s = (Save*)malloc(sizeof(Save));
+    if (!s)
+        return NULL;
+    s->adler = 1;
+    s->bits = s->bitcount = 0;
+    s->prev = 0xffff;
+    s->runlen = 0;
+    s->level = level;
+    s->failed = s->raw = 0;
+    s->write = write;
+    s->user = user;
+    s->z = level >= 2 ? lzInit(level) : NULL;
+    s->stored = level == 0 ? (unsigned char*)malloc(65535) : NULL;
+    s->storedLen = s->idatLen = 0;
+    if (level != 1 && !s->stored && !s->z) {
+        free(s->z);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void freeSave(Save* s) {
+    free(s->stored);
+    free(s->z);
+    free(s);
+}
+
+// Compresses bands of rows in parallel.
+typedef struct {
+    Tigr* bmp;
+    int level, channels, bandRows, numBands, next;
+    TigrMutex lock;
+    TigrCond cond;
+    MemWriter* out;
+    unsigned* adlers;
+    unsigned char* done;  // 1 when compressed, 2 on failure
+} Bands;
+
+// Adler32 of two pieces of data joined together, where the second is 'len2' bytes long.
+static unsigned combineAdler(unsigned adler1, unsigned adler2, unsigned long len2) {
+    unsigned long rem = len2 % 65521;
+    unsigned long s1 = adler1 & 0xffff;
+    unsigned long s2 = (rem * s1) % 65521;
+    s1 = (s1 + (adler2 & 0xffff) + 65521 - 1) % 65521;
+    s2 = (s2 + ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + 65521 - rem) % 65521;
+    return (unsigned)((s2 << 16) | s1);
+}
+
+static void compressBand(Bands* b, int i) {
+    int y0 = i * b->bandRows, y1, ok = 0;
+    Save* s;
+
+    y1 = y0 + b->bandRows < b->bmp->h ? y0 + b->bandRows : b->bmp->h;
+    s = newSave(b->level, memWrite, &b->out[i]);
+    if (s) {
+        s->raw = 1;
+        s->channels = b->channels;
+        startData(s, 0);
+        ok = compressRows(s, b->bmp, y0, y1);
+        finishData(s, 0);
+        flushIdat(s);
+        ok = ok && !s->failed;
+        b->adlers[i] = s->adler;
+        freeSave(s);
+    }
+
+    tigrMutexLock(&b->lock);
+    b->done[i] = ok ? 1 : 2;
+    tigrCondBroadcast(&b->cond);
+    tigrMutexUnlock(&b->lock);
+}
+
+static void bandWorker(void* arg) {
+    Bands* b = (Bands*)arg;
+    for (;;) {
+        int i;
+        tigrMutexLock(&b->lock);
+        i = b->next++;
+        tigrMutexUnlock(&b->lock);
+        if (i >= b->numBands)
+            break;
+        compressBand(b, i);
+    }
+}
+
+static void bandRange(void* ctx, int begin, int end) {
+    for (int i = begin; i < end; i++)
+        compressBand((Bands*)ctx, i);
+}
+
+// Compresses on 'threads' threads of its own, or on the thread pool if 'threads' is zero.
+static int savePngBands(Save* s, Tigr* bmp, int threads) {
+    Bands b;
+    TigrThread* workers;
+    int numThreads = 0, ok = 1, i, pool = threads == 0;
+    unsigned long rowBytes = 1 + (unsigned long)bmp->w * s->channels;
+
+    // Keep bands big enough that splitting doesn't hurt compression much.
+    if (pool)
+        threads = tigrGetThreads();
+    b.bmp = bmp;
+    b.level = s->level;
+    b.channels = s->channels;
+    b.bandRows = (bmp->h + threads * 4 - 1) / (threads * 4);
+    if ((unsigned long)b.bandRows * rowBytes < 131072)
+        b.bandRows = (int)((131072 + rowBytes - 1) / rowBytes);
+    b.numBands = (bmp->h + b.bandRows - 1) / b.bandRows;
+    b.next = 0;
+    b.out = (MemWriter*)calloc(b.numBands, sizeof(MemWriter));
+    b.adlers = (unsigned*)calloc(b.numBands, sizeof(unsigned));
+    b.done = (unsigned char*)calloc(b.numBands, 1);
+    workers = (TigrThread*)calloc(threads, sizeof(TigrThread));
+    if (!b.out || !b.adlers || !b.done || !workers) {
+        free(b.out);
+        free(b.adlers);
+        free(b.done);
+        free(workers);
+        return 0;
+    }
+    tigrMutexInit(&b.lock);
+    tigrCondInit(&b.cond);
+
+    if (pool) {
+        tigrParallelFor(0, b.numBands, 1, bandRange, &b);
+    } else {
+        for (i = 0; i < threads && i < b.numBands; i++) {
+            if (!tigrThreadStart(&workers[i], bandWorker, &b))
+                break;
+            numThreads++;
+        }
+        if (numThreads == 0)
+            bandWorker(&b);
+    }
+
+    // Join the bands up in order, as they finish.
+    zlibHeader(s);
+    for (i = 0; i < b.numBands; i++) {
+        tigrMutexLock(&b.lock);
+        while (!b.done[i])
+            tigrCondWait(&b.cond, &b.lock);
+        tigrMutexUnlock(&b.lock);
+
+        ok = ok && b.done[i] == 1;
+        if (ok) {
+            int y0 = i * b.bandRows;
+            int rows = y0 + b.bandRows < bmp->h ? b.bandRows : bmp->h - y0;
+            putBytes(s, b.out[i].data, b.out[i].len);
+            s->adler = i == 0 ? b.adlers[i] : combineAdler(s->adler, b.adlers[i], rowBytes * rows);
+        }
+        free(b.out[i].data);
+        b.out[i].data = NULL;
+    }
+
+    // An empty final block ends the stream.
+    putbits(s, 1 | (1 << 1), 3);
+    putbits(s, 0, 7);
+    flushbits(s);
     put32(s, s->adler);
-    dataSize = (ftell(s->out) - dataPos) - 8;
-    put32(s, ~s->crc);
-    return dataSize;
+    flushIdat(s);
+
+    for (i = 0; i < numThreads; i++)
+        tigrThreadJoin(workers[i]);
+    tigrCondDestroy(&b.cond);
+    tigrMutexDestroy(&b.lock);
+    free(b.out);
+    free(b.adlers);
+    free(b.done);
+    free(workers);
+    return ok;
 }
 
-int tigrSaveImage(const char* fileName, Tigr* bmp) {
-    Save s;
-    long dataPos, dataSize, err;
+static int savePngData(Save* s, Tigr* bmp, int threads) {
+    int ok;
+    if ((threads ? threads : tigrGetThreads()) > 1 && (unsigned long)bmp->h * (1 + bmp->w * s->channels) >= 2 * 131072)
+        return savePngBands(s, bmp, threads);
 
-    // TODO - unicode?
-    FILE* out = fopen(fileName, "wb");
-    if (!out)
-        return 1;
+    zlibHeader(s);
+    startData(s, 1);
+    ok = compressRows(s, bmp, 0, bmp->h);
+    finishData(s, 1);
+    put32(s, s->adler);
+    flushIdat(s);
+    return ok;
+}
+
+// Encodes a PNG, in order, through 'write'. Returns 1 on success, 0 if out of memory,
+// and -1 if 'write' failed.
+static int savePng(Tigr* bmp, int level, int threads, TigrWriteFunc write, void* user) {
+    Save* s = newSave(level, write, user);
+    int ok;
+
+    if (!s)
+        return 0;
+    s->channels = pngChannels(bmp);
+    savePngHeader(s, bmp);
+    ok = savePngData(s, bmp, threads);
+    writeChunk(s, "IEND", NULL, 0);
+    if (s->failed)
+        ok = -1;
+    freeSave(s);
+    return ok;
+}
+
+int tigrSaveImageFunc(Tigr* bmp, int level, TigrWriteFunc func, void* user) {
+    int ok;
+    if (level < 0 || level > 9) {
+        errno = EINVAL;
+        return 0;
+    }
+    ok = savePng(bmp, level, 0, func, user);
+    if (ok <= 0)
+        errno = ok < 0 ? ECANCELED : ENOMEM;
+    return ok > 0;
+}
+
+void* tigrSaveImageMem(Tigr* bmp, int level, int* length) {
+    MemWriter m = { NULL, 0, 0 };
+    if (level < 0 || level > 9) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (savePng(bmp, level, 0, memWrite, &m) <= 0) {
+        free(m.data);
+        errno = ENOMEM;
+        return NULL;
+    }
+    *length = m.len;
+    return m.data;
+}
 
-    s.out = out;
-    s.adler = 1;
-    s.bits = 0x80;
-    s.prev = 0xffff;
-    s.runlen = 0;
+static int fileWrite(void* user, const void* data, int len) {
+    return fwrite(data, 1, len, (FILE*)user) == (size_t)len;
+}
 
-    savePngHeader(&s, bmp);
-    dataPos = ftell(s.out);
-    dataSize = savePngData(&s, bmp, dataPos);
+// Saves to a file, on 'threads' threads, or on the thread pool if 'threads' is zero.
+static int saveFile(const char* fileName, Tigr* bmp, int level, int threads) {
+    FILE* out;
+    int ok;
 
-    // End chunk.
-    begin(&s, "IEND", 0);
-    put32(&s, ~s.crc);
+    if (level < 0 || level > 9) {
+        errno = EINVAL;
+        return 0;
+    }
 
-    // Write back payload size.
-    fseek(out, dataPos, SEEK_SET);
-    put32(&s, dataSize);
+    out = tigrOpenFile(fileName, "wb");
+    if (!out)
+        return 0;
+
+    ok = savePng(bmp, level, threads, fileWrite, out);
+    if (fclose(out) != 0 && ok > 0)
+        ok = -1;
+    if (ok == 0)
+        errno = ENOMEM;
+    else if (ok < 0)
+        errno = EIO;
+    return ok > 0;
+}
 
-    err = ferror(out);
-    fclose(out);
-    return !err;
+int tigrSaveImageThreads(const char* fileName, Tigr* bmp, int level, int threads) {
+    return saveFile(fileName, bmp, level, threads > 0 ? threads : tigrCpuCount());
 }
+
+int tigrSaveImageLevel(const char* fileName, Tigr* bmp, int level) {
+    return saveFile(fileName, bmp, level, 0);
+}
+
+int tigrSaveImage(const char* fileName, Tigr* bmp) {
+    return tigrSaveImageLevel(fileName, bmp, 1);
+}
+
+#undef WSIZE
+#undef HASH_BITS
+#undef HASH_SIZE
+#undef MIN_MATCH
+#undef MAX_MATCH
+#undef LOOKAHEAD
+#undef MAX_SYMS
+#undef IDAT_SIZE
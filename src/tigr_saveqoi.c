@@ -0,0 +1,120 @@
+#include "tigr_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define QOI_HASH(p) (((p).r * 3 + (p).g * 5 + (p).b * 7 + (p).a * 11) & 63)
+#define QOI_SAME(p, q) ((p).r == (q).r && (p).g == (q).g && (p).b == (q).b && (p).a == (q).a)
+
+static void qoiPut32(unsigned char* p, unsigned v) {
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+void* tigrSaveQoiMem(Tigr* bmp, int* length) {
+    int i, count = bmp->w * bmp->h, run = 0, opaque = 1;
+    TPixel index[64], prev;
+    unsigned char *data, *p;
+
+    for (i = 0; i < count && opaque; i++)
+        opaque = bmp->pix[i].a == 255;
+
+    // Worst case is a full RGBA op for every pixel.
+    data = (unsigned char*)malloc(14 + (size_t)count * 5 + 8);
+    if (!data) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    p = data;
+    memcpy(p, "qoif", 4);
+    qoiPut32(p + 4, bmp->w);
+    qoiPut32(p + 8, bmp->h);
+    p[12] = opaque ? 3 : 4;  // channels
+    p[13] = 0;               // sRGB with linear alpha
+    p += 14;
+
+    memset(index, 0, sizeof(index));
+    prev = tigrRGBA(0, 0, 0, 255);
+
+    for (i = 0; i < count; i++) {
+        TPixel px = bmp->pix[i];
+
+        if (QOI_SAME(px, prev)) {
+            if (++run == 62) {
+                *p++ = 0xc0 | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run) {
+            *p++ = 0xc0 | (run - 1);
+            run = 0;
+        }
+
+        int h = QOI_HASH(px);
+        if (QOI_SAME(index[h], px)) {
+            *p++ = (unsigned char)h;
+        } else {
+            index[h] = px;
+            if (px.a == prev.a) {
+                signed char vr = (signed char)(px.r - prev.r);
+                signed char vg = (signed char)(px.g - prev.g);
+                signed char vb = (signed char)(px.b - prev.b);
+                signed char vgr = (signed char)(vr - vg);
+                signed char vgb = (signed char)(vb - vg);
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    *p++ = 0x40 | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2);
+                } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                    *p++ = 0x80 | (vg + 32);
+                    *p++ = ((vgr + 8) << 4) | (vgb + 8);
+                } else {
+                    *p++ = 0xfe;
+                    *p++ = px.r;
+                    *p++ = px.g;
+                    *p++ = px.b;
+                }
+            } else {
+                *p++ = 0xff;
+                *p++ = px.r;
+                *p++ = px.g;
+                *p++ = px.b;
+                *p++ = px.a;
+            }
+        }
+        prev = px;
+    }
+    if (run)
+        *p++ = 0xc0 | (run - 1);
+
+    memcpy(p, "\0\0\0\0\0\0\0\1", 8);
+    p += 8;
+
+    *length = (int)(p - data);
+    return data;
+}
+
+int tigrSaveQoi(const char* fileName, Tigr* bmp) {
+    int len, ok;
+    FILE* out;
+    void* data = tigrSaveQoiMem(bmp, &len);
+    if (!data)
+        return 0;
+
+    out = tigrOpenFile(fileName, "wb");
+    if (!out) {
+        free(data);
+        return 0;
+    }
+    ok = fwrite(data, 1, len, out) == (size_t)len;
+    ok = (fclose(out) == 0) && ok;
+    free(data);
+    return ok;
+}
+
+#undef QOI_HASH
+#undef QOI_SAME
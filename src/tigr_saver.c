@@ -0,0 +1,157 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+typedef struct SaverJob {
+    struct SaverJob* next;
+    char* fileName;
+    Tigr* bmp;
+    int level;
+} SaverJob;
+
+struct TigrSaver {
+    TigrMutex lock;
+    TigrCond cond;
+    SaverJob *head, *tail;
+    int pending, maxPending, quit, started;
+
+    TigrSaverFunc func;
+    void* user;
+
+    TigrThread thread;
+};
+
+static void saveJob(TigrSaver* saver, SaverJob* job) {
+    int ok = tigrSaveImageLevel(job->fileName, job->bmp, job->level);
+    if (saver->func)
+        saver->func(saver->user, job->fileName, ok);
+    tigrFree(job->bmp);
+    free(job->fileName);
+    free(job);
+}
+
+static void saverWorker(void* arg) {
+    TigrSaver* saver = (TigrSaver*)arg;
+
+    for (;;) {
+        SaverJob* job;
+
+        tigrMutexLock(&saver->lock);
+        while (!saver->head && !saver->quit)
+            tigrCondWait(&saver->cond, &saver->lock);
+        job = saver->head;
+        if (job) {
+            saver->head = job->next;
+            if (!saver->head)
+                saver->tail = NULL;
+        }
+        tigrMutexUnlock(&saver->lock);
+        if (!job)
+            break;
+
+        saveJob(saver, job);
+
+        tigrMutexLock(&saver->lock);
+        saver->pending--;
+        tigrCondBroadcast(&saver->cond);
+        tigrMutexUnlock(&saver->lock);
+    }
+}
+
+TigrSaver* tigrSaverCreate(int maxPending, TigrSaverFunc func, void* user) {
+    TigrSaver* saver = (TigrSaver*)calloc(1, sizeof(TigrSaver));
+    if (!saver)
+        return NULL;
+
+    saver->maxPending = maxPending > 0 ? maxPending : 1;
+    saver->func = func;
+    saver->user = user;
+    tigrMutexInit(&saver->lock);
+    tigrCondInit(&saver->cond);
+
+    // Without a thread, images are just saved straight away.
+    saver->started = tigrThreadStart(&saver->thread, saverWorker, saver);
+    return saver;
+}
+
+int tigrSaveImageAsync(TigrSaver* saver, const char* fileName, Tigr* bmp, int level, int wait) {
+    size_t len = strlen(fileName) + 1;
+    SaverJob* job;
+
+    // Reserve a place in the queue before copying anything.
+    tigrMutexLock(&saver->lock);
+    while (saver->pending >= saver->maxPending && wait)
+        tigrCondWait(&saver->cond, &saver->lock);
+    if (saver->pending >= saver->maxPending) {
+        tigrMutexUnlock(&saver->lock);
+        errno = EAGAIN;
+        return 0;
+    }
+    saver->pending++;
+    tigrMutexUnlock(&saver->lock);
+
+    job = (SaverJob*)calloc(1, sizeof(SaverJob));
+    if (job) {
+        job->fileName = (char*)malloc(len);
+        job->bmp = tigrBitmap(bmp->w, bmp->h);
+        job->level = level;
+    }
+    if (!job || !job->fileName || !job->bmp) {
+        if (job) {
+            free(job->fileName);
+            if (job->bmp)
+                tigrFree(job->bmp);
+            free(job);
+        }
+        tigrMutexLock(&saver->lock);
+        saver->pending--;
+        tigrCondBroadcast(&saver->cond);
+        tigrMutexUnlock(&saver->lock);
+        errno = ENOMEM;
+        return 0;
+    }
+    memcpy(job->fileName, fileName, len);
+    memcpy(job->bmp->pix, bmp->pix, bmp->w * bmp->h * sizeof(TPixel));
+
+    if (!saver->started) {
+        saveJob(saver, job);
+        tigrMutexLock(&saver->lock);
+        saver->pending--;
+        tigrCondBroadcast(&saver->cond);
+        tigrMutexUnlock(&saver->lock);
+        return 1;
+    }
+
+    tigrMutexLock(&saver->lock);
+    if (saver->tail)
+        saver->tail->next = job;
+    else
+        saver->head = job;
+    saver->tail = job;
+    tigrCondBroadcast(&saver->cond);
+    tigrMutexUnlock(&saver->lock);
+    return 1;
+}
+
+int tigrSaverPending(TigrSaver* saver) {
+    int pending;
+    tigrMutexLock(&saver->lock);
+    pending = saver->pending;
+    tigrMutexUnlock(&saver->lock);
+    return pending;
+}
+
+void tigrSaverFree(TigrSaver* saver) {
+    tigrMutexLock(&saver->lock);
+    saver->quit = 1;
+    tigrCondBroadcast(&saver->cond);
+    tigrMutexUnlock(&saver->lock);
+
+    if (saver->started)
+        tigrThreadJoin(saver->thread);
+
+    tigrCondDestroy(&saver->cond);
+    tigrMutexDestroy(&saver->lock);
+    free(saver);
+}
@@ -0,0 +1,489 @@
+#include "tigr_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Signed distance field fonts. Each glyph is stored as the distance from its edge,
+// sampled at every pixel of the glyph plus 'spread' pixels of padding around it.
+// Distances are 8-bit, with 128 on the edge and higher values inside.
+typedef struct {
+    int code;
+    int x, y;  // top-left of the padded cell in the atlas
+    int w, h;  // size of the glyph itself, as in the original font
+} SdfGlyph;
+
+struct TigrSdfFont {
+    int spread, lineHeight;
+    int w, h;
+    unsigned char* dist;
+    int numGlyphs;
+    SdfGlyph* glyphs;  // sorted by code
+    SdfGlyph* fallback;
+};
+
+// Saved SDF fonts are "TIGRSDFA", then version, spread, line height, glyph count
+// and atlas size, then code, x, y, w, h for each glyph, then the distances.
+// All little-endian 32-bit values.
+#define SDF_VERSION 1
+#define SDF_HEADER 32
+#define SDF_INF 1e20f
+
+// Rounding and square roots without libm, which tigr doesn't otherwise need.
+static int sdfFloor(float v) {
+    int i = (int)v;
+    return i > v ? i - 1 : i;
+}
+
+static int sdfCeil(float v) {
+    int i = (int)v;
+    return i < v ? i + 1 : i;
+}
+
+static float sdfSqrt(float v) {
+    float r = v > 1 ? v / 2 : 1;
+    if (v <= 0)
+        return 0;
+    for (int i = 0; i < 16; i++)
+        r = 0.5f * (r + v / r);
+    return r;
+}
+
+static int sdfCompare(const void* a, const void* b) {
+    const SdfGlyph* ga = (const SdfGlyph*)a;
+    const SdfGlyph* gb = (const SdfGlyph*)b;
+    if (ga->code != gb->code)
+        return ga->code < gb->code ? -1 : 1;
+    if (ga->y != gb->y)
+        return ga->y < gb->y ? -1 : 1;
+    return ga->x < gb->x ? -1 : ga->x > gb->x;
+}
+
+static SdfGlyph* sdfSearch(TigrSdfFont* sdf, int code) {
+    int lo = 0, hi = sdf->numGlyphs - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (sdf->glyphs[mid].code < code)
+            lo = mid + 1;
+        else if (sdf->glyphs[mid].code > code)
+            hi = mid - 1;
+        else
+            return &sdf->glyphs[mid];
+    }
+    return NULL;
+}
+
+static SdfGlyph* sdfGet(TigrSdfFont* sdf, int code) {
+    SdfGlyph* g = sdfSearch(sdf, code);
+    return g ? g : sdf->fallback;
+}
+
+static void sdfSetFallback(TigrSdfFont* sdf) {
+    sdf->fallback = sdfSearch(sdf, '?');
+    if (!sdf->fallback)
+        sdf->fallback = &sdf->glyphs[0];
+}
+
+// Squared distance transform of a sampled function, in one dimension.
+// (Felzenszwalb & Huttenlocher, "Distance Transforms of Sampled Functions")
+static void sdfTransform1D(const float* f, float* d, int n, int* v, float* z) {
+    int k = 0;
+    v[0] = 0;
+    z[0] = -SDF_INF;
+    z[1] = SDF_INF;
+    for (int q = 1; q < n; q++) {
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        while (s <= z[k]) {
+            k--;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = SDF_INF;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; q++) {
+        while (z[k + 1] < q)
+            k++;
+        d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+// Squared distance from each cell of a w x h grid to the nearest zero cell, in place.
+static void sdfTransform(float* grid, int w, int h, float* f, float* d, int* v, float* z) {
+    for (int x = 0; x < w; x++) {
+        for (int y = 0; y < h; y++)
+            f[y] = grid[y * w + x];
+        sdfTransform1D(f, d, h, v, z);
+        for (int y = 0; y < h; y++)
+            grid[y * w + x] = d[y];
+    }
+    for (int y = 0; y < h; y++) {
+        sdfTransform1D(grid + y * w, d, w, v, z);
+        memcpy(grid + y * w, d, w * sizeof(float));
+    }
+}
+
+// Only the bright parts of a glyph make up its shape, so drop shadows are left out.
+static int sdfInside(TPixel p) {
+    int bright = p.r > p.g ? p.r : p.g;
+    bright = p.b > bright ? p.b : bright;
+    return p.a * bright >= 128 * 255;
+}
+
+// Fills in one glyph's padded cell of the atlas.
+static void sdfGlyph(TigrSdfFont* sdf, Tigr* sheet, TigrGlyph* src, SdfGlyph* g, float* scratch) {
+    int s = sdf->spread;
+    int cw = g->w + s * 2, ch = g->h + s * 2, n = cw > ch ? cw : ch;
+    float* toInside = scratch;
+    float* toOutside = toInside + cw * ch;
+    float* f = toOutside + cw * ch;
+    float* d = f + n;
+    float* z = d + n;
+    int* v = (int*)(z + n + 1);
+
+    for (int y = 0; y < ch; y++) {
+        for (int x = 0; x < cw; x++) {
+            int gx = x - s, gy = y - s;
+            int in = gx >= 0 && gy >= 0 && gx < g->w && gy < g->h &&
+                     sdfInside(sheet->pix[(src->y + gy) * sheet->w + src->x + gx]);
+            toInside[y * cw + x] = in ? 0 : SDF_INF;
+            toOutside[y * cw + x] = in ? SDF_INF : 0;
+        }
+    }
+    sdfTransform(toInside, cw, ch, f, d, v, z);
+    sdfTransform(toOutside, cw, ch, f, d, v, z);
+
+    // The edge is half a pixel from the centers of the pixels either side of it.
+    // Anything further than the spread is clamped, so its exact distance doesn't matter.
+    for (int y = 0; y < ch; y++) {
+        unsigned char* out = sdf->dist + (g->y + y) * sdf->w + g->x;
+        for (int x = 0; x < cw; x++) {
+            int i = y * cw + x;
+            float limit = (float)(s + 1) * (s + 1);
+            float outside = toOutside[i] < limit ? toOutside[i] : limit;
+            float inside = toInside[i] < limit ? toInside[i] : limit;
+            float dist = outside > 0 ? sdfSqrt(outside) - 0.5f : 0.5f - sdfSqrt(inside);
+            float value = 128.0f + dist * 127.0f / s;
+            out[x] = (unsigned char)(value < 0 ? 0 : value > 255 ? 255 : value + 0.5f);
+        }
+    }
+}
+
+TigrSdfFont* tigrCreateSdfFont(TigrFont* font, int spread) {
+    TigrSdfFont* sdf;
+    float* scratch;
+    long long area = 0;
+    int widest = 0, longest = 0, largest = 0, x = 0, y = 0, rowh = 0;
+
+    if (spread < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    tigrSetupFont(font);
+
+    sdf = (TigrSdfFont*)calloc(1, sizeof(TigrSdfFont));
+    if (!sdf || !(sdf->glyphs = (SdfGlyph*)malloc(font->numGlyphs * sizeof(SdfGlyph)))) {
+        free(sdf);
+        errno = ENOMEM;
+        return NULL;
+    }
+    sdf->spread = spread;
+    sdf->lineHeight = tigrGlyph(font, 0)->h;
+    sdf->numGlyphs = font->numGlyphs;
+
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* src = &font->glyphs[i];
+        int cw = src->w + spread * 2, ch = src->h + spread * 2;
+        area += (long long)cw * ch;
+        widest = cw > widest ? cw : widest;
+        longest = cw > longest ? cw : longest;
+        longest = ch > longest ? ch : longest;
+        largest = cw * ch > largest ? cw * ch : largest;
+    }
+
+    // Pack the padded cells in rows, into a roughly square atlas.
+    for (sdf->w = widest; (long long)sdf->w * sdf->w < area;)
+        sdf->w += 16;
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* src = &font->glyphs[i];
+        SdfGlyph* g = &sdf->glyphs[i];
+        int cw = src->w + spread * 2, ch = src->h + spread * 2;
+        if (x + cw > sdf->w) {
+            x = 0;
+            y += rowh;
+            rowh = 0;
+        }
+        g->code = src->code;
+        g->x = x;
+        g->y = y;
+        g->w = src->w;
+        g->h = src->h;
+        x += cw;
+        rowh = ch > rowh ? ch : rowh;
+    }
+    sdf->h = y + rowh;
+
+    sdf->dist = (unsigned char*)malloc((size_t)sdf->w * sdf->h);
+    scratch = (float*)malloc((largest * 2 + longest * 4 + 1) * sizeof(float));
+    if (!sdf->dist || !scratch) {
+        free(scratch);
+        tigrFreeSdfFont(sdf);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(sdf->dist, 0, (size_t)sdf->w * sdf->h);
+    for (int i = 0; i < font->numGlyphs; i++)
+        sdfGlyph(sdf, font->bitmap, &font->glyphs[i], &sdf->glyphs[i], scratch);
+    free(scratch);
+
+    qsort(sdf->glyphs, sdf->numGlyphs, sizeof(SdfGlyph), sdfCompare);
+    sdfSetFallback(sdf);
+    return sdf;
+}
+
+int tigrSaveSdfFont(TigrSdfFont* sdf, const char* fileName) {
+    unsigned char header[SDF_HEADER], entry[20];
+    FILE* out;
+    int ok;
+
+    memcpy(header, "TIGRSDFA", 8);
+    tigrPut32LE(header + 8, SDF_VERSION);
+    tigrPut32LE(header + 12, sdf->spread);
+    tigrPut32LE(header + 16, sdf->lineHeight);
+    tigrPut32LE(header + 20, sdf->numGlyphs);
+    tigrPut32LE(header + 24, sdf->w);
+    tigrPut32LE(header + 28, sdf->h);
+
+    out = tigrOpenFile(fileName, "wb");
+    if (!out)
+        return 0;
+
+    ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+    for (int i = 0; i < sdf->numGlyphs && ok; i++) {
+        SdfGlyph* g = &sdf->glyphs[i];
+        tigrPut32LE(entry, g->code);
+        tigrPut32LE(entry + 4, g->x);
+        tigrPut32LE(entry + 8, g->y);
+        tigrPut32LE(entry + 12, g->w);
+        tigrPut32LE(entry + 16, g->h);
+        ok = fwrite(entry, 1, sizeof(entry), out) == sizeof(entry);
+    }
+    ok = ok && fwrite(sdf->dist, 1, (size_t)sdf->w * sdf->h, out) == (size_t)sdf->w * sdf->h;
+    ok = (fclose(out) == 0) && ok;
+    return ok;
+}
+
+// Reads a saved SDF font, checking every glyph lies inside the atlas.
+static int sdfRead(TigrSdfFont* sdf, const unsigned char* data, int length) {
+    unsigned count, w, h;
+
+    errno = EINVAL;
+    if (length < SDF_HEADER || memcmp(data, "TIGRSDFA", 8) != 0 || tigrGet32LE(data + 8) != SDF_VERSION)
+        return 0;
+    sdf->spread = (int)tigrGet32LE(data + 12);
+    sdf->lineHeight = (int)tigrGet32LE(data + 16);
+    count = tigrGet32LE(data + 20);
+    w = tigrGet32LE(data + 24);
+    h = tigrGet32LE(data + 28);
+    if (sdf->spread < 1 || sdf->lineHeight < 0 || count == 0 || count > (unsigned)(length - SDF_HEADER) / 20 ||
+        w == 0 || h == 0 || w > 0x7fff || h > 0x7fff ||
+        (long long)w * h != (long long)length - SDF_HEADER - count * 20)
+        return 0;
+
+    sdf->glyphs = (SdfGlyph*)malloc(count * sizeof(SdfGlyph));
+    sdf->dist = (unsigned char*)malloc((size_t)w * h);
+    if (!sdf->glyphs || !sdf->dist) {
+        errno = ENOMEM;
+        return 0;
+    }
+    sdf->numGlyphs = (int)count;
+    sdf->w = (int)w;
+    sdf->h = (int)h;
+
+    data += SDF_HEADER;
+    for (unsigned i = 0; i < count; i++, data += 20) {
+        SdfGlyph* g = &sdf->glyphs[i];
+        g->code = (int)tigrGet32LE(data);
+        g->x = (int)tigrGet32LE(data + 4);
+        g->y = (int)tigrGet32LE(data + 8);
+        g->w = (int)tigrGet32LE(data + 12);
+        g->h = (int)tigrGet32LE(data + 16);
+        if (g->x < 0 || g->y < 0 || g->w < 0 || g->h < 0 || g->w + sdf->spread * 2 > sdf->w - g->x ||
+            g->h + sdf->spread * 2 > sdf->h - g->y)
+            return 0;
+        if (i > 0 && g->code < g[-1].code)
+            return 0;
+    }
+    memcpy(sdf->dist, data, (size_t)w * h);
+    return 1;
+}
+
+TigrSdfFont* tigrLoadSdfFont(const char* fileName) {
+    TigrSdfFont* sdf = (TigrSdfFont*)calloc(1, sizeof(TigrSdfFont));
+    int length, ok;
+    void* data;
+
+    if (!sdf) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    data = tigrReadFile(fileName, &length);
+    if (!data) {
+        free(sdf);
+        return NULL;
+    }
+    ok = sdfRead(sdf, (const unsigned char*)data, length);
+    free(data);
+    if (!ok) {
+        tigrFreeSdfFont(sdf);
+        return NULL;
+    }
+    sdfSetFallback(sdf);
+    return sdf;
+}
+
+#undef SDF_VERSION
+#undef SDF_HEADER
+#undef SDF_INF
+
+// Maps interpolated distances (scaled by 256, then by 1/64) to coverage at a given scale.
+// The edge is blurred over one destination pixel, however big the text is drawn.
+static void sdfCoverage(TigrSdfFont* sdf, float scale, unsigned char table[1024]) {
+    for (int i = 0; i < 1024; i++) {
+        float dist = ((i * 64 + 32) / 256.0f - 128.0f) * sdf->spread / 127.0f * scale;
+        float a = 0.5f + dist;
+        table[i] = (unsigned char)(a <= 0 ? 0 : a >= 1 ? 255 : a * 255 + 0.5f);
+    }
+}
+
+// Draws one glyph with its top-left corner at gx, gy, blending 'color' by coverage.
+static void sdfDraw(Tigr* dest, TigrSdfFont* sdf, SdfGlyph* g, float gx, float gy, float scale, TPixel color,
+                    const unsigned char* coverage) {
+    int cx = dest->cw >= 0 ? dest->cx : 0, cy = dest->ch >= 0 ? dest->cy : 0;
+    int cw = dest->cw >= 0 ? dest->cw : dest->w, ch = dest->ch >= 0 ? dest->ch : dest->h;
+    int s = sdf->spread, cellW = g->w + s * 2, cellH = g->h + s * 2;
+    int x0, y0, x1, y1, step;
+    int xr = color.r + (color.r > 0), xg = color.g + (color.g > 0), xb = color.b + (color.b > 0);
+    int xa = color.a + (color.a > 0);
+    unsigned char r = (unsigned char)(xr * 255 >> 8), gr = (unsigned char)(xg * 255 >> 8);
+    unsigned char b = (unsigned char)(xb * 255 >> 8);
+
+    // Nothing is drawn more than a source pixel outside the glyph.
+    x0 = sdfFloor(gx - scale);
+    y0 = sdfFloor(gy - scale);
+    x1 = sdfCeil(gx + (g->w + 1) * scale);
+    y1 = sdfCeil(gy + (g->h + 1) * scale);
+    x0 = x0 > cx ? x0 : cx;
+    y0 = y0 > cy ? y0 : cy;
+    x1 = x1 < cx + cw ? x1 : cx + cw;
+    y1 = y1 < cy + ch ? y1 : cy + ch;
+    x1 = x1 < dest->w ? x1 : dest->w;
+    y1 = y1 < dest->h ? y1 : dest->h;
+    x0 = x0 > 0 ? x0 : 0;
+    y0 = y0 > 0 ? y0 : 0;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    // Walk the cell in 16.16 fixed point, sampling at destination pixel centers.
+    step = (int)(65536.0f / scale);
+    for (int py = y0; py < y1; py++) {
+        int fy = (int)(((py + 0.5f - gy) / scale + s - 0.5f) * 65536.0f);
+        int sy0, sy1, wy;
+        const unsigned char *row0, *row1;
+        TPixel* td = dest->pix + py * dest->w;
+        int fx = (int)(((x0 + 0.5f - gx) / scale + s - 0.5f) * 65536.0f);
+
+        fy = fy < 0 ? 0 : fy > (cellH - 1) << 16 ? (cellH - 1) << 16 : fy;
+        sy0 = fy >> 16;
+        sy1 = sy0 + 1 < cellH ? sy0 + 1 : sy0;
+        wy = (fy >> 8) & 0xff;
+        row0 = sdf->dist + (g->y + sy0) * sdf->w + g->x;
+        row1 = sdf->dist + (g->y + sy1) * sdf->w + g->x;
+
+        for (int px = x0; px < x1; px++, fx += step) {
+            int cfx = fx < 0 ? 0 : fx > (cellW - 1) << 16 ? (cellW - 1) << 16 : fx;
+            int sx0 = cfx >> 16, sx1 = sx0 + 1 < cellW ? sx0 + 1 : sx0, wx = (cfx >> 8) & 0xff;
+            int top = row0[sx0] * (256 - wx) + row0[sx1] * wx;
+            int bottom = row1[sx0] * (256 - wx) + row1[sx1] * wx;
+            int value = (top * (256 - wy) + bottom * wy) >> 8;
+            int alpha = coverage[value >> 6];
+            unsigned a;
+
+            if (!alpha)
+                continue;
+            a = xa * (alpha + (alpha > 0));
+            td[px].r += (unsigned char)((r - td[px].r) * a >> 16);
+            td[px].g += (unsigned char)((gr - td[px].g) * a >> 16);
+            td[px].b += (unsigned char)((b - td[px].b) * a >> 16);
+            td[px].a += (dest->blitMode) * (unsigned char)((alpha - td[px].a) * a >> 16);
+        }
+    }
+}
+
+void tigrPrintSdf(Tigr* dest, TigrSdfFont* sdf, int x, int y, float scale, TPixel color, const char* text, int length) {
+    const char* end = text + (length < 0 ? strlen(text) : (size_t)length);
+    unsigned char coverage[1024];
+    int ux = 0, uy = 0, cps[256], n;
+
+    if (scale <= 0)
+        return;
+    sdfCoverage(sdf, scale, coverage);
+
+    // Glyphs are placed in font pixels, then scaled, so text keeps its shape at any size.
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            SdfGlyph* g;
+            if (cps[i] == '\r')
+                continue;
+            if (cps[i] == '\n') {
+                ux = 0;
+                uy += sdf->lineHeight;
+                continue;
+            }
+            g = sdfGet(sdf, cps[i]);
+            sdfDraw(dest, sdf, g, x + ux * scale, y + uy * scale, scale, color, coverage);
+            ux += g->w;
+        }
+    }
+}
+
+int tigrSdfTextWidth(TigrSdfFont* sdf, float scale, const char* text) {
+    const char* end = text + strlen(text);
+    int ux = 0, w = 0, cps[256], n;
+
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n' || cps[i] == '\r') {
+                ux = 0;
+            } else {
+                ux += sdfGet(sdf, cps[i])->w;
+                w = ux > w ? ux : w;
+            }
+        }
+    }
+    return sdfCeil(w * scale);
+}
+
+int tigrSdfTextHeight(TigrSdfFont* sdf, float scale, const char* text) {
+    const char* end = text + strlen(text);
+    int lines = 1, cps[256], n;
+
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n' && (i + 1 < n || text < end))
+                lines++;
+        }
+    }
+    return sdfCeil(lines * sdf->lineHeight * scale);
+}
+
+void tigrFreeSdfFont(TigrSdfFont* sdf) {
+    if (!sdf)
+        return;
+    free(sdf->glyphs);
+    free(sdf->dist);
+    free(sdf);
+}
@@ -0,0 +1,225 @@
+#include "tigr_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if (__linux__ && !__ANDROID__) || __MACOS__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define SNAPSHOT_MMAP 1
+#elif defined(_WIN32)
+#include <io.h>
+#define SNAPSHOT_MMAP 1
+#endif
+
+// Snapshot files are a small header, then raw RGBA rows from the next page onwards:
+//   "TIGRSNAP", version, format, width, height, stride (bytes), pixel offset
+// All little-endian 32-bit values.
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_RGBA8 0
+#define SNAPSHOT_OFFSET 4096
+#define SNAPSHOT_HEADER 32
+
+// Where a snapshot bitmap's pixels are mapped, so tigrFree can unmap them.
+// It's allocated along with the bitmap, and bmp->mapping points at it.
+typedef struct {
+    void* base;
+    size_t size;
+} SnapshotMapping;
+
+int tigrSaveSnapshot(const char* fileName, Tigr* bmp) {
+    unsigned char header[SNAPSHOT_OFFSET];
+    size_t rowBytes = (size_t)bmp->w * sizeof(TPixel);
+    FILE* out;
+    int ok, y;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "TIGRSNAP", 8);
+    tigrPut32LE(header + 8, SNAPSHOT_VERSION);
+    tigrPut32LE(header + 12, SNAPSHOT_RGBA8);
+    tigrPut32LE(header + 16, bmp->w);
+    tigrPut32LE(header + 20, bmp->h);
+    tigrPut32LE(header + 24, (unsigned)rowBytes);
+    tigrPut32LE(header + 28, SNAPSHOT_OFFSET);
+
+    out = tigrOpenFile(fileName, "wb");
+    if (!out)
+        return 0;
+
+    ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+    for (y = 0; y < bmp->h && ok; y++)
+        ok = fwrite(bmp->pix + (size_t)y * bmp->w, 1, rowBytes, out) == rowBytes;
+    ok = (fclose(out) == 0) && ok;
+    return ok;
+}
+
+// Checks a snapshot header, and returns the number of bytes the file needs to hold.
+static size_t snapshotCheck(const unsigned char* header, size_t fileSize, int* w, int* h) {
+    unsigned width, height, stride, offset;
+
+    if (memcmp(header, "TIGRSNAP", 8) != 0 || tigrGet32LE(header + 8) != SNAPSHOT_VERSION ||
+        tigrGet32LE(header + 12) != SNAPSHOT_RGBA8)
+        return 0;
+
+    width = tigrGet32LE(header + 16);
+    height = tigrGet32LE(header + 20);
+    stride = tigrGet32LE(header + 24);
+    offset = tigrGet32LE(header + 28);
+    if (width == 0 || height == 0 || width > 0x7fffffff / height || stride != width * sizeof(TPixel) ||
+        offset < SNAPSHOT_HEADER)
+        return 0;
+    if ((unsigned long long)stride * height + offset > fileSize)
+        return 0;
+
+    *w = (int)width;
+    *h = (int)height;
+    return (size_t)offset + (size_t)stride * height;
+}
+
+static Tigr* snapshotBitmap(int w, int h, TPixel* pix) {
+    Tigr* bmp = (Tigr*)calloc(1, sizeof(Tigr) + sizeof(SnapshotMapping));
+    if (!bmp)
+        return NULL;
+    bmp->w = w;
+    bmp->h = h;
+    bmp->cw = -1;
+    bmp->ch = -1;
+    bmp->pix = pix;
+    bmp->blitMode = TIGR_BLEND_ALPHA;
+    return bmp;
+}
+
+#ifdef SNAPSHOT_MMAP
+
+static void snapshotUnmap(void* base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+Tigr* tigrLoadSnapshot(const char* fileName, int copyOnWrite) {
+    unsigned char header[SNAPSHOT_HEADER];
+    size_t size = 0, need;
+    void* base = NULL;
+    SnapshotMapping* mapping;
+    Tigr* bmp;
+    int w, h;
+
+#ifdef _WIN32
+    FILE* file = tigrOpenFile(fileName, "rb");
+    if (!file)
+        return NULL;
+    need = 0;
+
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file)), section;
+    LARGE_INTEGER fileSize;
+
+    if (GetFileSizeEx(handle, &fileSize) && fread(header, 1, sizeof(header), file) == sizeof(header) &&
+        (need = snapshotCheck(header, (size_t)fileSize.QuadPart, &w, &h)) != 0) {
+        section = CreateFileMappingA(handle, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+        if (section) {
+            base = MapViewOfFile(section, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, need);
+            CloseHandle(section);
+        }
+        size = need;
+    }
+    fclose(file);
+#else
+    struct stat st;
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    need = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && read(fd, header, sizeof(header)) == sizeof(header) &&
+        (need = snapshotCheck(header, (size_t)st.st_size, &w, &h)) != 0) {
+        base = mmap(NULL, need, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED)
+            base = NULL;
+        size = need;
+    }
+    close(fd);
+#endif
+
+    if (!need) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!base) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    bmp = snapshotBitmap(w, h, (TPixel*)((unsigned char*)base + tigrGet32LE(header + 28)));
+    if (!bmp) {
+        snapshotUnmap(base, size);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    mapping = (SnapshotMapping*)(bmp + 1);
+    mapping->base = base;
+    mapping->size = size;
+    bmp->mapping = mapping;
+    return bmp;
+}
+
+void tigrFreePixels(Tigr* bmp) {
+    SnapshotMapping* mapping = (SnapshotMapping*)bmp->mapping;
+
+    if (mapping) {
+        snapshotUnmap(mapping->base, mapping->size);
+        bmp->mapping = NULL;
+    } else {
+        free(bmp->pix);
+    }
+}
+
+#else
+
+// No file mapping here, so read the pixels in.
+Tigr* tigrLoadSnapshot(const char* fileName, int copyOnWrite) {
+    unsigned char header[SNAPSHOT_HEADER];
+    TPixel* pix = NULL;
+    Tigr* bmp = NULL;
+    FILE* file;
+    int w, h;
+    long size;
+
+    (void)copyOnWrite;
+
+    file = tigrOpenFile(fileName, "rb");
+    if (!file)
+        return NULL;
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0 &&
+        fread(header, 1, sizeof(header), file) == sizeof(header) && snapshotCheck(header, (size_t)size, &w, &h) &&
+        fseek(file, (long)tigrGet32LE(header + 28), SEEK_SET) == 0) {
+        pix = (TPixel*)malloc((size_t)w * h * sizeof(TPixel));
+        if (pix && fread(pix, sizeof(TPixel), (size_t)w * h, file) == (size_t)w * h)
+            bmp = snapshotBitmap(w, h, pix);
+    }
+    fclose(file);
+
+    if (!bmp) {
+        free(pix);
+        errno = EINVAL;
+    }
+    return bmp;
+}
+
+void tigrFreePixels(Tigr* bmp) {
+    free(bmp->pix);
+}
+
+#endif  // SNAPSHOT_MMAP
+
+#undef SNAPSHOT_MMAP
+#undef SNAPSHOT_VERSION
+#undef SNAPSHOT_RGBA8
+#undef SNAPSHOT_OFFSET
+#undef SNAPSHOT_HEADER
@@ -581,7 +581,7 @@ void tigrFree(Tigr* bmp) {
 
         win->context = EGL_NO_CONTEXT;
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -0,0 +1,215 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// A wrapped line, as a range of bytes in the box's text.
+typedef struct {
+    int start, end, width;
+} BoxLine;
+
+struct TigrTextBox {
+    TigrFont* font;
+    int width, align;
+
+    char* text;
+    int length, capacity;
+
+    BoxLine* lines;
+    int numLines, maxLines;
+
+    // Where the last paragraph (which may still be appended to) starts.
+    int paraStart, paraLine;
+};
+
+static int boxAddLine(TigrTextBox* box, int start, int end, int width) {
+    if (box->numLines == box->maxLines) {
+        int maxLines = box->maxLines ? box->maxLines * 2 : 64;
+        BoxLine* lines = (BoxLine*)realloc(box->lines, maxLines * sizeof(BoxLine));
+        if (!lines)
+            return 0;
+        box->lines = lines;
+        box->maxLines = maxLines;
+    }
+    box->lines[box->numLines].start = start;
+    box->lines[box->numLines].end = end;
+    box->lines[box->numLines].width = width;
+    box->numLines++;
+    return 1;
+}
+
+// Wraps one paragraph into lines, in a single pass over its glyph widths.
+// Lines break at the last run of spaces that fits (the spaces are dropped),
+// or mid-word if a word is wider than the box.
+static int boxWrap(TigrTextBox* box, int start, int end) {
+    const char* text = box->text;
+    const char* p = text + start;
+    const char* stop = text + end;
+    int lineStart = start, x = 0, inSpaces = 0;
+    int breakEnd = -1, breakWidth = 0, breakNext = 0, breakX = 0;
+
+    if (start == end)
+        return boxAddLine(box, start, end, 0);
+
+    while (p < stop) {
+        int at = (int)(p - text), c, w;
+
+        p = tigrDecodeUTF8N(p, stop, &c);
+        if (c == '\r')
+            continue;
+        w = tigrGlyph(box->font, c)->w;
+
+        if (c == ' ') {
+            if (!inSpaces) {
+                breakEnd = at;
+                breakWidth = x;
+                inSpaces = 1;
+            }
+            x += w;
+            breakNext = (int)(p - text);
+            breakX = x;
+            continue;
+        }
+        inSpaces = 0;
+
+        while (box->width > 0 && x + w > box->width && at > lineStart) {
+            if (breakEnd > lineStart) {
+                // Wrap at the spaces, and carry the rest of the word over.
+                if (!boxAddLine(box, lineStart, breakEnd, breakWidth))
+                    return 0;
+                x -= breakX;
+                lineStart = breakNext;
+            } else {
+                if (!boxAddLine(box, lineStart, at, x))
+                    return 0;
+                x = 0;
+                lineStart = at;
+            }
+            breakEnd = -1;
+        }
+        x += w;
+    }
+
+    // Spaces at the very end don't count towards the width.
+    if (inSpaces && breakEnd >= lineStart)
+        return boxAddLine(box, lineStart, breakEnd, breakWidth);
+    return boxAddLine(box, lineStart, end, x);
+}
+
+// Lays out everything from the start of the last paragraph onwards.
+static int boxReflow(TigrTextBox* box) {
+    int start = box->paraStart;
+
+    box->numLines = box->paraLine;
+    for (int i = start; i < box->length; i++) {
+        if (box->text[i] == '\n') {
+            if (!boxWrap(box, start, i))
+                return 0;
+            start = i + 1;
+            box->paraStart = start;
+            box->paraLine = box->numLines;
+        }
+    }
+
+    // The last paragraph only has lines once it has some text.
+    return start == box->length || boxWrap(box, start, box->length);
+}
+
+TigrTextBox* tigrTextBoxCreate(TigrFont* font, int width, int align) {
+    TigrTextBox* box = (TigrTextBox*)calloc(1, sizeof(TigrTextBox));
+    if (!box) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    tigrSetupFont(font);
+    box->font = font;
+    box->width = width;
+    box->align = align;
+    return box;
+}
+
+int tigrTextBoxAppend(TigrTextBox* box, const char* text, int length) {
+    if (length < 0)
+        length = (int)strlen(text);
+    if (box->length + length + 1 > box->capacity) {
+        int capacity = box->capacity ? box->capacity : 256;
+        char* grown;
+        while (capacity < box->length + length + 1)
+            capacity *= 2;
+        grown = (char*)realloc(box->text, capacity);
+        if (!grown) {
+            errno = ENOMEM;
+            return 0;
+        }
+        box->text = grown;
+        box->capacity = capacity;
+    }
+    memcpy(box->text + box->length, text, length);
+    box->length += length;
+    box->text[box->length] = '\0';
+
+    if (!boxReflow(box)) {
+        errno = ENOMEM;
+        return 0;
+    }
+    return 1;
+}
+
+int tigrTextBoxSetWidth(TigrTextBox* box, int width) {
+    box->width = width;
+    box->paraStart = 0;
+    box->paraLine = 0;
+    if (!boxReflow(box)) {
+        errno = ENOMEM;
+        return 0;
+    }
+    return 1;
+}
+
+void tigrTextBoxClear(TigrTextBox* box) {
+    box->length = 0;
+    box->numLines = 0;
+    box->paraStart = 0;
+    box->paraLine = 0;
+}
+
+int tigrTextBoxLines(TigrTextBox* box) {
+    return box->numLines;
+}
+
+int tigrTextBoxHeight(TigrTextBox* box) {
+    return box->numLines * tigrGlyph(box->font, 0)->h;
+}
+
+void tigrDrawTextBox(Tigr* dest, TigrTextBox* box, int x, int y, TPixel color) {
+    int cy = dest->ch >= 0 ? dest->cy : 0;
+    int ch = dest->ch >= 0 ? dest->ch : dest->h;
+    int rowh = tigrGlyph(box->font, 0)->h;
+    int first, last;
+
+    if (rowh <= 0)
+        return;
+
+    // Only lay out the lines that overlap the clip rect.
+    first = cy > y ? (cy - y) / rowh : 0;
+    last = cy + ch > y ? (cy + ch - y + rowh - 1) / rowh : 0;
+    last = last < box->numLines ? last : box->numLines;
+
+    for (int i = first; i < last; i++) {
+        BoxLine* line = &box->lines[i];
+        int lx = x;
+        if (box->align == TIGR_ALIGN_CENTER)
+            lx += (box->width - line->width) / 2;
+        else if (box->align == TIGR_ALIGN_RIGHT)
+            lx += box->width - line->width;
+        tigrPrintText(dest, box->font, lx, y + i * rowh, color, box->text + line->start, line->end - line->start);
+    }
+}
+
+void tigrTextBoxFree(TigrTextBox* box) {
+    if (!box)
+        return;
+    free(box->text);
+    free(box->lines);
+    free(box);
+}
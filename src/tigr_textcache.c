@@ -0,0 +1,369 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// A string rendered once, trimmed to the pixels its glyphs cover. Glyphs never
+// overlap, so one blit of the whole label gives the same result as a blit per glyph.
+typedef struct TextEntry {
+    TigrFont* font;
+    char* text;
+    int length;
+    unsigned long long hash;
+    int dx, dy;            // offset of the trimmed label from where the text starts
+    Tigr shape;            // label size; pix holds untinted glyphs if there's no index
+    unsigned char* index;  // label as font atlas indices, if the font has an atlas
+    long long bytes;
+    int refs, evicted;     // threads drawing it, and whether it's left the cache
+
+    struct TextEntry* next;            // hash chain
+    struct TextEntry *newer, *older;  // most recently drawn first
+} TextEntry;
+
+struct TigrTextCache {
+    TigrMutex lock;
+    long long budget;
+    int count, numBuckets;
+    TextEntry** buckets;
+    TextEntry *newest, *oldest;
+    TigrCacheStats stats;
+};
+
+// FNV-1a, over the text and the font it's drawn with.
+static unsigned long long textHash(TigrFont* font, const char* text, int length) {
+    unsigned long long h = 0xcbf29ce484222325ULL ^ (unsigned long long)(size_t)font;
+    while (length--)
+        h = (h ^ (unsigned char)*text++) * 0x100000001b3ULL;
+    return h;
+}
+
+static unsigned textBucket(TigrTextCache* cache, unsigned long long h) {
+    return (unsigned)(h ^ (h >> 32)) & (cache->numBuckets - 1);
+}
+
+static void textUnlinkLru(TigrTextCache* cache, TextEntry* e) {
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        cache->newest = e->older;
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        cache->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void textPushLru(TigrTextCache* cache, TextEntry* e) {
+    e->older = cache->newest;
+    if (cache->newest)
+        cache->newest->newer = e;
+    else
+        cache->oldest = e;
+    cache->newest = e;
+}
+
+static void textDestroy(TextEntry* e) {
+    free(e->shape.pix);
+    free(e->index);
+    free(e->text);
+    free(e);
+}
+
+// Drops the least recently drawn labels until the cache is within budget,
+// always keeping the newest. Labels still being drawn are freed by textUnpin.
+static void textEvict(TigrTextCache* cache) {
+    while (cache->stats.bytes > cache->budget && cache->oldest != cache->newest) {
+        TextEntry* e = cache->oldest;
+        TextEntry** link = &cache->buckets[textBucket(cache, e->hash)];
+        while (*link != e)
+            link = &(*link)->next;
+        *link = e->next;
+        textUnlinkLru(cache, e);
+        cache->count--;
+        cache->stats.images--;
+        cache->stats.bytes -= e->bytes;
+        cache->stats.evictions++;
+        if (e->refs > 0)
+            e->evicted = 1;
+        else
+            textDestroy(e);
+    }
+}
+
+static TextEntry* textFind(TigrTextCache* cache, unsigned long long h, TigrFont* font, const char* text, int length) {
+    TextEntry* e;
+    for (e = cache->buckets[textBucket(cache, h)]; e; e = e->next) {
+        if (e->hash == h && e->font == font && e->length == length && memcmp(e->text, text, length) == 0)
+            break;
+    }
+    return e;
+}
+
+// Marks a label as the most recently drawn, and keeps it alive until textUnpin.
+// Called with the lock held.
+static void textPin(TigrTextCache* cache, TextEntry* e) {
+    e->refs++;
+    textPushLru(cache, e);
+    textEvict(cache);
+}
+
+static void textUnpin(TigrTextCache* cache, TextEntry* e) {
+    int destroy;
+    tigrMutexLock(&cache->lock);
+    destroy = --e->refs == 0 && e->evicted;
+    tigrMutexUnlock(&cache->lock);
+    if (destroy)
+        textDestroy(e);
+}
+
+static void textGrow(TigrTextCache* cache) {
+    int oldBuckets = cache->numBuckets;
+    TextEntry** old = cache->buckets;
+    TextEntry** buckets = (TextEntry**)calloc(oldBuckets * 2, sizeof(TextEntry*));
+    if (!buckets)
+        return;
+
+    cache->numBuckets = oldBuckets * 2;
+    cache->buckets = buckets;
+    for (int i = 0; i < oldBuckets; i++) {
+        while (old[i]) {
+            TextEntry* e = old[i];
+            unsigned b = textBucket(cache, e->hash);
+            old[i] = e->next;
+            e->next = buckets[b];
+            buckets[b] = e;
+        }
+    }
+    free(old);
+}
+
+// Finds the box covered by non-transparent pixels. Returns zero if there are none.
+static int textTrim(Tigr* bmp, const unsigned char* index, int box[4]) {
+    int x0 = bmp->w, y0 = bmp->h, x1 = 0, y1 = 0;
+    for (int y = 0; y < bmp->h; y++) {
+        for (int x = 0; x < bmp->w; x++) {
+            int i = y * bmp->w + x;
+            if (index ? index[i] != 0 : bmp->pix[i].a != 0) {
+                x0 = x < x0 ? x : x0;
+                x1 = x >= x1 ? x + 1 : x1;
+                y0 = y < y0 ? y : y0;
+                y1 = y + 1;
+            }
+        }
+    }
+    box[0] = x0;
+    box[1] = y0;
+    box[2] = x1 - x0;
+    box[3] = y1 - y0;
+    return x1 > x0;
+}
+
+// Renders text into a new entry, the same way tigrPrintText lays it out.
+static TextEntry* textRender(TigrFont* font, const char* text, int length) {
+    const char* end = text + length;
+    const char* p;
+    TextEntry* e;
+    TigrFontAtlas* atlas = font->atlas;
+    Tigr* sheet = font->bitmap;
+    Tigr full;
+    unsigned char* index = NULL;
+    int rowh = tigrGlyph(font, 0)->h;
+    int x = 0, y = 0, w = 0, lines = 1, box[4], c;
+
+    for (p = text; p < end;) {
+        p = tigrDecodeUTF8N(p, end, &c);
+        if (c == '\n') {
+            x = 0;
+            lines++;
+        } else if (c != '\r') {
+            x += tigrGlyph(font, c)->w;
+            w = x > w ? x : w;
+        }
+    }
+
+    e = (TextEntry*)calloc(1, sizeof(TextEntry));
+    if (!e)
+        return NULL;
+    e->text = (char*)malloc(length + 1);
+    if (!e->text) {
+        free(e);
+        return NULL;
+    }
+    memcpy(e->text, text, length);
+    e->text[length] = '\0';
+    e->length = length;
+    e->font = font;
+
+    // Draw the glyphs into a full-size label.
+    memset(&full, 0, sizeof(full));
+    full.w = w;
+    full.h = lines * rowh;
+    if (atlas)
+        index = (unsigned char*)calloc((size_t)full.w * full.h + 1, 1);
+    else
+        full.pix = (TPixel*)calloc((size_t)full.w * full.h + 1, sizeof(TPixel));
+    if (!index && !full.pix) {
+        textDestroy(e);
+        return NULL;
+    }
+    full.cw = full.ch = -1;
+
+    x = y = 0;
+    for (p = text; p < end;) {
+        TigrGlyph* g;
+        p = tigrDecodeUTF8N(p, end, &c);
+        if (c == '\r')
+            continue;
+        if (c == '\n') {
+            x = 0;
+            y += rowh;
+            continue;
+        }
+        g = tigrGlyph(font, c);
+        if (atlas) {
+            for (int row = 0; row < g->h; row++)
+                memcpy(index + (y + row) * full.w + x, atlas->index + (g->y + row) * sheet->w + g->x, g->w);
+        } else {
+            tigrBlit(&full, sheet, x, y, g->x, g->y, g->w, g->h);
+        }
+        x += g->w;
+    }
+
+    // Keep just the part that gets drawn.
+    memset(&e->shape, 0, sizeof(e->shape));
+    if (textTrim(&full, index, box)) {
+        e->dx = box[0];
+        e->dy = box[1];
+        e->shape.w = box[2];
+        e->shape.h = box[3];
+        if (atlas)
+            e->index = (unsigned char*)malloc((size_t)box[2] * box[3]);
+        else
+            e->shape.pix = (TPixel*)malloc((size_t)box[2] * box[3] * sizeof(TPixel));
+        if (!e->index && !e->shape.pix) {
+            free(index);
+            free(full.pix);
+            textDestroy(e);
+            return NULL;
+        }
+        for (int row = 0; row < box[3]; row++) {
+            int from = (box[1] + row) * full.w + box[0];
+            if (atlas)
+                memcpy(e->index + row * box[2], index + from, box[2]);
+            else
+                memcpy(e->shape.pix + row * box[2], full.pix + from, box[2] * sizeof(TPixel));
+        }
+    }
+    free(index);
+    free(full.pix);
+
+    e->shape.cw = e->shape.ch = -1;
+    e->bytes = sizeof(TextEntry) + length + 1 + (long long)e->shape.w * e->shape.h * (atlas ? 1 : sizeof(TPixel));
+    return e;
+}
+
+TigrTextCache* tigrTextCacheCreate(long long budget) {
+    TigrTextCache* cache = (TigrTextCache*)calloc(1, sizeof(TigrTextCache));
+    if (!cache) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    cache->budget = budget;
+    cache->numBuckets = 64;
+    cache->buckets = (TextEntry**)calloc(cache->numBuckets, sizeof(TextEntry*));
+    if (!cache->buckets) {
+        free(cache);
+        errno = ENOMEM;
+        return NULL;
+    }
+    tigrMutexInit(&cache->lock);
+    return cache;
+}
+
+void tigrPrintCached(TigrTextCache* cache,
+                     Tigr* dest,
+                     TigrFont* font,
+                     int x,
+                     int y,
+                     TPixel color,
+                     const char* text,
+                     int length) {
+    unsigned long long h;
+    TextEntry *e, *made;
+
+    tigrSetupFont(font);
+    if (length < 0)
+        length = (int)strlen(text);
+    h = textHash(font, text, length);
+
+    // The lock only covers the lookup; rendering and drawing happen outside it.
+    tigrMutexLock(&cache->lock);
+    e = textFind(cache, h, font, text, length);
+    if (e) {
+        cache->stats.hits++;
+        textUnlinkLru(cache, e);
+        textPin(cache, e);
+    } else {
+        cache->stats.misses++;
+    }
+    tigrMutexUnlock(&cache->lock);
+
+    if (!e) {
+        made = textRender(font, text, length);
+        if (!made) {
+            // Out of memory, so just draw it directly.
+            tigrPrintText(dest, font, x, y, color, text, length);
+            return;
+        }
+        made->hash = h;
+
+        // Another thread may have added it in the meantime.
+        tigrMutexLock(&cache->lock);
+        e = textFind(cache, h, font, text, length);
+        if (e) {
+            textUnlinkLru(cache, e);
+        } else {
+            e = made;
+            made = NULL;
+            if (cache->count >= cache->numBuckets)
+                textGrow(cache);
+            e->next = cache->buckets[textBucket(cache, h)];
+            cache->buckets[textBucket(cache, h)] = e;
+            cache->count++;
+            cache->stats.images++;
+            cache->stats.bytes += e->bytes;
+        }
+        textPin(cache, e);
+        tigrMutexUnlock(&cache->lock);
+        if (made)
+            textDestroy(made);
+    }
+
+    if (e->shape.w > 0) {
+        if (e->index) {
+            TigrTintTable tint;
+            tigrTintTable(&tint, font->atlas->palette, font->atlas->numColors, color);
+            tigrBlitIndexed(dest, &e->shape, e->index, &tint, x + e->dx, y + e->dy, 0, 0, e->shape.w, e->shape.h);
+        } else {
+            tigrBlitTint(dest, &e->shape, x + e->dx, y + e->dy, 0, 0, e->shape.w, e->shape.h, color);
+        }
+    }
+    textUnpin(cache, e);
+}
+
+void tigrTextCacheStats(TigrTextCache* cache, TigrCacheStats* stats) {
+    tigrMutexLock(&cache->lock);
+    *stats = cache->stats;
+    tigrMutexUnlock(&cache->lock);
+}
+
+void tigrTextCacheFree(TigrTextCache* cache) {
+    while (cache->newest) {
+        TextEntry* e = cache->newest;
+        cache->newest = e->older;
+        textDestroy(e);
+    }
+    tigrMutexDestroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
@@ -0,0 +1,167 @@
+#include "tigr_internal.h"
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+typedef struct {
+    void (*func)(void*);
+    void* arg;
+} ThreadStart;
+
+#ifdef _WIN32
+
+void tigrMutexInit(TigrMutex* mutex) {
+    InitializeSRWLock(mutex);
+}
+
+void tigrMutexDestroy(TigrMutex* mutex) {
+    (void)mutex;
+}
+
+void tigrMutexLock(TigrMutex* mutex) {
+    AcquireSRWLockExclusive(mutex);
+}
+
+void tigrMutexUnlock(TigrMutex* mutex) {
+    ReleaseSRWLockExclusive(mutex);
+}
+
+void tigrCondInit(TigrCond* cond) {
+    InitializeConditionVariable(cond);
+}
+
+void tigrCondDestroy(TigrCond* cond) {
+    (void)cond;
+}
+
+void tigrCondWait(TigrCond* cond, TigrMutex* mutex) {
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+void tigrCondBroadcast(TigrCond* cond) {
+    WakeAllConditionVariable(cond);
+}
+
+typedef struct {
+    void (*func)(void);
+} OnceCall;
+
+static BOOL CALLBACK onceMain(PINIT_ONCE once, PVOID param, PVOID* context) {
+    (void)once;
+    (void)context;
+    ((OnceCall*)param)->func();
+    return TRUE;
+}
+
+void tigrOnce(TigrOnce* once, void (*func)(void)) {
+    OnceCall call;
+    call.func = func;
+    InitOnceExecuteOnce(once, onceMain, &call, NULL);
+}
+
+static DWORD WINAPI threadMain(LPVOID param) {
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return 0;
+}
+
+int tigrThreadStart(TigrThread* thread, void (*func)(void*), void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start)
+        return 0;
+    start->func = func;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, threadMain, start, 0, NULL);
+    if (!*thread) {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void tigrThreadJoin(TigrThread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+int tigrCpuCount(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+void tigrMutexInit(TigrMutex* mutex) {
+    pthread_mutex_init(mutex, NULL);
+}
+
+void tigrMutexDestroy(TigrMutex* mutex) {
+    pthread_mutex_destroy(mutex);
+}
+
+void tigrMutexLock(TigrMutex* mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+void tigrMutexUnlock(TigrMutex* mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+void tigrCondInit(TigrCond* cond) {
+    pthread_cond_init(cond, NULL);
+}
+
+void tigrCondDestroy(TigrCond* cond) {
+    pthread_cond_destroy(cond);
+}
+
+void tigrCondWait(TigrCond* cond, TigrMutex* mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+
+void tigrCondBroadcast(TigrCond* cond) {
+    pthread_cond_broadcast(cond);
+}
+
+void tigrOnce(TigrOnce* once, void (*func)(void)) {
+    pthread_once(once, func);
+}
+
+static void* threadMain(void* param) {
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return NULL;
+}
+
+int tigrThreadStart(TigrThread* thread, void (*func)(void*), void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start)
+        return 0;
+    start->func = func;
+    start->arg = arg;
+    if (pthread_create(thread, NULL, threadMain, start) != 0) {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void tigrThreadJoin(TigrThread thread) {
+    pthread_join(thread, NULL);
+}
+
+int tigrCpuCount(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#else
+    return 1;
+#endif
+}
+
+#endif  // _WIN32
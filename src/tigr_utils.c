@@ -1,6 +1,22 @@
 #include "tigr_internal.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if (__linux__ && !__ANDROID__) || __MACOS__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+FILE* tigrOpenFile(const char* fileName, const char* mode) {
+    // TODO - unicode?
+    return fopen(fileName, mode);
+}
 
 #ifndef __ANDROID__
 
@@ -9,15 +25,21 @@ void* _tigrReadFile(const char* fileName, int* length) {
 #else
 void* tigrReadFile(const char* fileName, int* length) {
 #endif
-    // TODO - unicode?
+    TigrArchive* archive = tigrFindMounted(fileName);
     FILE* file;
     char* data;
     size_t len;
 
+    if (archive) {
+        data = (char*)tigrReadMountedFile(archive, fileName, length);
+        tigrReleaseMounted(archive);
+        return data;
+    }
+
     if (length)
         *length = 0;
 
-    file = fopen(fileName, "rb");
+    file = tigrOpenFile(fileName, "rb");
     if (!file)
         return NULL;
 
@@ -47,8 +69,108 @@ void* tigrReadFile(const char* fileName, int* length) {
 
 #endif  // __ANDROID__
 
+#if defined(_WIN32)
+
+const void* tigrMapFile(const char* fileName, int* length) {
+    FILE* file;
+    HANDLE handle, mapping;
+    LARGE_INTEGER size;
+    void* data = NULL;
+
+    if (length)
+        *length = 0;
+
+    file = tigrOpenFile(fileName, "rb");
+    if (!file)
+        return NULL;
+
+    handle = (HANDLE)_get_osfhandle(_fileno(file));
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart <= 0 || size.QuadPart > 0x7fffffff) {
+        fclose(file);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // The view keeps the file open after it's closed here.
+    mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) {
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    fclose(file);
+
+    if (!data) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (length)
+        *length = (int)size.QuadPart;
+    return data;
+}
+
+void tigrUnmapFile(const void* data, int length) {
+    (void)length;
+    if (data)
+        UnmapViewOfFile(data);
+}
+
+#elif (__linux__ && !__ANDROID__) || __MACOS__
+
+const void* tigrMapFile(const char* fileName, int* length) {
+    struct stat st;
+    void* data;
+    int fd;
+
+    if (length)
+        *length = 0;
+
+    // File names are already UTF-8 here, so there's nothing for tigrOpenFile to convert.
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > 0x7fffffff) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    if (length)
+        *length = (int)st.st_size;
+    return data;
+}
+
+void tigrUnmapFile(const void* data, int length) {
+    if (data)
+        munmap((void*)data, (size_t)length);
+}
+
+#else
+
+// No file mapping here, so just read the whole thing.
+const void* tigrMapFile(const char* fileName, int* length) {
+    return tigrReadFile(fileName, length);
+}
+
+void tigrUnmapFile(const void* data, int length) {
+    (void)length;
+    free((void*)data);
+}
+
+#endif
+
 // Reads a single UTF8 codepoint.
 const char* tigrDecodeUTF8(const char* text, int* cp) {
+    return tigrDecodeUTF8N(text, NULL, cp);
+}
+
+const char* tigrDecodeUTF8N(const char* text, const char* end, int* cp) {
     unsigned char c = *text++;
     int extra = 0, min = 0;
     *cp = 0;
@@ -70,6 +192,10 @@ const char* tigrDecodeUTF8(const char* text, int* cp) {
         *cp = c;
     }
     while (extra--) {
+        if (text == end) {
+            *cp = 0xfffd;
+            break;
+        }
         c = *text++;
         if ((c & 0xc0) != 0x80) {
             *cp = 0xfffd;
@@ -83,6 +209,42 @@ const char* tigrDecodeUTF8(const char* text, int* cp) {
     return text;
 }
 
+int tigrDecodeUTF8Run(const char** text, const char* end, int* cps, int max) {
+    const unsigned long long high = 0x8080808080808080ULL;
+    const char* p = *text;
+    int n = 0;
+
+    while (n < max && p < end) {
+        // Plain ASCII is copied across 16 bytes at a time, checking 8 at once for high bits.
+        if (end - p >= 16 && max - n >= 16) {
+            unsigned long long a, b;
+            memcpy(&a, p, 8);
+            memcpy(&b, p + 8, 8);
+            if (((a | b) & high) == 0) {
+                for (int i = 0; i < 16; i++)
+                    cps[n + i] = (unsigned char)p[i];
+                p += 16;
+                n += 16;
+                continue;
+            }
+        }
+        if ((unsigned char)*p < 0x80)
+            cps[n++] = (unsigned char)*p++;
+        else
+            p = tigrDecodeUTF8N(p, end, &cps[n++]);
+    }
+    *text = p;
+    return n;
+}
+
+int tigrDecodeUTF8Array(const char* text, int length, int* cps, int max, const char** next) {
+    const char* end = text + (length < 0 ? strlen(text) : (size_t)length);
+    int n = tigrDecodeUTF8Run(&text, end, cps, max);
+    if (next)
+        *next = text;
+    return n;
+}
+
 char* tigrEncodeUTF8(char* text, int cp) {
     if (cp < 0 || cp > 0x10ffff) {
         cp = 0xfffd;
@@ -108,6 +270,55 @@ char* tigrEncodeUTF8(char* text, int cp) {
 #undef EMIT
 }
 
+void tigrPut32LE(unsigned char* p, unsigned v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+unsigned tigrGet32LE(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static unsigned crcTable[8][256];
+static TigrOnce crcOnce = TIGR_ONCE_INIT;
+
+static void initCrc(void) {
+    for (unsigned i = 0; i < 256; i++) {
+        unsigned c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c >> 1) ^ (0xedb88320 & (0 - (c & 1)));
+        crcTable[0][i] = c;
+    }
+    for (int t = 1; t < 8; t++) {
+        for (int i = 0; i < 256; i++) {
+            unsigned c = crcTable[t - 1][i];
+            crcTable[t][i] = (c >> 8) ^ crcTable[0][c & 0xff];
+        }
+    }
+}
+
+// Slice-by-8 CRC32.
+unsigned tigrCrc32(unsigned crc, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned(*t)[256] = crcTable;
+
+    tigrOnce(&crcOnce, initCrc);
+    crc = ~crc;
+    while (len >= 8) {
+        unsigned a = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24));
+        unsigned b = p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned)p[7] << 24);
+        crc = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff] ^ t[5][(a >> 16) & 0xff] ^ t[4][a >> 24] ^ t[3][b & 0xff] ^
+              t[2][(b >> 8) & 0xff] ^ t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    return ~crc;
+}
+
 #ifndef TIGR_HEADLESS
 
 int tigrBeginOpenGL(Tigr* bmp) {
@@ -138,4 +349,26 @@ void tigrSetPostFX(Tigr* bmp, float p1, float p2, float p3, float p4) {
     win->p4 = p4;
 }
 
+void tigrPushEvent(TigrInternal* win, const TigrEvent* event) {
+    if (win->numEvents == MAX_EVENTS) {
+        win->firstEvent = (win->firstEvent + 1) % MAX_EVENTS;
+        win->numEvents--;
+    }
+    win->events[(win->firstEvent + win->numEvents) % MAX_EVENTS] = *event;
+    win->numEvents++;
+}
+
+int tigrPollEvent(Tigr* bmp, TigrEvent* event) {
+    TigrInternal* win = tigrInternal(bmp);
+    if (win->numEvents == 0) {
+        memset(event, 0, sizeof(TigrEvent));
+        event->type = TIGR_EVENT_NONE;
+        return 0;
+    }
+    *event = win->events[win->firstEvent];
+    win->firstEvent = (win->firstEvent + 1) % MAX_EVENTS;
+    win->numEvents--;
+    return 1;
+}
+
 #endif // TIGR_HEADLESS
@@ -539,7 +539,7 @@ void tigrFree(Tigr* bmp) {
         free(win->wtitle);
         tigrFree(win->widgets);
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
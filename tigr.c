@@ -10,6 +10,7 @@
 #define __TIGR_INTERNAL_H__
 
 #define _CRT_SECURE_NO_WARNINGS NOPE
+#include <stdio.h>
 
 // Graphics configuration.
 #ifndef TIGR_HEADLESS
@@ -22,21 +23,185 @@ int tigrCalcScale(int bmpW, int bmpH, int areaW, int areaH);
 // Creates a new bitmap, with extra payload bytes.
 Tigr* tigrBitmap2(int w, int h, int extra);
 
+// The most pixels an image loader will allocate a bitmap for.
+#define TIGR_MAX_PIXELS 400000000
+
 // Resizes an existing bitmap.
 void tigrResize(Tigr* bmp, int w, int h);
 
+// Frees a bitmap's pixels, which may be mapped from a snapshot file.
+void tigrFreePixels(Tigr* bmp);
+
+// A font sheet with each pixel replaced by an index into a palette of at most 256 colors.
+// Index 0 is fully transparent.
+typedef struct TigrFontAtlas {
+    unsigned char* index;
+    TPixel palette[256];
+    int numColors;
+} TigrFontAtlas;
+
+// Palette colors with a tint applied, ready for tigrBlitIndexed.
+typedef struct {
+    unsigned char r[256], g[256], b[256], a[256];
+    unsigned blend[256];  // tint alpha * color alpha, 0 to 65536
+} TigrTintTable;
+
+// Tints a palette, the same way tigrBlitTint tints each source pixel.
+void tigrTintTable(TigrTintTable* table, const TPixel* palette, int numColors, TPixel tint);
+
+// Same as tigrBlitTint, but the source pixels are read from 'index', an 8-bit
+// image the size of 'src', through a tinted palette. Gives identical results.
+void tigrBlitIndexed(Tigr* dst,
+                     Tigr* src,
+                     const unsigned char* index,
+                     const TigrTintTable* table,
+                     int dx,
+                     int dy,
+                     int sx,
+                     int sy,
+                     int w,
+                     int h);
+
+// Loads the stock font the first time it's used.
+void tigrSetupFont(TigrFont* font);
+
+// Looks up the glyph for a code point, or the font's fallback glyph.
+TigrGlyph* tigrGlyph(TigrFont* font, int code);
+
+// Decodes a single UTF8 codepoint like tigrDecodeUTF8, without reading past 'end'.
+// If 'end' is NULL, the text must be NUL terminated instead.
+const char* tigrDecodeUTF8N(const char* text, const char* end, int* cp);
+
+// Decodes up to 'max' codepoints from *text, without reading past 'end', and advances *text.
+// Returns the number of codepoints written to 'cps'.
+int tigrDecodeUTF8Run(const char** text, const char* end, int* cps, int max);
+
 // Calculates a new scale, taking minimum-scale flags into account.
 int tigrEnforceScale(int scale, int flags);
 
+// Opens a file like fopen. (fileName is UTF-8)
+// POSIX platforms can open UTF-8 names directly, without going through this.
+FILE* tigrOpenFile(const char* fileName, const char* mode);
+
+// Writes and reads little-endian 32-bit values, as used by tigr's own file formats.
+void tigrPut32LE(unsigned char* p, unsigned v);
+unsigned tigrGet32LE(const unsigned char* p);
+
+// Continues a CRC-32, as used by PNG and zip. Start with a crc of 0.
+unsigned tigrCrc32(unsigned crc, const void* data, size_t len);
+
 // Calculates the correct position for a bitmap to fit into a window.
 void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]);
 
+// Supplies more compressed input to tigrInflateStream.
+// Returns zero if there is none.
+typedef int (*TigrInflateSource)(void* ctx, const unsigned char** in, unsigned* len);
+
+// Receives decompressed data from tigrInflateStream.
+// Returns non-zero to continue.
+typedef int (*TigrInflateSink)(void* ctx, const unsigned char* data, unsigned len);
+
+// Largest window needed: the 32kB history plus a full block of new output.
+#define TIGR_INFLATE_WINDOW 65536
+
+// Like tigrInflate, but also returns how many bytes were written to 'out'.
+int tigrInflateSize(void* out, unsigned outlen, const void* in, unsigned inlen, unsigned* written);
+
+// Inflate state, including a streaming window, that can be reused between calls.
+typedef struct TigrInflateState TigrInflateState;
+
+// Allocates reusable inflate state. Free it with tigrInflateFree.
+TigrInflateState* tigrInflateState(void);
+void tigrInflateFree(TigrInflateState* state);
+
+// Decompresses DEFLATEd data through a sliding window, handing output to 'sink'
+// as the window fills up. Input continues from 'more' (if not NULL) once 'in' runs out.
+// 'outlen' is the expected size of the output, which bounds the window size.
+// Uses a temporary state if 'state' is NULL.
+// Returns non-zero on success.
+int tigrInflateStream(TigrInflateState* state,
+                      unsigned outlen,
+                      const void* in,
+                      unsigned inlen,
+                      TigrInflateSource more,
+                      TigrInflateSink sink,
+                      void* ctx);
+
+// Decodes an image from memory or a file, using 'state' (which may be NULL) for decompression.
+Tigr* tigrDecodeImage(const void* data, int length, TigrInflateState* state);
+Tigr* tigrDecodeImageFile(const char* fileName, TigrInflateState* state);
+
+// Decodes a QOI image, or reads its header.
+// On error, returns NULL/zero and sets errno.
+Tigr* tigrLoadQoi(const void* data, int length);
+int tigrQoiInfo(const void* data, int length, int* w, int* h, int* channels);
+
+// Decodes a QOI image a row at a time. 'target' returns where row y goes, and 'done'
+// (which may be NULL) is called once it's written; returning zero from it stops decoding.
+typedef TPixel* (*TigrQoiTarget)(void* user, int y);
+typedef int (*TigrQoiDone)(void* user, int y);
+int tigrLoadQoiRows(const void* data, int length, TigrQoiTarget target, TigrQoiDone done, void* user);
+
+// Returns the most recently mounted archive holding a file, or NULL.
+// The archive stays open until it's handed back with tigrReleaseMounted.
+TigrArchive* tigrFindMounted(const char* fileName);
+void tigrReleaseMounted(TigrArchive* archive);
+
+// Finds a file in the mounted archives, for tigrCacheLoad. 'stamp' changes when
+// the file does, or when a different archive provides it.
+// Returns zero if no mounted archive has it.
+int tigrMountedInfo(const char* fileName, long long* size, long long* stamp);
+
+// Reads a file from an archive into a NUL terminated copy, like tigrReadFile.
+void* tigrReadMountedFile(TigrArchive* archive, const char* fileName, int* length);
+
 // ----------------------------------------------------------
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Threads.
+#ifdef _WIN32
+typedef SRWLOCK TigrMutex;
+typedef CONDITION_VARIABLE TigrCond;
+typedef HANDLE TigrThread;
+typedef INIT_ONCE TigrOnce;
+#define TIGR_MUTEX_INIT SRWLOCK_INIT
+#define TIGR_ONCE_INIT INIT_ONCE_STATIC_INIT
+#else
+typedef pthread_mutex_t TigrMutex;
+typedef pthread_cond_t TigrCond;
+typedef pthread_t TigrThread;
+typedef pthread_once_t TigrOnce;
+#define TIGR_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define TIGR_ONCE_INIT PTHREAD_ONCE_INIT
 #endif
 
+// Mutexes can also be set up statically with TIGR_MUTEX_INIT.
+void tigrMutexInit(TigrMutex* mutex);
+void tigrMutexDestroy(TigrMutex* mutex);
+void tigrMutexLock(TigrMutex* mutex);
+void tigrMutexUnlock(TigrMutex* mutex);
+
+void tigrCondInit(TigrCond* cond);
+void tigrCondDestroy(TigrCond* cond);
+void tigrCondWait(TigrCond* cond, TigrMutex* mutex);
+void tigrCondBroadcast(TigrCond* cond);
+
+// Calls func exactly once, however many threads get here at the same time.
+// None of them return until it has finished. 'once' must start as TIGR_ONCE_INIT.
+void tigrOnce(TigrOnce* once, void (*func)(void));
+
+// Starts a thread running func(arg). Returns non-zero on success.
+int tigrThreadStart(TigrThread* thread, void (*func)(void*), void* arg);
+void tigrThreadJoin(TigrThread thread);
+
+// Returns the number of CPU cores available.
+int tigrCpuCount(void);
+
 #if !defined(TIGR_HEADLESS) && __linux__ && !__ANDROID__
 #include <X11/X.h>
 #include <X11/Xlib.h>
@@ -96,6 +261,7 @@ typedef struct {
 #endif
 
 #define MAX_TOUCH_POINTS 10
+#define MAX_EVENTS 256
 
 typedef struct {
     int shown, closed;
@@ -133,6 +299,8 @@ typedef struct {
     int pos[4];
     int lastChar;
     int keys[256], prev[256];
+    TigrEvent events[MAX_EVENTS];
+    int firstEvent, numEvents;
 #if __ANDROID__
     int released[256];
 #endif  // __ANDROID__
@@ -154,11 +322,22 @@ typedef struct {
     float scrollDeltaX;
     float scrollDeltaY;
 #endif  // _WIN32 __linux__ __MACOS__
+#if __linux__ && !__ANDROID__
+    unsigned int prevButtons;
+    char prevKeys[32];
+    char eventKeys[32];  // keycodes held, as seen by events
+    int eventW, eventH;
+    double eventClock;   // from X server time to ours
+    double lastEventTime;
+#endif  // __linux__
 } TigrInternal;
 // ----------------------------------------------------------
 
 TigrInternal* tigrInternal(Tigr* bmp);
 
+// Adds an event to a window's queue, dropping the oldest one if it's full.
+void tigrPushEvent(TigrInternal* win, const TigrEvent* event);
+
 void tigrGAPICreate(Tigr* bmp);
 void tigrGAPIDestroy(Tigr* bmp);
 int tigrGAPIBegin(Tigr* bmp);
@@ -306,7 +485,7 @@ Tigr* tigrBitmap(int w, int h) {
 
 #ifdef TIGR_HEADLESS
 void tigrFree(Tigr* bmp) {
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 #endif // TIGR_HEADLESS
@@ -326,7 +505,7 @@ void tigrResize(Tigr* bmp, int w, int h) {
     for (y = 0; y < ch; y++)
         memcpy(newpix + y * w, bmp->pix + y * bmp->w, cw * sizeof(TPixel));
 
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     bmp->pix = newpix;
     bmp->w = w;
     bmp->h = h;
@@ -370,16 +549,52 @@ void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]) {
     out[3] = out[1] + bmp->h * scale;
 }
 
+// Operations on at least this many pixels are split into bands of rows on the thread pool,
+// in pieces of about PARALLEL_GRAIN pixels. Anything smaller isn't worth waking threads for.
+#define PARALLEL_PIXELS (1 << 18)
+#define PARALLEL_GRAIN (1 << 14)
+
+typedef struct {
+    Tigr *dst, *src;
+    int dx, dy, sx, sy, w;
+    TPixel color;
+} RowJob;
+
+static void setRows(RowJob* job, Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, TPixel color) {
+    job->dst = dst;
+    job->src = src;
+    job->dx = dx;
+    job->dy = dy;
+    job->sx = sx;
+    job->sy = sy;
+    job->w = w;
+    job->color = color;
+}
+
+// Runs func over rows [0, h), across the thread pool if there are enough pixels.
+// Blits of a bitmap onto itself always go in order, top to bottom.
+static void runRows(RowJob* job, int h, TigrRangeFunc func) {
+    if (job->src != job->dst && (long long)job->w * h >= PARALLEL_PIXELS)
+        tigrParallelFor(0, h, PARALLEL_GRAIN / job->w + 1, func, job);
+    else
+        func(job, 0, h);
+}
+
+static void fillRows(void* ctx, int y0, int y1) {
+    RowJob* job = (RowJob*)ctx;
+    for (int y = y0; y < y1; y++) {
+        TPixel* td = &job->dst->pix[(job->dy + y) * job->dst->w + job->dx];
+        for (int i = 0; i < job->w; i++)
+            td[i] = job->color;
+    }
+}
+
 void tigrClear(Tigr* bmp, TPixel color) {
-    int count = bmp->w * bmp->h;
-    int n;
-    for (n = 0; n < count; n++)
-        bmp->pix[n] = color;
+    tigrFill(bmp, 0, 0, bmp->w, bmp->h, color);
 }
 
 void tigrFill(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
-    TPixel* td;
-    int dt, i;
+    RowJob job;
 
     if (x < 0) {
         w += x;
@@ -398,13 +613,8 @@ void tigrFill(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
     if (w <= 0 || h <= 0)
         return;
 
-    td = &bmp->pix[y * bmp->w + x];
-    dt = bmp->w;
-    do {
-        for (i = 0; i < w; i++)
-            td[i] = color;
-        td += dt;
-    } while (--h);
+    setRows(&job, bmp, NULL, x, y, 0, 0, w, color);
+    runRows(&job, h, fillRows);
 }
 
 void tigrLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
@@ -605,21 +815,47 @@ void tigrClip(Tigr* bmp, int cx, int cy, int cw, int ch) {
     bmp->ch = ch;
 }
 
+static void blitRows(void* ctx, int y0, int y1) {
+    RowJob* job = (RowJob*)ctx;
+    for (int y = y0; y < y1; y++) {
+        TPixel* ts = &job->src->pix[(job->sy + y) * job->src->w + job->sx];
+        memcpy(&job->dst->pix[(job->dy + y) * job->dst->w + job->dx], ts, job->w * sizeof(TPixel));
+    }
+}
+
 void tigrBlit(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h) {
     int cw = dst->cw >= 0 ? dst->cw : dst->w;
     int ch = dst->ch >= 0 ? dst->ch : dst->h;
 
     CLIP();
 
-    TPixel* ts = &src->pix[sy * src->w + sx];
-    TPixel* td = &dst->pix[dy * dst->w + dx];
-    int st = src->w;
-    int dt = dst->w;
-    do {
-        memcpy(td, ts, w * sizeof(TPixel));
-        ts += st;
-        td += dt;
-    } while (--h);
+    RowJob job;
+    setRows(&job, dst, src, dx, dy, sx, sy, w, tigrRGBA(0, 0, 0, 0));
+    runRows(&job, h, blitRows);
+}
+
+static void tintRows(void* ctx, int y0, int y1) {
+    RowJob* job = (RowJob*)ctx;
+    Tigr* dst = job->dst;
+    int xr = EXPAND(job->color.r);
+    int xg = EXPAND(job->color.g);
+    int xb = EXPAND(job->color.b);
+    int xa = EXPAND(job->color.a);
+
+    for (int y = y0; y < y1; y++) {
+        TPixel* ts = &job->src->pix[(job->sy + y) * job->src->w + job->sx];
+        TPixel* td = &dst->pix[(job->dy + y) * dst->w + job->dx];
+        for (int x = 0; x < job->w; x++) {
+            unsigned r = (xr * ts[x].r) >> 8;
+            unsigned g = (xg * ts[x].g) >> 8;
+            unsigned b = (xb * ts[x].b) >> 8;
+            unsigned a = xa * EXPAND(ts[x].a);
+            td[x].r += (unsigned char)((r - td[x].r) * a >> 16);
+            td[x].g += (unsigned char)((g - td[x].g) * a >> 16);
+            td[x].b += (unsigned char)((b - td[x].b) * a >> 16);
+            td[x].a += (dst->blitMode) * (unsigned char)((ts[x].a - td[x].a) * a >> 16);
+        }
+    }
 }
 
 void tigrBlitTint(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint) {
@@ -628,25 +864,75 @@ void tigrBlitTint(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, i
 
     CLIP();
 
+    RowJob job;
+    setRows(&job, dst, src, dx, dy, sx, sy, w, tint);
+    runRows(&job, h, tintRows);
+}
+
+void tigrTintTable(TigrTintTable* table, const TPixel* palette, int numColors, TPixel tint) {
     int xr = EXPAND(tint.r);
     int xg = EXPAND(tint.g);
     int xb = EXPAND(tint.b);
     int xa = EXPAND(tint.a);
 
-    TPixel* ts = &src->pix[sy * src->w + sx];
+    for (int i = 0; i < numColors; i++) {
+        table->r[i] = (unsigned char)((xr * palette[i].r) >> 8);
+        table->g[i] = (unsigned char)((xg * palette[i].g) >> 8);
+        table->b[i] = (unsigned char)((xb * palette[i].b) >> 8);
+        table->a[i] = palette[i].a;
+        table->blend[i] = xa * EXPAND(palette[i].a);
+    }
+}
+
+void tigrBlitIndexed(Tigr* dst,
+                     Tigr* src,
+                     const unsigned char* index,
+                     const TigrTintTable* table,
+                     int dx,
+                     int dy,
+                     int sx,
+                     int sy,
+                     int w,
+                     int h) {
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    CLIP();
+
+    const unsigned char* ts = &index[sy * src->w + sx];
     TPixel* td = &dst->pix[dy * dst->w + dx];
     int st = src->w;
     int dt = dst->w;
+    int mode = dst->blitMode;
     do {
         for (int x = 0; x < w; x++) {
-            unsigned r = (xr * ts[x].r) >> 8;
-            unsigned g = (xg * ts[x].g) >> 8;
-            unsigned b = (xb * ts[x].b) >> 8;
-            unsigned a = xa * EXPAND(ts[x].a);
-            td[x].r += (unsigned char)((r - td[x].r) * a >> 16);
-            td[x].g += (unsigned char)((g - td[x].g) * a >> 16);
-            td[x].b += (unsigned char)((b - td[x].b) * a >> 16);
-            td[x].a += (dst->blitMode) * (unsigned char)((ts[x].a - td[x].a) * a >> 16);
+            unsigned i = ts[x], r, g, b, a;
+            if (i == 0) {
+                // Skip transparent pixels, four at a time where we can.
+                unsigned quad;
+                if (x + 4 <= w) {
+                    memcpy(&quad, ts + x, sizeof(quad));
+                    if (quad == 0)
+                        x += 3;
+                }
+                continue;
+            }
+
+            r = table->r[i];
+            g = table->g[i];
+            b = table->b[i];
+            a = table->blend[i];
+            if (a == 65536) {
+                // Opaque, so the blend would just give the tinted color.
+                td[x].r = (unsigned char)r;
+                td[x].g = (unsigned char)g;
+                td[x].b = (unsigned char)b;
+            } else {
+                td[x].r += (unsigned char)((r - td[x].r) * a >> 16);
+                td[x].g += (unsigned char)((g - td[x].g) * a >> 16);
+                td[x].b += (unsigned char)((b - td[x].b) * a >> 16);
+            }
+            td[x].a += mode * (unsigned char)((table->a[i] - td[x].a) * a >> 16);
         }
         ts += st;
         td += dt;
@@ -665,15 +951,19 @@ void tigrBlitMode(Tigr* dst, int mode) {
 #undef CLIP0
 #undef CLIP1
 #undef CLIP
+#undef PARALLEL_PIXELS
+#undef PARALLEL_GRAIN
 
 //////// End of inlined file: tigr_bitmaps.c ////////
 
 //////// Start of inlined file: tigr_loadpng.c ////////
 
 //#include "tigr_internal.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 typedef struct {
     const unsigned char *p, *end;
@@ -685,11 +975,13 @@ static unsigned get32(const unsigned char* v) {
 
 static const unsigned char* find(PNG* png, const char* chunk, unsigned minlen) {
     const unsigned char* start;
-    while (png->p < png->end) {
+    while (png->end - png->p >= 12) {
         unsigned len = get32(png->p + 0);
         start = png->p;
+        if (len > (size_t)(png->end - png->p) - 12)
+            break;
         png->p += len + 12;
-        if (memcmp(start + 4, chunk, 4) == 0 && len >= minlen && png->p <= png->end)
+        if (memcmp(start + 4, chunk, 4) == 0 && len >= minlen)
             return start + 8;
     }
 
@@ -707,37 +999,29 @@ static int rowBytes(int w, int bipp) {
     return rowBits / 8 + ((rowBits % 8) ? 1 : 0);
 }
 
-static int unfilter(int w, int h, int bipp, unsigned char* raw) {
-    int len = rowBytes(w, bipp);
-    int bpp = rowBytes(1, bipp);
-    int x, y;
-    unsigned char* first = (unsigned char*)malloc(len + 1);
-    memset(first, 0, len + 1);
-    unsigned char* prev = first;
-    for (y = 0; y < h; y++, prev = raw, raw += len) {
+static int unfilter(int len, int bpp, unsigned char* raw, const unsigned char* prev) {
+    int x;
 #define LOOP(A, B)            \
     for (x = 0; x < bpp; x++) \
         raw[x] += A;          \
     for (; x < len; x++)      \
         raw[x] += B;          \
     break
-        switch (*raw++) {
-            case 0:
-                break;
-            case 1:
-                LOOP(0, raw[x - bpp]);
-            case 2:
-                LOOP(prev[x], prev[x]);
-            case 3:
-                LOOP(prev[x] / 2, (raw[x - bpp] + prev[x]) / 2);
-            case 4:
-                LOOP(prev[x], paeth(raw[x - bpp], prev[x], prev[x - bpp]));
-            default:
-                return 0;
-        }
-#undef LOOP
+    switch (*raw++) {
+        case 0:
+            break;
+        case 1:
+            LOOP(0, raw[x - bpp]);
+        case 2:
+            LOOP(prev[x], prev[x]);
+        case 3:
+            LOOP(prev[x] / 2, (raw[x - bpp] + prev[x]) / 2);
+        case 4:
+            LOOP(prev[x], paeth(raw[x - bpp], prev[x], prev[x - bpp]));
+        default:
+            return 0;
     }
-    free(first);
+#undef LOOP
     return 1;
 }
 
@@ -836,221 +1120,710 @@ static void depalette(int w,
     if (!(X))    \
     FAIL()
 
-static int outsize(Tigr* bmp, int bipp) {
-    return (rowBytes(bmp->w, bipp) + 1) * bmp->h;
-}
-
-static Tigr* tigrLoadPng(PNG* png) {
-    const unsigned char *ihdr, *idat, *plte, *trns, *first;
-    int trnsSize = 0;
-    int depth, ctype, bipp;
-    int datalen = 0;
-    unsigned char *data = NULL, *out;
-    Tigr* bmp = NULL;
-
-    CHECK(memcmp(png->p, "\211PNG\r\n\032\n", 8) == 0);  // PNG signature
+// Decoder state for one PNG, unfiltering and converting a row at a time.
+typedef struct PngRows {
+    int w, h, depth, ctype, bipp;
+    const unsigned char *plte, *trns;
+    int trnsSize;
+    int len, bpp;
+    unsigned char *cur, *prev;
+    int fill, y;
+    PNG* png;
+    TigrInflateState* inflate;
+
+    // Returns where row y should be converted to, and is told when it's done.
+    TPixel* (*target)(struct PngRows* rows, int y);
+    int (*done)(struct PngRows* rows, int y);
+    void* user;
+} PngRows;
+
+static int pngHeader(PNG* png, PngRows* rows) {
+    const unsigned char* ihdr;
+
+    CHECK(png->end - png->p >= 8 && memcmp(png->p, "\211PNG\r\n\032\n", 8) == 0);  // PNG signature
     png->p += 8;
-    first = png->p;
 
     // Read IHDR
     ihdr = find(png, "IHDR", 13);
     CHECK(ihdr);
-    depth = ihdr[8];
-    ctype = ihdr[9];
-    switch (ctype) {
+    rows->w = get32(ihdr + 0);
+    rows->h = get32(ihdr + 4);
+    rows->depth = ihdr[8];
+    rows->ctype = ihdr[9];
+    switch (rows->ctype) {
         case 0:
-            bipp = depth;
+            rows->bipp = rows->depth;
             break;  // greyscale
         case 2:
-            bipp = 3 * depth;
+            rows->bipp = 3 * rows->depth;
             break;  // RGB
         case 3:
-            bipp = depth;
+            rows->bipp = rows->depth;
             break;  // paletted
         case 4:
-            bipp = 2 * depth;
+            rows->bipp = 2 * rows->depth;
             break;  // grey+alpha
         case 6:
-            bipp = 4 * depth;
+            rows->bipp = 4 * rows->depth;
             break;  // RGBA
         default:
             FAIL();
     }
 
-    // Allocate bitmap (+1 width to save room for stupid PNG filter bytes)
-    bmp = tigrBitmap(get32(ihdr + 0) + 1, get32(ihdr + 4));
-    CHECK(bmp);
-    bmp->w--;
-
     // We support 8-bit color components and 1, 2, 4 and 8 bit palette formats.
     // No interlacing, or wacky filter types.
-    CHECK((depth != 16) && ihdr[10] == 0 && ihdr[11] == 0 && ihdr[12] == 0);
+    CHECK((rows->depth != 16) && ihdr[10] == 0 && ihdr[11] == 0 && ihdr[12] == 0);
 
-    // Join IDAT chunks.
-    for (idat = find(png, "IDAT", 0); idat; idat = find(png, "IDAT", 0)) {
-        unsigned len = get32(idat - 8);
-        data = (unsigned char*)realloc(data, datalen + len);
-        if (!data)
-            break;
+    // Row lengths and the bitmap size have to fit in an int.
+    CHECK(rows->w > 0 && rows->h > 0 && rows->bipp > 0);
+    CHECK(rows->w <= INT_MAX / 4 / rows->bipp && (size_t)rows->w * rows->h <= TIGR_MAX_PIXELS);
+    return 1;
 
-        memcpy(data + datalen, idat, len);
-        datalen += len;
+err:
+    return 0;
+}
+
+static int pngRow(PngRows* rows) {
+    unsigned char* tmp;
+    TPixel* dest;
+
+    if (rows->y >= rows->h || !unfilter(rows->len, rows->bpp, rows->cur, rows->prev + 1))
+        return 0;
+
+    dest = rows->target(rows, rows->y);
+    if (rows->ctype == 3) {
+        depalette(rows->w, 1, rows->cur, dest, rows->bipp, rows->plte, rows->trns, rows->trnsSize);
+    } else {
+        convert(rows->bipp / 8, rows->w, 1, rows->cur, dest, rows->trns);
     }
+    if (rows->done && !rows->done(rows, rows->y))
+        return 0;
+
+    tmp = rows->prev;
+    rows->prev = rows->cur;
+    rows->cur = tmp;
+    rows->fill = 0;
+    rows->y++;
+    return 1;
+}
+
+static int pngSink(void* ctx, const unsigned char* data, unsigned len) {
+    PngRows* rows = (PngRows*)ctx;
+    while (len > 0) {
+        unsigned n = rows->len + 1 - rows->fill;
+        if (n > len)
+            n = len;
+        memcpy(rows->cur + rows->fill, data, n);
+        rows->fill += n;
+        data += n;
+        len -= n;
+        if (rows->fill == rows->len + 1 && !pngRow(rows))
+            return 0;
+    }
+    return 1;
+}
+
+static int pngSource(void* ctx, const unsigned char** in, unsigned* len) {
+    PngRows* rows = (PngRows*)ctx;
+    const unsigned char* idat = find(rows->png, "IDAT", 0);
+    if (!idat)
+        return 0;
+    *in = idat;
+    *len = get32(idat - 8);
+    return 1;
+}
+
+// Decodes image data, after pngHeader has been called.
+static int pngDecode(PNG* png, PngRows* rows) {
+    const unsigned char *idat, *first;
+    unsigned char* buf = NULL;
+    unsigned outlen;
+
+    first = png->p;
+    rows->png = png;
 
     // Find palette.
-    png->p = first;
-    plte = find(png, "PLTE", 0);
+    rows->plte = find(png, "PLTE", 0);
 
     // Find transparency info.
     png->p = first;
-    trns = find(png, "tRNS", 0);
-    if (trns) {
-        trnsSize = get32(trns - 8);
+    rows->trns = find(png, "tRNS", 0);
+    if (rows->trns) {
+        rows->trnsSize = get32(rows->trns - 8);
     }
 
-    CHECK(data && datalen >= 6);
-    CHECK((data[0] & 0x0f) == 0x08     // compression method (RFC 1950)
-          && (data[0] & 0xf0) <= 0x70  // window size
-          && (data[1] & 0x20) == 0);   // preset dictionary present
+    // Image data is inflated straight out of the IDAT chunks, pulling in
+    // the following ones as needed.
+    png->p = first;
+    idat = find(png, "IDAT", 2);
+    CHECK(idat);
+    CHECK((idat[0] & 0x0f) == 0x08     // compression method (RFC 1950)
+          && (idat[0] & 0xf0) <= 0x70  // window size
+          && (idat[1] & 0x20) == 0);   // preset dictionary present
+    CHECK(rows->ctype == 3 ? rows->plte != NULL : rows->bipp % 8 == 0);
+
+    // Two raw rows for unfiltering.
+    rows->len = rowBytes(rows->w, rows->bipp);
+    rows->bpp = rowBytes(1, rows->bipp);
+    buf = (unsigned char*)calloc(2, rows->len + 1);
+    CHECK(buf);
+    rows->cur = buf;
+    rows->prev = buf + rows->len + 1;
+
+    outlen = rows->h > TIGR_INFLATE_WINDOW / (rows->len + 1) ? TIGR_INFLATE_WINDOW : (rows->len + 1) * rows->h;
+    errno = 0;
+    if (!tigrInflateStream(rows->inflate, outlen, idat + 2, get32(idat - 8) - 2, pngSource, pngSink, rows)) {
+        if (errno != ECANCELED && errno != ENOMEM)
+            errno = EINVAL;
+        goto err;
+    }
 
-    out = (unsigned char*)bmp->pix + outsize(bmp, 32) - outsize(bmp, bipp);
-    CHECK(tigrInflate(out, outsize(bmp, bipp), data + 2, datalen - 6));
-    CHECK(unfilter(bmp->w, bmp->h, bipp, out));
+    free(buf);
+    return 1;
 
-    if (ctype == 3) {
-        CHECK(plte);
-        depalette(bmp->w, bmp->h, out, bmp->pix, bipp, plte, trns, trnsSize);
-    } else {
-        CHECK(bipp % 8 == 0);
-        convert(bipp / 8, bmp->w, bmp->h, out, bmp->pix, trns);
-    }
+err:
+    free(buf);
+    return 0;
+}
 
-    free(data);
+static TPixel* bitmapTarget(PngRows* rows, int y) {
+    Tigr* bmp = (Tigr*)rows->user;
+    return bmp->pix + y * bmp->w;
+}
+
+static Tigr* tigrLoadPng(PNG* png, TigrInflateState* state) {
+    PngRows rows;
+    Tigr* bmp = NULL;
+
+    memset(&rows, 0, sizeof(rows));
+    rows.inflate = state;
+    CHECK(pngHeader(png, &rows));
+
+    bmp = tigrBitmap(rows.w, rows.h);
+    CHECK(bmp);
+
+    rows.target = bitmapTarget;
+    rows.user = bmp;
+    CHECK(pngDecode(png, &rows));
     return bmp;
 
 err:
-    if (data)
-        free(data);
     if (bmp)
         tigrFree(bmp);
     return NULL;
 }
 
+typedef struct {
+    TPixel* strip;
+    int stripRows;
+    TigrRowsFunc func;
+    void* user;
+} PngStrip;
+
+static TPixel* stripTarget(PngRows* rows, int y) {
+    PngStrip* strip = (PngStrip*)rows->user;
+    return strip->strip + (y % strip->stripRows) * rows->w;
+}
+
+static int stripDone(PngRows* rows, int y) {
+    PngStrip* strip = (PngStrip*)rows->user;
+    int count = y % strip->stripRows + 1;
+    if (count == strip->stripRows || y == rows->h - 1) {
+        if (!strip->func(strip->user, y + 1 - count, count, rows->w, strip->strip)) {
+            errno = ECANCELED;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Decodes rows of a 'w' pixels wide image straight into another bitmap, clipped like tigrBlit.
+// Rows that don't fit go through a scratch row first. PNG and QOI both use this.
+typedef struct {
+    Tigr* dest;
+    int dx, dy, w;
+    int x0, y0, x1, y1;
+    TPixel* row;
+} PngInto;
+
+static int intoStart(PngInto* into, Tigr* dest, int dx, int dy, int w) {
+    into->dest = dest;
+    into->dx = dx;
+    into->dy = dy;
+    into->w = w;
+    into->x0 = dest->cx > 0 ? dest->cx : 0;
+    into->y0 = dest->cy > 0 ? dest->cy : 0;
+    into->x1 = dest->cw >= 0 ? dest->cx + dest->cw : dest->w;
+    into->y1 = dest->ch >= 0 ? dest->cy + dest->ch : dest->h;
+    into->x1 = into->x1 < dest->w ? into->x1 : dest->w;
+    into->y1 = into->y1 < dest->h ? into->y1 : dest->h;
+    into->row = (TPixel*)malloc(w * sizeof(TPixel));
+    return into->row != NULL;
+}
+
+static int intoDirect(PngInto* into, int y) {
+    y += into->dy;
+    return y >= into->y0 && y < into->y1 && into->dx >= into->x0 && into->dx + into->w <= into->x1;
+}
+
+static TPixel* intoRow(void* user, int y) {
+    PngInto* into = (PngInto*)user;
+    if (intoDirect(into, y))
+        return into->dest->pix + (into->dy + y) * into->dest->w + into->dx;
+    return into->row;
+}
+
+static int intoRowDone(void* user, int y) {
+    PngInto* into = (PngInto*)user;
+    int x0 = into->dx, x1 = into->dx + into->w;
+
+    // Rows that were converted into the scratch row need clipping.
+    if (intoDirect(into, y) || into->dy + y < into->y0 || into->dy + y >= into->y1)
+        return 1;
+    x0 = x0 > into->x0 ? x0 : into->x0;
+    x1 = x1 < into->x1 ? x1 : into->x1;
+    if (x1 > x0) {
+        memcpy(into->dest->pix + (into->dy + y) * into->dest->w + x0, into->row + (x0 - into->dx),
+               (x1 - x0) * sizeof(TPixel));
+    }
+    return 1;
+}
+
+static TPixel* intoTarget(PngRows* rows, int y) {
+    return intoRow(rows->user, y);
+}
+
+static int intoDone(PngRows* rows, int y) {
+    return intoRowDone(rows->user, y);
+}
+
 #undef CHECK
 #undef FAIL
 
-Tigr* tigrLoadImageMem(const void* data, int length) {
+static int isQoi(const void* data, int length) {
+    return length >= 4 && memcmp(data, "qoif", 4) == 0;
+}
+
+Tigr* tigrDecodeImage(const void* data, int length, TigrInflateState* state) {
     PNG png;
+    if (isQoi(data, length))
+        return tigrLoadQoi(data, length);
     png.p = (unsigned char*)data;
     png.end = (unsigned char*)data + length;
-    return tigrLoadPng(&png);
+    return tigrLoadPng(&png, state);
 }
 
-Tigr* tigrLoadImage(const char* fileName) {
-    int len;
+Tigr* tigrLoadImageMem(const void* data, int length) {
+    return tigrDecodeImage(data, length, NULL);
+}
+
+// Maps or reads a whole file, from a mounted archive if it's in one, and decodes it with 'decode'.
+static int withFile(const char* fileName, int (*decode)(const void* data, int len, void* arg), void* arg) {
+    TigrArchive* archive = tigrFindMounted(fileName);
+    int len, ok;
+    const void* mapped;
     void* data;
-    Tigr* bmp;
+
+    if (archive) {
+        mapped = tigrArchiveRead(archive, fileName, &len);
+        ok = mapped && decode(mapped, len, arg);
+        if (mapped)
+            tigrArchiveRelease(archive, mapped);
+        tigrReleaseMounted(archive);
+        return ok;
+    }
+
+    mapped = tigrMapFile(fileName, &len);
+    if (mapped) {
+        ok = decode(mapped, len, arg);
+        tigrUnmapFile(mapped, len);
+        return ok;
+    }
 
     data = tigrReadFile(fileName, &len);
     if (!data)
-        return NULL;
+        return 0;
 
-    bmp = tigrLoadImageMem(data, len);
+    ok = decode(data, len, arg);
     free(data);
-    return bmp;
+    return ok;
 }
 
-//////// End of inlined file: tigr_loadpng.c ////////
+typedef struct {
+    TigrInflateState* state;
+    Tigr* bmp;
+} FileLoad;
 
-//////// Start of inlined file: tigr_savepng.c ////////
+static int decodeFile(const void* data, int len, void* arg) {
+    FileLoad* load = (FileLoad*)arg;
+    load->bmp = tigrDecodeImage(data, len, load->state);
+    return load->bmp != NULL;
+}
 
-//#include "tigr_internal.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
+Tigr* tigrDecodeImageFile(const char* fileName, TigrInflateState* state) {
+    FileLoad load = { state, NULL };
+    withFile(fileName, decodeFile, &load);
+    return load.bmp;
+}
 
-typedef struct {
-    unsigned crc, adler, bits, prev, runlen;
-    FILE* out;
-    unsigned crcTable[256];
-} Save;
+Tigr* tigrLoadImage(const char* fileName) {
+    return tigrDecodeImageFile(fileName, NULL);
+}
 
-static const unsigned crctable[16] = { 0,          0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
-                                       0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
-                                       0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c };
+int tigrLoadImageRowsMem(const void* data, int length, int stripRows, TigrRowsFunc func, void* user) {
+    PNG png;
+    PngRows rows;
+    PngStrip strip;
+    int ok;
 
-static void put(Save* s, unsigned v) {
-    fputc(v, s->out);
-    s->crc = (s->crc >> 4) ^ crctable[(s->crc & 15) ^ (v & 15)];
-    s->crc = (s->crc >> 4) ^ crctable[(s->crc & 15) ^ (v >> 4)];
+    png.p = (unsigned char*)data;
+    png.end = (unsigned char*)data + length;
+    memset(&rows, 0, sizeof(rows));
+    if (!pngHeader(&png, &rows))
+        return 0;
+
+    if (stripRows < 1)
+        stripRows = 1;
+    if (stripRows > rows.h)
+        stripRows = rows.h;
+
+    strip.strip = (TPixel*)malloc((size_t)stripRows * rows.w * sizeof(TPixel));
+    if (!strip.strip)
+        return 0;
+    strip.stripRows = stripRows;
+    strip.func = func;
+    strip.user = user;
+
+    rows.target = stripTarget;
+    rows.done = stripDone;
+    rows.user = &strip;
+    errno = 0;
+    ok = pngDecode(&png, &rows);
+
+    free(strip.strip);
+    return ok;
 }
 
-static void updateAdler(Save* s, unsigned v) {
-    unsigned s1 = s->adler & 0xffff, s2 = (s->adler >> 16) & 0xffff;
-    s1 = (s1 + v) % 65521;
-    s2 = (s2 + s1) % 65521;
-    s->adler = (s2 << 16) + s1;
+typedef struct {
+    int stripRows;
+    TigrRowsFunc func;
+    void* user;
+} FileRows;
+
+static int decodeFileRows(const void* data, int len, void* arg) {
+    FileRows* rows = (FileRows*)arg;
+    return tigrLoadImageRowsMem(data, len, rows->stripRows, rows->func, rows->user);
 }
 
-static void put32(Save* s, unsigned v) {
-    put(s, (v >> 24) & 0xff);
-    put(s, (v >> 16) & 0xff);
-    put(s, (v >> 8) & 0xff);
-    put(s, v & 0xff);
+int tigrLoadImageRows(const char* fileName, int stripRows, TigrRowsFunc func, void* user) {
+    FileRows rows = { stripRows, func, user };
+    return withFile(fileName, decodeFileRows, &rows);
 }
 
-void putbits(Save* s, unsigned data, unsigned bitcount) {
-    while (bitcount--) {
-        unsigned prev = s->bits;
-        s->bits = (s->bits >> 1) | ((data & 1) << 7);
-        data >>= 1;
-        if (prev & 1) {
-            put(s, s->bits);
-            s->bits = 0x80;
-        }
+int tigrImageInfoMem(const void* data, int length, int* w, int* h, int* colorType) {
+    PNG png;
+    PngRows rows;
+    int channels;
+
+    if (isQoi(data, length)) {
+        if (!tigrQoiInfo(data, length, w, h, &channels))
+            return 0;
+        if (colorType)
+            *colorType = channels == 3 ? 2 : 6;
+        return 1;
     }
-}
 
-void putbitsr(Save* s, unsigned data, unsigned bitcount) {
-    while (bitcount--)
-        putbits(s, data >> bitcount, 1);
-}
+    png.p = (unsigned char*)data;
+    png.end = (unsigned char*)data + length;
+    memset(&rows, 0, sizeof(rows));
+    if (!pngHeader(&png, &rows))
+        return 0;
 
-static void begin(Save* s, const char* id, unsigned len) {
-    put32(s, len);
-    s->crc = 0xffffffff;
-    put(s, id[0]);
-    put(s, id[1]);
-    put(s, id[2]);
-    put(s, id[3]);
+    if (w)
+        *w = rows.w;
+    if (h)
+        *h = rows.h;
+    if (colorType)
+        *colorType = rows.ctype;
+    return 1;
 }
 
-static void literal(Save* s, unsigned v) {
-    // Encode a literal/length using the built-in tables.
-    // Could do better with a custom table but whatever.
-    if (v < 144)
-        putbitsr(s, 0x030 + v - 0, 8);
-    else if (v < 256)
-        putbitsr(s, 0x190 + v - 144, 9);
-    else if (v < 280)
-        putbitsr(s, 0x000 + v - 256, 7);
-    else
-        putbitsr(s, 0x0c0 + v - 280, 8);
+static int decodeFileInfo(const void* data, int len, void* arg) {
+    int** out = (int**)arg;
+    return tigrImageInfoMem(data, len, out[0], out[1], out[2]);
 }
 
-static void encodelen(Save* s, unsigned code, unsigned bits, unsigned len) {
-    literal(s, code + (len >> bits));
-    putbits(s, len, bits);
-    putbits(s, 0, 5);
+int tigrImageInfo(const char* fileName, int* w, int* h, int* colorType) {
+    // Only the header gets read, so mapping the file touches just its first page.
+    int* out[3] = { w, h, colorType };
+    return withFile(fileName, decodeFileInfo, out);
 }
 
-static void endrun(Save* s) {
-    s->runlen--;
-    literal(s, s->prev);
+int tigrLoadImageMemInto(Tigr* dest, int dx, int dy, const void* data, int length) {
+    PNG png;
+    PngRows rows;
+    PngInto into;
+    int ok;
 
-    if (s->runlen >= 67)
-        encodelen(s, 277, 4, s->runlen - 67);
+    if (isQoi(data, length)) {
+        int w;
+        if (!tigrQoiInfo(data, length, &w, NULL, NULL) || !intoStart(&into, dest, dx, dy, w))
+            return 0;
+        ok = tigrLoadQoiRows(data, length, intoRow, intoRowDone, &into);
+        free(into.row);
+        return ok;
+    }
+
+    png.p = (unsigned char*)data;
+    png.end = (unsigned char*)data + length;
+    memset(&rows, 0, sizeof(rows));
+    if (!pngHeader(&png, &rows) || !intoStart(&into, dest, dx, dy, rows.w))
+        return 0;
+
+    rows.target = intoTarget;
+    rows.done = intoDone;
+    rows.user = &into;
+    ok = pngDecode(&png, &rows);
+
+    free(into.row);
+    return ok;
+}
+
+typedef struct {
+    Tigr* dest;
+    int dx, dy;
+} FileInto;
+
+static int decodeFileInto(const void* data, int len, void* arg) {
+    FileInto* into = (FileInto*)arg;
+    return tigrLoadImageMemInto(into->dest, into->dx, into->dy, data, len);
+}
+
+int tigrLoadImageInto(Tigr* dest, int dx, int dy, const char* fileName) {
+    FileInto into = { dest, dx, dy };
+    return withFile(fileName, decodeFileInto, &into);
+}
+
+//////// End of inlined file: tigr_loadpng.c ////////
+
+//////// Start of inlined file: tigr_savepng.c ////////
+
+//#include "tigr_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// DEFLATE compressor settings.
+#define WSIZE 32768
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define LOOKAHEAD (MAX_MATCH + MIN_MATCH + 1)
+#define MAX_SYMS 16384
+
+// LZ77 + Huffman compressor state, for compression lzLevels 2 and up.
+typedef struct {
+    unsigned char win[2 * WSIZE];
+    int head[HASH_SIZE];
+    int prev[WSIZE];
+    int pos, avail;
+    int chain, nice, lazy, good;
+    int nextLen, nextDist;  // match already found at pos, from lazy matching
+
+    // Symbols for the current block. Literals have a zero distance.
+    unsigned short lens[MAX_SYMS], dists[MAX_SYMS];
+    int numSyms;
+    unsigned litFreq[286], distFreq[30];
+
+    unsigned char lenCode[MAX_MATCH + 1], distCode[WSIZE + 1];
+} Deflate;
+
+// Compressed data is sent out in IDAT chunks of this size.
+#define IDAT_SIZE 65536
+
+typedef struct {
+    unsigned adler, bits, bitcount, prev, runlen;
+    int level, failed, raw, channels;
+    TigrWriteFunc write;
+    void* user;
+    Deflate* z;
+    unsigned char* stored;
+    int storedLen, idatLen;
+    unsigned char idat[IDAT_SIZE];
+} Save;
+
+// By compression level: chain length to search, length that ends the search early,
+// longest match to still look one byte further for a better one, and the match length
+// after which that second search is cut short.
+static const int lzLevels[10][4] = {
+    { 0, 0, 0, 0 },       { 0, 0, 0, 0 },        { 4, 16, 0, 0 },      { 8, 32, 0, 0 },
+    { 16, 16, 4, 4 },     { 32, 32, 16, 8 },     { 128, 128, 16, 8 },  { 256, 128, 32, 8 },
+    { 1024, 258, 128, 32 }, { 4096, 258, 258, 32 },
+};
+
+static const unsigned short lengthStart[29] = { 3,  4,  5,  6,  7,  8,  9,  10,  11,  13,  15,  17,  19,  23, 27,
+                                                31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                               2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distStart[30] = { 1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                              33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                              1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                             6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char lenOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static void output(Save* s, const void* data, int len) {
+    if (!s->failed && len > 0 && !s->write(s->user, data, len))
+        s->failed = 1;
+}
+
+static void store32(unsigned char* p, unsigned v) {
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static void writeChunk(Save* s, const char* id, const unsigned char* data, int len) {
+    unsigned char head[8], tail[4];
+    unsigned crc;
+    store32(head, len);
+    memcpy(head + 4, id, 4);
+    crc = tigrCrc32(0, head + 4, 4);
+    crc = tigrCrc32(crc, data, len);
+    store32(tail, crc);
+    output(s, head, 8);
+    output(s, data, len);
+    output(s, tail, 4);
+}
+
+// Sends out buffered compressed data, either as an IDAT chunk or as it is (for bands).
+static void flushIdat(Save* s) {
+    if (s->idatLen > 0 && s->raw)
+        output(s, s->idat, s->idatLen);
+    else if (s->idatLen > 0)
+        writeChunk(s, "IDAT", s->idat, s->idatLen);
+    s->idatLen = 0;
+}
+
+static void put(Save* s, unsigned v) {
+    s->idat[s->idatLen++] = (unsigned char)v;
+    if (s->idatLen == IDAT_SIZE)
+        flushIdat(s);
+}
+
+static void putBytes(Save* s, const unsigned char* data, int len) {
+    while (len > 0) {
+        int n = IDAT_SIZE - s->idatLen;
+        n = n < len ? n : len;
+        memcpy(s->idat + s->idatLen, data, n);
+        s->idatLen += n;
+        data += n;
+        len -= n;
+        if (s->idatLen == IDAT_SIZE)
+            flushIdat(s);
+    }
+}
+
+static void updateAdler(Save* s, const unsigned char* data, int len) {
+    unsigned s1 = s->adler & 0xffff, s2 = (s->adler >> 16) & 0xffff;
+    while (len > 0) {
+        // 5552 is the most bytes we can sum before s2 might overflow.
+        int n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n >= 8) {
+            s1 += data[0];
+            s2 += s1;
+            s1 += data[1];
+            s2 += s1;
+            s1 += data[2];
+            s2 += s1;
+            s1 += data[3];
+            s2 += s1;
+            s1 += data[4];
+            s2 += s1;
+            s1 += data[5];
+            s2 += s1;
+            s1 += data[6];
+            s2 += s1;
+            s1 += data[7];
+            s2 += s1;
+            data += 8;
+            n -= 8;
+        }
+        while (n--) {
+            s1 += *data++;
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+    }
+    s->adler = (s2 << 16) + s1;
+}
+
+static void put32(Save* s, unsigned v) {
+    put(s, (v >> 24) & 0xff);
+    put(s, (v >> 16) & 0xff);
+    put(s, (v >> 8) & 0xff);
+    put(s, v & 0xff);
+}
+
+static void putbits(Save* s, unsigned data, unsigned bitcount) {
+    s->bits |= data << s->bitcount;
+    s->bitcount += bitcount;
+    while (s->bitcount >= 8) {
+        put(s, s->bits & 0xff);
+        s->bits >>= 8;
+        s->bitcount -= 8;
+    }
+}
+
+static unsigned reverseBits(unsigned data, unsigned bitcount) {
+    unsigned r = 0;
+    while (bitcount--) {
+        r = (r << 1) | (data & 1);
+        data >>= 1;
+    }
+    return r;
+}
+
+static void putbitsr(Save* s, unsigned data, unsigned bitcount) {
+    putbits(s, reverseBits(data, bitcount), bitcount);
+}
+
+static void flushbits(Save* s) {
+    if (s->bitcount > 0)
+        put(s, s->bits & 0xff);
+    s->bits = 0;
+    s->bitcount = 0;
+}
+
+static void literal(Save* s, unsigned v) {
+    // Encode a literal/length using the built-in tables.
+    if (v < 144)
+        putbitsr(s, 0x030 + v - 0, 8);
+    else if (v < 256)
+        putbitsr(s, 0x190 + v - 144, 9);
+    else if (v < 280)
+        putbitsr(s, 0x000 + v - 256, 7);
+    else
+        putbitsr(s, 0x0c0 + v - 280, 8);
+}
+
+static void encodelen(Save* s, unsigned code, unsigned bits, unsigned len) {
+    literal(s, code + (len >> bits));
+    putbits(s, len & ((1 << bits) - 1), bits);
+    putbits(s, 0, 5);
+}
+
+static void endrun(Save* s) {
+    s->runlen--;
+    literal(s, s->prev);
+
+    if (s->runlen >= 67)
+        encodelen(s, 277, 4, s->runlen - 67);
     else if (s->runlen >= 35)
         encodelen(s, 273, 3, s->runlen - 35);
     else if (s->runlen >= 19)
@@ -1065,10 +1838,7 @@ static void endrun(Save* s) {
 }
 
 static void encodeByte(Save* s, unsigned char v) {
-    updateAdler(s, v);
-
-    // Simple RLE compression. We could do better by doing a search
-    // to find matches, but this works pretty well TBH.
+    // Simple RLE compression, used for the fastest level.
     if (s->prev == v && s->runlen < 115) {
         s->runlen++;
     } else {
@@ -1080,387 +1850,2888 @@ static void encodeByte(Save* s, unsigned char v) {
     }
 }
 
-static void savePngHeader(Save* s, Tigr* bmp) {
-    fwrite("\211PNG\r\n\032\n", 8, 1, s->out);
-    begin(s, "IHDR", 13);
-    put32(s, bmp->w);
-    put32(s, bmp->h);
-    put(s, 8);  // bit depth
-    put(s, 6);  // RGBA
-    put(s, 0);  // compression (deflate)
-    put(s, 0);  // filter (standard)
-    put(s, 0);  // interlace off
-    put32(s, ~s->crc);
-}
-
-static long savePngData(Save* s, Tigr* bmp, long dataPos) {
-    int x, y;
-    long dataSize;
-    begin(s, "IDAT", 0);
-    put(s, 0x08);      // zlib compression method
-    put(s, 0x1d);      // zlib compression flags
-    putbits(s, 3, 3);  // zlib last block + fixed dictionary
-    for (y = 0; y < bmp->h; y++) {
-        TPixel* row = &bmp->pix[y * bmp->w];
-        TPixel prev = tigrRGBA(0, 0, 0, 0);
-
-        encodeByte(s, 1);  // sub filter
-        for (x = 0; x < bmp->w; x++) {
-            encodeByte(s, row[x].r - prev.r);
-            encodeByte(s, row[x].g - prev.g);
-            encodeByte(s, row[x].b - prev.b);
-            encodeByte(s, row[x].a - prev.a);
-            prev = row[x];
-        }
-    }
-    endrun(s);
-    literal(s, 256);  // terminator
-    while (s->bits != 0x80)
-        putbits(s, 0, 1);
-    put32(s, s->adler);
-    dataSize = (ftell(s->out) - dataPos) - 8;
-    put32(s, ~s->crc);
-    return dataSize;
+// Uncompressed blocks, for level 0.
+static void storedBlock(Save* s, int last) {
+    putbits(s, last, 3);
+    flushbits(s);
+    put(s, s->storedLen & 0xff);
+    put(s, s->storedLen >> 8);
+    put(s, ~s->storedLen & 0xff);
+    put(s, (~s->storedLen >> 8) & 0xff);
+    putBytes(s, s->stored, s->storedLen);
+    s->storedLen = 0;
 }
 
-int tigrSaveImage(const char* fileName, Tigr* bmp) {
-    Save s;
-    long dataPos, dataSize, err;
-
-    // TODO - unicode?
-    FILE* out = fopen(fileName, "wb");
-    if (!out)
-        return 1;
+// Huffman code lengths -------------------------------------------------
 
-    s.out = out;
-    s.adler = 1;
-    s.bits = 0x80;
-    s.prev = 0xffff;
-    s.runlen = 0;
+typedef struct {
+    unsigned freq;
+    int sym;
+} Leaf;
+
+static int compareLeaves(const void* a, const void* b) {
+    const Leaf* la = (const Leaf*)a;
+    const Leaf* lb = (const Leaf*)b;
+    if (la->freq != lb->freq)
+        return la->freq < lb->freq ? -1 : 1;
+    return la->sym - lb->sym;
+}
+
+// Builds Huffman code lengths of at most 'limit' bits for 'n' symbols.
+static void huffLengths(const unsigned* freqs, int n, int limit, unsigned char* lens) {
+    Leaf leaves[286];
+    unsigned weight[2 * 286], freq[286];
+    int parent[2 * 286], depth[2 * 286];
+    int count, i, j, k, maxlen;
+
+    memcpy(freq, freqs, n * sizeof(unsigned));
+
+    // Make sure there are always at least two codes, so that the code is complete.
+    for (i = 0, count = 0; i < n; i++)
+        count += freq[i] != 0;
+    for (i = 0; count < 2 && i < n; i++) {
+        if (!freq[i]) {
+            freq[i] = 1;
+            count++;
+        }
+    }
 
-    savePngHeader(&s, bmp);
-    dataPos = ftell(s.out);
-    dataSize = savePngData(&s, bmp, dataPos);
+    for (;;) {
+        for (i = 0, count = 0; i < n; i++) {
+            lens[i] = 0;
+            if (freq[i]) {
+                leaves[count].freq = freq[i];
+                leaves[count].sym = i;
+                count++;
+            }
+        }
+        qsort(leaves, count, sizeof(Leaf), compareLeaves);
+
+        // Two-queue Huffman: leaves in order, then internal nodes in creation order.
+        for (i = 0; i < count; i++)
+            weight[i] = leaves[i].freq;
+        i = 0;
+        j = count;
+        for (k = count; k < 2 * count - 1; k++) {
+            int a, b;
+            a = (i < count && (j >= k || weight[i] <= weight[j])) ? i++ : j++;
+            b = (i < count && (j >= k || weight[i] <= weight[j])) ? i++ : j++;
+            weight[k] = weight[a] + weight[b];
+            parent[a] = parent[b] = k;
+        }
 
-    // End chunk.
-    begin(&s, "IEND", 0);
-    put32(&s, ~s.crc);
+        depth[2 * count - 2] = 0;
+        maxlen = 0;
+        for (k = 2 * count - 3; k >= 0; k--) {
+            depth[k] = depth[parent[k]] + 1;
+            if (k < count && depth[k] > maxlen)
+                maxlen = depth[k];
+        }
 
-    // Write back payload size.
-    fseek(out, dataPos, SEEK_SET);
-    put32(&s, dataSize);
+        if (maxlen <= limit) {
+            for (i = 0; i < count; i++)
+                lens[leaves[i].sym] = (unsigned char)depth[i];
+            return;
+        }
 
-    err = ferror(out);
-    fclose(out);
-    return !err;
+        // Too deep, so flatten the distribution and try again.
+        for (i = 0; i < n; i++) {
+            if (freq[i])
+                freq[i] = (freq[i] >> 1) | 1;
+        }
+    }
 }
 
-//////// End of inlined file: tigr_savepng.c ////////
-
-//////// Start of inlined file: tigr_inflate.c ////////
-
-//#include "tigr_internal.h"
-#include <stdlib.h>
-#include <setjmp.h>
-
-typedef struct {
-    unsigned bits, count;
-    const unsigned char *in, *inend;
-    unsigned char *out, *outend;
-    jmp_buf jmp;
-    unsigned litcodes[288], distcodes[32], lencodes[19];
-    int tlit, tdist, tlen;
-} State;
-
-#define FAIL() longjmp(s->jmp, 1)
-#define CHECK(X) \
-    if (!(X))    \
-    FAIL()
+// Turns code lengths into bit-reversed canonical codes, ready for putbits.
+static void huffCodes(const unsigned char* lens, int n, unsigned* codes) {
+    unsigned counts[16] = { 0 }, next[16];
+    int i;
+    for (i = 0; i < n; i++)
+        counts[lens[i]]++;
+    counts[0] = 0;
+    next[0] = 0;
+    for (i = 1; i < 16; i++)
+        next[i] = (next[i - 1] + counts[i - 1]) << 1;
+    for (i = 0; i < n; i++) {
+        if (lens[i])
+            codes[i] = reverseBits(next[lens[i]]++, lens[i]);
+    }
+}
 
-// Built-in DEFLATE standard tables.
-static char order[] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
-static char lenBits[29 + 2] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
-                                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 0, 0 };
-static int lenBase[29 + 2] = { 3,  4,  5,  6,  7,  8,  9,  10,  11,  13,  15,  17,  19,  23, 27, 31,
-                               35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0,  0 };
-static char distBits[30 + 2] = { 0, 0, 0, 0, 1, 1, 2,  2,  3,  3,  4,  4,  5,  5,  6, 6,
-                                 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 0, 0 };
-static int distBase[30 + 2] = {
-    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
-    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
-};
+// LZ77 -----------------------------------------------------------------
 
-// Table to bit-reverse a byte.
-static const unsigned char reverseTable[256] = {
-#define R2(n) n, n + 128, n + 64, n + 192
-#define R4(n) R2(n), R2(n + 32), R2(n + 16), R2(n + 48)
-#define R6(n) R4(n), R4(n + 8), R4(n + 4), R4(n + 12)
-    R6(0), R6(2), R6(1), R6(3)
-};
+static Deflate* lzInit(int level) {
+    Deflate* z = (Deflate*)malloc(sizeof(Deflate));
+    int code, n;
+    if (!z)
+        return NULL;
 
-static unsigned rev16(unsigned n) {
-    return (reverseTable[n & 0xff] << 8) | reverseTable[(n >> 8) & 0xff];
-}
+    memset(z->head, 0xff, sizeof(z->head));
+    z->pos = z->avail = 0;
+    z->numSyms = 0;
+    memset(z->litFreq, 0, sizeof(z->litFreq));
+    memset(z->distFreq, 0, sizeof(z->distFreq));
+    z->chain = lzLevels[level][0];
+    z->nice = lzLevels[level][1];
+    z->lazy = lzLevels[level][2];
+    z->good = lzLevels[level][3];
+    z->nextLen = -1;
 
-static int bits(State* s, int n) {
-    int v = s->bits & ((1 << n) - 1);
-    s->bits >>= n;
-    s->count -= n;
-    while (s->count < 16) {
-        CHECK(s->in != s->inend);
-        s->bits |= (*s->in++) << s->count;
-        s->count += 8;
+    for (code = 0; code < 29; code++) {
+        for (n = 0; n < (1 << lengthExtra[code]) && lengthStart[code] + n <= MAX_MATCH; n++)
+            z->lenCode[lengthStart[code] + n] = (unsigned char)code;
     }
-    return v;
+    z->lenCode[MAX_MATCH] = 28;
+    for (code = 0; code < 30; code++) {
+        for (n = 0; n < (1 << distExtra[code]); n++)
+            z->distCode[distStart[code] + n] = (unsigned char)code;
+    }
+    return z;
 }
 
-static unsigned char* emit(State* s, int len) {
-    s->out += len;
-    CHECK(s->out <= s->outend);
-    return s->out - len;
+static unsigned lzHash(const unsigned char* p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (HASH_SIZE - 1);
 }
 
-static void copy(State* s, const unsigned char* src, int len) {
-    unsigned char* dest = emit(s, len);
-    while (len--)
-        *dest++ = *src++;
+static void lzInsert(Deflate* z, int p) {
+    if (p + MIN_MATCH <= z->pos + z->avail) {
+        unsigned h = lzHash(z->win + p);
+        z->prev[p & (WSIZE - 1)] = z->head[h];
+        z->head[h] = p;
+    }
 }
 
-static int build(State* s, unsigned* tree, unsigned char* lens, unsigned int symcount) {
-    unsigned int codes[16], first[16], counts[16] = { 0 };
+static int lzMatch(Deflate* z, int p, int chain, int* dist) {
+    const unsigned char* win = z->win;
+    int maxlen = z->pos + z->avail - p;
+    int best = MIN_MATCH - 1;
+    int cur;
 
-    // Frequency count.
-    for (unsigned int n = 0; n < symcount; n++)
-        counts[lens[n]]++;
+    if (maxlen > MAX_MATCH)
+        maxlen = MAX_MATCH;
+    if (maxlen < MIN_MATCH)
+        return 0;
 
-    // Distribute codes.
-    counts[0] = codes[0] = first[0] = 0;
-    for (unsigned int n = 1; n <= 15; n++) {
-        codes[n] = (codes[n - 1] + counts[n - 1]) << 1;
-        first[n] = first[n - 1] + counts[n - 1];
+    for (cur = z->head[lzHash(win + p)]; cur >= 0 && cur > p - WSIZE && chain-- > 0;) {
+        int next;
+        if (win[cur + best] == win[p + best] && win[cur] == win[p] && win[cur + 1] == win[p + 1]) {
+            int len = 2;
+            while (len < maxlen && win[cur + len] == win[p + len])
+                len++;
+            if (len > best) {
+                best = len;
+                *dist = p - cur;
+                if (len >= z->nice || len >= maxlen)
+                    break;
+            }
+        }
+        next = z->prev[cur & (WSIZE - 1)];
+        if (next >= cur)
+            break;
+        cur = next;
+    }
+    return best >= MIN_MATCH ? best : 0;
+}
+
+static void lzBlock(Save* s, int last) {
+    Deflate* z = s->z;
+    unsigned char litLens[288], distLens[30], lens[286 + 30], clenLens[19];
+    unsigned litCodes[288], distCodes[30], clenCodes[19], clenFreq[19] = { 0 };
+    unsigned char rle[286 + 30], rleExtra[286 + 30];
+    unsigned long dynamicCost, fixedCost;
+    int hlit, hdist, hclen, numRle = 0, i, useFixed;
+
+    z->litFreq[256]++;
+    huffLengths(z->litFreq, 286, 15, litLens);
+    huffLengths(z->distFreq, 30, 15, distLens);
+
+    for (hlit = 286; hlit > 257 && !litLens[hlit - 1]; hlit--)
+        ;
+    for (hdist = 30; hdist > 1 && !distLens[hdist - 1]; hdist--)
+        ;
+
+    // Run-length encode the code lengths.
+    memcpy(lens, litLens, hlit);
+    memcpy(lens + hlit, distLens, hdist);
+    for (i = 0; i < hlit + hdist;) {
+        int run = 1;
+        while (i + run < hlit + hdist && lens[i + run] == lens[i])
+            run++;
+        if (lens[i] == 0 && run >= 3) {
+            run = run > 138 ? 138 : run;
+            rle[numRle] = run >= 11 ? 18 : 17;
+            rleExtra[numRle++] = (unsigned char)(run >= 11 ? run - 11 : run - 3);
+        } else if (run >= 4) {
+            run = run > 7 ? 7 : run;
+            rle[numRle] = lens[i];
+            rleExtra[numRle++] = 0;
+            rle[numRle] = 16;
+            rleExtra[numRle++] = (unsigned char)(run - 4);
+        } else {
+            run = 1;
+            rle[numRle] = lens[i];
+            rleExtra[numRle++] = 0;
+        }
+        i += run;
+    }
+    for (i = 0; i < numRle; i++)
+        clenFreq[rle[i]]++;
+    huffLengths(clenFreq, 19, 7, clenLens);
+    for (hclen = 19; hclen > 4 && !clenLens[lenOrder[hclen - 1]]; hclen--)
+        ;
+
+    // Pick whichever of the dynamic and fixed codes is smaller.
+    dynamicCost = 14 + 3 * hclen;
+    fixedCost = 0;
+    for (i = 0; i < 19; i++)
+        dynamicCost += clenFreq[i] * (clenLens[i] + (i == 16 ? 2 : i == 17 ? 3 : i == 18 ? 7 : 0));
+    for (i = 0; i < 286; i++) {
+        dynamicCost += z->litFreq[i] * litLens[i];
+        fixedCost += z->litFreq[i] * (i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+    }
+    for (i = 0; i < 30; i++) {
+        dynamicCost += z->distFreq[i] * distLens[i];
+        fixedCost += z->distFreq[i] * 5;
+    }
+    useFixed = fixedCost <= dynamicCost;
+
+    if (useFixed) {
+        // The fixed code covers 288 symbols, even though the last two are never used.
+        for (i = 0; i < 288; i++)
+            litLens[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        for (i = 0; i < 30; i++)
+            distLens[i] = 5;
+        putbits(s, last | (1 << 1), 3);
+    } else {
+        huffCodes(clenLens, 19, clenCodes);
+        putbits(s, last | (2 << 1), 3);
+        putbits(s, hlit - 257, 5);
+        putbits(s, hdist - 1, 5);
+        putbits(s, hclen - 4, 4);
+        for (i = 0; i < hclen; i++)
+            putbits(s, clenLens[lenOrder[i]], 3);
+        for (i = 0; i < numRle; i++) {
+            putbits(s, clenCodes[rle[i]], clenLens[rle[i]]);
+            if (rle[i] >= 16)
+                putbits(s, rleExtra[i], rle[i] == 16 ? 2 : rle[i] == 17 ? 3 : 7);
+        }
     }
-    CHECK(first[15] + counts[15] <= symcount);
+    huffCodes(litLens, useFixed ? 288 : 286, litCodes);
+    huffCodes(distLens, 30, distCodes);
 
-    // Insert keys into the tree for each symbol.
-    for (unsigned int n = 0; n < symcount; n++) {
-        int len = lens[n];
-        if (len != 0) {
-            unsigned code = codes[len]++, slot = first[len]++;
-            tree[slot] = (code << (32 - len)) | (n << 4) | len;
+    for (i = 0; i < z->numSyms; i++) {
+        unsigned len = z->lens[i], dist = z->dists[i];
+        if (dist == 0) {
+            putbits(s, litCodes[len], litLens[len]);
+        } else {
+            unsigned lc = z->lenCode[len], dc = z->distCode[dist];
+            putbits(s, litCodes[257 + lc], litLens[257 + lc]);
+            putbits(s, len - lengthStart[lc], lengthExtra[lc]);
+            putbits(s, distCodes[dc], distLens[dc]);
+            putbits(s, dist - distStart[dc], distExtra[dc]);
         }
     }
+    putbits(s, litCodes[256], litLens[256]);
 
-    return first[15];
+    z->numSyms = 0;
+    memset(z->litFreq, 0, sizeof(z->litFreq));
+    memset(z->distFreq, 0, sizeof(z->distFreq));
 }
 
-static int decode(State* s, unsigned tree[], int max) {
-    // Find the next prefix code.
-    unsigned lo = 0, hi = max, key;
-    unsigned search = (rev16(s->bits) << 16) | 0xffff;
-    while (lo < hi) {
-        unsigned guess = (lo + hi) / 2;
-        if (search < tree[guess])
-            hi = guess;
-        else
-            lo = guess + 1;
-    }
+static void lzTally(Save* s, unsigned len, unsigned dist) {
+    Deflate* z = s->z;
+    z->lens[z->numSyms] = (unsigned short)len;
+    z->dists[z->numSyms] = (unsigned short)dist;
+    z->numSyms++;
+    if (dist == 0) {
+        z->litFreq[len]++;
+    } else {
+        z->litFreq[257 + z->lenCode[len]]++;
+        z->distFreq[z->distCode[dist]]++;
+    }
+    if (z->numSyms == MAX_SYMS)
+        lzBlock(s, 0);
+}
+
+// Finds matches in the window, until less than a full match of lookahead is left.
+static void lzWindow(Save* s, int flush) {
+    Deflate* z = s->z;
+    while (z->avail >= LOOKAHEAD || (flush && z->avail > 0)) {
+        int dist = z->nextDist, len = z->nextLen;
+        if (len < 0)
+            len = lzMatch(z, z->pos, z->chain, &dist);
+        z->nextLen = -1;
+        lzInsert(z, z->pos);
+
+        if (len && len < z->lazy) {
+            // Emit a literal instead if there's a longer match at the next byte.
+            int dist2 = 0, len2 = lzMatch(z, z->pos + 1, len >= z->good ? z->chain >> 2 : z->chain, &dist2);
+            if (len2 > len) {
+                z->nextLen = len2;
+                z->nextDist = dist2;
+                len = 0;
+            }
+        }
 
-    // Pull out the key and check it.
-    key = tree[lo - 1];
-    CHECK(((search ^ key) >> (32 - (key & 0xf))) == 0);
+        if (len) {
+            lzTally(s, len, dist);
+            for (int i = 1; i < len; i++)
+                lzInsert(z, z->pos + i);
+        } else {
+            lzTally(s, z->win[z->pos], 0);
+            len = 1;
+        }
+        z->pos += len;
+        z->avail -= len;
+    }
+}
+
+static void lzSlide(Deflate* z) {
+    int i;
+    memmove(z->win, z->win + WSIZE, WSIZE);
+    z->pos -= WSIZE;
+    for (i = 0; i < HASH_SIZE; i++)
+        z->head[i] = z->head[i] >= WSIZE ? z->head[i] - WSIZE : -1;
+    for (i = 0; i < WSIZE; i++)
+        z->prev[i] = z->prev[i] >= WSIZE ? z->prev[i] - WSIZE : -1;
+}
+
+// Compresses a piece of (filtered) image data.
+static void compressData(Save* s, const unsigned char* data, int len) {
+    updateAdler(s, data, len);
+
+    if (s->level == 0) {
+        while (len > 0) {
+            int n = 65535 - s->storedLen;
+            n = n < len ? n : len;
+            memcpy(s->stored + s->storedLen, data, n);
+            s->storedLen += n;
+            data += n;
+            len -= n;
+            if (s->storedLen == 65535)
+                storedBlock(s, 0);
+        }
+    } else if (s->level == 1) {
+        while (len--)
+            encodeByte(s, *data++);
+    } else {
+        Deflate* z = s->z;
+        while (len > 0) {
+            int n = 2 * WSIZE - (z->pos + z->avail);
+            if (n == 0) {
+                lzSlide(z);
+                n = WSIZE;
+            }
+            n = n < len ? n : len;
+            memcpy(z->win + z->pos + z->avail, data, n);
+            z->avail += n;
+            data += n;
+            len -= n;
+            lzWindow(s, 0);
+        }
+    }
+}
 
-    bits(s, key & 0xf);
-    return (key >> 4) & 0xfff;
+static void startData(Save* s, int last) {
+    if (s->level == 1)
+        putbits(s, last | (1 << 1), 3);  // fixed dictionary
 }
 
-static void run(State* s, int sym) {
-    int length = bits(s, lenBits[sym]) + lenBase[sym];
-    int dsym = decode(s, s->distcodes, s->tdist);
-    int offs = bits(s, distBits[dsym]) + distBase[dsym];
-    copy(s, s->out - offs, length);
+// Ends the compressed data. If it isn't the last part of the stream, it ends
+// byte aligned after an empty stored block, so that more can be appended.
+static void finishData(Save* s, int last) {
+    if (s->level == 0) {
+        storedBlock(s, last);
+    } else if (s->level == 1) {
+        endrun(s);
+        literal(s, 256);  // terminator
+    } else {
+        lzWindow(s, 1);
+        lzBlock(s, last);
+    }
+    if (!last && s->level != 0) {
+        putbits(s, 0, 3);
+        flushbits(s);
+        put32(s, 0x0000ffff);
+    }
+    flushbits(s);
 }
 
-static void block(State* s) {
-    for (;;) {
-        int sym = decode(s, s->litcodes, s->tlit);
-        if (sym < 256)
-            *emit(s, 1) = (unsigned char)sym;
-        else if (sym > 256)
-            run(s, sym - 257);
-        else
-            break;
+typedef struct {
+    unsigned char* data;
+    int len, cap;
+} MemWriter;
+
+static int memWrite(void* user, const void* data, int len) {
+    MemWriter* m = (MemWriter*)user;
+    if (len > m->cap - m->len) {
+        int cap = m->cap ? m->cap : 65536;
+        unsigned char* grown;
+        while (cap - m->len < len)
+            cap *= 2;
+        grown = (unsigned char*)realloc(m->data, cap);
+        if (!grown)
+            return 0;
+        m->data = grown;
+        m->cap = cap;
     }
+    memcpy(m->data + m->len, data, len);
+    m->len += len;
+    return 1;
 }
 
-static void stored(State* s) {
-    // Uncompressed data block.
-    int len;
-    bits(s, s->count & 7);
-    len = bits(s, 16);
-    CHECK(((len ^ s->bits) & 0xffff) == 0xffff);
-    CHECK(s->in + len <= s->inend);
+static void savePngHeader(Save* s, Tigr* bmp) {
+    unsigned char ihdr[13];
+    store32(ihdr, bmp->w);
+    store32(ihdr + 4, bmp->h);
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = s->channels == 1 ? 0 : s->channels == 2 ? 4 : s->channels == 3 ? 2 : 6;  // color type
+    ihdr[10] = 0;  // compression (deflate)
+    ihdr[11] = 0;  // filter (standard)
+    ihdr[12] = 0;  // interlace off
+    output(s, "\211PNG\r\n\032\n", 8);
+    writeChunk(s, "IHDR", ihdr, 13);
+}
+
+static void zlibHeader(Save* s) {
+    if (s->level == 1) {
+        put(s, 0x08);  // zlib compression method, 256 byte window
+        put(s, 0x1d);  // zlib compression flags
+    } else {
+        put(s, 0x78);  // zlib compression method, 32k window
+        put(s, s->level == 0 ? 0x01 : s->level < 6 ? 0x5e : s->level == 6 ? 0x9c : 0xda);  // compression flags
+    }
+}
 
-    copy(s, s->in, len);
-    s->in += len;
-    bits(s, 16);
+// Picks the fewest channels that hold the image exactly: grey, grey+alpha, RGB or RGBA.
+static int pngChannels(Tigr* bmp) {
+    int opaque = 1, grey = 1;
+    TPixel* p = bmp->pix;
+    for (int i = bmp->w * bmp->h; i > 0 && (opaque || grey); i--, p++) {
+        opaque &= p->a == 255;
+        grey &= p->r == p->g && p->g == p->b;
+    }
+    return (grey ? 1 : 3) + !opaque;
 }
 
-static void fixed(State* s) {
-    // Fixed set of Huffman codes.
-    int n;
-    unsigned char lens[288 + 32];
-    for (n = 0; n <= 143; n++)
-        lens[n] = 8;
-    for (n = 144; n <= 255; n++)
-        lens[n] = 9;
-    for (n = 256; n <= 279; n++)
-        lens[n] = 7;
-    for (n = 280; n <= 287; n++)
-        lens[n] = 8;
-    for (n = 0; n < 32; n++)
-        lens[288 + n] = 5;
+static void packRow(unsigned char* out, const TPixel* src, int w, int channels) {
+    int x;
+    switch (channels) {
+        case 1:
+            for (x = 0; x < w; x++)
+                *out++ = src[x].r;
+            break;
+        case 2:
+            for (x = 0; x < w; x++) {
+                *out++ = src[x].r;
+                *out++ = src[x].a;
+            }
+            break;
+        case 3:
+            for (x = 0; x < w; x++) {
+                *out++ = src[x].r;
+                *out++ = src[x].g;
+                *out++ = src[x].b;
+            }
+            break;
+        default:
+            memcpy(out, src, w * sizeof(TPixel));
+            break;
+    }
+}
 
-    // Build lit/dist trees.
-    s->tlit = build(s, s->litcodes, lens, 288);
-    s->tdist = build(s, s->distcodes, lens + 288, 32);
+static int predictPaeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
 }
 
-static void dynamic(State* s) {
-    int n, i, nlit, ndist, nlen;
-    unsigned char lenlens[19] = { 0 }, lens[288 + 32];
-    nlit = 257 + bits(s, 5);
-    ndist = 1 + bits(s, 5);
-    nlen = 4 + bits(s, 4);
-    for (n = 0; n < nlen; n++)
-        lenlens[(int) order[n]] = (unsigned char)bits(s, 3);
+static unsigned absSum(const unsigned char* data, int len) {
+    unsigned sum = 0;
+    for (int i = 0; i < len; i++)
+        sum += abs((signed char)data[i]);
+    return sum;
+}
+
+// Filters a row, which has a spare byte before it for the filter type. Levels 2 and up
+// try every filter and keep the one with the smallest sum of absolute differences.
+static unsigned char* filterRow(unsigned char* out[5], unsigned char* cur, const unsigned char* prev, int len, int bpp,
+                                int level) {
+    unsigned char *sub = out[1] + 1, *up = out[2] + 1, *avg = out[3] + 1, *pae = out[4] + 1;
+    unsigned best, sum;
+    int i, f, pick;
+
+    if (level == 0) {
+        cur[-1] = 0;
+        return cur - 1;
+    }
+
+    out[1][0] = 1;
+    for (i = 0; i < bpp && i < len; i++)
+        sub[i] = cur[i];
+    for (; i < len; i++)
+        sub[i] = cur[i] - cur[i - bpp];
+    if (level == 1)
+        return out[1];
+
+    for (i = 0; i < bpp && i < len; i++) {
+        up[i] = cur[i] - prev[i];
+        avg[i] = cur[i] - (prev[i] >> 1);
+        pae[i] = cur[i] - prev[i];
+    }
+    for (; i < len; i++) {
+        up[i] = cur[i] - prev[i];
+        avg[i] = cur[i] - ((cur[i - bpp] + prev[i]) >> 1);
+        pae[i] = cur[i] - predictPaeth(cur[i - bpp], prev[i], prev[i - bpp]);
+    }
+
+    cur[-1] = 0;
+    best = absSum(cur, len);
+    pick = 0;
+    for (f = 1; f < 5; f++) {
+        sum = absSum(out[f] + 1, len);
+        if (sum < best) {
+            best = sum;
+            pick = f;
+        }
+    }
+    if (pick == 0)
+        return cur - 1;
+    out[pick][0] = (unsigned char)pick;
+    return out[pick];
+}
 
-    // Build the tree for decoding code lengths.
-    s->tlen = build(s, s->lencodes, lenlens, 19);
+// Filters and compresses rows [y0, y1).
+static int compressRows(Save* s, Tigr* bmp, int y0, int y1) {
+    int y, f, len = bmp->w * s->channels;
+    unsigned char *buf, *out[5], *cur, *prev;
 
-    // Decode code lengths.
-    for (n = 0; n < nlit + ndist;) {
-        int sym = decode(s, s->lencodes, s->tlen);
-        switch (sym) {
-            case 16:
-                for (i = 3 + bits(s, 2); i; i--, n++)
-                    lens[n] = lens[n - 1];
-                break;
-            case 17:
-                for (i = 3 + bits(s, 3); i; i--, n++)
-                    lens[n] = 0;
-                break;
-            case 18:
-                for (i = 11 + bits(s, 7); i; i--, n++)
-                    lens[n] = 0;
-                break;
-            default:
-                lens[n++] = (unsigned char)sym;
+    buf = (unsigned char*)calloc(7, len + 1);
+    if (!buf)
+        return 0;
+    for (f = 0; f < 5; f++)
+        out[f] = buf + f * (len + 1);
+    cur = buf + 5 * (len + 1) + 1;
+    prev = buf + 6 * (len + 1) + 1;
+
+    // Bands start from the previous row, so Up/Average/Paeth still work across them.
+    if (y0 > 0)
+        packRow(prev, &bmp->pix[(y0 - 1) * bmp->w], bmp->w, s->channels);
+
+    for (y = y0; y < y1 && !s->failed; y++) {
+        unsigned char* row;
+        packRow(cur, &bmp->pix[y * bmp->w], bmp->w, s->channels);
+        row = filterRow(out, cur, prev, len, s->channels, s->level);
+        compressData(s, row, len + 1);
+
+        row = prev;
+        prev = cur;
+        cur = row;
+    }
+    free(buf);
+    return 1;
+}
+
+static Save* newSave(int level, TigrWriteFunc write, void* user) {
+    Save* s = (Save*)malloc(sizeof(Save));
+    if (!s)
+        return NULL;
+    s->adler = 1;
+    s->bits = s->bitcount = 0;
+    s->prev = 0xffff;
+    s->runlen = 0;
+    s->level = level;
+    s->failed = s->raw = 0;
+    s->write = write;
+    s->user = user;
+    s->z = level >= 2 ? lzInit(level) : NULL;
+    s->stored = level == 0 ? (unsigned char*)malloc(65535) : NULL;
+    s->storedLen = s->idatLen = 0;
+    if (level != 1 && !s->stored && !s->z) {
+        free(s->z);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void freeSave(Save* s) {
+    free(s->stored);
+    free(s->z);
+    free(s);
+}
+
+// Compresses bands of rows in parallel.
+typedef struct {
+    Tigr* bmp;
+    int level, channels, bandRows, numBands, next;
+    TigrMutex lock;
+    TigrCond cond;
+    MemWriter* out;
+    unsigned* adlers;
+    unsigned char* done;  // 1 when compressed, 2 on failure
+} Bands;
+
+// Adler32 of two pieces of data joined together, where the second is 'len2' bytes long.
+static unsigned combineAdler(unsigned adler1, unsigned adler2, unsigned long len2) {
+    unsigned long rem = len2 % 65521;
+    unsigned long s1 = adler1 & 0xffff;
+    unsigned long s2 = (rem * s1) % 65521;
+    s1 = (s1 + (adler2 & 0xffff) + 65521 - 1) % 65521;
+    s2 = (s2 + ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + 65521 - rem) % 65521;
+    return (unsigned)((s2 << 16) | s1);
+}
+
+static void compressBand(Bands* b, int i) {
+    int y0 = i * b->bandRows, y1, ok = 0;
+    Save* s;
+
+    y1 = y0 + b->bandRows < b->bmp->h ? y0 + b->bandRows : b->bmp->h;
+    s = newSave(b->level, memWrite, &b->out[i]);
+    if (s) {
+        s->raw = 1;
+        s->channels = b->channels;
+        startData(s, 0);
+        ok = compressRows(s, b->bmp, y0, y1);
+        finishData(s, 0);
+        flushIdat(s);
+        ok = ok && !s->failed;
+        b->adlers[i] = s->adler;
+        freeSave(s);
+    }
+
+    tigrMutexLock(&b->lock);
+    b->done[i] = ok ? 1 : 2;
+    tigrCondBroadcast(&b->cond);
+    tigrMutexUnlock(&b->lock);
+}
+
+static void bandWorker(void* arg) {
+    Bands* b = (Bands*)arg;
+    for (;;) {
+        int i;
+        tigrMutexLock(&b->lock);
+        i = b->next++;
+        tigrMutexUnlock(&b->lock);
+        if (i >= b->numBands)
+            break;
+        compressBand(b, i);
+    }
+}
+
+static void bandRange(void* ctx, int begin, int end) {
+    for (int i = begin; i < end; i++)
+        compressBand((Bands*)ctx, i);
+}
+
+// Compresses on 'threads' threads of its own, or on the thread pool if 'threads' is zero.
+static int savePngBands(Save* s, Tigr* bmp, int threads) {
+    Bands b;
+    TigrThread* workers;
+    int numThreads = 0, ok = 1, i, pool = threads == 0;
+    unsigned long rowBytes = 1 + (unsigned long)bmp->w * s->channels;
+
+    // Keep bands big enough that splitting doesn't hurt compression much.
+    if (pool)
+        threads = tigrGetThreads();
+    b.bmp = bmp;
+    b.level = s->level;
+    b.channels = s->channels;
+    b.bandRows = (bmp->h + threads * 4 - 1) / (threads * 4);
+    if ((unsigned long)b.bandRows * rowBytes < 131072)
+        b.bandRows = (int)((131072 + rowBytes - 1) / rowBytes);
+    b.numBands = (bmp->h + b.bandRows - 1) / b.bandRows;
+    b.next = 0;
+    b.out = (MemWriter*)calloc(b.numBands, sizeof(MemWriter));
+    b.adlers = (unsigned*)calloc(b.numBands, sizeof(unsigned));
+    b.done = (unsigned char*)calloc(b.numBands, 1);
+    workers = (TigrThread*)calloc(threads, sizeof(TigrThread));
+    if (!b.out || !b.adlers || !b.done || !workers) {
+        free(b.out);
+        free(b.adlers);
+        free(b.done);
+        free(workers);
+        return 0;
+    }
+    tigrMutexInit(&b.lock);
+    tigrCondInit(&b.cond);
+
+    if (pool) {
+        tigrParallelFor(0, b.numBands, 1, bandRange, &b);
+    } else {
+        for (i = 0; i < threads && i < b.numBands; i++) {
+            if (!tigrThreadStart(&workers[i], bandWorker, &b))
                 break;
+            numThreads++;
         }
+        if (numThreads == 0)
+            bandWorker(&b);
+    }
+
+    // Join the bands up in order, as they finish.
+    zlibHeader(s);
+    for (i = 0; i < b.numBands; i++) {
+        tigrMutexLock(&b.lock);
+        while (!b.done[i])
+            tigrCondWait(&b.cond, &b.lock);
+        tigrMutexUnlock(&b.lock);
+
+        ok = ok && b.done[i] == 1;
+        if (ok) {
+            int y0 = i * b.bandRows;
+            int rows = y0 + b.bandRows < bmp->h ? b.bandRows : bmp->h - y0;
+            putBytes(s, b.out[i].data, b.out[i].len);
+            s->adler = i == 0 ? b.adlers[i] : combineAdler(s->adler, b.adlers[i], rowBytes * rows);
+        }
+        free(b.out[i].data);
+        b.out[i].data = NULL;
     }
 
-    // Build lit/dist trees.
-    s->tlit = build(s, s->litcodes, lens, nlit);
-    s->tdist = build(s, s->distcodes, lens + nlit, ndist);
+    // An empty final block ends the stream.
+    putbits(s, 1 | (1 << 1), 3);
+    putbits(s, 0, 7);
+    flushbits(s);
+    put32(s, s->adler);
+    flushIdat(s);
+
+    for (i = 0; i < numThreads; i++)
+        tigrThreadJoin(workers[i]);
+    tigrCondDestroy(&b.cond);
+    tigrMutexDestroy(&b.lock);
+    free(b.out);
+    free(b.adlers);
+    free(b.done);
+    free(workers);
+    return ok;
+}
+
+static int savePngData(Save* s, Tigr* bmp, int threads) {
+    int ok;
+    if ((threads ? threads : tigrGetThreads()) > 1 && (unsigned long)bmp->h * (1 + bmp->w * s->channels) >= 2 * 131072)
+        return savePngBands(s, bmp, threads);
+
+    zlibHeader(s);
+    startData(s, 1);
+    ok = compressRows(s, bmp, 0, bmp->h);
+    finishData(s, 1);
+    put32(s, s->adler);
+    flushIdat(s);
+    return ok;
 }
 
-int tigrInflate(void* out, unsigned outlen, const void* in, unsigned inlen) {
-    int last;
-    State* s = (State*)calloc(1, sizeof(State));
+// Encodes a PNG, in order, through 'write'. Returns 1 on success, 0 if out of memory,
+// and -1 if 'write' failed.
+static int savePng(Tigr* bmp, int level, int threads, TigrWriteFunc write, void* user) {
+    Save* s = newSave(level, write, user);
+    int ok;
 
-    // We assume we can buffer 2 extra bytes from off the end of 'in'.
-    s->in = (unsigned char*)in;
-    s->inend = s->in + inlen + 2;
-    s->out = (unsigned char*)out;
-    s->outend = s->out + outlen;
-    s->bits = 0;
-    s->count = 0;
-    bits(s, 0);
+    if (!s)
+        return 0;
+    s->channels = pngChannels(bmp);
+    savePngHeader(s, bmp);
+    ok = savePngData(s, bmp, threads);
+    writeChunk(s, "IEND", NULL, 0);
+    if (s->failed)
+        ok = -1;
+    freeSave(s);
+    return ok;
+}
+
+int tigrSaveImageFunc(Tigr* bmp, int level, TigrWriteFunc func, void* user) {
+    int ok;
+    if (level < 0 || level > 9) {
+        errno = EINVAL;
+        return 0;
+    }
+    ok = savePng(bmp, level, 0, func, user);
+    if (ok <= 0)
+        errno = ok < 0 ? ECANCELED : ENOMEM;
+    return ok > 0;
+}
 
-    if (setjmp(s->jmp) == 1) {
-        free(s);
+void* tigrSaveImageMem(Tigr* bmp, int level, int* length) {
+    MemWriter m = { NULL, 0, 0 };
+    if (level < 0 || level > 9) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (savePng(bmp, level, 0, memWrite, &m) <= 0) {
+        free(m.data);
+        errno = ENOMEM;
+        return NULL;
+    }
+    *length = m.len;
+    return m.data;
+}
+
+static int fileWrite(void* user, const void* data, int len) {
+    return fwrite(data, 1, len, (FILE*)user) == (size_t)len;
+}
+
+// Saves to a file, on 'threads' threads, or on the thread pool if 'threads' is zero.
+static int saveFile(const char* fileName, Tigr* bmp, int level, int threads) {
+    FILE* out;
+    int ok;
+
+    if (level < 0 || level > 9) {
+        errno = EINVAL;
         return 0;
     }
 
-    do {
-        last = bits(s, 1);
-        switch (bits(s, 2)) {
-            case 0:
-                stored(s);
-                break;
-            case 1:
-                fixed(s);
-                block(s);
-                break;
-            case 2:
-                dynamic(s);
-                block(s);
-                break;
-            case 3:
-                FAIL();
-        }
-    } while (!last);
+    out = tigrOpenFile(fileName, "wb");
+    if (!out)
+        return 0;
 
-    free(s);
+    ok = savePng(bmp, level, threads, fileWrite, out);
+    if (fclose(out) != 0 && ok > 0)
+        ok = -1;
+    if (ok == 0)
+        errno = ENOMEM;
+    else if (ok < 0)
+        errno = EIO;
+    return ok > 0;
+}
+
+int tigrSaveImageThreads(const char* fileName, Tigr* bmp, int level, int threads) {
+    return saveFile(fileName, bmp, level, threads > 0 ? threads : tigrCpuCount());
+}
+
+int tigrSaveImageLevel(const char* fileName, Tigr* bmp, int level) {
+    return saveFile(fileName, bmp, level, 0);
+}
+
+int tigrSaveImage(const char* fileName, Tigr* bmp) {
+    return tigrSaveImageLevel(fileName, bmp, 1);
+}
+
+#undef WSIZE
+#undef HASH_BITS
+#undef HASH_SIZE
+#undef MIN_MATCH
+#undef MAX_MATCH
+#undef LOOKAHEAD
+#undef MAX_SYMS
+#undef IDAT_SIZE
+
+//////// End of inlined file: tigr_savepng.c ////////
+
+//////// Start of inlined file: tigr_loadqoi.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// QOI, the "Quite OK Image" format.
+#define QOI_HEADER 14
+#define QOI_PADDING 8
+#define QOI_HASH(p) (((p).r * 3 + (p).g * 5 + (p).b * 7 + (p).a * 11) & 63)
+
+static unsigned qoiGet32(const unsigned char* v) {
+    return (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
+}
+
+int tigrQoiInfo(const void* data, int length, int* w, int* h, int* channels) {
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned width, height;
+
+    if (length < QOI_HEADER || memcmp(p, "qoif", 4) != 0)
+        goto err;
+    width = qoiGet32(p + 4);
+    height = qoiGet32(p + 8);
+    if (width == 0 || height == 0 || height >= TIGR_MAX_PIXELS / width)
+        goto err;
+    if ((p[12] != 3 && p[12] != 4) || p[13] > 1)
+        goto err;
+
+    if (w)
+        *w = (int)width;
+    if (h)
+        *h = (int)height;
+    if (channels)
+        *channels = p[12];
     return 1;
+
+err:
+    errno = EINVAL;
+    return 0;
 }
 
-#undef CHECK
-#undef FAIL
+int tigrLoadQoiRows(const void* data, int length, TigrQoiTarget target, TigrQoiDone done, void* user) {
+    const unsigned char *p = (const unsigned char*)data, *end = p + length;
+    TPixel index[64], px;
+    int w, h, run = 0;
 
-//////// End of inlined file: tigr_inflate.c ////////
+    if (!tigrQoiInfo(data, length, &w, &h, NULL))
+        return 0;
 
-//////// Start of inlined file: tigr_print.c ////////
+    memset(index, 0, sizeof(index));
+    px = tigrRGBA(0, 0, 0, 255);
+    p += QOI_HEADER;
+
+    for (int y = 0; y < h; y++) {
+        TPixel* out = target(user, y);
+        for (int x = 0; x < w; x++) {
+            int b1;
+            if (run > 0) {
+                run--;
+                out[x] = px;
+                continue;
+            }
+            if (end - p < 5)
+                goto err;
+
+            b1 = *p++;
+            if (b1 == 0xfe) {
+                px.r = p[0];
+                px.g = p[1];
+                px.b = p[2];
+                p += 3;
+            } else if (b1 == 0xff) {
+                px.r = p[0];
+                px.g = p[1];
+                px.b = p[2];
+                px.a = p[3];
+                p += 4;
+            } else {
+                switch (b1 & 0xc0) {
+                    case 0x00:  // index
+                        px = index[b1];
+                        break;
+                    case 0x40:  // small difference
+                        px.r += ((b1 >> 4) & 3) - 2;
+                        px.g += ((b1 >> 2) & 3) - 2;
+                        px.b += (b1 & 3) - 2;
+                        break;
+                    case 0x80: {  // difference, relative to green
+                        int b2 = *p++;
+                        int vg = (b1 & 0x3f) - 32;
+                        px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                        px.g += vg;
+                        px.b += vg - 8 + (b2 & 0x0f);
+                        break;
+                    }
+                    default:  // run, which can carry on into the next rows
+                        run = b1 & 0x3f;
+                        break;
+                }
+            }
+            index[QOI_HASH(px)] = px;
+            out[x] = px;
+        }
+        if (done && !done(user, y))
+            return 0;
+    }
+    if (run > 0)
+        goto err;
+    return 1;
+
+err:
+    errno = EINVAL;
+    return 0;
+}
+
+static TPixel* qoiBitmapRow(void* user, int y) {
+    Tigr* bmp = (Tigr*)user;
+    return bmp->pix + y * bmp->w;
+}
+
+Tigr* tigrLoadQoi(const void* data, int length) {
+    int w, h;
+    Tigr* bmp;
+
+    if (!tigrQoiInfo(data, length, &w, &h, NULL))
+        return NULL;
+    bmp = tigrBitmap(w, h);
+    if (!bmp)
+        return NULL;
+    if (!tigrLoadQoiRows(data, length, qoiBitmapRow, NULL, bmp)) {
+        tigrFree(bmp);
+        errno = EINVAL;
+        return NULL;
+    }
+    return bmp;
+}
+
+#undef QOI_HEADER
+#undef QOI_PADDING
+#undef QOI_HASH
+
+//////// End of inlined file: tigr_loadqoi.c ////////
+
+//////// Start of inlined file: tigr_saveqoi.c ////////
 
 //#include "tigr_internal.h"
-//////// Start of inlined file: tigr_font.h ////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
-// Auto-generated by incbin.pl from font.png
+#define QOI_HASH(p) (((p).r * 3 + (p).g * 5 + (p).b * 7 + (p).a * 11) & 63)
+#define QOI_SAME(p, q) ((p).r == (q).r && (p).g == (q).g && (p).b == (q).b && (p).a == (q).a)
 
-const unsigned char tigr_font[] = {
-	0x89,0x50,0x4e,0x47,0x0d,0x0a,0x1a,0x0a,0x00,0x00,0x00,0x0d,0x49,0x48,0x44,0x52,
-	0x00,0x00,0x00,0xfd,0x00,0x00,0x00,0x5c,0x08,0x03,0x00,0x00,0x00,0x92,0xab,0x43,
-	0x85,0x00,0x00,0x03,0x00,0x50,0x4c,0x54,0x45,0x5f,0x53,0x87,0x00,0x00,0x00,0x54,
-	0x54,0x54,0xff,0xff,0xfa,0x31,0x2a,0x42,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
-	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
-	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
-	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+static void qoiPut32(unsigned char* p, unsigned v) {
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+void* tigrSaveQoiMem(Tigr* bmp, int* length) {
+    int i, count = bmp->w * bmp->h, run = 0, opaque = 1;
+    TPixel index[64], prev;
+    unsigned char *data, *p;
+
+    for (i = 0; i < count && opaque; i++)
+        opaque = bmp->pix[i].a == 255;
+
+    // Worst case is a full RGBA op for every pixel.
+    data = (unsigned char*)malloc(14 + (size_t)count * 5 + 8);
+    if (!data) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    p = data;
+    memcpy(p, "qoif", 4);
+    qoiPut32(p + 4, bmp->w);
+    qoiPut32(p + 8, bmp->h);
+    p[12] = opaque ? 3 : 4;  // channels
+    p[13] = 0;               // sRGB with linear alpha
+    p += 14;
+
+    memset(index, 0, sizeof(index));
+    prev = tigrRGBA(0, 0, 0, 255);
+
+    for (i = 0; i < count; i++) {
+        TPixel px = bmp->pix[i];
+
+        if (QOI_SAME(px, prev)) {
+            if (++run == 62) {
+                *p++ = 0xc0 | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run) {
+            *p++ = 0xc0 | (run - 1);
+            run = 0;
+        }
+
+        int h = QOI_HASH(px);
+        if (QOI_SAME(index[h], px)) {
+            *p++ = (unsigned char)h;
+        } else {
+            index[h] = px;
+            if (px.a == prev.a) {
+                signed char vr = (signed char)(px.r - prev.r);
+                signed char vg = (signed char)(px.g - prev.g);
+                signed char vb = (signed char)(px.b - prev.b);
+                signed char vgr = (signed char)(vr - vg);
+                signed char vgb = (signed char)(vb - vg);
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    *p++ = 0x40 | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2);
+                } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                    *p++ = 0x80 | (vg + 32);
+                    *p++ = ((vgr + 8) << 4) | (vgb + 8);
+                } else {
+                    *p++ = 0xfe;
+                    *p++ = px.r;
+                    *p++ = px.g;
+                    *p++ = px.b;
+                }
+            } else {
+                *p++ = 0xff;
+                *p++ = px.r;
+                *p++ = px.g;
+                *p++ = px.b;
+                *p++ = px.a;
+            }
+        }
+        prev = px;
+    }
+    if (run)
+        *p++ = 0xc0 | (run - 1);
+
+    memcpy(p, "\0\0\0\0\0\0\0\1", 8);
+    p += 8;
+
+    *length = (int)(p - data);
+    return data;
+}
+
+int tigrSaveQoi(const char* fileName, Tigr* bmp) {
+    int len, ok;
+    FILE* out;
+    void* data = tigrSaveQoiMem(bmp, &len);
+    if (!data)
+        return 0;
+
+    out = tigrOpenFile(fileName, "wb");
+    if (!out) {
+        free(data);
+        return 0;
+    }
+    ok = fwrite(data, 1, len, out) == (size_t)len;
+    ok = (fclose(out) == 0) && ok;
+    free(data);
+    return ok;
+}
+
+#undef QOI_HASH
+#undef QOI_SAME
+
+//////// End of inlined file: tigr_saveqoi.c ////////
+
+//////// Start of inlined file: tigr_snapshot.c ////////
+
+//#include "tigr_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if (__linux__ && !__ANDROID__) || __MACOS__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define SNAPSHOT_MMAP 1
+#elif defined(_WIN32)
+#include <io.h>
+#define SNAPSHOT_MMAP 1
+#endif
+
+// Snapshot files are a small header, then raw RGBA rows from the next page onwards:
+//   "TIGRSNAP", version, format, width, height, stride (bytes), pixel offset
+// All little-endian 32-bit values.
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_RGBA8 0
+#define SNAPSHOT_OFFSET 4096
+#define SNAPSHOT_HEADER 32
+
+// Where a snapshot bitmap's pixels are mapped, so tigrFree can unmap them.
+// It's allocated along with the bitmap, and bmp->mapping points at it.
+typedef struct {
+    void* base;
+    size_t size;
+} SnapshotMapping;
+
+int tigrSaveSnapshot(const char* fileName, Tigr* bmp) {
+    unsigned char header[SNAPSHOT_OFFSET];
+    size_t rowBytes = (size_t)bmp->w * sizeof(TPixel);
+    FILE* out;
+    int ok, y;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "TIGRSNAP", 8);
+    tigrPut32LE(header + 8, SNAPSHOT_VERSION);
+    tigrPut32LE(header + 12, SNAPSHOT_RGBA8);
+    tigrPut32LE(header + 16, bmp->w);
+    tigrPut32LE(header + 20, bmp->h);
+    tigrPut32LE(header + 24, (unsigned)rowBytes);
+    tigrPut32LE(header + 28, SNAPSHOT_OFFSET);
+
+    out = tigrOpenFile(fileName, "wb");
+    if (!out)
+        return 0;
+
+    ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+    for (y = 0; y < bmp->h && ok; y++)
+        ok = fwrite(bmp->pix + (size_t)y * bmp->w, 1, rowBytes, out) == rowBytes;
+    ok = (fclose(out) == 0) && ok;
+    return ok;
+}
+
+// Checks a snapshot header, and returns the number of bytes the file needs to hold.
+static size_t snapshotCheck(const unsigned char* header, size_t fileSize, int* w, int* h) {
+    unsigned width, height, stride, offset;
+
+    if (memcmp(header, "TIGRSNAP", 8) != 0 || tigrGet32LE(header + 8) != SNAPSHOT_VERSION ||
+        tigrGet32LE(header + 12) != SNAPSHOT_RGBA8)
+        return 0;
+
+    width = tigrGet32LE(header + 16);
+    height = tigrGet32LE(header + 20);
+    stride = tigrGet32LE(header + 24);
+    offset = tigrGet32LE(header + 28);
+    if (width == 0 || height == 0 || width > 0x7fffffff / height || stride != width * sizeof(TPixel) ||
+        offset < SNAPSHOT_HEADER)
+        return 0;
+    if ((unsigned long long)stride * height + offset > fileSize)
+        return 0;
+
+    *w = (int)width;
+    *h = (int)height;
+    return (size_t)offset + (size_t)stride * height;
+}
+
+static Tigr* snapshotBitmap(int w, int h, TPixel* pix) {
+    Tigr* bmp = (Tigr*)calloc(1, sizeof(Tigr) + sizeof(SnapshotMapping));
+    if (!bmp)
+        return NULL;
+    bmp->w = w;
+    bmp->h = h;
+    bmp->cw = -1;
+    bmp->ch = -1;
+    bmp->pix = pix;
+    bmp->blitMode = TIGR_BLEND_ALPHA;
+    return bmp;
+}
+
+#ifdef SNAPSHOT_MMAP
+
+static void snapshotUnmap(void* base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+Tigr* tigrLoadSnapshot(const char* fileName, int copyOnWrite) {
+    unsigned char header[SNAPSHOT_HEADER];
+    size_t size = 0, need;
+    void* base = NULL;
+    SnapshotMapping* mapping;
+    Tigr* bmp;
+    int w, h;
+
+#ifdef _WIN32
+    FILE* file = tigrOpenFile(fileName, "rb");
+    if (!file)
+        return NULL;
+    need = 0;
+
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file)), section;
+    LARGE_INTEGER fileSize;
+
+    if (GetFileSizeEx(handle, &fileSize) && fread(header, 1, sizeof(header), file) == sizeof(header) &&
+        (need = snapshotCheck(header, (size_t)fileSize.QuadPart, &w, &h)) != 0) {
+        section = CreateFileMappingA(handle, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+        if (section) {
+            base = MapViewOfFile(section, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, need);
+            CloseHandle(section);
+        }
+        size = need;
+    }
+    fclose(file);
+#else
+    struct stat st;
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    need = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && read(fd, header, sizeof(header)) == sizeof(header) &&
+        (need = snapshotCheck(header, (size_t)st.st_size, &w, &h)) != 0) {
+        base = mmap(NULL, need, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED)
+            base = NULL;
+        size = need;
+    }
+    close(fd);
+#endif
+
+    if (!need) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!base) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    bmp = snapshotBitmap(w, h, (TPixel*)((unsigned char*)base + tigrGet32LE(header + 28)));
+    if (!bmp) {
+        snapshotUnmap(base, size);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    mapping = (SnapshotMapping*)(bmp + 1);
+    mapping->base = base;
+    mapping->size = size;
+    bmp->mapping = mapping;
+    return bmp;
+}
+
+void tigrFreePixels(Tigr* bmp) {
+    SnapshotMapping* mapping = (SnapshotMapping*)bmp->mapping;
+
+    if (mapping) {
+        snapshotUnmap(mapping->base, mapping->size);
+        bmp->mapping = NULL;
+    } else {
+        free(bmp->pix);
+    }
+}
+
+#else
+
+// No file mapping here, so read the pixels in.
+Tigr* tigrLoadSnapshot(const char* fileName, int copyOnWrite) {
+    unsigned char header[SNAPSHOT_HEADER];
+    TPixel* pix = NULL;
+    Tigr* bmp = NULL;
+    FILE* file;
+    int w, h;
+    long size;
+
+    (void)copyOnWrite;
+
+    file = tigrOpenFile(fileName, "rb");
+    if (!file)
+        return NULL;
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0 &&
+        fread(header, 1, sizeof(header), file) == sizeof(header) && snapshotCheck(header, (size_t)size, &w, &h) &&
+        fseek(file, (long)tigrGet32LE(header + 28), SEEK_SET) == 0) {
+        pix = (TPixel*)malloc((size_t)w * h * sizeof(TPixel));
+        if (pix && fread(pix, sizeof(TPixel), (size_t)w * h, file) == (size_t)w * h)
+            bmp = snapshotBitmap(w, h, pix);
+    }
+    fclose(file);
+
+    if (!bmp) {
+        free(pix);
+        errno = EINVAL;
+    }
+    return bmp;
+}
+
+void tigrFreePixels(Tigr* bmp) {
+    free(bmp->pix);
+}
+
+#endif  // SNAPSHOT_MMAP
+
+#undef SNAPSHOT_MMAP
+#undef SNAPSHOT_VERSION
+#undef SNAPSHOT_RGBA8
+#undef SNAPSHOT_OFFSET
+#undef SNAPSHOT_HEADER
+
+//////// End of inlined file: tigr_snapshot.c ////////
+
+//////// Start of inlined file: tigr_cache.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+typedef struct CacheEntry {
+    char* fileName;           // NULL for images loaded from memory
+    void* data;               // a copy of the memory contents, to compare against
+    unsigned long long hash;  // of the file name, or the memory contents
+    long long size, mtime;    // file size and time, or memory length
+    Tigr* bmp;
+    long long bytes;
+    int refs, stale;
+
+    struct CacheEntry *nextKey, *nextBmp;  // hash chains
+    struct CacheEntry *newer, *older;      // unused images, most recently released first
+} CacheEntry;
+
+struct TigrCache {
+    TigrMutex lock;
+    long long budget;
+    int count, numBuckets;
+    CacheEntry **byKey, **byBmp;
+    CacheEntry *newest, *oldest;
+    TigrCacheStats stats;
+};
+
+// FNV-1a.
+static unsigned long long cacheHash(const void* data, size_t len, unsigned long long h) {
+    const unsigned char* p = (const unsigned char*)data;
+    while (len--)
+        h = (h ^ *p++) * 0x100000001b3ULL;
+    return h;
+}
+
+static unsigned cacheBucket(TigrCache* cache, unsigned long long h) {
+    return (unsigned)(h ^ (h >> 32)) & (cache->numBuckets - 1);
+}
+
+static unsigned cacheBmpBucket(TigrCache* cache, Tigr* bmp) {
+    return cacheBucket(cache, (unsigned long long)(size_t)bmp * 0x9e3779b97f4a7c15ULL >> 16);
+}
+
+static int cacheFileInfo(const char* fileName, long long* size, long long* mtime) {
+    // Files in mounted archives are found first, just like tigrReadFile does.
+    if (tigrMountedInfo(fileName, size, mtime))
+        return 1;
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(fileName, &st) != 0)
+        return 0;
+#else
+    struct stat st;
+    if (stat(fileName, &st) != 0)
+        return 0;
+#endif
+    *size = (long long)st.st_size;
+    *mtime = (long long)st.st_mtime;
+    return 1;
+}
+
+// Finds the entry for a file name, or for memory contents if 'fileName' is NULL.
+static CacheEntry* cacheFind(TigrCache* cache,
+                             const char* fileName,
+                             const void* data,
+                             unsigned long long h,
+                             long long size) {
+    CacheEntry* e;
+    for (e = cache->byKey[cacheBucket(cache, h)]; e; e = e->nextKey) {
+        if (e->hash != h)
+            continue;
+        if (fileName ? (e->fileName && strcmp(e->fileName, fileName) == 0)
+                     : (!e->fileName && e->size == size && memcmp(e->data, data, (size_t)size) == 0))
+            return e;
+    }
+    return NULL;
+}
+
+static void cacheUnlinkKey(TigrCache* cache, CacheEntry* e) {
+    CacheEntry** link = &cache->byKey[cacheBucket(cache, e->hash)];
+    while (*link != e)
+        link = &(*link)->nextKey;
+    *link = e->nextKey;
+}
+
+static void cacheUnlinkBmp(TigrCache* cache, CacheEntry* e) {
+    CacheEntry** link = &cache->byBmp[cacheBmpBucket(cache, e->bmp)];
+    while (*link != e)
+        link = &(*link)->nextBmp;
+    *link = e->nextBmp;
+}
+
+static void cacheUnlinkUnused(TigrCache* cache, CacheEntry* e) {
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        cache->newest = e->older;
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        cache->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void cacheDestroy(TigrCache* cache, CacheEntry* e) {
+    if (!e->stale)
+        cacheUnlinkKey(cache, e);
+    cacheUnlinkBmp(cache, e);
+    cache->count--;
+    cache->stats.images--;
+    cache->stats.bytes -= e->bytes;
+    tigrFree(e->bmp);
+    free(e->fileName);
+    free(e->data);
+    free(e);
+}
+
+// Frees unused images, oldest first, until the cache is within its budget.
+static void cacheEvict(TigrCache* cache) {
+    while (cache->stats.bytes > cache->budget && cache->oldest) {
+        CacheEntry* e = cache->oldest;
+        cacheUnlinkUnused(cache, e);
+        cacheDestroy(cache, e);
+        cache->stats.evictions++;
+    }
+}
+
+static void cacheGrow(TigrCache* cache) {
+    int oldBuckets = cache->numBuckets, i;
+    CacheEntry **oldKey = cache->byKey, **oldBmp = cache->byBmp;
+    CacheEntry **byKey = (CacheEntry**)calloc(oldBuckets * 2, sizeof(CacheEntry*));
+    CacheEntry **byBmp = (CacheEntry**)calloc(oldBuckets * 2, sizeof(CacheEntry*));
+    if (!byKey || !byBmp) {
+        free(byKey);
+        free(byBmp);
+        return;
+    }
+
+    cache->numBuckets = oldBuckets * 2;
+    cache->byKey = byKey;
+    cache->byBmp = byBmp;
+    for (i = 0; i < oldBuckets; i++) {
+        while (oldKey[i]) {
+            CacheEntry* e = oldKey[i];
+            unsigned b = cacheBucket(cache, e->hash);
+            oldKey[i] = e->nextKey;
+            e->nextKey = byKey[b];
+            byKey[b] = e;
+        }
+        while (oldBmp[i]) {
+            CacheEntry* e = oldBmp[i];
+            unsigned b = cacheBmpBucket(cache, e->bmp);
+            oldBmp[i] = e->nextBmp;
+            e->nextBmp = byBmp[b];
+            byBmp[b] = e;
+        }
+    }
+    free(oldKey);
+    free(oldBmp);
+}
+
+// Drops an out of date entry. It's freed once it's unused.
+static void cacheDrop(TigrCache* cache, CacheEntry* e) {
+    if (e->refs == 0) {
+        cacheUnlinkUnused(cache, e);
+        cacheDestroy(cache, e);
+    } else {
+        cacheUnlinkKey(cache, e);
+        e->stale = 1;
+    }
+}
+
+// Takes a reference to a cached image. Called with the lock held.
+static Tigr* cacheUse(TigrCache* cache, CacheEntry* e) {
+    if (e->refs++ == 0)
+        cacheUnlinkUnused(cache, e);
+    return e->bmp;
+}
+
+// Adds a freshly decoded image, unless another thread got there first.
+static Tigr* cacheAdd(TigrCache* cache,
+                      const char* fileName,
+                      const void* data,
+                      unsigned long long h,
+                      long long size,
+                      long long mtime,
+                      Tigr* bmp) {
+    CacheEntry* e;
+    unsigned b;
+
+    tigrMutexLock(&cache->lock);
+    e = cacheFind(cache, fileName, data, h, size);
+    if (e && e->mtime == mtime && e->size == size) {
+        tigrFree(bmp);
+        bmp = cacheUse(cache, e);
+        tigrMutexUnlock(&cache->lock);
+        return bmp;
+    }
+    if (e)
+        cacheDrop(cache, e);
+
+    e = (CacheEntry*)calloc(1, sizeof(CacheEntry));
+    if (e && fileName) {
+        e->fileName = (char*)malloc(strlen(fileName) + 1);
+        if (e->fileName)
+            strcpy(e->fileName, fileName);
+    } else if (e) {
+        e->data = malloc(size ? (size_t)size : 1);
+        if (e->data)
+            memcpy(e->data, data, (size_t)size);
+    }
+    if (!e || (fileName ? !e->fileName : !e->data)) {
+        // Can't cache it, so hand it out uncached.
+        free(e);
+        tigrMutexUnlock(&cache->lock);
+        return bmp;
+    }
+
+    e->hash = h;
+    e->size = size;
+    e->mtime = mtime;
+    e->bmp = bmp;
+    e->bytes = sizeof(Tigr) + (long long)bmp->w * bmp->h * sizeof(TPixel) + (fileName ? 0 : size);
+    e->refs = 1;
+
+    if (cache->count >= cache->numBuckets)
+        cacheGrow(cache);
+    b = cacheBucket(cache, h);
+    e->nextKey = cache->byKey[b];
+    cache->byKey[b] = e;
+    b = cacheBmpBucket(cache, bmp);
+    e->nextBmp = cache->byBmp[b];
+    cache->byBmp[b] = e;
+
+    cache->count++;
+    cache->stats.images++;
+    cache->stats.bytes += e->bytes;
+    cacheEvict(cache);
+    tigrMutexUnlock(&cache->lock);
+    return bmp;
+}
+
+// Looks up an image, dropping it if it's out of date.
+static Tigr* cacheLookup(TigrCache* cache,
+                         const char* fileName,
+                         const void* data,
+                         unsigned long long h,
+                         long long size,
+                         long long mtime) {
+    CacheEntry* e;
+    Tigr* bmp = NULL;
+
+    tigrMutexLock(&cache->lock);
+    e = cacheFind(cache, fileName, data, h, size);
+    if (e && (e->mtime != mtime || e->size != size)) {
+        cacheDrop(cache, e);
+        e = NULL;
+    }
+    if (e) {
+        bmp = cacheUse(cache, e);
+        cache->stats.hits++;
+    } else {
+        cache->stats.misses++;
+    }
+    tigrMutexUnlock(&cache->lock);
+    return bmp;
+}
+
+TigrCache* tigrCacheCreate(long long budget) {
+    TigrCache* cache = (TigrCache*)calloc(1, sizeof(TigrCache));
+    if (!cache)
+        return NULL;
+    cache->budget = budget;
+    cache->numBuckets = 64;
+    cache->byKey = (CacheEntry**)calloc(cache->numBuckets, sizeof(CacheEntry*));
+    cache->byBmp = (CacheEntry**)calloc(cache->numBuckets, sizeof(CacheEntry*));
+    if (!cache->byKey || !cache->byBmp) {
+        free(cache->byKey);
+        free(cache->byBmp);
+        free(cache);
+        return NULL;
+    }
+    tigrMutexInit(&cache->lock);
+    return cache;
+}
+
+Tigr* tigrCacheLoad(TigrCache* cache, const char* fileName) {
+    unsigned long long h = cacheHash(fileName, strlen(fileName), 0xcbf29ce484222325ULL);
+    long long size, mtime;
+    Tigr* bmp;
+
+    if (!cacheFileInfo(fileName, &size, &mtime))
+        return NULL;
+    bmp = cacheLookup(cache, fileName, NULL, h, size, mtime);
+    if (bmp)
+        return bmp;
+
+    bmp = tigrLoadImage(fileName);
+    return bmp ? cacheAdd(cache, fileName, NULL, h, size, mtime, bmp) : NULL;
+}
+
+Tigr* tigrCacheLoadMem(TigrCache* cache, const void* data, int length) {
+    unsigned long long h = cacheHash(data, length, 0xcbf29ce484222325ULL);
+    Tigr* bmp = cacheLookup(cache, NULL, data, h, length, 0);
+    if (bmp)
+        return bmp;
+
+    bmp = tigrLoadImageMem(data, length);
+    return bmp ? cacheAdd(cache, NULL, data, h, length, 0, bmp) : NULL;
+}
+
+void tigrCacheRelease(TigrCache* cache, Tigr* bmp) {
+    CacheEntry* e;
+
+    tigrMutexLock(&cache->lock);
+    for (e = cache->byBmp[cacheBmpBucket(cache, bmp)]; e && e->bmp != bmp; e = e->nextBmp)
+        ;
+    if (!e) {
+        // Wasn't cached after all.
+        tigrMutexUnlock(&cache->lock);
+        tigrFree(bmp);
+        return;
+    }
+
+    if (--e->refs == 0) {
+        if (e->stale) {
+            cacheDestroy(cache, e);
+        } else {
+            e->older = cache->newest;
+            if (cache->newest)
+                cache->newest->newer = e;
+            else
+                cache->oldest = e;
+            cache->newest = e;
+            cacheEvict(cache);
+        }
+    }
+    tigrMutexUnlock(&cache->lock);
+}
+
+void tigrCacheStats(TigrCache* cache, TigrCacheStats* stats) {
+    tigrMutexLock(&cache->lock);
+    *stats = cache->stats;
+    tigrMutexUnlock(&cache->lock);
+}
+
+void tigrCacheFree(TigrCache* cache) {
+    int i;
+    for (i = 0; i < cache->numBuckets; i++) {
+        while (cache->byBmp[i]) {
+            CacheEntry* e = cache->byBmp[i];
+            cache->byBmp[i] = e->nextBmp;
+            tigrFree(e->bmp);
+            free(e->fileName);
+            free(e->data);
+            free(e);
+        }
+    }
+    tigrMutexDestroy(&cache->lock);
+    free(cache->byKey);
+    free(cache->byBmp);
+    free(cache);
+}
+
+//////// End of inlined file: tigr_cache.c ////////
+
+//////// Start of inlined file: tigr_archive.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Zip archives, mapped once and indexed by name. Entries are found through the
+// central directory at the end of the file, and inflated only when they're read.
+#define ARCHIVE_END_SIG 0x06054b50
+#define ARCHIVE_DIR_SIG 0x02014b50
+#define ARCHIVE_LOCAL_SIG 0x04034b50
+#define ARCHIVE_END_SIZE 22
+#define ARCHIVE_DIR_SIZE 46
+#define ARCHIVE_LOCAL_SIZE 30
+#define ARCHIVE_STORED 0
+#define ARCHIVE_DEFLATED 8
+
+typedef struct {
+    const char* name;  // points into the mapping, not NUL terminated
+    unsigned nameLen, hash;
+    unsigned method, compSize, size, offset;
+    unsigned modified;  // DOS date and time
+    unsigned crc;
+} ArchiveEntry;
+
+struct TigrArchive {
+    const unsigned char* data;
+    int length;
+    int count;
+    ArchiveEntry* entries;
+    unsigned* slots;  // open addressing, entry index + 1, or zero if empty
+    unsigned mask;
+    unsigned serial;  // tells archives apart in tigrMountedInfo
+    TigrArchive* nextMount;
+    int refs, closing;  // from tigrFindMounted, and a pending tigrCloseArchive
+};
+
+// What empty entries read as, so they never point at the end of the mapping.
+static const unsigned char archiveEmpty[1] = { 0 };
+
+// Archives searched by tigrFindMounted, most recently mounted first.
+static TigrArchive* archiveMounts;
+static TigrMutex archiveLock = TIGR_MUTEX_INIT;
+static unsigned archiveSerial;
+
+static unsigned archiveGet16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+// FNV-1a.
+static unsigned archiveHash(const char* name, unsigned len) {
+    unsigned h = 2166136261u;
+    while (len--)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return h;
+}
+
+static ArchiveEntry* archiveFind(TigrArchive* archive, const char* name) {
+    unsigned len, h, i, slot;
+
+    // Archive names are relative, with forward slashes.
+    while (name[0] == '.' && (name[1] == '/' || name[1] == '\\'))
+        name += 2;
+    len = (unsigned)strlen(name);
+    h = archiveHash(name, len);
+    for (i = h & archive->mask; (slot = archive->slots[i]) != 0; i = (i + 1) & archive->mask) {
+        ArchiveEntry* e = &archive->entries[slot - 1];
+        if (e->hash == h && e->nameLen == len && memcmp(e->name, name, len) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+// Finds the end of central directory record, which is followed by a comment of up to 64kB.
+static const unsigned char* archiveEnd(const unsigned char* data, int length) {
+    const unsigned char* p;
+    const unsigned char* stop;
+
+    if (length < ARCHIVE_END_SIZE)
+        return NULL;
+    p = data + length - ARCHIVE_END_SIZE;
+    stop = length > 0xffff + ARCHIVE_END_SIZE ? data + length - 0xffff - ARCHIVE_END_SIZE : data;
+    for (; p >= stop; p--) {
+        if (tigrGet32LE(p) == ARCHIVE_END_SIG && p + ARCHIVE_END_SIZE + archiveGet16(p + 20) == data + length)
+            return p;
+    }
+    return NULL;
+}
+
+// Builds the name index from the central directory.
+static int archiveIndex(TigrArchive* archive) {
+    const unsigned char *end, *p, *dirEnd;
+    unsigned total, dirSize, dirOffset, slots, slot, i;
+
+    end = archiveEnd(archive->data, archive->length);
+    if (!end)
+        return 0;
+    total = archiveGet16(end + 10);
+    dirSize = tigrGet32LE(end + 12);
+    dirOffset = tigrGet32LE(end + 16);
+    // Zip64 and multi-disk archives aren't supported.
+    if (archiveGet16(end + 4) != 0 || total == 0xffff || dirOffset == 0xffffffff ||
+        dirOffset > (unsigned)(end - archive->data) || dirSize > (unsigned)(end - archive->data) - dirOffset)
+        return 0;
+
+    for (slots = 16; slots < total * 2; slots *= 2)
+        ;
+    archive->entries = (ArchiveEntry*)malloc((total ? total : 1) * sizeof(ArchiveEntry));
+    archive->slots = (unsigned*)calloc(slots, sizeof(unsigned));
+    if (!archive->entries || !archive->slots) {
+        errno = ENOMEM;
+        return 0;
+    }
+    archive->mask = slots - 1;
+
+    p = archive->data + dirOffset;
+    dirEnd = p + dirSize;
+    for (i = 0; i < total; i++) {
+        ArchiveEntry* e = &archive->entries[archive->count];
+        unsigned flags, nameLen, skip;
+
+        if (dirEnd - p < ARCHIVE_DIR_SIZE || tigrGet32LE(p) != ARCHIVE_DIR_SIG)
+            return 0;
+        flags = archiveGet16(p + 8);
+        nameLen = archiveGet16(p + 28);
+        skip = ARCHIVE_DIR_SIZE + nameLen + archiveGet16(p + 30) + archiveGet16(p + 32);
+        if ((unsigned)(dirEnd - p) < skip)
+            return 0;
+
+        e->name = (const char*)p + ARCHIVE_DIR_SIZE;
+        e->nameLen = nameLen;
+        e->method = archiveGet16(p + 10);
+        e->modified = tigrGet32LE(p + 12);
+        e->crc = tigrGet32LE(p + 16);
+        e->compSize = tigrGet32LE(p + 20);
+        e->size = tigrGet32LE(p + 24);
+        e->offset = tigrGet32LE(p + 42);
+        p += skip;
+
+        // Leave out directories, encrypted entries and anything we can't decompress.
+        if (nameLen == 0 || e->name[nameLen - 1] == '/' || (flags & 1) ||
+            (e->method != ARCHIVE_STORED && e->method != ARCHIVE_DEFLATED) || e->size > 0x7ffffffe)
+            continue;
+
+        e->hash = archiveHash(e->name, nameLen);
+        slot = e->hash & archive->mask;
+        while (archive->slots[slot])
+            slot = (slot + 1) & archive->mask;
+        archive->slots[slot] = ++archive->count;
+    }
+    return 1;
+}
+
+TigrArchive* tigrOpenArchive(const char* fileName) {
+    TigrArchive* archive = (TigrArchive*)calloc(1, sizeof(TigrArchive));
+    if (!archive) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    archive->data = (const unsigned char*)tigrMapFile(fileName, &archive->length);
+    if (!archive->data) {
+        free(archive);
+        return NULL;
+    }
+
+    errno = EINVAL;
+    if (!archiveIndex(archive)) {
+        tigrCloseArchive(archive);
+        return NULL;
+    }
+    return archive;
+}
+
+const void* tigrArchiveRead(TigrArchive* archive, const char* name, int* length) {
+    ArchiveEntry* e = archiveFind(archive, name);
+    const unsigned char* local;
+    unsigned start, written;
+    unsigned char* out;
+
+    if (length)
+        *length = 0;
+    if (!e) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    // The local header can have a different extra field, so find the data through it.
+    local = archive->data + e->offset;
+    if ((long long)e->offset + ARCHIVE_LOCAL_SIZE > archive->length || tigrGet32LE(local) != ARCHIVE_LOCAL_SIG) {
+        errno = EINVAL;
+        return NULL;
+    }
+    start = e->offset + ARCHIVE_LOCAL_SIZE + archiveGet16(local + 26) + archiveGet16(local + 28);
+    if ((long long)start + e->compSize > archive->length) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (e->method == ARCHIVE_STORED) {
+        if (e->compSize != e->size) {
+            errno = EINVAL;
+            return NULL;
+        }
+        if (length)
+            *length = (int)e->size;
+        return e->size ? archive->data + start : archiveEmpty;
+    }
+
+    if (e->size >= 0x7fffffff) {
+        errno = EINVAL;
+        return NULL;
+    }
+    out = (unsigned char*)malloc(e->size + 1);
+    if (!out) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    // The whole entry has to be there, and match the directory's CRC.
+    if (!tigrInflateSize(out, e->size, archive->data + start, e->compSize, &written) || written != e->size ||
+        tigrCrc32(0, out, written) != e->crc) {
+        free(out);
+        errno = EINVAL;
+        return NULL;
+    }
+    out[e->size] = '\0';
+    if (length)
+        *length = (int)e->size;
+    return out;
+}
+
+// Stored entries point straight into the mapping.
+static int archiveMapped(TigrArchive* archive, const void* data) {
+    const unsigned char* p = (const unsigned char*)data;
+    return p == archiveEmpty || (p >= archive->data && p < archive->data + archive->length);
+}
+
+void tigrArchiveRelease(TigrArchive* archive, const void* data) {
+    if (!archiveMapped(archive, data))
+        free((void*)data);
+}
+
+void tigrMountArchive(TigrArchive* archive) {
+    tigrUnmountArchive(archive);
+    tigrMutexLock(&archiveLock);
+    archive->serial = ++archiveSerial;
+    archive->nextMount = archiveMounts;
+    archiveMounts = archive;
+    tigrMutexUnlock(&archiveLock);
+}
+
+void tigrUnmountArchive(TigrArchive* archive) {
+    TigrArchive** link;
+
+    tigrMutexLock(&archiveLock);
+    for (link = &archiveMounts; *link; link = &(*link)->nextMount) {
+        if (*link == archive) {
+            *link = archive->nextMount;
+            break;
+        }
+    }
+    archive->nextMount = NULL;
+    tigrMutexUnlock(&archiveLock);
+}
+
+TigrArchive* tigrFindMounted(const char* fileName) {
+    TigrArchive* archive;
+
+    tigrMutexLock(&archiveLock);
+    for (archive = archiveMounts; archive; archive = archive->nextMount) {
+        if (archiveFind(archive, fileName))
+            break;
+    }
+    if (archive)
+        archive->refs++;
+    tigrMutexUnlock(&archiveLock);
+    return archive;
+}
+
+static void archiveDestroy(TigrArchive* archive) {
+    if (archive->data)
+        tigrUnmapFile(archive->data, archive->length);
+    free(archive->entries);
+    free(archive->slots);
+    free(archive);
+}
+
+void tigrReleaseMounted(TigrArchive* archive) {
+    int destroy;
+
+    tigrMutexLock(&archiveLock);
+    destroy = --archive->refs == 0 && archive->closing;
+    tigrMutexUnlock(&archiveLock);
+    if (destroy)
+        archiveDestroy(archive);
+}
+
+int tigrMountedInfo(const char* fileName, long long* size, long long* stamp) {
+    TigrArchive* archive;
+    ArchiveEntry* e = NULL;
+
+    tigrMutexLock(&archiveLock);
+    for (archive = archiveMounts; archive && !e; archive = archive->nextMount) {
+        e = archiveFind(archive, fileName);
+        if (e) {
+            *size = e->size;
+            *stamp = (long long)archive->serial << 32 | e->modified;
+        }
+    }
+    tigrMutexUnlock(&archiveLock);
+    return e != NULL;
+}
+
+void* tigrReadMountedFile(TigrArchive* archive, const char* fileName, int* length) {
+    int len;
+    const void* data = tigrArchiveRead(archive, fileName, &len);
+    char* copy;
+
+    if (length)
+        *length = 0;
+    if (!data)
+        return NULL;
+    if (!archiveMapped(archive, data)) {
+        copy = (char*)data;  // already inflated, with a NUL terminator
+    } else if ((copy = (char*)malloc(len + 1)) != NULL) {
+        memcpy(copy, data, len);
+        copy[len] = '\0';
+    } else {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (length)
+        *length = len;
+    return copy;
+}
+
+void tigrCloseArchive(TigrArchive* archive) {
+    int inUse;
+
+    if (!archive)
+        return;
+    tigrUnmountArchive(archive);
+
+    // Files still being read through the mount keep it open until they're done.
+    tigrMutexLock(&archiveLock);
+    inUse = archive->refs > 0;
+    archive->closing = 1;
+    tigrMutexUnlock(&archiveLock);
+    if (!inUse)
+        archiveDestroy(archive);
+}
+
+#undef ARCHIVE_END_SIG
+#undef ARCHIVE_DIR_SIG
+#undef ARCHIVE_LOCAL_SIG
+#undef ARCHIVE_END_SIZE
+#undef ARCHIVE_DIR_SIZE
+#undef ARCHIVE_LOCAL_SIZE
+#undef ARCHIVE_STORED
+#undef ARCHIVE_DEFLATED
+
+//////// End of inlined file: tigr_archive.c ////////
+
+//////// Start of inlined file: tigr_inflate.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+
+typedef struct TigrInflateState {
+    unsigned bits, count;
+    const unsigned char *in, *inend;
+    unsigned char *out, *outbegin, *outend, *flushed;
+    TigrInflateSource more;
+    TigrInflateSink sink;
+    void* ctx;
+    jmp_buf jmp;
+    unsigned litcodes[288], distcodes[32], lencodes[19];
+    int tlit, tdist, tlen;
+    unsigned char* window;
+    unsigned windowSize;
+} State;
+
+#define FAIL() longjmp(s->jmp, 1)
+#define CHECK(X) \
+    if (!(X))    \
+    FAIL()
+
+// Built-in DEFLATE standard tables.
+static char order[] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+static char lenBits[29 + 2] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 0, 0 };
+static int lenBase[29 + 2] = { 3,  4,  5,  6,  7,  8,  9,  10,  11,  13,  15,  17,  19,  23, 27, 31,
+                               35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0,  0 };
+static char distBits[30 + 2] = { 0, 0, 0, 0, 1, 1, 2,  2,  3,  3,  4,  4,  5,  5,  6, 6,
+                                 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 0, 0 };
+static int distBase[30 + 2] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+// Table to bit-reverse a byte.
+static const unsigned char reverseTable[256] = {
+#define R2(n) n, n + 128, n + 64, n + 192
+#define R4(n) R2(n), R2(n + 32), R2(n + 16), R2(n + 48)
+#define R6(n) R4(n), R4(n + 8), R4(n + 4), R4(n + 12)
+    R6(0), R6(2), R6(1), R6(3)
+};
+
+static unsigned rev16(unsigned n) {
+    return (reverseTable[n & 0xff] << 8) | reverseTable[(n >> 8) & 0xff];
+}
+
+static void refill(State* s) {
+    unsigned len = 0;
+    while (len == 0) {
+        CHECK(s->more && s->more(s->ctx, &s->in, &len));
+    }
+    s->inend = s->in + len;
+}
+
+static int bits(State* s, int n) {
+    int v = s->bits & ((1 << n) - 1);
+    s->bits >>= n;
+    s->count -= n;
+    while (s->count < 16) {
+        if (s->in == s->inend)
+            refill(s);
+        s->bits |= (*s->in++) << s->count;
+        s->count += 8;
+    }
+    return v;
+}
+
+static void slide(State* s) {
+    // Hand finished output to the sink, keeping the last 32kB around for back-references.
+    unsigned keep = (unsigned)(s->out - s->outbegin);
+    CHECK(s->sink(s->ctx, s->flushed, (unsigned)(s->out - s->flushed)));
+    if (keep > 32768)
+        keep = 32768;
+    memmove(s->outbegin, s->out - keep, keep);
+    s->out = s->outbegin + keep;
+    s->flushed = s->out;
+}
+
+static unsigned char* emit(State* s, int len) {
+    if (s->sink && s->out + len > s->outend)
+        slide(s);
+    s->out += len;
+    CHECK(s->out <= s->outend);
+    return s->out - len;
+}
+
+static void copy(State* s, const unsigned char* src, int len) {
+    unsigned char* dest = emit(s, len);
+    while (len--)
+        *dest++ = *src++;
+}
+
+static int build(State* s, unsigned* tree, unsigned char* lens, unsigned int symcount) {
+    unsigned int codes[16], first[16], counts[16] = { 0 };
+
+    // Frequency count.
+    for (unsigned int n = 0; n < symcount; n++)
+        counts[lens[n]]++;
+
+    // Distribute codes.
+    counts[0] = codes[0] = first[0] = 0;
+    for (unsigned int n = 1; n <= 15; n++) {
+        codes[n] = (codes[n - 1] + counts[n - 1]) << 1;
+        first[n] = first[n - 1] + counts[n - 1];
+    }
+    CHECK(first[15] + counts[15] <= symcount);
+
+    // Insert keys into the tree for each symbol.
+    for (unsigned int n = 0; n < symcount; n++) {
+        int len = lens[n];
+        if (len != 0) {
+            unsigned code = codes[len]++, slot = first[len]++;
+            tree[slot] = (code << (32 - len)) | (n << 4) | len;
+        }
+    }
+
+    return first[15];
+}
+
+static int decode(State* s, unsigned tree[], int max) {
+    // Find the next prefix code.
+    unsigned lo = 0, hi = max, key;
+    unsigned search = (rev16(s->bits) << 16) | 0xffff;
+    while (lo < hi) {
+        unsigned guess = (lo + hi) / 2;
+        if (search < tree[guess])
+            hi = guess;
+        else
+            lo = guess + 1;
+    }
+
+    // Pull out the key and check it.
+    key = tree[lo - 1];
+    CHECK(((search ^ key) >> (32 - (key & 0xf))) == 0);
+
+    bits(s, key & 0xf);
+    return (key >> 4) & 0xfff;
+}
+
+static void run(State* s, int sym) {
+    int length = bits(s, lenBits[sym]) + lenBase[sym];
+    int dsym = decode(s, s->distcodes, s->tdist);
+    int offs = bits(s, distBits[dsym]) + distBase[dsym];
+    // Emit first, since that may slide the window.
+    unsigned char* dest = emit(s, length);
+    const unsigned char* src = dest - offs;
+    CHECK(src >= s->outbegin);
+    while (length--)
+        *dest++ = *src++;
+}
+
+static void block(State* s) {
+    for (;;) {
+        int sym = decode(s, s->litcodes, s->tlit);
+        if (sym < 256)
+            *emit(s, 1) = (unsigned char)sym;
+        else if (sym > 256)
+            run(s, sym - 257);
+        else
+            break;
+    }
+}
+
+static void stored(State* s) {
+    // Uncompressed data block.
+    int len;
+    bits(s, s->count & 7);
+    len = bits(s, 16);
+    CHECK(((len ^ s->bits) & 0xffff) == 0xffff);
+    CHECK(s->more || s->in + len <= s->inend);
+
+    // Copy in pieces that fit both the input and a streaming window.
+    while (len > 0) {
+        int n = len < 32768 ? len : 32768;
+        if (s->in == s->inend)
+            refill(s);
+        if (n > s->inend - s->in)
+            n = (int)(s->inend - s->in);
+        copy(s, s->in, n);
+        s->in += n;
+        len -= n;
+    }
+    bits(s, 16);
+}
+
+static void fixed(State* s) {
+    // Fixed set of Huffman codes.
+    int n;
+    unsigned char lens[288 + 32];
+    for (n = 0; n <= 143; n++)
+        lens[n] = 8;
+    for (n = 144; n <= 255; n++)
+        lens[n] = 9;
+    for (n = 256; n <= 279; n++)
+        lens[n] = 7;
+    for (n = 280; n <= 287; n++)
+        lens[n] = 8;
+    for (n = 0; n < 32; n++)
+        lens[288 + n] = 5;
+
+    // Build lit/dist trees.
+    s->tlit = build(s, s->litcodes, lens, 288);
+    s->tdist = build(s, s->distcodes, lens + 288, 32);
+}
+
+static void dynamic(State* s) {
+    int n, i, nlit, ndist, nlen;
+    unsigned char lenlens[19] = { 0 }, lens[288 + 32];
+    nlit = 257 + bits(s, 5);
+    ndist = 1 + bits(s, 5);
+    nlen = 4 + bits(s, 4);
+    for (n = 0; n < nlen; n++)
+        lenlens[(int) order[n]] = (unsigned char)bits(s, 3);
+
+    // Build the tree for decoding code lengths.
+    s->tlen = build(s, s->lencodes, lenlens, 19);
+
+    // Decode code lengths. Repeats can't run past the end, or copy a length that isn't there.
+    for (n = 0; n < nlit + ndist;) {
+        int sym = decode(s, s->lencodes, s->tlen);
+        switch (sym) {
+            case 16:
+                CHECK(n > 0);
+                i = 3 + bits(s, 2);
+                CHECK(n + i <= nlit + ndist);
+                for (; i; i--, n++)
+                    lens[n] = lens[n - 1];
+                break;
+            case 17:
+                i = 3 + bits(s, 3);
+                CHECK(n + i <= nlit + ndist);
+                for (; i; i--, n++)
+                    lens[n] = 0;
+                break;
+            case 18:
+                i = 11 + bits(s, 7);
+                CHECK(n + i <= nlit + ndist);
+                for (; i; i--, n++)
+                    lens[n] = 0;
+                break;
+            default:
+                lens[n++] = (unsigned char)sym;
+                break;
+        }
+    }
+
+    // Build lit/dist trees.
+    s->tlit = build(s, s->litcodes, lens, nlit);
+    s->tdist = build(s, s->distcodes, lens + nlit, ndist);
+}
+
+static int decompress(State* s, void* out, unsigned outlen, const void* in, unsigned inlen) {
+    int last;
+
+    // We assume we can buffer 2 extra bytes from off the end of 'in',
+    // unless there is a source to read further input from.
+    s->in = (unsigned char*)in;
+    s->inend = s->in + inlen + (s->more ? 0 : 2);
+    s->out = s->outbegin = s->flushed = (unsigned char*)out;
+    s->outend = s->out + outlen;
+    s->bits = 0;
+    s->count = 0;
+
+    if (setjmp(s->jmp) == 1) {
+        return 0;
+    }
+
+    bits(s, 0);
+
+    do {
+        last = bits(s, 1);
+        switch (bits(s, 2)) {
+            case 0:
+                stored(s);
+                break;
+            case 1:
+                fixed(s);
+                block(s);
+                break;
+            case 2:
+                dynamic(s);
+                block(s);
+                break;
+            case 3:
+                FAIL();
+        }
+    } while (!last);
+
+    if (s->sink && s->out != s->flushed) {
+        return s->sink(s->ctx, s->flushed, (unsigned)(s->out - s->flushed));
+    }
+    return 1;
+}
+
+int tigrInflateSize(void* out, unsigned outlen, const void* in, unsigned inlen, unsigned* written) {
+    State* s = (State*)calloc(1, sizeof(State));
+    int ok;
+
+    *written = 0;
+    if (!s)
+        return 0;
+    ok = decompress(s, out, outlen, in, inlen);
+    if (ok)
+        *written = (unsigned)(s->out - s->outbegin);
+    free(s);
+    return ok;
+}
+
+int tigrInflate(void* out, unsigned outlen, const void* in, unsigned inlen) {
+    unsigned written;
+    return tigrInflateSize(out, outlen, in, inlen, &written);
+}
+
+TigrInflateState* tigrInflateState(void) {
+    return (State*)calloc(1, sizeof(State));
+}
+
+void tigrInflateFree(TigrInflateState* state) {
+    if (state)
+        free(state->window);
+    free(state);
+}
+
+int tigrInflateStream(TigrInflateState* state,
+                      unsigned outlen,
+                      const void* in,
+                      unsigned inlen,
+                      TigrInflateSource more,
+                      TigrInflateSink sink,
+                      void* ctx) {
+    State* s = state ? state : tigrInflateState();
+    unsigned size = outlen < TIGR_INFLATE_WINDOW ? outlen : TIGR_INFLATE_WINDOW;
+    int ok = 0;
+    if (!s)
+        return 0;
+
+    // The window never needs to be bigger than the whole output.
+    if (s->windowSize < size) {
+        unsigned char* window = (unsigned char*)realloc(s->window, size);
+        if (!window) {
+            errno = ENOMEM;
+            goto done;
+        }
+        s->window = window;
+        s->windowSize = size;
+    }
+    s->more = more;
+    s->sink = sink;
+    s->ctx = ctx;
+    ok = decompress(s, s->window, size, in, inlen);
+
+done:
+    if (!state)
+        tigrInflateFree(s);
+    return ok;
+}
+
+#undef CHECK
+#undef FAIL
+
+//////// End of inlined file: tigr_inflate.c ////////
+
+//////// Start of inlined file: tigr_batch.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+struct TigrBatch {
+    TigrMutex lock;
+    TigrCond cond;
+    int count, next;
+
+    // Either file names or memory blobs.
+    char** fileNames;
+    const void** data;
+    int* lengths;
+
+    Tigr** results;
+    unsigned char *ready, *claimed;
+
+    TigrBatchFunc func;
+    void* user;
+
+    int numThreads;
+    TigrThread* threads;
+};
+
+static void batchWorker(void* arg) {
+    TigrBatch* batch = (TigrBatch*)arg;
+    TigrInflateState* state = tigrInflateState();
+
+    for (;;) {
+        int index;
+        Tigr* bmp;
+
+        tigrMutexLock(&batch->lock);
+        index = batch->next++;
+        tigrMutexUnlock(&batch->lock);
+        if (index >= batch->count)
+            break;
+
+        if (batch->fileNames) {
+            bmp = tigrDecodeImageFile(batch->fileNames[index], state);
+        } else {
+            bmp = tigrDecodeImage(batch->data[index], batch->lengths[index], state);
+        }
+
+        tigrMutexLock(&batch->lock);
+        batch->results[index] = bmp;
+        batch->ready[index] = 1;
+        tigrCondBroadcast(&batch->cond);
+        tigrMutexUnlock(&batch->lock);
+
+        if (batch->func)
+            batch->func(batch->user, index, bmp);
+    }
+
+    tigrInflateFree(state);
+}
+
+// Frees a batch's memory, once no workers are left.
+static void freeBatch(TigrBatch* batch) {
+    if (batch->fileNames) {
+        for (int i = 0; i < batch->count; i++)
+            free(batch->fileNames[i]);
+    }
+    free(batch->fileNames);
+    free(batch->data);
+    free(batch->lengths);
+    free(batch->results);
+    free(batch->ready);
+    free(batch->claimed);
+    free(batch->threads);
+    free(batch);
+}
+
+static TigrBatch* startBatch(TigrBatch* batch, int count, int threads, TigrBatchFunc func, void* user) {
+    if (threads <= 0)
+        threads = tigrCpuCount();
+    if (threads > count)
+        threads = count;
+    if (threads < 1)
+        threads = 1;
+
+    batch->func = func;
+    batch->user = user;
+    batch->results = (Tigr**)calloc(count + 1, sizeof(Tigr*));
+    batch->ready = (unsigned char*)calloc(count + 1, 1);
+    batch->claimed = (unsigned char*)calloc(count + 1, 1);
+    batch->threads = (TigrThread*)calloc(threads, sizeof(TigrThread));
+    if (!batch->results || !batch->ready || !batch->claimed || !batch->threads) {
+        freeBatch(batch);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    tigrMutexInit(&batch->lock);
+    tigrCondInit(&batch->cond);
+
+    for (int i = 0; i < threads; i++) {
+        if (!tigrThreadStart(&batch->threads[i], batchWorker, batch))
+            break;
+        batch->numThreads++;
+    }
+
+    // Fall back to decoding on the calling thread if no workers could be started.
+    if (batch->numThreads == 0)
+        batchWorker(batch);
+
+    return batch;
+}
+
+TigrBatch* tigrLoadImages(const char* const* fileNames, int count, int threads, TigrBatchFunc func, void* user) {
+    TigrBatch* batch = (TigrBatch*)calloc(1, sizeof(TigrBatch));
+    if (!batch || !(batch->fileNames = (char**)calloc(count + 1, sizeof(char*)))) {
+        free(batch);
+        errno = ENOMEM;
+        return NULL;
+    }
+    batch->count = count;
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(fileNames[i]) + 1;
+        batch->fileNames[i] = (char*)malloc(len);
+        if (!batch->fileNames[i]) {
+            freeBatch(batch);
+            errno = ENOMEM;
+            return NULL;
+        }
+        memcpy(batch->fileNames[i], fileNames[i], len);
+    }
+    return startBatch(batch, count, threads, func, user);
+}
+
+TigrBatch* tigrLoadImagesMem(const void* const* data,
+                             const int* lengths,
+                             int count,
+                             int threads,
+                             TigrBatchFunc func,
+                             void* user) {
+    TigrBatch* batch = (TigrBatch*)calloc(1, sizeof(TigrBatch));
+    if (!batch) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    batch->count = count;
+    batch->data = (const void**)calloc(count + 1, sizeof(void*));
+    batch->lengths = (int*)calloc(count + 1, sizeof(int));
+    if (!batch->data || !batch->lengths) {
+        freeBatch(batch);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        batch->data[i] = data[i];
+        batch->lengths[i] = lengths[i];
+    }
+    return startBatch(batch, count, threads, func, user);
+}
+
+int tigrBatchReady(TigrBatch* batch, int index) {
+    int ready;
+    if (index < 0 || index >= batch->count)
+        return 0;
+    tigrMutexLock(&batch->lock);
+    ready = batch->ready[index];
+    tigrMutexUnlock(&batch->lock);
+    return ready;
+}
+
+Tigr* tigrBatchWait(TigrBatch* batch, int index) {
+    Tigr* bmp;
+    if (index < 0 || index >= batch->count)
+        return NULL;
+    tigrMutexLock(&batch->lock);
+    while (!batch->ready[index])
+        tigrCondWait(&batch->cond, &batch->lock);
+    bmp = batch->claimed[index] ? NULL : batch->results[index];
+    batch->claimed[index] = 1;
+    tigrMutexUnlock(&batch->lock);
+    return bmp;
+}
+
+void tigrBatchFree(TigrBatch* batch) {
+    // Skip anything that hasn't been started yet.
+    tigrMutexLock(&batch->lock);
+    batch->next = batch->count;
+    tigrMutexUnlock(&batch->lock);
+
+    for (int i = 0; i < batch->numThreads; i++)
+        tigrThreadJoin(batch->threads[i]);
+
+    for (int i = 0; i < batch->count; i++) {
+        if (batch->results[i] && !batch->claimed[i])
+            tigrFree(batch->results[i]);
+    }
+
+    tigrCondDestroy(&batch->cond);
+    tigrMutexDestroy(&batch->lock);
+    freeBatch(batch);
+}
+
+//////// End of inlined file: tigr_batch.c ////////
+
+//////// Start of inlined file: tigr_saver.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+typedef struct SaverJob {
+    struct SaverJob* next;
+    char* fileName;
+    Tigr* bmp;
+    int level;
+} SaverJob;
+
+struct TigrSaver {
+    TigrMutex lock;
+    TigrCond cond;
+    SaverJob *head, *tail;
+    int pending, maxPending, quit, started;
+
+    TigrSaverFunc func;
+    void* user;
+
+    TigrThread thread;
+};
+
+static void saveJob(TigrSaver* saver, SaverJob* job) {
+    int ok = tigrSaveImageLevel(job->fileName, job->bmp, job->level);
+    if (saver->func)
+        saver->func(saver->user, job->fileName, ok);
+    tigrFree(job->bmp);
+    free(job->fileName);
+    free(job);
+}
+
+static void saverWorker(void* arg) {
+    TigrSaver* saver = (TigrSaver*)arg;
+
+    for (;;) {
+        SaverJob* job;
+
+        tigrMutexLock(&saver->lock);
+        while (!saver->head && !saver->quit)
+            tigrCondWait(&saver->cond, &saver->lock);
+        job = saver->head;
+        if (job) {
+            saver->head = job->next;
+            if (!saver->head)
+                saver->tail = NULL;
+        }
+        tigrMutexUnlock(&saver->lock);
+        if (!job)
+            break;
+
+        saveJob(saver, job);
+
+        tigrMutexLock(&saver->lock);
+        saver->pending--;
+        tigrCondBroadcast(&saver->cond);
+        tigrMutexUnlock(&saver->lock);
+    }
+}
+
+TigrSaver* tigrSaverCreate(int maxPending, TigrSaverFunc func, void* user) {
+    TigrSaver* saver = (TigrSaver*)calloc(1, sizeof(TigrSaver));
+    if (!saver)
+        return NULL;
+
+    saver->maxPending = maxPending > 0 ? maxPending : 1;
+    saver->func = func;
+    saver->user = user;
+    tigrMutexInit(&saver->lock);
+    tigrCondInit(&saver->cond);
+
+    // Without a thread, images are just saved straight away.
+    saver->started = tigrThreadStart(&saver->thread, saverWorker, saver);
+    return saver;
+}
+
+int tigrSaveImageAsync(TigrSaver* saver, const char* fileName, Tigr* bmp, int level, int wait) {
+    size_t len = strlen(fileName) + 1;
+    SaverJob* job;
+
+    // Reserve a place in the queue before copying anything.
+    tigrMutexLock(&saver->lock);
+    while (saver->pending >= saver->maxPending && wait)
+        tigrCondWait(&saver->cond, &saver->lock);
+    if (saver->pending >= saver->maxPending) {
+        tigrMutexUnlock(&saver->lock);
+        errno = EAGAIN;
+        return 0;
+    }
+    saver->pending++;
+    tigrMutexUnlock(&saver->lock);
+
+    job = (SaverJob*)calloc(1, sizeof(SaverJob));
+    if (job) {
+        job->fileName = (char*)malloc(len);
+        job->bmp = tigrBitmap(bmp->w, bmp->h);
+        job->level = level;
+    }
+    if (!job || !job->fileName || !job->bmp) {
+        if (job) {
+            free(job->fileName);
+            if (job->bmp)
+                tigrFree(job->bmp);
+            free(job);
+        }
+        tigrMutexLock(&saver->lock);
+        saver->pending--;
+        tigrCondBroadcast(&saver->cond);
+        tigrMutexUnlock(&saver->lock);
+        errno = ENOMEM;
+        return 0;
+    }
+    memcpy(job->fileName, fileName, len);
+    memcpy(job->bmp->pix, bmp->pix, bmp->w * bmp->h * sizeof(TPixel));
+
+    if (!saver->started) {
+        saveJob(saver, job);
+        tigrMutexLock(&saver->lock);
+        saver->pending--;
+        tigrCondBroadcast(&saver->cond);
+        tigrMutexUnlock(&saver->lock);
+        return 1;
+    }
+
+    tigrMutexLock(&saver->lock);
+    if (saver->tail)
+        saver->tail->next = job;
+    else
+        saver->head = job;
+    saver->tail = job;
+    tigrCondBroadcast(&saver->cond);
+    tigrMutexUnlock(&saver->lock);
+    return 1;
+}
+
+int tigrSaverPending(TigrSaver* saver) {
+    int pending;
+    tigrMutexLock(&saver->lock);
+    pending = saver->pending;
+    tigrMutexUnlock(&saver->lock);
+    return pending;
+}
+
+void tigrSaverFree(TigrSaver* saver) {
+    tigrMutexLock(&saver->lock);
+    saver->quit = 1;
+    tigrCondBroadcast(&saver->cond);
+    tigrMutexUnlock(&saver->lock);
+
+    if (saver->started)
+        tigrThreadJoin(saver->thread);
+
+    tigrCondDestroy(&saver->cond);
+    tigrMutexDestroy(&saver->lock);
+    free(saver);
+}
+
+//////// End of inlined file: tigr_saver.c ////////
+
+//////// Start of inlined file: tigr_print.c ////////
+
+//#include "tigr_internal.h"
+//////// Start of inlined file: tigr_font.h ////////
+
+// Auto-generated by incbin.pl from font.png
+
+const unsigned char tigr_font[] = {
+	0x89,0x50,0x4e,0x47,0x0d,0x0a,0x1a,0x0a,0x00,0x00,0x00,0x0d,0x49,0x48,0x44,0x52,
+	0x00,0x00,0x00,0xfd,0x00,0x00,0x00,0x5c,0x08,0x03,0x00,0x00,0x00,0x92,0xab,0x43,
+	0x85,0x00,0x00,0x03,0x00,0x50,0x4c,0x54,0x45,0x5f,0x53,0x87,0x00,0x00,0x00,0x54,
+	0x54,0x54,0xff,0xff,0xfa,0x31,0x2a,0x42,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
+	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
+	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
+	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
 	0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,
 	0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,
 	0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,0x00,0x80,0x00,
@@ -1660,292 +4931,2075 @@ const unsigned char tigr_font[] = {
 	0x1b,0xaa,0xdf,0x6a,0xd1,0xba,0xa4,0x00,0x00,0x00,0x00,0x49,0x45,0x4e,0x44,0xae,
 	0x42,0x60,0x82 };
 
-int tigr_font_size = (int)sizeof(tigr_font);
+int tigr_font_size = (int)sizeof(tigr_font);
+
+
+//////// End of inlined file: tigr_font.h ////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdio.h>
+
+#ifdef _MSC_VER
+#define vsnprintf _vsnprintf
+#endif
+
+TigrFont tigrStockFont;
+TigrFont* const tfont = &tigrStockFont;
+
+// Converts 8-bit codepage entries into Unicode code points.
+static int cp1252[] = {
+    0x20ac, 0xfffd, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021, 0x02c6, 0x2030, 0x0160, 0x2039, 0x0152,
+    0xfffd, 0x017d, 0xfffd, 0xfffd, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014, 0x02dc, 0x2122,
+    0x0161, 0x203a, 0x0153, 0xfffd, 0x017e, 0x0178, 0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x00a4, 0x00a5, 0x00a6,
+    0x00a7, 0x00a8, 0x00a9, 0x00aa, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af, 0x00b0, 0x00b1, 0x00b2, 0x00b3,
+    0x00b4, 0x00b5, 0x00b6, 0x00b7, 0x00b8, 0x00b9, 0x00ba, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x00bf, 0x00c0,
+    0x00c1, 0x00c2, 0x00c3, 0x00c4, 0x00c5, 0x00c6, 0x00c7, 0x00c8, 0x00c9, 0x00ca, 0x00cb, 0x00cc, 0x00cd,
+    0x00ce, 0x00cf, 0x00d0, 0x00d1, 0x00d2, 0x00d3, 0x00d4, 0x00d5, 0x00d6, 0x00d7, 0x00d8, 0x00d9, 0x00da,
+    0x00db, 0x00dc, 0x00dd, 0x00de, 0x00df, 0x00e0, 0x00e1, 0x00e2, 0x00e3, 0x00e4, 0x00e5, 0x00e6, 0x00e7,
+    0x00e8, 0x00e9, 0x00ea, 0x00eb, 0x00ec, 0x00ed, 0x00ee, 0x00ef, 0x00f0, 0x00f1, 0x00f2, 0x00f3, 0x00f4,
+    0x00f5, 0x00f6, 0x00f7, 0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x00fd, 0x00fe, 0x00ff,
+};
+
+// Glyphs are separated by pixels the same color as the top-left one (ignoring alpha).
+typedef struct {
+    const TPixel* pix;
+    int w, h;
+    unsigned key, mask;
+} Sheet;
+
+static unsigned rgbBits(const Sheet* sheet, const TPixel* p) {
+    unsigned v;
+    memcpy(&v, p, sizeof(v));
+    return v & sheet->mask;
+}
+
+static void sheetInit(Sheet* sheet, Tigr* bmp) {
+    TPixel rgb = { 0xff, 0xff, 0xff, 0 };
+    sheet->pix = bmp->pix;
+    sheet->w = bmp->w;
+    sheet->h = bmp->h;
+    memcpy(&sheet->mask, &rgb, sizeof(sheet->mask));
+    sheet->key = rgbBits(sheet, bmp->pix);
+}
+
+// Finds the next glyph, skipping over border pixels a row at a time.
+static void scan(const Sheet* sheet, int* x, int* y, int* rowh) {
+    while (*y < sheet->h) {
+        const TPixel* row;
+        int px = *x;
+
+        if (px >= sheet->w) {
+            px = 0;
+            (*y) += *rowh;
+            *rowh = 1;
+            if (*y >= sheet->h) {
+                *x = px;
+                return;
+            }
+        }
+        row = sheet->pix + *y * sheet->w;
+        while (px < sheet->w && rgbBits(sheet, row + px) == sheet->key)
+            px++;
+        *x = px;
+        if (px < sheet->w)
+            return;
+    }
+}
+
+// Measures a glyph, from its top-left pixel to the border on its right and below.
+static void measure(const Sheet* sheet, int x, int y, int* w, int* h) {
+    const TPixel* p = sheet->pix + y * sheet->w + x;
+    int n;
+
+    for (n = 0; x + n < sheet->w && rgbBits(sheet, p + n) != sheet->key; n++)
+        ;
+    *w = n;
+    for (n = 0; y + n < sheet->h && rgbBits(sheet, p) != sheet->key; n++)
+        p += sheet->w;
+    *h = n;
+}
+
+// Orders glyphs by code point, then by where they are on the sheet.
+static int compareGlyphs(const void* a, const void* b) {
+    const TigrGlyph* ga = (const TigrGlyph*)a;
+    const TigrGlyph* gb = (const TigrGlyph*)b;
+    if (ga->code != gb->code)
+        return ga->code < gb->code ? -1 : 1;
+    if (ga->y != gb->y)
+        return ga->y < gb->y ? -1 : 1;
+    return ga->x < gb->x ? -1 : ga->x > gb->x;
+}
+
+static void sortGlyphs(TigrFont* font) {
+    // Sheets are usually in code point order already.
+    for (int i = 1; i < font->numGlyphs; i++) {
+        if (font->glyphs[i - 1].code > font->glyphs[i].code) {
+            qsort(font->glyphs, font->numGlyphs, sizeof(TigrGlyph), compareGlyphs);
+            return;
+        }
+    }
+}
+
+/*
+ * Watermarks are encoded vertically in the alpha channel using seven pixels
+ * starting at x, y. The first and last alpha values contain the magic values
+ * 0b10101010 and 0b01010101 respectively.
+ */
+static int readWatermark(Tigr* bmp, int x, int y, int* big, int* small) {
+    const int magicHeader = 0xAA;
+    const int magicFooter = 0x55;
+
+    unsigned char watermark[7];
+
+    for (int i = 0; i < 7; i++) {
+        TPixel c = tigrGet(bmp, x, y + i);
+        watermark[i] = c.a;
+    }
+
+    if (watermark[0] != magicHeader || watermark[6] != magicFooter) {
+        return 0;
+    }
+
+    *big = watermark[1] | (watermark[2] << 8) | (watermark[3] << 16) | (watermark[4] << 24);
+    *small = watermark[5];
+
+    return 1;
+}
+
+static TigrGlyph* search(TigrFont* font, int code) {
+    unsigned lo = 0, hi = font->numGlyphs;
+    while (lo < hi) {
+        unsigned guess = (lo + hi) / 2;
+        if (code < font->glyphs[guess].code)
+            hi = guess;
+        else
+            lo = guess + 1;
+    }
+    return (lo == 0 || font->glyphs[lo - 1].code != code) ? NULL : &font->glyphs[lo - 1];
+}
+
+static void freeIndex(TigrFont* font) {
+    for (int i = 0; i < font->numPages; i++)
+        free(font->pages[i]);
+    free(font->pages);
+    font->pages = NULL;
+    font->numPages = 0;
+}
+
+// Builds a two-level table from code points to glyphs, with a page for each
+// block of 256 code points that has any glyphs in it.
+static int indexGlyphs(TigrFont* font) {
+    TigrGlyph* g;
+    int numPages;
+
+    freeIndex(font);
+    if (font->numGlyphs <= 0) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    font->fallback = search(font, '?');
+    if (!font->fallback)
+        font->fallback = search(font, 0xfffd);
+    if (!font->fallback)
+        font->fallback = &font->glyphs[0];
+
+    // Glyphs are sorted, so the last one has the highest code point.
+    // Anything past the end of Unicode is left out.
+    numPages = font->glyphs[font->numGlyphs - 1].code;
+    numPages = (numPages < 0 ? 0 : numPages > 0x10ffff ? 0x10ffff : numPages) / 256 + 1;
+    font->pages = (TigrGlyph***)calloc(numPages, sizeof(TigrGlyph**));
+    if (!font->pages) {
+        errno = ENOMEM;
+        return 0;
+    }
+    font->numPages = numPages;
+
+    for (g = font->glyphs; g < font->glyphs + font->numGlyphs; g++) {
+        TigrGlyph** page;
+        if (g->code < 0 || g->code > 0x10ffff)
+            continue;
+        page = font->pages[g->code >> 8];
+        if (!page) {
+            page = font->pages[g->code >> 8] = (TigrGlyph**)malloc(256 * sizeof(TigrGlyph*));
+            if (!page) {
+                freeIndex(font);
+                errno = ENOMEM;
+                return 0;
+            }
+            for (int i = 0; i < 256; i++)
+                page[i] = font->fallback;
+        }
+        page[g->code & 0xff] = g;
+    }
+    return 1;
+}
+
+static void freeAtlas(TigrFont* font) {
+    if (font->atlas) {
+        free(font->atlas->index);
+        free(font->atlas);
+        font->atlas = NULL;
+    }
+}
+
+// Copies the glyphs into an 8-bit atlas, if they use few enough colors.
+// Fonts with more stay drawn with tigrBlitTint.
+static void buildAtlas(TigrFont* font) {
+    Tigr* bmp = font->bitmap;
+    TigrFontAtlas* atlas;
+    unsigned keys[512];
+    unsigned char slots[512];
+
+    freeAtlas(font);
+    atlas = (TigrFontAtlas*)calloc(1, sizeof(TigrFontAtlas));
+    if (!atlas)
+        return;
+    atlas->index = (unsigned char*)calloc((size_t)bmp->w * bmp->h, 1);
+    if (!atlas->index) {
+        free(atlas);
+        return;
+    }
+
+    // Index 0 is for transparent pixels, which blending leaves alone whatever their color.
+    atlas->numColors = 1;
+    memset(slots, 0, sizeof(slots));
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* g = &font->glyphs[i];
+        int x1 = g->x + g->w < bmp->w ? g->x + g->w : bmp->w;
+        int y1 = g->y + g->h < bmp->h ? g->y + g->h : bmp->h;
+        for (int y = g->y < 0 ? 0 : g->y; y < y1; y++) {
+            const TPixel* src = bmp->pix + y * bmp->w;
+            unsigned char* dst = atlas->index + y * bmp->w;
+            for (int x = g->x < 0 ? 0 : g->x; x < x1; x++) {
+                unsigned key, h;
+                if (src[x].a == 0)
+                    continue;
+                memcpy(&key, &src[x], sizeof(key));
+                h = (key * 0x9e3779b1u) >> 23;
+                while (slots[h] && keys[h] != key)
+                    h = (h + 1) & 511;
+                if (!slots[h]) {
+                    if (atlas->numColors == 256) {
+                        free(atlas->index);
+                        free(atlas);
+                        return;
+                    }
+                    keys[h] = key;
+                    slots[h] = (unsigned char)atlas->numColors;
+                    atlas->palette[atlas->numColors++] = src[x];
+                }
+                dst[x] = slots[h];
+            }
+        }
+    }
+    font->atlas = atlas;
+}
+
+int tigrLoadGlyphs(TigrFont* font, int codepage) {
+    int x = 0;
+    int y = 0;
+    int w = 0;
+    int h = 0;
+    int rowh = 1;
+
+    TigrGlyph* g;
+    Sheet sheet;
+    sheetInit(&sheet, font->bitmap);
+    switch (codepage) {
+        case TCP_ASCII:
+            font->numGlyphs = 128 - 32;
+            break;
+        case TCP_1252:
+            font->numGlyphs = 256 - 32;
+            break;
+        case TCP_UTF32:
+            if (!readWatermark(font->bitmap, 0, 0, &font->numGlyphs, &rowh)) {
+                return 0;
+            }
+            h = rowh;
+            x = 1;
+            break;
+        default:
+            errno = EINVAL;
+            return 0;
+    }
+
+    font->glyphs = (TigrGlyph*)calloc(font->numGlyphs, sizeof(TigrGlyph));
+
+    for (int index = 0; index < font->numGlyphs; index++) {
+        // Look up the Unicode code point.
+        g = &font->glyphs[index];
+
+        if (codepage != TCP_UTF32) {
+            // Find the next glyph.
+            scan(&sheet, &x, &y, &rowh);
+
+            if (y >= font->bitmap->h) {
+                errno = EINVAL;
+                return 0;
+            }
+
+            // Scan the width and height
+            measure(&sheet, x, y, &w, &h);
+        }
+
+        switch (codepage) {
+            case TCP_ASCII:
+                g->code = index + 32;
+                break;
+            case TCP_1252:
+                if (index < 96) {
+                    g->code = index + 32;
+                } else {
+                    g->code = cp1252[index - 96];
+                }
+                break;
+            case TCP_UTF32:
+                if (!readWatermark(font->bitmap, x, y, &g->code, &w)) {
+                    // Maybe we are at the end of a row?
+                    x = 0;
+                    y += rowh;
+                    if (!readWatermark(font->bitmap, x, y, &g->code, &w)) {
+                        return 0;
+                    }
+                }
+                x++;
+                break;
+            default:
+                return 0;
+        }
+
+        g->x = x;
+        g->y = y;
+        g->w = w;
+        g->h = h;
+        x += w;
+        if (h != font->glyphs[0].h) {
+            errno = EINVAL;
+            return 0;
+        }
+
+        if (h > rowh) {
+            rowh = h;
+        }
+    }
+
+    sortGlyphs(font);
+    buildAtlas(font);
+    return indexGlyphs(font);
+}
+
+TigrFont* tigrLoadFont(Tigr* bitmap, int codepage) {
+    TigrFont* font = (TigrFont*)calloc(1, sizeof(TigrFont));
+    font->bitmap = bitmap;
+    if (!tigrLoadGlyphs(font, codepage)) {
+        tigrFreeFont(font);
+        return NULL;
+    }
+    return font;
+}
+
+// Glyph tables are "TIGRGLYF", then version, glyph count and sheet size,
+// then code, x, y, w, h for each glyph. All little-endian 32-bit values.
+#define GLYPH_TABLE_VERSION 1
+#define GLYPH_TABLE_HEADER 24
+
+int tigrSaveFontTable(TigrFont* font, const char* fileName) {
+    unsigned char header[GLYPH_TABLE_HEADER], entry[20];
+    FILE* out;
+    int ok;
+
+    memcpy(header, "TIGRGLYF", 8);
+    tigrPut32LE(header + 8, GLYPH_TABLE_VERSION);
+    tigrPut32LE(header + 12, font->numGlyphs);
+    tigrPut32LE(header + 16, font->bitmap->w);
+    tigrPut32LE(header + 20, font->bitmap->h);
+
+    out = tigrOpenFile(fileName, "wb");
+    if (!out)
+        return 0;
+
+    ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+    for (int i = 0; i < font->numGlyphs && ok; i++) {
+        TigrGlyph* g = &font->glyphs[i];
+        tigrPut32LE(entry, g->code);
+        tigrPut32LE(entry + 4, g->x);
+        tigrPut32LE(entry + 8, g->y);
+        tigrPut32LE(entry + 12, g->w);
+        tigrPut32LE(entry + 16, g->h);
+        ok = fwrite(entry, 1, sizeof(entry), out) == sizeof(entry);
+    }
+    ok = (fclose(out) == 0) && ok;
+    return ok;
+}
+
+// Reads a saved glyph table, checking it fits the font's bitmap.
+static int readTable(TigrFont* font, const unsigned char* data, int length) {
+    unsigned count;
+
+    errno = EINVAL;
+    if (length < GLYPH_TABLE_HEADER || memcmp(data, "TIGRGLYF", 8) != 0 ||
+        tigrGet32LE(data + 8) != GLYPH_TABLE_VERSION || tigrGet32LE(data + 16) != (unsigned)font->bitmap->w ||
+        tigrGet32LE(data + 20) != (unsigned)font->bitmap->h)
+        return 0;
+    count = tigrGet32LE(data + 12);
+    if (count == 0 || count > (unsigned)(length - GLYPH_TABLE_HEADER) / 20)
+        return 0;
+
+    font->glyphs = (TigrGlyph*)malloc(count * sizeof(TigrGlyph));
+    if (!font->glyphs) {
+        errno = ENOMEM;
+        return 0;
+    }
+    font->numGlyphs = (int)count;
+
+    data += GLYPH_TABLE_HEADER;
+    for (unsigned i = 0; i < count; i++, data += 20) {
+        TigrGlyph* g = &font->glyphs[i];
+        g->code = (int)tigrGet32LE(data);
+        g->x = (int)tigrGet32LE(data + 4);
+        g->y = (int)tigrGet32LE(data + 8);
+        g->w = (int)tigrGet32LE(data + 12);
+        g->h = (int)tigrGet32LE(data + 16);
+        if (g->x < 0 || g->y < 0 || g->w < 0 || g->h < 0 || g->w > font->bitmap->w - g->x ||
+            g->h > font->bitmap->h - g->y)
+            return 0;
+    }
+    return 1;
+}
+
+TigrFont* tigrLoadFontTable(Tigr* bitmap, const char* fileName) {
+    TigrFont* font = (TigrFont*)calloc(1, sizeof(TigrFont));
+    int length, ok;
+    void* data;
+
+    if (!font) {
+        tigrFree(bitmap);
+        errno = ENOMEM;
+        return NULL;
+    }
+    font->bitmap = bitmap;
+
+    data = tigrReadFile(fileName, &length);
+    if (!data) {
+        tigrFreeFont(font);
+        return NULL;
+    }
+    ok = readTable(font, (const unsigned char*)data, length);
+    free(data);
+    if (!ok) {
+        tigrFreeFont(font);
+        return NULL;
+    }
+
+    sortGlyphs(font);
+    buildAtlas(font);
+    if (!indexGlyphs(font)) {
+        tigrFreeFont(font);
+        return NULL;
+    }
+    return font;
+}
+
+#undef GLYPH_TABLE_VERSION
+#undef GLYPH_TABLE_HEADER
+
+void tigrFreeFont(TigrFont* font) {
+    freeIndex(font);
+    freeAtlas(font);
+    tigrFree(font->bitmap);
+    free(font->glyphs);
+    free(font);
+}
+
+static TigrGlyph* get(TigrFont* font, int code) {
+    TigrGlyph* g;
+    if (font->pages) {
+        unsigned page = (unsigned)code >> 8;
+        return page < (unsigned)font->numPages && font->pages[page] ? font->pages[page][code & 0xff] : font->fallback;
+    }
+
+    // Fonts filled in by hand don't have a table.
+    g = search(font, code);
+    if (g)
+        return g;
+    g = search(font, '?');
+    return g ? g : &font->glyphs[0];
+}
+
+TigrGlyph* tigrGlyph(TigrFont* font, int code) {
+    return get(font, code);
+}
+
+static TigrOnce stockFontOnce = TIGR_ONCE_INIT;
+
+static void loadStockFont(void) {
+    tigrStockFont.bitmap = tigrLoadImageMem(tigr_font, tigr_font_size);
+    tigrLoadGlyphs(&tigrStockFont, 1252);
+}
+
+void tigrSetupFont(TigrFont* font) {
+    // Load the stock font the first time it's used, on whichever thread gets there first.
+    if (font == &tigrStockFont)
+        tigrOnce(&stockFontOnce, loadStockFont);
+}
+
+// Draws glyphs in the given color, through the atlas when the font has one.
+typedef struct {
+    Tigr* dest;
+    TigrFont* font;
+    TPixel color;
+    TigrTintTable tint;
+} GlyphPen;
+
+static void penInit(GlyphPen* pen, Tigr* dest, TigrFont* font, TPixel color) {
+    pen->dest = dest;
+    pen->font = font;
+    pen->color = color;
+    if (font->atlas)
+        tigrTintTable(&pen->tint, font->atlas->palette, font->atlas->numColors, color);
+}
+
+static void penDraw(GlyphPen* pen, TigrGlyph* g, int x, int y) {
+    TigrFont* font = pen->font;
+    if (font->atlas)
+        tigrBlitIndexed(pen->dest, font->bitmap, font->atlas->index, &pen->tint, x, y, g->x, g->y, g->w, g->h);
+    else
+        tigrBlitTint(pen->dest, font->bitmap, x, y, g->x, g->y, g->w, g->h, pen->color);
+}
+
+void tigrPrintText(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const char* text, int length) {
+    const char* end;
+    GlyphPen pen;
+    TigrGlyph* g;
+    int start = x, rowh, cps[256], n;
+
+    tigrSetupFont(font);
+    penInit(&pen, dest, font, color);
+    rowh = get(font, 0)->h;
+
+    // Print each glyph, decoding a block of text at a time.
+    end = text + (length < 0 ? strlen(text) : (size_t)length);
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\r')
+                continue;
+            if (cps[i] == '\n') {
+                x = start;
+                y += rowh;
+                continue;
+            }
+            g = get(font, cps[i]);
+            penDraw(&pen, g, x, y);
+            x += g->w;
+        }
+    }
+}
+
+void tigrPrint(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const char* text, ...) {
+    char tmp[1024];
+    va_list args;
+
+    // Expand the formatting string.
+    va_start(args, text);
+    vsnprintf(tmp, sizeof(tmp), text, args);
+    tmp[sizeof(tmp) - 1] = 0;
+    va_end(args);
+
+    tigrPrintText(dest, font, x, y, color, tmp, -1);
+}
+
+int tigrTextWidth(TigrFont* font, const char* text) {
+    const char* end = text + strlen(text);
+    int x = 0, w = 0, cps[256], n;
+    tigrSetupFont(font);
+
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n' || cps[i] == '\r') {
+                x = 0;
+            } else {
+                x += get(font, cps[i])->w;
+                w = (x > w) ? x : w;
+            }
+        }
+    }
+    return w;
+}
+
+int tigrTextHeight(TigrFont* font, const char* text) {
+    const char* end = text + strlen(text);
+    int rowh, h, cps[256], n;
+    tigrSetupFont(font);
+
+    h = rowh = get(font, 0)->h;
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n' && (i + 1 < n || text < end))
+                h += rowh;
+        }
+    }
+    return h;
+}
+
+typedef struct {
+    TigrGlyph* glyph;
+    int x, y;
+} PlacedGlyph;
+
+struct TigrTextLayout {
+    TigrFont* font;
+    int numGlyphs;
+    PlacedGlyph* glyphs;
+    int numLines;
+    int* lines;  // index of the first glyph on each line, plus one past the end
+    int rowh, w, h;
+};
+
+TigrTextLayout* tigrLayoutText(TigrFont* font, const char* text, int length) {
+    TigrTextLayout* layout;
+    const char *p, *end;
+    int x = 0, y = 0, cps[256], n, glyphs = 0, lines = 1;
+
+    tigrSetupFont(font);
+    end = text + (length < 0 ? strlen(text) : (size_t)length);
+
+    // Count first, so everything can be allocated up front.
+    for (p = text; (n = tigrDecodeUTF8Run(&p, end, cps, 256)) > 0;) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n')
+                lines++;
+            else if (cps[i] != '\r')
+                glyphs++;
+        }
+    }
+
+    layout = (TigrTextLayout*)calloc(1, sizeof(TigrTextLayout));
+    if (layout) {
+        layout->glyphs = (PlacedGlyph*)malloc((glyphs ? glyphs : 1) * sizeof(PlacedGlyph));
+        layout->lines = (int*)malloc((lines + 1) * sizeof(int));
+    }
+    if (!layout || !layout->glyphs || !layout->lines) {
+        tigrFreeLayout(layout);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    layout->font = font;
+    layout->rowh = get(font, 0)->h;
+    layout->lines[0] = 0;
+    for (p = text; (n = tigrDecodeUTF8Run(&p, end, cps, 256)) > 0;) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\r')
+                continue;
+            if (cps[i] == '\n') {
+                layout->lines[++layout->numLines] = layout->numGlyphs;
+                x = 0;
+                y += layout->rowh;
+                continue;
+            }
+            PlacedGlyph* g = &layout->glyphs[layout->numGlyphs++];
+            g->glyph = get(font, cps[i]);
+            g->x = x;
+            g->y = y;
+            x += g->glyph->w;
+            layout->w = x > layout->w ? x : layout->w;
+        }
+    }
+    layout->lines[++layout->numLines] = layout->numGlyphs;
+
+    // A trailing newline doesn't add a line, as in tigrTextHeight.
+    layout->h = layout->rowh * (layout->numLines - (lines > 1 && end[-1] == '\n'));
+    return layout;
+}
+
+void tigrDrawLayout(Tigr* dest, TigrTextLayout* layout, int x, int y, TPixel color) {
+    int cy = dest->ch >= 0 ? dest->cy : 0;
+    int ch = dest->ch >= 0 ? dest->ch : dest->h;
+    int first, last;
+    GlyphPen pen;
+
+    // Only lines that overlap the clip rect get drawn.
+    first = layout->rowh > 0 && cy > y ? (cy - y) / layout->rowh : 0;
+    last = layout->rowh > 0 ? (cy + ch - y + layout->rowh - 1) / layout->rowh : layout->numLines;
+    last = last < layout->numLines ? last : layout->numLines;
+    if (first >= last)
+        return;
+
+    penInit(&pen, dest, layout->font, color);
+    for (int i = layout->lines[first]; i < layout->lines[last]; i++) {
+        PlacedGlyph* g = &layout->glyphs[i];
+        penDraw(&pen, g->glyph, x + g->x, y + g->y);
+    }
+}
+
+void tigrLayoutSize(TigrTextLayout* layout, int* w, int* h) {
+    if (w)
+        *w = layout->w;
+    if (h)
+        *h = layout->h;
+}
+
+void tigrFreeLayout(TigrTextLayout* layout) {
+    if (!layout)
+        return;
+    free(layout->glyphs);
+    free(layout->lines);
+    free(layout);
+}
+
+//////// End of inlined file: tigr_print.c ////////
+
+//////// Start of inlined file: tigr_textcache.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// A string rendered once, trimmed to the pixels its glyphs cover. Glyphs never
+// overlap, so one blit of the whole label gives the same result as a blit per glyph.
+typedef struct TextEntry {
+    TigrFont* font;
+    char* text;
+    int length;
+    unsigned long long hash;
+    int dx, dy;            // offset of the trimmed label from where the text starts
+    Tigr shape;            // label size; pix holds untinted glyphs if there's no index
+    unsigned char* index;  // label as font atlas indices, if the font has an atlas
+    long long bytes;
+    int refs, evicted;     // threads drawing it, and whether it's left the cache
+
+    struct TextEntry* next;            // hash chain
+    struct TextEntry *newer, *older;  // most recently drawn first
+} TextEntry;
+
+struct TigrTextCache {
+    TigrMutex lock;
+    long long budget;
+    int count, numBuckets;
+    TextEntry** buckets;
+    TextEntry *newest, *oldest;
+    TigrCacheStats stats;
+};
+
+// FNV-1a, over the text and the font it's drawn with.
+static unsigned long long textHash(TigrFont* font, const char* text, int length) {
+    unsigned long long h = 0xcbf29ce484222325ULL ^ (unsigned long long)(size_t)font;
+    while (length--)
+        h = (h ^ (unsigned char)*text++) * 0x100000001b3ULL;
+    return h;
+}
+
+static unsigned textBucket(TigrTextCache* cache, unsigned long long h) {
+    return (unsigned)(h ^ (h >> 32)) & (cache->numBuckets - 1);
+}
+
+static void textUnlinkLru(TigrTextCache* cache, TextEntry* e) {
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        cache->newest = e->older;
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        cache->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void textPushLru(TigrTextCache* cache, TextEntry* e) {
+    e->older = cache->newest;
+    if (cache->newest)
+        cache->newest->newer = e;
+    else
+        cache->oldest = e;
+    cache->newest = e;
+}
+
+static void textDestroy(TextEntry* e) {
+    free(e->shape.pix);
+    free(e->index);
+    free(e->text);
+    free(e);
+}
+
+// Drops the least recently drawn labels until the cache is within budget,
+// always keeping the newest. Labels still being drawn are freed by textUnpin.
+static void textEvict(TigrTextCache* cache) {
+    while (cache->stats.bytes > cache->budget && cache->oldest != cache->newest) {
+        TextEntry* e = cache->oldest;
+        TextEntry** link = &cache->buckets[textBucket(cache, e->hash)];
+        while (*link != e)
+            link = &(*link)->next;
+        *link = e->next;
+        textUnlinkLru(cache, e);
+        cache->count--;
+        cache->stats.images--;
+        cache->stats.bytes -= e->bytes;
+        cache->stats.evictions++;
+        if (e->refs > 0)
+            e->evicted = 1;
+        else
+            textDestroy(e);
+    }
+}
+
+static TextEntry* textFind(TigrTextCache* cache, unsigned long long h, TigrFont* font, const char* text, int length) {
+    TextEntry* e;
+    for (e = cache->buckets[textBucket(cache, h)]; e; e = e->next) {
+        if (e->hash == h && e->font == font && e->length == length && memcmp(e->text, text, length) == 0)
+            break;
+    }
+    return e;
+}
 
+// Marks a label as the most recently drawn, and keeps it alive until textUnpin.
+// Called with the lock held.
+static void textPin(TigrTextCache* cache, TextEntry* e) {
+    e->refs++;
+    textPushLru(cache, e);
+    textEvict(cache);
+}
 
-//////// End of inlined file: tigr_font.h ////////
+static void textUnpin(TigrTextCache* cache, TextEntry* e) {
+    int destroy;
+    tigrMutexLock(&cache->lock);
+    destroy = --e->refs == 0 && e->evicted;
+    tigrMutexUnlock(&cache->lock);
+    if (destroy)
+        textDestroy(e);
+}
+
+static void textGrow(TigrTextCache* cache) {
+    int oldBuckets = cache->numBuckets;
+    TextEntry** old = cache->buckets;
+    TextEntry** buckets = (TextEntry**)calloc(oldBuckets * 2, sizeof(TextEntry*));
+    if (!buckets)
+        return;
+
+    cache->numBuckets = oldBuckets * 2;
+    cache->buckets = buckets;
+    for (int i = 0; i < oldBuckets; i++) {
+        while (old[i]) {
+            TextEntry* e = old[i];
+            unsigned b = textBucket(cache, e->hash);
+            old[i] = e->next;
+            e->next = buckets[b];
+            buckets[b] = e;
+        }
+    }
+    free(old);
+}
+
+// Finds the box covered by non-transparent pixels. Returns zero if there are none.
+static int textTrim(Tigr* bmp, const unsigned char* index, int box[4]) {
+    int x0 = bmp->w, y0 = bmp->h, x1 = 0, y1 = 0;
+    for (int y = 0; y < bmp->h; y++) {
+        for (int x = 0; x < bmp->w; x++) {
+            int i = y * bmp->w + x;
+            if (index ? index[i] != 0 : bmp->pix[i].a != 0) {
+                x0 = x < x0 ? x : x0;
+                x1 = x >= x1 ? x + 1 : x1;
+                y0 = y < y0 ? y : y0;
+                y1 = y + 1;
+            }
+        }
+    }
+    box[0] = x0;
+    box[1] = y0;
+    box[2] = x1 - x0;
+    box[3] = y1 - y0;
+    return x1 > x0;
+}
+
+// Renders text into a new entry, the same way tigrPrintText lays it out.
+static TextEntry* textRender(TigrFont* font, const char* text, int length) {
+    const char* end = text + length;
+    const char* p;
+    TextEntry* e;
+    TigrFontAtlas* atlas = font->atlas;
+    Tigr* sheet = font->bitmap;
+    Tigr full;
+    unsigned char* index = NULL;
+    int rowh = tigrGlyph(font, 0)->h;
+    int x = 0, y = 0, w = 0, lines = 1, box[4], c;
+
+    for (p = text; p < end;) {
+        p = tigrDecodeUTF8N(p, end, &c);
+        if (c == '\n') {
+            x = 0;
+            lines++;
+        } else if (c != '\r') {
+            x += tigrGlyph(font, c)->w;
+            w = x > w ? x : w;
+        }
+    }
+
+    e = (TextEntry*)calloc(1, sizeof(TextEntry));
+    if (!e)
+        return NULL;
+    e->text = (char*)malloc(length + 1);
+    if (!e->text) {
+        free(e);
+        return NULL;
+    }
+    memcpy(e->text, text, length);
+    e->text[length] = '\0';
+    e->length = length;
+    e->font = font;
+
+    // Draw the glyphs into a full-size label.
+    memset(&full, 0, sizeof(full));
+    full.w = w;
+    full.h = lines * rowh;
+    if (atlas)
+        index = (unsigned char*)calloc((size_t)full.w * full.h + 1, 1);
+    else
+        full.pix = (TPixel*)calloc((size_t)full.w * full.h + 1, sizeof(TPixel));
+    if (!index && !full.pix) {
+        textDestroy(e);
+        return NULL;
+    }
+    full.cw = full.ch = -1;
+
+    x = y = 0;
+    for (p = text; p < end;) {
+        TigrGlyph* g;
+        p = tigrDecodeUTF8N(p, end, &c);
+        if (c == '\r')
+            continue;
+        if (c == '\n') {
+            x = 0;
+            y += rowh;
+            continue;
+        }
+        g = tigrGlyph(font, c);
+        if (atlas) {
+            for (int row = 0; row < g->h; row++)
+                memcpy(index + (y + row) * full.w + x, atlas->index + (g->y + row) * sheet->w + g->x, g->w);
+        } else {
+            tigrBlit(&full, sheet, x, y, g->x, g->y, g->w, g->h);
+        }
+        x += g->w;
+    }
+
+    // Keep just the part that gets drawn.
+    memset(&e->shape, 0, sizeof(e->shape));
+    if (textTrim(&full, index, box)) {
+        e->dx = box[0];
+        e->dy = box[1];
+        e->shape.w = box[2];
+        e->shape.h = box[3];
+        if (atlas)
+            e->index = (unsigned char*)malloc((size_t)box[2] * box[3]);
+        else
+            e->shape.pix = (TPixel*)malloc((size_t)box[2] * box[3] * sizeof(TPixel));
+        if (!e->index && !e->shape.pix) {
+            free(index);
+            free(full.pix);
+            textDestroy(e);
+            return NULL;
+        }
+        for (int row = 0; row < box[3]; row++) {
+            int from = (box[1] + row) * full.w + box[0];
+            if (atlas)
+                memcpy(e->index + row * box[2], index + from, box[2]);
+            else
+                memcpy(e->shape.pix + row * box[2], full.pix + from, box[2] * sizeof(TPixel));
+        }
+    }
+    free(index);
+    free(full.pix);
+
+    e->shape.cw = e->shape.ch = -1;
+    e->bytes = sizeof(TextEntry) + length + 1 + (long long)e->shape.w * e->shape.h * (atlas ? 1 : sizeof(TPixel));
+    return e;
+}
+
+TigrTextCache* tigrTextCacheCreate(long long budget) {
+    TigrTextCache* cache = (TigrTextCache*)calloc(1, sizeof(TigrTextCache));
+    if (!cache) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    cache->budget = budget;
+    cache->numBuckets = 64;
+    cache->buckets = (TextEntry**)calloc(cache->numBuckets, sizeof(TextEntry*));
+    if (!cache->buckets) {
+        free(cache);
+        errno = ENOMEM;
+        return NULL;
+    }
+    tigrMutexInit(&cache->lock);
+    return cache;
+}
+
+void tigrPrintCached(TigrTextCache* cache,
+                     Tigr* dest,
+                     TigrFont* font,
+                     int x,
+                     int y,
+                     TPixel color,
+                     const char* text,
+                     int length) {
+    unsigned long long h;
+    TextEntry *e, *made;
+
+    tigrSetupFont(font);
+    if (length < 0)
+        length = (int)strlen(text);
+    h = textHash(font, text, length);
+
+    // The lock only covers the lookup; rendering and drawing happen outside it.
+    tigrMutexLock(&cache->lock);
+    e = textFind(cache, h, font, text, length);
+    if (e) {
+        cache->stats.hits++;
+        textUnlinkLru(cache, e);
+        textPin(cache, e);
+    } else {
+        cache->stats.misses++;
+    }
+    tigrMutexUnlock(&cache->lock);
 
+    if (!e) {
+        made = textRender(font, text, length);
+        if (!made) {
+            // Out of memory, so just draw it directly.
+            tigrPrintText(dest, font, x, y, color, text, length);
+            return;
+        }
+        made->hash = h;
+
+        // Another thread may have added it in the meantime.
+        tigrMutexLock(&cache->lock);
+        e = textFind(cache, h, font, text, length);
+        if (e) {
+            textUnlinkLru(cache, e);
+        } else {
+            e = made;
+            made = NULL;
+            if (cache->count >= cache->numBuckets)
+                textGrow(cache);
+            e->next = cache->buckets[textBucket(cache, h)];
+            cache->buckets[textBucket(cache, h)] = e;
+            cache->count++;
+            cache->stats.images++;
+            cache->stats.bytes += e->bytes;
+        }
+        textPin(cache, e);
+        tigrMutexUnlock(&cache->lock);
+        if (made)
+            textDestroy(made);
+    }
+
+    if (e->shape.w > 0) {
+        if (e->index) {
+            TigrTintTable tint;
+            tigrTintTable(&tint, font->atlas->palette, font->atlas->numColors, color);
+            tigrBlitIndexed(dest, &e->shape, e->index, &tint, x + e->dx, y + e->dy, 0, 0, e->shape.w, e->shape.h);
+        } else {
+            tigrBlitTint(dest, &e->shape, x + e->dx, y + e->dy, 0, 0, e->shape.w, e->shape.h, color);
+        }
+    }
+    textUnpin(cache, e);
+}
+
+void tigrTextCacheStats(TigrTextCache* cache, TigrCacheStats* stats) {
+    tigrMutexLock(&cache->lock);
+    *stats = cache->stats;
+    tigrMutexUnlock(&cache->lock);
+}
+
+void tigrTextCacheFree(TigrTextCache* cache) {
+    while (cache->newest) {
+        TextEntry* e = cache->newest;
+        cache->newest = e->older;
+        textDestroy(e);
+    }
+    tigrMutexDestroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
+
+//////// End of inlined file: tigr_textcache.c ////////
+
+//////// Start of inlined file: tigr_textbox.c ////////
+
+//#include "tigr_internal.h"
 #include <stdlib.h>
-#include <stdarg.h>
+#include <string.h>
 #include <errno.h>
-#include <stdio.h>
 
-#ifdef _MSC_VER
-#define vsnprintf _vsnprintf
-#endif
+// A wrapped line, as a range of bytes in the box's text.
+typedef struct {
+    int start, end, width;
+} BoxLine;
 
-TigrFont tigrStockFont;
-TigrFont* tfont = &tigrStockFont;
+struct TigrTextBox {
+    TigrFont* font;
+    int width, align;
 
-// Converts 8-bit codepage entries into Unicode code points.
-static int cp1252[] = {
-    0x20ac, 0xfffd, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021, 0x02c6, 0x2030, 0x0160, 0x2039, 0x0152,
-    0xfffd, 0x017d, 0xfffd, 0xfffd, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014, 0x02dc, 0x2122,
-    0x0161, 0x203a, 0x0153, 0xfffd, 0x017e, 0x0178, 0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x00a4, 0x00a5, 0x00a6,
-    0x00a7, 0x00a8, 0x00a9, 0x00aa, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af, 0x00b0, 0x00b1, 0x00b2, 0x00b3,
-    0x00b4, 0x00b5, 0x00b6, 0x00b7, 0x00b8, 0x00b9, 0x00ba, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x00bf, 0x00c0,
-    0x00c1, 0x00c2, 0x00c3, 0x00c4, 0x00c5, 0x00c6, 0x00c7, 0x00c8, 0x00c9, 0x00ca, 0x00cb, 0x00cc, 0x00cd,
-    0x00ce, 0x00cf, 0x00d0, 0x00d1, 0x00d2, 0x00d3, 0x00d4, 0x00d5, 0x00d6, 0x00d7, 0x00d8, 0x00d9, 0x00da,
-    0x00db, 0x00dc, 0x00dd, 0x00de, 0x00df, 0x00e0, 0x00e1, 0x00e2, 0x00e3, 0x00e4, 0x00e5, 0x00e6, 0x00e7,
-    0x00e8, 0x00e9, 0x00ea, 0x00eb, 0x00ec, 0x00ed, 0x00ee, 0x00ef, 0x00f0, 0x00f1, 0x00f2, 0x00f3, 0x00f4,
-    0x00f5, 0x00f6, 0x00f7, 0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x00fd, 0x00fe, 0x00ff,
+    char* text;
+    int length, capacity;
+
+    BoxLine* lines;
+    int numLines, maxLines;
+
+    // Where the last paragraph (which may still be appended to) starts.
+    int paraStart, paraLine;
 };
 
-static int border(Tigr* bmp, int x, int y) {
-    TPixel top = tigrGet(bmp, 0, 0);
-    TPixel c = tigrGet(bmp, x, y);
-    return (c.r == top.r && c.g == top.g && c.b == top.b) || x >= bmp->w || y >= bmp->h;
+static int boxAddLine(TigrTextBox* box, int start, int end, int width) {
+    if (box->numLines == box->maxLines) {
+        int maxLines = box->maxLines ? box->maxLines * 2 : 64;
+        BoxLine* lines = (BoxLine*)realloc(box->lines, maxLines * sizeof(BoxLine));
+        if (!lines)
+            return 0;
+        box->lines = lines;
+        box->maxLines = maxLines;
+    }
+    box->lines[box->numLines].start = start;
+    box->lines[box->numLines].end = end;
+    box->lines[box->numLines].width = width;
+    box->numLines++;
+    return 1;
 }
 
-static void scan(Tigr* bmp, int* x, int* y, int* rowh) {
-    while (*y < bmp->h) {
-        if (*x >= bmp->w) {
-            *x = 0;
-            (*y) += *rowh;
-            *rowh = 1;
+// Wraps one paragraph into lines, in a single pass over its glyph widths.
+// Lines break at the last run of spaces that fits (the spaces are dropped),
+// or mid-word if a word is wider than the box.
+static int boxWrap(TigrTextBox* box, int start, int end) {
+    const char* text = box->text;
+    const char* p = text + start;
+    const char* stop = text + end;
+    int lineStart = start, x = 0, inSpaces = 0;
+    int breakEnd = -1, breakWidth = 0, breakNext = 0, breakX = 0;
+
+    if (start == end)
+        return boxAddLine(box, start, end, 0);
+
+    while (p < stop) {
+        int at = (int)(p - text), c, w;
+
+        p = tigrDecodeUTF8N(p, stop, &c);
+        if (c == '\r')
+            continue;
+        w = tigrGlyph(box->font, c)->w;
+
+        if (c == ' ') {
+            if (!inSpaces) {
+                breakEnd = at;
+                breakWidth = x;
+                inSpaces = 1;
+            }
+            x += w;
+            breakNext = (int)(p - text);
+            breakX = x;
+            continue;
         }
-        if (!border(bmp, *x, *y))
-            return;
-        (*x)++;
+        inSpaces = 0;
+
+        while (box->width > 0 && x + w > box->width && at > lineStart) {
+            if (breakEnd > lineStart) {
+                // Wrap at the spaces, and carry the rest of the word over.
+                if (!boxAddLine(box, lineStart, breakEnd, breakWidth))
+                    return 0;
+                x -= breakX;
+                lineStart = breakNext;
+            } else {
+                if (!boxAddLine(box, lineStart, at, x))
+                    return 0;
+                x = 0;
+                lineStart = at;
+            }
+            breakEnd = -1;
+        }
+        x += w;
     }
+
+    // Spaces at the very end don't count towards the width.
+    if (inSpaces && breakEnd >= lineStart)
+        return boxAddLine(box, lineStart, breakEnd, breakWidth);
+    return boxAddLine(box, lineStart, end, x);
 }
 
-/*
- * Watermarks are encoded vertically in the alpha channel using seven pixels
- * starting at x, y. The first and last alpha values contain the magic values
- * 0b10101010 and 0b01010101 respectively.
- */
-static int readWatermark(Tigr* bmp, int x, int y, int* big, int* small) {
-    const int magicHeader = 0xAA;
-    const int magicFooter = 0x55;
+// Lays out everything from the start of the last paragraph onwards.
+static int boxReflow(TigrTextBox* box) {
+    int start = box->paraStart;
 
-    unsigned char watermark[7];
+    box->numLines = box->paraLine;
+    for (int i = start; i < box->length; i++) {
+        if (box->text[i] == '\n') {
+            if (!boxWrap(box, start, i))
+                return 0;
+            start = i + 1;
+            box->paraStart = start;
+            box->paraLine = box->numLines;
+        }
+    }
 
-    for (int i = 0; i < 7; i++) {
-        TPixel c = tigrGet(bmp, x, y + i);
-        watermark[i] = c.a;
+    // The last paragraph only has lines once it has some text.
+    return start == box->length || boxWrap(box, start, box->length);
+}
+
+TigrTextBox* tigrTextBoxCreate(TigrFont* font, int width, int align) {
+    TigrTextBox* box = (TigrTextBox*)calloc(1, sizeof(TigrTextBox));
+    if (!box) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    tigrSetupFont(font);
+    box->font = font;
+    box->width = width;
+    box->align = align;
+    return box;
+}
+
+int tigrTextBoxAppend(TigrTextBox* box, const char* text, int length) {
+    if (length < 0)
+        length = (int)strlen(text);
+    if (box->length + length + 1 > box->capacity) {
+        int capacity = box->capacity ? box->capacity : 256;
+        char* grown;
+        while (capacity < box->length + length + 1)
+            capacity *= 2;
+        grown = (char*)realloc(box->text, capacity);
+        if (!grown) {
+            errno = ENOMEM;
+            return 0;
+        }
+        box->text = grown;
+        box->capacity = capacity;
     }
+    memcpy(box->text + box->length, text, length);
+    box->length += length;
+    box->text[box->length] = '\0';
 
-    if (watermark[0] != magicHeader || watermark[6] != magicFooter) {
+    if (!boxReflow(box)) {
+        errno = ENOMEM;
+        return 0;
+    }
+    return 1;
+}
+
+int tigrTextBoxSetWidth(TigrTextBox* box, int width) {
+    box->width = width;
+    box->paraStart = 0;
+    box->paraLine = 0;
+    if (!boxReflow(box)) {
+        errno = ENOMEM;
         return 0;
     }
+    return 1;
+}
 
-    *big = watermark[1] | (watermark[2] << 8) | (watermark[3] << 16) | (watermark[4] << 24);
-    *small = watermark[5];
+void tigrTextBoxClear(TigrTextBox* box) {
+    box->length = 0;
+    box->numLines = 0;
+    box->paraStart = 0;
+    box->paraLine = 0;
+}
+
+int tigrTextBoxLines(TigrTextBox* box) {
+    return box->numLines;
+}
+
+int tigrTextBoxHeight(TigrTextBox* box) {
+    return box->numLines * tigrGlyph(box->font, 0)->h;
+}
+
+void tigrDrawTextBox(Tigr* dest, TigrTextBox* box, int x, int y, TPixel color) {
+    int cy = dest->ch >= 0 ? dest->cy : 0;
+    int ch = dest->ch >= 0 ? dest->ch : dest->h;
+    int rowh = tigrGlyph(box->font, 0)->h;
+    int first, last;
+
+    if (rowh <= 0)
+        return;
+
+    // Only lay out the lines that overlap the clip rect.
+    first = cy > y ? (cy - y) / rowh : 0;
+    last = cy + ch > y ? (cy + ch - y + rowh - 1) / rowh : 0;
+    last = last < box->numLines ? last : box->numLines;
+
+    for (int i = first; i < last; i++) {
+        BoxLine* line = &box->lines[i];
+        int lx = x;
+        if (box->align == TIGR_ALIGN_CENTER)
+            lx += (box->width - line->width) / 2;
+        else if (box->align == TIGR_ALIGN_RIGHT)
+            lx += box->width - line->width;
+        tigrPrintText(dest, box->font, lx, y + i * rowh, color, box->text + line->start, line->end - line->start);
+    }
+}
+
+void tigrTextBoxFree(TigrTextBox* box) {
+    if (!box)
+        return;
+    free(box->text);
+    free(box->lines);
+    free(box);
+}
+
+//////// End of inlined file: tigr_textbox.c ////////
+
+//////// Start of inlined file: tigr_console.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+typedef struct {
+    int code;
+    TPixel fg, bg;
+} ConsoleCell;
+
+struct TigrConsole {
+    TigrFont* font;
+    int cols, rows;
+    int cellW, cellH;
+    ConsoleCell* cells;
+    unsigned char* dirty;     // per cell
+    unsigned char* dirtyRow;  // any cell in the row is dirty
+    int anyDirty;
+
+    // Rows scrolled since the last draw, and where that was, so the
+    // pixels already drawn can be moved instead of drawn again.
+    int scrolled;
+    Tigr* lastDest;
+    int lastX, lastY;
+};
+
+static void consoleDirtyAll(TigrConsole* con) {
+    memset(con->dirty, 1, (size_t)con->cols * con->rows);
+    memset(con->dirtyRow, 1, con->rows);
+    con->anyDirty = 1;
+}
+
+static void consoleSet(TigrConsole* con, int col, int row, int code, TPixel fg, TPixel bg) {
+    int i = row * con->cols + col;
+    ConsoleCell* cell = &con->cells[i];
+    if (cell->code == code && memcmp(&cell->fg, &fg, sizeof(fg)) == 0 && memcmp(&cell->bg, &bg, sizeof(bg)) == 0)
+        return;
+    cell->code = code;
+    cell->fg = fg;
+    cell->bg = bg;
+    con->dirty[i] = 1;
+    con->dirtyRow[row] = 1;
+    con->anyDirty = 1;
+}
+
+TigrConsole* tigrConsoleCreate(TigrFont* font, int cols, int rows) {
+    TigrConsole* con;
+    TPixel black = { 0, 0, 0, 255 }, white = { 255, 255, 255, 255 };
+
+    if (cols <= 0 || rows <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    con = (TigrConsole*)calloc(1, sizeof(TigrConsole));
+    if (con) {
+        con->cells = (ConsoleCell*)malloc((size_t)cols * rows * sizeof(ConsoleCell));
+        con->dirty = (unsigned char*)malloc((size_t)cols * rows);
+        con->dirtyRow = (unsigned char*)malloc(rows);
+    }
+    if (!con || !con->cells || !con->dirty || !con->dirtyRow) {
+        tigrConsoleFree(con);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    tigrSetupFont(font);
+    con->font = font;
+    con->cols = cols;
+    con->rows = rows;
+
+    // Cells fit the widest ASCII glyph.
+    for (int c = 32; c < 127; c++) {
+        TigrGlyph* g = tigrGlyph(font, c);
+        con->cellW = g->w > con->cellW ? g->w : con->cellW;
+    }
+    con->cellH = tigrGlyph(font, 0)->h;
+
+    for (int i = 0; i < cols * rows; i++) {
+        con->cells[i].code = ' ';
+        con->cells[i].fg = white;
+        con->cells[i].bg = black;
+    }
+    consoleDirtyAll(con);
+    return con;
+}
+
+void tigrConsoleSize(TigrConsole* con, int* w, int* h) {
+    if (w)
+        *w = con->cols * con->cellW;
+    if (h)
+        *h = con->rows * con->cellH;
+}
+
+void tigrConsolePut(TigrConsole* con, int col, int row, int code, TPixel fg, TPixel bg) {
+    if (col >= 0 && col < con->cols && row >= 0 && row < con->rows)
+        consoleSet(con, col, row, code, fg, bg);
+}
+
+int tigrConsolePrint(TigrConsole* con, int col, int row, TPixel fg, TPixel bg, const char* text, int length) {
+    const char* end = text + (length < 0 ? strlen(text) : (size_t)length);
+    int c;
+
+    while (text < end) {
+        text = tigrDecodeUTF8N(text, end, &c);
+        if (c == '\r')
+            continue;
+        if (c == '\n') {
+            col = 0;
+            row++;
+            continue;
+        }
+        tigrConsolePut(con, col++, row, c, fg, bg);
+    }
+    return col;
+}
+
+void tigrConsoleClear(TigrConsole* con, TPixel fg, TPixel bg) {
+    for (int row = 0; row < con->rows; row++) {
+        for (int col = 0; col < con->cols; col++)
+            consoleSet(con, col, row, ' ', fg, bg);
+    }
+}
+
+void tigrConsoleScroll(TigrConsole* con, int lines, TPixel fg, TPixel bg) {
+    int keep;
+
+    if (lines <= 0)
+        return;
+    if (lines > con->rows)
+        lines = con->rows;
+    keep = con->rows - lines;
+
+    memmove(con->cells, con->cells + lines * con->cols, (size_t)keep * con->cols * sizeof(ConsoleCell));
+    memmove(con->dirty, con->dirty + lines * con->cols, (size_t)keep * con->cols);
+    memmove(con->dirtyRow, con->dirtyRow + lines, keep);
+    con->scrolled += lines;
+
+    // The new rows at the bottom get drawn from scratch.
+    for (int row = keep; row < con->rows; row++) {
+        for (int col = 0; col < con->cols; col++) {
+            ConsoleCell* cell = &con->cells[row * con->cols + col];
+            cell->code = ' ';
+            cell->fg = fg;
+            cell->bg = bg;
+        }
+        memset(con->dirty + row * con->cols, 1, con->cols);
+        con->dirtyRow[row] = 1;
+    }
+    con->anyDirty = 1;
+}
+
+// Finds dest's clip rect, clamped to the bitmap.
+static void consoleClipRect(Tigr* dest, int clip[4]) {
+    int x0 = dest->cx > 0 ? dest->cx : 0, y0 = dest->cy > 0 ? dest->cy : 0;
+    int x1 = dest->cw >= 0 ? dest->cx + dest->cw : dest->w;
+    int y1 = dest->ch >= 0 ? dest->cy + dest->ch : dest->h;
+    clip[0] = x0;
+    clip[1] = y0;
+    clip[2] = x1 < dest->w ? x1 : dest->w;
+    clip[3] = y1 < dest->h ? y1 : dest->h;
+}
+
+// Moves the pixels already on screen up, to match rows scrolled since the last draw.
+// Returns zero if they have to be drawn again instead.
+static int consoleMovePixels(Tigr* dest, TigrConsole* con, int x, int y, const int clip[4]) {
+    int w = con->cols * con->cellW, h = con->rows * con->cellH;
+    int shift = con->scrolled * con->cellH;
+
+    if (dest != con->lastDest || x != con->lastX || y != con->lastY || con->scrolled >= con->rows)
+        return 0;
+    if (x < clip[0] || y < clip[1] || x + w > clip[2] || y + h > clip[3])
+        return 0;
 
+    for (int row = y; row < y + h - shift; row++)
+        memmove(dest->pix + row * dest->w + x, dest->pix + (row + shift) * dest->w + x, w * sizeof(TPixel));
     return 1;
 }
 
-int tigrLoadGlyphs(TigrFont* font, int codepage) {
-    int x = 0;
-    int y = 0;
-    int w = 0;
-    int h = 0;
-    int rowh = 1;
+void tigrDrawConsole(Tigr* dest, TigrConsole* con, int x, int y) {
+    TigrFont* font = con->font;
+    TigrTintTable tint;
+    TPixel tinted;
+    int haveTint = 0, clip[4];
+
+    consoleClipRect(dest, clip);
+    if (con->scrolled && !consoleMovePixels(dest, con, x, y, clip))
+        consoleDirtyAll(con);
+    else if (dest != con->lastDest || x != con->lastX || y != con->lastY)
+        consoleDirtyAll(con);
+    con->scrolled = 0;
+    con->lastDest = dest;
+    con->lastX = x;
+    con->lastY = y;
+    if (!con->anyDirty)
+        return;
 
-    TigrGlyph* g;
-    switch (codepage) {
-        case TCP_ASCII:
-            font->numGlyphs = 128 - 32;
-            break;
-        case TCP_1252:
-            font->numGlyphs = 256 - 32;
-            break;
-        case TCP_UTF32:
-            if (!readWatermark(font->bitmap, 0, 0, &font->numGlyphs, &rowh)) {
-                return 0;
+    // Cells outside the clip rect stay dirty, and get drawn once they're inside it.
+    con->anyDirty = 0;
+    for (int row = 0; row < con->rows; row++) {
+        int py = y + row * con->cellH, rowDirty = 0;
+        if (!con->dirtyRow[row])
+            continue;
+        for (int col = 0; col < con->cols; col++) {
+            int i = row * con->cols + col;
+            ConsoleCell* cell = &con->cells[i];
+            TigrGlyph* g;
+            int px = x + col * con->cellW, gw;
+            int fx0 = px > clip[0] ? px : clip[0], fy0 = py > clip[1] ? py : clip[1];
+            int fx1 = px + con->cellW < clip[2] ? px + con->cellW : clip[2];
+            int fy1 = py + con->cellH < clip[3] ? py + con->cellH : clip[3];
+
+            if (!con->dirty[i])
+                continue;
+            if (fx0 >= fx1 || fy0 >= fy1) {
+                rowDirty = 1;
+                continue;
+            }
+            if (fx1 - fx0 < con->cellW || fy1 - fy0 < con->cellH)
+                rowDirty = 1;  // only partly drawn
+            else
+                con->dirty[i] = 0;
+            tigrFill(dest, fx0, fy0, fx1 - fx0, fy1 - fy0, cell->bg);
+
+            // Glyphs wider than a cell are cut off, so they don't spill into the next one.
+            g = tigrGlyph(font, cell->code);
+            gw = g->w < con->cellW ? g->w : con->cellW;
+            if (font->atlas) {
+                if (!haveTint || memcmp(&tinted, &cell->fg, sizeof(tinted)) != 0) {
+                    tigrTintTable(&tint, font->atlas->palette, font->atlas->numColors, cell->fg);
+                    tinted = cell->fg;
+                    haveTint = 1;
+                }
+                tigrBlitIndexed(dest, font->bitmap, font->atlas->index, &tint, px, py, g->x, g->y, gw, g->h);
+            } else {
+                tigrBlitTint(dest, font->bitmap, px, py, g->x, g->y, gw, g->h, cell->fg);
             }
-            h = rowh;
-            x = 1;
-            break;
-        default:
-            errno = EINVAL;
-            return 0;
+        }
+        con->dirtyRow[row] = rowDirty;
+        con->anyDirty |= rowDirty;
     }
+}
 
-    font->glyphs = (TigrGlyph*)calloc(font->numGlyphs, sizeof(TigrGlyph));
+void tigrConsoleInvalidate(TigrConsole* con) {
+    consoleDirtyAll(con);
+}
 
-    for (int index = 0; index < font->numGlyphs; index++) {
-        // Look up the Unicode code point.
-        g = &font->glyphs[index];
+void tigrConsoleFree(TigrConsole* con) {
+    if (!con)
+        return;
+    free(con->cells);
+    free(con->dirty);
+    free(con->dirtyRow);
+    free(con);
+}
 
-        if (codepage != TCP_UTF32) {
-            // Find the next glyph.
-            scan(font->bitmap, &x, &y, &rowh);
+//////// End of inlined file: tigr_console.c ////////
 
-            if (y >= font->bitmap->h) {
-                errno = EINVAL;
-                return 0;
-            }
+//////// Start of inlined file: tigr_sdf.c ////////
 
-            // Scan the width and height
-            w = h = 0;
-            while (!border(font->bitmap, x + w, y)) {
-                w++;
-            }
+//#include "tigr_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
-            while (!border(font->bitmap, x, y + h)) {
-                h++;
-            }
-        }
+// Signed distance field fonts. Each glyph is stored as the distance from its edge,
+// sampled at every pixel of the glyph plus 'spread' pixels of padding around it.
+// Distances are 8-bit, with 128 on the edge and higher values inside.
+typedef struct {
+    int code;
+    int x, y;  // top-left of the padded cell in the atlas
+    int w, h;  // size of the glyph itself, as in the original font
+} SdfGlyph;
+
+struct TigrSdfFont {
+    int spread, lineHeight;
+    int w, h;
+    unsigned char* dist;
+    int numGlyphs;
+    SdfGlyph* glyphs;  // sorted by code
+    SdfGlyph* fallback;
+};
 
-        switch (codepage) {
-            case TCP_ASCII:
-                g->code = index + 32;
-                break;
-            case TCP_1252:
-                if (index < 96) {
-                    g->code = index + 32;
-                } else {
-                    g->code = cp1252[index - 96];
-                }
-                break;
-            case TCP_UTF32:
-                if (!readWatermark(font->bitmap, x, y, &g->code, &w)) {
-                    // Maybe we are at the end of a row?
-                    x = 0;
-                    y += rowh;
-                    if (!readWatermark(font->bitmap, x, y, &g->code, &w)) {
-                        return 0;
-                    }
-                }
-                x++;
-                break;
-            default:
-                return 0;
-        }
+// Saved SDF fonts are "TIGRSDFA", then version, spread, line height, glyph count
+// and atlas size, then code, x, y, w, h for each glyph, then the distances.
+// All little-endian 32-bit values.
+#define SDF_VERSION 1
+#define SDF_HEADER 32
+#define SDF_INF 1e20f
 
-        g->x = x;
-        g->y = y;
-        g->w = w;
-        g->h = h;
-        x += w;
-        if (h != font->glyphs[0].h) {
-            errno = EINVAL;
-            return 0;
-        }
+// Rounding and square roots without libm, which tigr doesn't otherwise need.
+static int sdfFloor(float v) {
+    int i = (int)v;
+    return i > v ? i - 1 : i;
+}
 
-        if (h > rowh) {
-            rowh = h;
-        }
+static int sdfCeil(float v) {
+    int i = (int)v;
+    return i < v ? i + 1 : i;
+}
+
+static float sdfSqrt(float v) {
+    float r = v > 1 ? v / 2 : 1;
+    if (v <= 0)
+        return 0;
+    for (int i = 0; i < 16; i++)
+        r = 0.5f * (r + v / r);
+    return r;
+}
+
+static int sdfCompare(const void* a, const void* b) {
+    const SdfGlyph* ga = (const SdfGlyph*)a;
+    const SdfGlyph* gb = (const SdfGlyph*)b;
+    if (ga->code != gb->code)
+        return ga->code < gb->code ? -1 : 1;
+    if (ga->y != gb->y)
+        return ga->y < gb->y ? -1 : 1;
+    return ga->x < gb->x ? -1 : ga->x > gb->x;
+}
+
+static SdfGlyph* sdfSearch(TigrSdfFont* sdf, int code) {
+    int lo = 0, hi = sdf->numGlyphs - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (sdf->glyphs[mid].code < code)
+            lo = mid + 1;
+        else if (sdf->glyphs[mid].code > code)
+            hi = mid - 1;
+        else
+            return &sdf->glyphs[mid];
     }
+    return NULL;
+}
 
-    // Sort by code point.
-    for (int i = 1; i < font->numGlyphs; i++) {
-        int j = i;
-        TigrGlyph g = font->glyphs[i];
-        while (j > 0 && font->glyphs[j - 1].code > g.code) {
-            font->glyphs[j] = font->glyphs[j - 1];
-            j--;
+static SdfGlyph* sdfGet(TigrSdfFont* sdf, int code) {
+    SdfGlyph* g = sdfSearch(sdf, code);
+    return g ? g : sdf->fallback;
+}
+
+static void sdfSetFallback(TigrSdfFont* sdf) {
+    sdf->fallback = sdfSearch(sdf, '?');
+    if (!sdf->fallback)
+        sdf->fallback = &sdf->glyphs[0];
+}
+
+// Squared distance transform of a sampled function, in one dimension.
+// (Felzenszwalb & Huttenlocher, "Distance Transforms of Sampled Functions")
+static void sdfTransform1D(const float* f, float* d, int n, int* v, float* z) {
+    int k = 0;
+    v[0] = 0;
+    z[0] = -SDF_INF;
+    z[1] = SDF_INF;
+    for (int q = 1; q < n; q++) {
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        while (s <= z[k]) {
+            k--;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = SDF_INF;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; q++) {
+        while (z[k + 1] < q)
+            k++;
+        d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+// Squared distance from each cell of a w x h grid to the nearest zero cell, in place.
+static void sdfTransform(float* grid, int w, int h, float* f, float* d, int* v, float* z) {
+    for (int x = 0; x < w; x++) {
+        for (int y = 0; y < h; y++)
+            f[y] = grid[y * w + x];
+        sdfTransform1D(f, d, h, v, z);
+        for (int y = 0; y < h; y++)
+            grid[y * w + x] = d[y];
+    }
+    for (int y = 0; y < h; y++) {
+        sdfTransform1D(grid + y * w, d, w, v, z);
+        memcpy(grid + y * w, d, w * sizeof(float));
+    }
+}
+
+// Only the bright parts of a glyph make up its shape, so drop shadows are left out.
+static int sdfInside(TPixel p) {
+    int bright = p.r > p.g ? p.r : p.g;
+    bright = p.b > bright ? p.b : bright;
+    return p.a * bright >= 128 * 255;
+}
+
+// Fills in one glyph's padded cell of the atlas.
+static void sdfGlyph(TigrSdfFont* sdf, Tigr* sheet, TigrGlyph* src, SdfGlyph* g, float* scratch) {
+    int s = sdf->spread;
+    int cw = g->w + s * 2, ch = g->h + s * 2, n = cw > ch ? cw : ch;
+    float* toInside = scratch;
+    float* toOutside = toInside + cw * ch;
+    float* f = toOutside + cw * ch;
+    float* d = f + n;
+    float* z = d + n;
+    int* v = (int*)(z + n + 1);
+
+    for (int y = 0; y < ch; y++) {
+        for (int x = 0; x < cw; x++) {
+            int gx = x - s, gy = y - s;
+            int in = gx >= 0 && gy >= 0 && gx < g->w && gy < g->h &&
+                     sdfInside(sheet->pix[(src->y + gy) * sheet->w + src->x + gx]);
+            toInside[y * cw + x] = in ? 0 : SDF_INF;
+            toOutside[y * cw + x] = in ? SDF_INF : 0;
+        }
+    }
+    sdfTransform(toInside, cw, ch, f, d, v, z);
+    sdfTransform(toOutside, cw, ch, f, d, v, z);
+
+    // The edge is half a pixel from the centers of the pixels either side of it.
+    // Anything further than the spread is clamped, so its exact distance doesn't matter.
+    for (int y = 0; y < ch; y++) {
+        unsigned char* out = sdf->dist + (g->y + y) * sdf->w + g->x;
+        for (int x = 0; x < cw; x++) {
+            int i = y * cw + x;
+            float limit = (float)(s + 1) * (s + 1);
+            float outside = toOutside[i] < limit ? toOutside[i] : limit;
+            float inside = toInside[i] < limit ? toInside[i] : limit;
+            float dist = outside > 0 ? sdfSqrt(outside) - 0.5f : 0.5f - sdfSqrt(inside);
+            float value = 128.0f + dist * 127.0f / s;
+            out[x] = (unsigned char)(value < 0 ? 0 : value > 255 ? 255 : value + 0.5f);
         }
-        font->glyphs[j] = g;
     }
-
-    return 1;
 }
 
-TigrFont* tigrLoadFont(Tigr* bitmap, int codepage) {
-    TigrFont* font = (TigrFont*)calloc(1, sizeof(TigrFont));
-    font->bitmap = bitmap;
-    if (!tigrLoadGlyphs(font, codepage)) {
-        tigrFreeFont(font);
+TigrSdfFont* tigrCreateSdfFont(TigrFont* font, int spread) {
+    TigrSdfFont* sdf;
+    float* scratch;
+    long long area = 0;
+    int widest = 0, longest = 0, largest = 0, x = 0, y = 0, rowh = 0;
+
+    if (spread < 1) {
+        errno = EINVAL;
         return NULL;
     }
-    return font;
-}
+    tigrSetupFont(font);
 
-void tigrFreeFont(TigrFont* font) {
-    tigrFree(font->bitmap);
-    free(font->glyphs);
-    free(font);
+    sdf = (TigrSdfFont*)calloc(1, sizeof(TigrSdfFont));
+    if (!sdf || !(sdf->glyphs = (SdfGlyph*)malloc(font->numGlyphs * sizeof(SdfGlyph)))) {
+        free(sdf);
+        errno = ENOMEM;
+        return NULL;
+    }
+    sdf->spread = spread;
+    sdf->lineHeight = tigrGlyph(font, 0)->h;
+    sdf->numGlyphs = font->numGlyphs;
+
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* src = &font->glyphs[i];
+        int cw = src->w + spread * 2, ch = src->h + spread * 2;
+        area += (long long)cw * ch;
+        widest = cw > widest ? cw : widest;
+        longest = cw > longest ? cw : longest;
+        longest = ch > longest ? ch : longest;
+        largest = cw * ch > largest ? cw * ch : largest;
+    }
+
+    // Pack the padded cells in rows, into a roughly square atlas.
+    for (sdf->w = widest; (long long)sdf->w * sdf->w < area;)
+        sdf->w += 16;
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* src = &font->glyphs[i];
+        SdfGlyph* g = &sdf->glyphs[i];
+        int cw = src->w + spread * 2, ch = src->h + spread * 2;
+        if (x + cw > sdf->w) {
+            x = 0;
+            y += rowh;
+            rowh = 0;
+        }
+        g->code = src->code;
+        g->x = x;
+        g->y = y;
+        g->w = src->w;
+        g->h = src->h;
+        x += cw;
+        rowh = ch > rowh ? ch : rowh;
+    }
+    sdf->h = y + rowh;
+
+    sdf->dist = (unsigned char*)malloc((size_t)sdf->w * sdf->h);
+    scratch = (float*)malloc((largest * 2 + longest * 4 + 1) * sizeof(float));
+    if (!sdf->dist || !scratch) {
+        free(scratch);
+        tigrFreeSdfFont(sdf);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(sdf->dist, 0, (size_t)sdf->w * sdf->h);
+    for (int i = 0; i < font->numGlyphs; i++)
+        sdfGlyph(sdf, font->bitmap, &font->glyphs[i], &sdf->glyphs[i], scratch);
+    free(scratch);
+
+    qsort(sdf->glyphs, sdf->numGlyphs, sizeof(SdfGlyph), sdfCompare);
+    sdfSetFallback(sdf);
+    return sdf;
 }
 
-static TigrGlyph* get(TigrFont* font, int code) {
-    unsigned lo = 0, hi = font->numGlyphs;
-    while (lo < hi) {
-        unsigned guess = (lo + hi) / 2;
-        if (code < font->glyphs[guess].code)
-            hi = guess;
-        else
-            lo = guess + 1;
-    }
+int tigrSaveSdfFont(TigrSdfFont* sdf, const char* fileName) {
+    unsigned char header[SDF_HEADER], entry[20];
+    FILE* out;
+    int ok;
 
-    if (lo == 0 || font->glyphs[lo - 1].code != code)
-        return &font->glyphs['?' - 32];
-    else
-        return &font->glyphs[lo - 1];
+    memcpy(header, "TIGRSDFA", 8);
+    tigrPut32LE(header + 8, SDF_VERSION);
+    tigrPut32LE(header + 12, sdf->spread);
+    tigrPut32LE(header + 16, sdf->lineHeight);
+    tigrPut32LE(header + 20, sdf->numGlyphs);
+    tigrPut32LE(header + 24, sdf->w);
+    tigrPut32LE(header + 28, sdf->h);
+
+    out = tigrOpenFile(fileName, "wb");
+    if (!out)
+        return 0;
+
+    ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+    for (int i = 0; i < sdf->numGlyphs && ok; i++) {
+        SdfGlyph* g = &sdf->glyphs[i];
+        tigrPut32LE(entry, g->code);
+        tigrPut32LE(entry + 4, g->x);
+        tigrPut32LE(entry + 8, g->y);
+        tigrPut32LE(entry + 12, g->w);
+        tigrPut32LE(entry + 16, g->h);
+        ok = fwrite(entry, 1, sizeof(entry), out) == sizeof(entry);
+    }
+    ok = ok && fwrite(sdf->dist, 1, (size_t)sdf->w * sdf->h, out) == (size_t)sdf->w * sdf->h;
+    ok = (fclose(out) == 0) && ok;
+    return ok;
 }
 
-void tigrSetupFont(TigrFont* font) {
-    // Load the stock font if needed.
-    if (font == tfont && !tfont->bitmap) {
-        tfont->bitmap = tigrLoadImageMem(tigr_font, tigr_font_size);
-        tigrLoadGlyphs(tfont, 1252);
+// Reads a saved SDF font, checking every glyph lies inside the atlas.
+static int sdfRead(TigrSdfFont* sdf, const unsigned char* data, int length) {
+    unsigned count, w, h;
+
+    errno = EINVAL;
+    if (length < SDF_HEADER || memcmp(data, "TIGRSDFA", 8) != 0 || tigrGet32LE(data + 8) != SDF_VERSION)
+        return 0;
+    sdf->spread = (int)tigrGet32LE(data + 12);
+    sdf->lineHeight = (int)tigrGet32LE(data + 16);
+    count = tigrGet32LE(data + 20);
+    w = tigrGet32LE(data + 24);
+    h = tigrGet32LE(data + 28);
+    if (sdf->spread < 1 || sdf->lineHeight < 0 || count == 0 || count > (unsigned)(length - SDF_HEADER) / 20 ||
+        w == 0 || h == 0 || w > 0x7fff || h > 0x7fff ||
+        (long long)w * h != (long long)length - SDF_HEADER - count * 20)
+        return 0;
+
+    sdf->glyphs = (SdfGlyph*)malloc(count * sizeof(SdfGlyph));
+    sdf->dist = (unsigned char*)malloc((size_t)w * h);
+    if (!sdf->glyphs || !sdf->dist) {
+        errno = ENOMEM;
+        return 0;
+    }
+    sdf->numGlyphs = (int)count;
+    sdf->w = (int)w;
+    sdf->h = (int)h;
+
+    data += SDF_HEADER;
+    for (unsigned i = 0; i < count; i++, data += 20) {
+        SdfGlyph* g = &sdf->glyphs[i];
+        g->code = (int)tigrGet32LE(data);
+        g->x = (int)tigrGet32LE(data + 4);
+        g->y = (int)tigrGet32LE(data + 8);
+        g->w = (int)tigrGet32LE(data + 12);
+        g->h = (int)tigrGet32LE(data + 16);
+        if (g->x < 0 || g->y < 0 || g->w < 0 || g->h < 0 || g->w + sdf->spread * 2 > sdf->w - g->x ||
+            g->h + sdf->spread * 2 > sdf->h - g->y)
+            return 0;
+        if (i > 0 && g->code < g[-1].code)
+            return 0;
     }
+    memcpy(sdf->dist, data, (size_t)w * h);
+    return 1;
 }
 
-void tigrPrint(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const char* text, ...) {
-    char tmp[1024];
-    TigrGlyph* g;
-    va_list args;
-    const char* p;
-    int start = x, c;
+TigrSdfFont* tigrLoadSdfFont(const char* fileName) {
+    TigrSdfFont* sdf = (TigrSdfFont*)calloc(1, sizeof(TigrSdfFont));
+    int length, ok;
+    void* data;
 
-    tigrSetupFont(font);
+    if (!sdf) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    data = tigrReadFile(fileName, &length);
+    if (!data) {
+        free(sdf);
+        return NULL;
+    }
+    ok = sdfRead(sdf, (const unsigned char*)data, length);
+    free(data);
+    if (!ok) {
+        tigrFreeSdfFont(sdf);
+        return NULL;
+    }
+    sdfSetFallback(sdf);
+    return sdf;
+}
+
+#undef SDF_VERSION
+#undef SDF_HEADER
+#undef SDF_INF
+
+// Maps interpolated distances (scaled by 256, then by 1/64) to coverage at a given scale.
+// The edge is blurred over one destination pixel, however big the text is drawn.
+static void sdfCoverage(TigrSdfFont* sdf, float scale, unsigned char table[1024]) {
+    for (int i = 0; i < 1024; i++) {
+        float dist = ((i * 64 + 32) / 256.0f - 128.0f) * sdf->spread / 127.0f * scale;
+        float a = 0.5f + dist;
+        table[i] = (unsigned char)(a <= 0 ? 0 : a >= 1 ? 255 : a * 255 + 0.5f);
+    }
+}
+
+// Draws one glyph with its top-left corner at gx, gy, blending 'color' by coverage.
+static void sdfDraw(Tigr* dest, TigrSdfFont* sdf, SdfGlyph* g, float gx, float gy, float scale, TPixel color,
+                    const unsigned char* coverage) {
+    int cx = dest->cw >= 0 ? dest->cx : 0, cy = dest->ch >= 0 ? dest->cy : 0;
+    int cw = dest->cw >= 0 ? dest->cw : dest->w, ch = dest->ch >= 0 ? dest->ch : dest->h;
+    int s = sdf->spread, cellW = g->w + s * 2, cellH = g->h + s * 2;
+    int x0, y0, x1, y1, step;
+    int xr = color.r + (color.r > 0), xg = color.g + (color.g > 0), xb = color.b + (color.b > 0);
+    int xa = color.a + (color.a > 0);
+    unsigned char r = (unsigned char)(xr * 255 >> 8), gr = (unsigned char)(xg * 255 >> 8);
+    unsigned char b = (unsigned char)(xb * 255 >> 8);
+
+    // Nothing is drawn more than a source pixel outside the glyph.
+    x0 = sdfFloor(gx - scale);
+    y0 = sdfFloor(gy - scale);
+    x1 = sdfCeil(gx + (g->w + 1) * scale);
+    y1 = sdfCeil(gy + (g->h + 1) * scale);
+    x0 = x0 > cx ? x0 : cx;
+    y0 = y0 > cy ? y0 : cy;
+    x1 = x1 < cx + cw ? x1 : cx + cw;
+    y1 = y1 < cy + ch ? y1 : cy + ch;
+    x1 = x1 < dest->w ? x1 : dest->w;
+    y1 = y1 < dest->h ? y1 : dest->h;
+    x0 = x0 > 0 ? x0 : 0;
+    y0 = y0 > 0 ? y0 : 0;
+    if (x0 >= x1 || y0 >= y1)
+        return;
 
-    // Expand the formatting string.
-    va_start(args, text);
-    vsnprintf(tmp, sizeof(tmp), text, args);
-    tmp[sizeof(tmp) - 1] = 0;
-    va_end(args);
+    // Walk the cell in 16.16 fixed point, sampling at destination pixel centers.
+    step = (int)(65536.0f / scale);
+    for (int py = y0; py < y1; py++) {
+        int fy = (int)(((py + 0.5f - gy) / scale + s - 0.5f) * 65536.0f);
+        int sy0, sy1, wy;
+        const unsigned char *row0, *row1;
+        TPixel* td = dest->pix + py * dest->w;
+        int fx = (int)(((x0 + 0.5f - gx) / scale + s - 0.5f) * 65536.0f);
+
+        fy = fy < 0 ? 0 : fy > (cellH - 1) << 16 ? (cellH - 1) << 16 : fy;
+        sy0 = fy >> 16;
+        sy1 = sy0 + 1 < cellH ? sy0 + 1 : sy0;
+        wy = (fy >> 8) & 0xff;
+        row0 = sdf->dist + (g->y + sy0) * sdf->w + g->x;
+        row1 = sdf->dist + (g->y + sy1) * sdf->w + g->x;
+
+        for (int px = x0; px < x1; px++, fx += step) {
+            int cfx = fx < 0 ? 0 : fx > (cellW - 1) << 16 ? (cellW - 1) << 16 : fx;
+            int sx0 = cfx >> 16, sx1 = sx0 + 1 < cellW ? sx0 + 1 : sx0, wx = (cfx >> 8) & 0xff;
+            int top = row0[sx0] * (256 - wx) + row0[sx1] * wx;
+            int bottom = row1[sx0] * (256 - wx) + row1[sx1] * wx;
+            int value = (top * (256 - wy) + bottom * wy) >> 8;
+            int alpha = coverage[value >> 6];
+            unsigned a;
+
+            if (!alpha)
+                continue;
+            a = xa * (alpha + (alpha > 0));
+            td[px].r += (unsigned char)((r - td[px].r) * a >> 16);
+            td[px].g += (unsigned char)((gr - td[px].g) * a >> 16);
+            td[px].b += (unsigned char)((b - td[px].b) * a >> 16);
+            td[px].a += (dest->blitMode) * (unsigned char)((alpha - td[px].a) * a >> 16);
+        }
+    }
+}
 
-    // Print each glyph.
-    p = tmp;
-    while (*p) {
-        p = tigrDecodeUTF8(p, &c);
-        if (c == '\r')
-            continue;
-        if (c == '\n') {
-            x = start;
-            y += tigrTextHeight(font, "");
-            continue;
+void tigrPrintSdf(Tigr* dest, TigrSdfFont* sdf, int x, int y, float scale, TPixel color, const char* text, int length) {
+    const char* end = text + (length < 0 ? strlen(text) : (size_t)length);
+    unsigned char coverage[1024];
+    int ux = 0, uy = 0, cps[256], n;
+
+    if (scale <= 0)
+        return;
+    sdfCoverage(sdf, scale, coverage);
+
+    // Glyphs are placed in font pixels, then scaled, so text keeps its shape at any size.
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            SdfGlyph* g;
+            if (cps[i] == '\r')
+                continue;
+            if (cps[i] == '\n') {
+                ux = 0;
+                uy += sdf->lineHeight;
+                continue;
+            }
+            g = sdfGet(sdf, cps[i]);
+            sdfDraw(dest, sdf, g, x + ux * scale, y + uy * scale, scale, color, coverage);
+            ux += g->w;
         }
-        g = get(font, c);
-        tigrBlitTint(dest, font->bitmap, x, y, g->x, g->y, g->w, g->h, color);
-        x += g->w;
     }
 }
 
-int tigrTextWidth(TigrFont* font, const char* text) {
-    int x = 0, w = 0, c;
-    tigrSetupFont(font);
+int tigrSdfTextWidth(TigrSdfFont* sdf, float scale, const char* text) {
+    const char* end = text + strlen(text);
+    int ux = 0, w = 0, cps[256], n;
 
-    while (*text) {
-        text = tigrDecodeUTF8(text, &c);
-        if (c == '\n' || c == '\r') {
-            x = 0;
-        } else {
-            x += get(font, c)->w;
-            w = (x > w) ? x : w;
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n' || cps[i] == '\r') {
+                ux = 0;
+            } else {
+                ux += sdfGet(sdf, cps[i])->w;
+                w = ux > w ? ux : w;
+            }
         }
     }
-    return w;
+    return sdfCeil(w * scale);
 }
 
-int tigrTextHeight(TigrFont* font, const char* text) {
-    int rowh, h, c;
-    tigrSetupFont(font);
+int tigrSdfTextHeight(TigrSdfFont* sdf, float scale, const char* text) {
+    const char* end = text + strlen(text);
+    int lines = 1, cps[256], n;
 
-    h = rowh = get(font, 0)->h;
-    while (*text) {
-        text = tigrDecodeUTF8(text, &c);
-        if (c == '\n' && *text)
-            h += rowh;
+    while ((n = tigrDecodeUTF8Run(&text, end, cps, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (cps[i] == '\n' && (i + 1 < n || text < end))
+                lines++;
+        }
     }
-    return h;
+    return sdfCeil(lines * sdf->lineHeight * scale);
 }
 
-//////// End of inlined file: tigr_print.c ////////
+void tigrFreeSdfFont(TigrSdfFont* sdf) {
+    if (!sdf)
+        return;
+    free(sdf->glyphs);
+    free(sdf->dist);
+    free(sdf);
+}
+
+//////// End of inlined file: tigr_sdf.c ////////
 
 //////// Start of inlined file: tigr_win.c ////////
 
@@ -2490,7 +7544,7 @@ void tigrFree(Tigr* bmp) {
         free(win->wtitle);
         tigrFree(win->widgets);
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -3297,7 +8351,7 @@ void tigrFree(Tigr* bmp) {
         objc_msgSend_void((id)win->gl.glContext, sel("release"));
         objc_msgSend_void(window, sel("release"));
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -4442,7 +9496,7 @@ void tigrFree(Tigr* bmp) {
     if (bmp->handle) {
         TigrInternal* win = tigrInternal(bmp);
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -4477,6 +9531,13 @@ int tigrReadChar(Tigr* bmp) {
 extern void* _tigrReadFile(const char* fileName, int* length);
 
 void* tigrReadFile(const char* fileName, int* length) {
+    TigrArchive* archive = tigrFindMounted(fileName);
+    if (archive) {
+        void* data = tigrReadMountedFile(archive, fileName, length);
+        tigrReleaseMounted(archive);
+        return data;
+    }
+
     id mainBundle = objc_msgSend_id(class("NSBundle"), sel("mainBundle"));
     id resourcePath = objc_msgSend_id(mainBundle, sel("resourcePath"));
     resourcePath = joinNSStrings(resourcePath, makeNSString("/"));
@@ -4552,6 +9613,7 @@ void tigr_android_destroy();
 #include <string.h>
 #include <stdarg.h>
 #include <sys/time.h>
+#include <time.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xlocale.h>
@@ -4624,6 +9686,9 @@ static void initX11Stuff() {
 
         wmDeleteMessage = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
 
+        // Held keys repeat as presses alone, rather than release/press pairs.
+        XkbSetDetectableAutoRepeat(dpy, True, NULL);
+
         atexit(tearDownX11Stuff);
 
         done = 1;
@@ -4746,8 +9811,10 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
         XResizeWindow(dpy, xwin, w * scale, h * scale);
     }
 
-    // Enable mouse events reporting (needed for mouse wheel events)
-    XSelectInput(dpy, xwin, ButtonPressMask);
+    // Enable input events, for tigrPollEvent and the mouse wheel.
+    XSelectInput(dpy, xwin,
+                 KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask |
+                     StructureNotifyMask);
 
     XTextProperty prop;
     int result = Xutf8TextListToTextProperty(dpy, (char**)&title, 1, XUTF8StringStyle, &prop);
@@ -4797,6 +9864,8 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
 
     memset(win->keys, 0, 256);
     memset(win->prev, 0, 256);
+    win->eventW = w * scale;
+    win->eventH = h * scale;
 
     if (flags & TIGR_NOCURSOR) {
         tigrHideCursor(win);
@@ -5003,21 +10072,148 @@ static void tigrUpdateModifiers(TigrInternal* win) {
     win->keys[TK_ALT] = win->keys[TK_LALT] || win->keys[TK_RALT];
 }
 
-static void tigrInterpretChar(TigrInternal* win, Window root, unsigned int keycode, unsigned int mask) {
-    XKeyEvent event;
-    memset(&event, 0, sizeof(event));
-    event.type = KeyPress;
-    event.display = win->dpy;
-    event.root = root;
-    event.window = win->win;
-    event.state = mask;
-    event.keycode = keycode;
-    char inputTextUTF8[10];
-    Status status = 0;
-    Xutf8LookupString(win->ic, &event, inputTextUTF8, sizeof(inputTextUTF8), NULL, &status);
+static double tigrMonotonicTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// Maps an X server timestamp (milliseconds) onto our clock. Events can only
+// arrive after they happen, so the smallest gap seen so far is the best guess
+// at the offset between the two clocks. Events without one get the time now.
+static double tigrEventTime(TigrInternal* win, Time serverTime) {
+    double now = tigrMonotonicTime();
+    double t = now;
+
+    if (serverTime != CurrentTime) {
+        double gap = now - serverTime / 1000.0;
+        // Start over the first time, and when the server's 32-bit clock wraps.
+        if (win->eventClock == 0 || gap < win->eventClock || gap > win->eventClock + 60)
+            win->eventClock = gap;
+        t = serverTime / 1000.0 + win->eventClock;
+    }
+    if (t < win->lastEventTime)
+        t = win->lastEventTime;
+    win->lastEventTime = t;
+    return t;
+}
+
+static void tigrPushX11Event(TigrInternal* win, TigrEvent* ev, int type, Time serverTime, int x, int y) {
+    memset(ev, 0, sizeof(TigrEvent));
+    ev->type = type;
+    ev->time = tigrEventTime(win, serverTime);
+    ev->x = (x - win->pos[0]) / win->scale;
+    ev->y = (y - win->pos[1]) / win->scale;
+}
+
+static Bool tigrIsWindowEvent(Display* display, XEvent* event, XPointer arg) {
+    (void)display;
+    return event->xany.window == *(Window*)arg;
+}
+
+// Drains the X11 queue for this window into its event queue, in order.
+static void tigrProcessEvents(TigrInternal* win) {
+    XEvent event;
+    TigrEvent ev;
+    Window xwin = win->win;
+
+    while (XCheckIfEvent(win->dpy, &event, tigrIsWindowEvent, (XPointer)&xwin)) {
+        if (XFilterEvent(&event, None))
+            continue;
+
+        switch (event.type) {
+            case KeyPress:
+            case KeyRelease: {
+                int code = event.xkey.keycode;
+                int held = win->eventKeys[code / 8] & (1 << (code % 8));
+                int key = tigrKeyFromX11(XkbKeycodeToKeysym(win->dpy, code, 0, 0));
+
+                if (event.type == KeyRelease) {
+                    win->eventKeys[code / 8] &= ~(1 << (code % 8));
+                    if (key) {
+                        tigrPushX11Event(win, &ev, TIGR_EVENT_KEY_UP, event.xkey.time, event.xkey.x, event.xkey.y);
+                        ev.key = key;
+                        tigrPushEvent(win, &ev);
+                    }
+                    break;
+                }
+
+                // Auto-repeat sends more presses; only the first counts as a key down.
+                win->eventKeys[code / 8] |= 1 << (code % 8);
+                if (key && !held) {
+                    tigrPushX11Event(win, &ev, TIGR_EVENT_KEY_DOWN, event.xkey.time, event.xkey.x, event.xkey.y);
+                    ev.key = key;
+                    tigrPushEvent(win, &ev);
+                }
+
+                char text[32];
+                Status status = 0;
+                int len = Xutf8LookupString(win->ic, &event.xkey, text, sizeof(text), NULL, &status);
+                if (status == XLookupChars || status == XLookupBoth) {
+                    const char* p = text;
+                    while (p < text + len) {
+                        p = tigrDecodeUTF8N(p, text + len, &win->lastChar);
+                        tigrPushX11Event(win, &ev, TIGR_EVENT_CHAR, event.xkey.time, event.xkey.x, event.xkey.y);
+                        ev.key = win->lastChar;
+                        tigrPushEvent(win, &ev);
+                    }
+                }
+                break;
+            }
+
+            case ButtonPress:
+            case ButtonRelease: {
+                int button = event.xbutton.button;
+                int type = event.type == ButtonPress ? TIGR_EVENT_MOUSE_DOWN : TIGR_EVENT_MOUSE_UP;
+
+                tigrPushX11Event(win, &ev, type, event.xbutton.time, event.xbutton.x, event.xbutton.y);
+                if (button >= Button4 && button <= 7) {
+                    // Button4 = WheelUp / Button5 = WheelDown, 6 and 7 scroll sideways
+                    if (event.type == ButtonRelease)
+                        break;
+                    ev.type = TIGR_EVENT_WHEEL;
+                    ev.dy = button == Button4 ? 1.0f : button == Button5 ? -1.0f : 0.0f;
+                    ev.dx = button == 6 ? 1.0f : button == 7 ? -1.0f : 0.0f;
+                    win->scrollDeltaX += ev.dx;
+                    win->scrollDeltaY += ev.dy;
+                } else {
+                    ev.button = button == Button1 ? 1 : button == Button3 ? 2 : button == Button2 ? 4 : 0;
+                    if (!ev.button)
+                        break;
+                }
+                tigrPushEvent(win, &ev);
+                break;
+            }
+
+            case MotionNotify:
+                tigrPushX11Event(win, &ev, TIGR_EVENT_MOUSE_MOVE, event.xmotion.time, event.xmotion.x,
+                                 event.xmotion.y);
+                tigrPushEvent(win, &ev);
+                break;
+
+            case ConfigureNotify:
+                if (event.xconfigure.width != win->eventW || event.xconfigure.height != win->eventH) {
+                    win->eventW = event.xconfigure.width;
+                    win->eventH = event.xconfigure.height;
+                    tigrPushX11Event(win, &ev, TIGR_EVENT_RESIZE, CurrentTime, 0, 0);
+                    ev.x = win->eventW;
+                    ev.y = win->eventH;
+                    tigrPushEvent(win, &ev);
+                }
+                break;
 
-    if (status == XLookupChars) {
-        tigrDecodeUTF8(inputTextUTF8, &win->lastChar);
+            case ClientMessage:
+                if (event.xclient.data.l[0] == (long)wmDeleteMessage) {
+                    tigrPushX11Event(win, &ev, TIGR_EVENT_CLOSE, CurrentTime, 0, 0);
+                    tigrPushEvent(win, &ev);
+                    glXMakeCurrent(win->dpy, None, NULL);
+                    glXDestroyContext(win->dpy, win->glc);
+                    XDestroyWindow(win->dpy, win->win);
+                    win->win = 0;
+                    return;
+                }
+                break;
+        }
     }
 }
 
@@ -5041,54 +10237,25 @@ static void tigrProcessInput(TigrInternal* win, int winWidth, int winHeight) {
     unsigned int mask;
 
     if (XQueryPointer(win->dpy, win->win, &root, &child, &rootX, &rootY, &winX, &winY, &mask)) {
-        static unsigned int prevButtons;
         unsigned int buttons = mask & (Button1Mask | Button2Mask | Button3Mask);
 
         win->mouseX = (winX - win->pos[0]) / win->scale;
         win->mouseY = (winY - win->pos[1]) / win->scale;
 
-        if (buttons != prevButtons && (winX > 0 && winX < winWidth) && (winY > 0 && winY < winHeight)) {
+        if (buttons != win->prevButtons && (winX > 0 && winX < winWidth) && (winY > 0 && winY < winHeight)) {
             win->mouseButtons = (buttons & Button1Mask)       ? 1
                                 : 0 | (buttons & Button3Mask) ? 2
                                 : 0 | (buttons & Button2Mask) ? 4
                                                               : 0;
         }
-        prevButtons = buttons;
-    }
-
-    // Retrieve mouse wheel events - Cannot be done in the XQueryPointer call
-    // -> https://comp.unix.programmer.narkive.com/eOnjkQ6L/xlib-xquerypointer-and-button4mask-button5mask#post2
-    // Button4 = WheelUp / Button5 = WheelDown
-    XEvent mouseButtonEvent;
-    while (XPending(win->dpy)) {
-        XPeekEvent(win->dpy, &mouseButtonEvent);
-        if (mouseButtonEvent.xany.type == ButtonPress) {
-            switch (mouseButtonEvent.xbutton.button) {
-                case Button4:
-                    win->scrollDeltaY += 1;
-                    break;
-                case Button5:
-                    win->scrollDeltaY -= 1;
-                    break;
-                case 6:
-                    win->scrollDeltaX += 1;
-                    break;
-                case 7:
-                    win->scrollDeltaX -= 1;
-                    break;
-            }
-            XNextEvent(win->dpy, &mouseButtonEvent);
-        } else {
-            break;
-        }
+        win->prevButtons = buttons;
     }
 
-    static char prevKeys[32];
     char keys[32];
     XQueryKeymap(win->dpy, keys);
     for (int i = 0; i < 32; i++) {
         char thisBlock = keys[i];
-        char prevBlock = prevKeys[i];
+        char prevBlock = win->prevKeys[i];
         if (thisBlock != prevBlock) {
             for (int j = 0; j < 8; j++) {
                 int thisBit = thisBlock & 1;
@@ -5102,27 +10269,12 @@ static void tigrProcessInput(TigrInternal* win, int winWidth, int winHeight) {
                         int key = tigrKeyFromX11(keySym);
                         win->keys[key] = thisBit;
                         tigrUpdateModifiers(win);
-
-                        if (thisBit) {
-                            tigrInterpretChar(win, root, keyCode, mask);
-                        }
                     }
                 }
-            }
-        }
-    }
-    memcpy(prevKeys, keys, 32);
-
-    XEvent event;
-    while (XCheckTypedWindowEvent(win->dpy, win->win, ClientMessage, &event)) {
-        if (event.xclient.data.l[0] == wmDeleteMessage) {
-            glXMakeCurrent(win->dpy, None, NULL);
-            glXDestroyContext(win->dpy, win->glc);
-            XDestroyWindow(win->dpy, win->win);
-            win->win = 0;
+            }
         }
     }
-    XFlush(win->dpy);
+    memcpy(win->prevKeys, keys, 32);
 }
 
 void tigrUpdate(Tigr* bmp) {
@@ -5146,7 +10298,11 @@ void tigrUpdate(Tigr* bmp) {
     tigrGAPIPresent(bmp, gwa.width, gwa.height);
     glXSwapBuffers(win->dpy, win->win);
 
-    tigrProcessInput(win, gwa.width, gwa.height);
+    // Events first: the wheel only comes that way, and the window may get closed.
+    tigrProcessEvents(win);
+    if (win->win)
+        tigrProcessInput(win, gwa.width, gwa.height);
+    XFlush(win->dpy);
 }
 
 void tigrFree(Tigr* bmp) {
@@ -5159,7 +10315,7 @@ void tigrFree(Tigr* bmp) {
             win->win = 0;
         }
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -5927,7 +11083,7 @@ void tigrFree(Tigr* bmp) {
 
         win->context = EGL_NO_CONTEXT;
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -5987,6 +11143,13 @@ void tigrMouseWheel(Tigr* bmp, float* x, float* y) {
 }
 
 void* tigrReadFile(const char* fileName, int* length) {
+    TigrArchive* archive = tigrFindMounted(fileName);
+    if (archive) {
+        void* data = tigrReadMountedFile(archive, fileName, length);
+        tigrReleaseMounted(archive);
+        return data;
+    }
+
     if (length != 0) {
         *length = 0;
     }
@@ -6585,7 +11748,7 @@ void tigrFree(Tigr* bmp) {
 
         win->context = EGL_NO_CONTEXT;
     }
-    free(bmp->pix);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -7163,6 +12326,22 @@ void tigrGAPIPresent(Tigr* bmp, int w, int h) {
 //#include "tigr_internal.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if (__linux__ && !__ANDROID__) || __MACOS__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+FILE* tigrOpenFile(const char* fileName, const char* mode) {
+    // TODO - unicode?
+    return fopen(fileName, mode);
+}
 
 #ifndef __ANDROID__
 
@@ -7171,15 +12350,21 @@ void* _tigrReadFile(const char* fileName, int* length) {
 #else
 void* tigrReadFile(const char* fileName, int* length) {
 #endif
-    // TODO - unicode?
+    TigrArchive* archive = tigrFindMounted(fileName);
     FILE* file;
     char* data;
     size_t len;
 
+    if (archive) {
+        data = (char*)tigrReadMountedFile(archive, fileName, length);
+        tigrReleaseMounted(archive);
+        return data;
+    }
+
     if (length)
         *length = 0;
 
-    file = fopen(fileName, "rb");
+    file = tigrOpenFile(fileName, "rb");
     if (!file)
         return NULL;
 
@@ -7209,8 +12394,108 @@ void* tigrReadFile(const char* fileName, int* length) {
 
 #endif  // __ANDROID__
 
+#if defined(_WIN32)
+
+const void* tigrMapFile(const char* fileName, int* length) {
+    FILE* file;
+    HANDLE handle, mapping;
+    LARGE_INTEGER size;
+    void* data = NULL;
+
+    if (length)
+        *length = 0;
+
+    file = tigrOpenFile(fileName, "rb");
+    if (!file)
+        return NULL;
+
+    handle = (HANDLE)_get_osfhandle(_fileno(file));
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart <= 0 || size.QuadPart > 0x7fffffff) {
+        fclose(file);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // The view keeps the file open after it's closed here.
+    mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) {
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    fclose(file);
+
+    if (!data) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (length)
+        *length = (int)size.QuadPart;
+    return data;
+}
+
+void tigrUnmapFile(const void* data, int length) {
+    (void)length;
+    if (data)
+        UnmapViewOfFile(data);
+}
+
+#elif (__linux__ && !__ANDROID__) || __MACOS__
+
+const void* tigrMapFile(const char* fileName, int* length) {
+    struct stat st;
+    void* data;
+    int fd;
+
+    if (length)
+        *length = 0;
+
+    // File names are already UTF-8 here, so there's nothing for tigrOpenFile to convert.
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > 0x7fffffff) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    if (length)
+        *length = (int)st.st_size;
+    return data;
+}
+
+void tigrUnmapFile(const void* data, int length) {
+    if (data)
+        munmap((void*)data, (size_t)length);
+}
+
+#else
+
+// No file mapping here, so just read the whole thing.
+const void* tigrMapFile(const char* fileName, int* length) {
+    return tigrReadFile(fileName, length);
+}
+
+void tigrUnmapFile(const void* data, int length) {
+    (void)length;
+    free((void*)data);
+}
+
+#endif
+
 // Reads a single UTF8 codepoint.
 const char* tigrDecodeUTF8(const char* text, int* cp) {
+    return tigrDecodeUTF8N(text, NULL, cp);
+}
+
+const char* tigrDecodeUTF8N(const char* text, const char* end, int* cp) {
     unsigned char c = *text++;
     int extra = 0, min = 0;
     *cp = 0;
@@ -7232,6 +12517,10 @@ const char* tigrDecodeUTF8(const char* text, int* cp) {
         *cp = c;
     }
     while (extra--) {
+        if (text == end) {
+            *cp = 0xfffd;
+            break;
+        }
         c = *text++;
         if ((c & 0xc0) != 0x80) {
             *cp = 0xfffd;
@@ -7245,6 +12534,42 @@ const char* tigrDecodeUTF8(const char* text, int* cp) {
     return text;
 }
 
+int tigrDecodeUTF8Run(const char** text, const char* end, int* cps, int max) {
+    const unsigned long long high = 0x8080808080808080ULL;
+    const char* p = *text;
+    int n = 0;
+
+    while (n < max && p < end) {
+        // Plain ASCII is copied across 16 bytes at a time, checking 8 at once for high bits.
+        if (end - p >= 16 && max - n >= 16) {
+            unsigned long long a, b;
+            memcpy(&a, p, 8);
+            memcpy(&b, p + 8, 8);
+            if (((a | b) & high) == 0) {
+                for (int i = 0; i < 16; i++)
+                    cps[n + i] = (unsigned char)p[i];
+                p += 16;
+                n += 16;
+                continue;
+            }
+        }
+        if ((unsigned char)*p < 0x80)
+            cps[n++] = (unsigned char)*p++;
+        else
+            p = tigrDecodeUTF8N(p, end, &cps[n++]);
+    }
+    *text = p;
+    return n;
+}
+
+int tigrDecodeUTF8Array(const char* text, int length, int* cps, int max, const char** next) {
+    const char* end = text + (length < 0 ? strlen(text) : (size_t)length);
+    int n = tigrDecodeUTF8Run(&text, end, cps, max);
+    if (next)
+        *next = text;
+    return n;
+}
+
 char* tigrEncodeUTF8(char* text, int cp) {
     if (cp < 0 || cp > 0x10ffff) {
         cp = 0xfffd;
@@ -7270,6 +12595,55 @@ char* tigrEncodeUTF8(char* text, int cp) {
 #undef EMIT
 }
 
+void tigrPut32LE(unsigned char* p, unsigned v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+unsigned tigrGet32LE(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static unsigned crcTable[8][256];
+static TigrOnce crcOnce = TIGR_ONCE_INIT;
+
+static void initCrc(void) {
+    for (unsigned i = 0; i < 256; i++) {
+        unsigned c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c >> 1) ^ (0xedb88320 & (0 - (c & 1)));
+        crcTable[0][i] = c;
+    }
+    for (int t = 1; t < 8; t++) {
+        for (int i = 0; i < 256; i++) {
+            unsigned c = crcTable[t - 1][i];
+            crcTable[t][i] = (c >> 8) ^ crcTable[0][c & 0xff];
+        }
+    }
+}
+
+// Slice-by-8 CRC32.
+unsigned tigrCrc32(unsigned crc, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned(*t)[256] = crcTable;
+
+    tigrOnce(&crcOnce, initCrc);
+    crc = ~crc;
+    while (len >= 8) {
+        unsigned a = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24));
+        unsigned b = p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned)p[7] << 24);
+        crc = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff] ^ t[5][(a >> 16) & 0xff] ^ t[4][a >> 24] ^ t[3][b & 0xff] ^
+              t[2][(b >> 8) & 0xff] ^ t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    return ~crc;
+}
+
 #ifndef TIGR_HEADLESS
 
 int tigrBeginOpenGL(Tigr* bmp) {
@@ -7300,10 +12674,439 @@ void tigrSetPostFX(Tigr* bmp, float p1, float p2, float p3, float p4) {
     win->p4 = p4;
 }
 
+void tigrPushEvent(TigrInternal* win, const TigrEvent* event) {
+    if (win->numEvents == MAX_EVENTS) {
+        win->firstEvent = (win->firstEvent + 1) % MAX_EVENTS;
+        win->numEvents--;
+    }
+    win->events[(win->firstEvent + win->numEvents) % MAX_EVENTS] = *event;
+    win->numEvents++;
+}
+
+int tigrPollEvent(Tigr* bmp, TigrEvent* event) {
+    TigrInternal* win = tigrInternal(bmp);
+    if (win->numEvents == 0) {
+        memset(event, 0, sizeof(TigrEvent));
+        event->type = TIGR_EVENT_NONE;
+        return 0;
+    }
+    *event = win->events[win->firstEvent];
+    win->firstEvent = (win->firstEvent + 1) % MAX_EVENTS;
+    win->numEvents--;
+    return 1;
+}
+
 #endif // TIGR_HEADLESS
 
 //////// End of inlined file: tigr_utils.c ////////
 
+//////// Start of inlined file: tigr_thread.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+typedef struct {
+    void (*func)(void*);
+    void* arg;
+} ThreadStart;
+
+#ifdef _WIN32
+
+void tigrMutexInit(TigrMutex* mutex) {
+    InitializeSRWLock(mutex);
+}
+
+void tigrMutexDestroy(TigrMutex* mutex) {
+    (void)mutex;
+}
+
+void tigrMutexLock(TigrMutex* mutex) {
+    AcquireSRWLockExclusive(mutex);
+}
+
+void tigrMutexUnlock(TigrMutex* mutex) {
+    ReleaseSRWLockExclusive(mutex);
+}
+
+void tigrCondInit(TigrCond* cond) {
+    InitializeConditionVariable(cond);
+}
+
+void tigrCondDestroy(TigrCond* cond) {
+    (void)cond;
+}
+
+void tigrCondWait(TigrCond* cond, TigrMutex* mutex) {
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+void tigrCondBroadcast(TigrCond* cond) {
+    WakeAllConditionVariable(cond);
+}
+
+typedef struct {
+    void (*func)(void);
+} OnceCall;
+
+static BOOL CALLBACK onceMain(PINIT_ONCE once, PVOID param, PVOID* context) {
+    (void)once;
+    (void)context;
+    ((OnceCall*)param)->func();
+    return TRUE;
+}
+
+void tigrOnce(TigrOnce* once, void (*func)(void)) {
+    OnceCall call;
+    call.func = func;
+    InitOnceExecuteOnce(once, onceMain, &call, NULL);
+}
+
+static DWORD WINAPI threadMain(LPVOID param) {
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return 0;
+}
+
+int tigrThreadStart(TigrThread* thread, void (*func)(void*), void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start)
+        return 0;
+    start->func = func;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, threadMain, start, 0, NULL);
+    if (!*thread) {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void tigrThreadJoin(TigrThread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+int tigrCpuCount(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+void tigrMutexInit(TigrMutex* mutex) {
+    pthread_mutex_init(mutex, NULL);
+}
+
+void tigrMutexDestroy(TigrMutex* mutex) {
+    pthread_mutex_destroy(mutex);
+}
+
+void tigrMutexLock(TigrMutex* mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+void tigrMutexUnlock(TigrMutex* mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+void tigrCondInit(TigrCond* cond) {
+    pthread_cond_init(cond, NULL);
+}
+
+void tigrCondDestroy(TigrCond* cond) {
+    pthread_cond_destroy(cond);
+}
+
+void tigrCondWait(TigrCond* cond, TigrMutex* mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+
+void tigrCondBroadcast(TigrCond* cond) {
+    pthread_cond_broadcast(cond);
+}
+
+void tigrOnce(TigrOnce* once, void (*func)(void)) {
+    pthread_once(once, func);
+}
+
+static void* threadMain(void* param) {
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.func(start.arg);
+    return NULL;
+}
+
+int tigrThreadStart(TigrThread* thread, void (*func)(void*), void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start)
+        return 0;
+    start->func = func;
+    start->arg = arg;
+    if (pthread_create(thread, NULL, threadMain, start) != 0) {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void tigrThreadJoin(TigrThread thread) {
+    pthread_join(thread, NULL);
+}
+
+int tigrCpuCount(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#else
+    return 1;
+#endif
+}
+
+#endif  // _WIN32
+
+//////// End of inlined file: tigr_thread.c ////////
+
+//////// Start of inlined file: tigr_pool.c ////////
+
+//#include "tigr_internal.h"
+#include <stdlib.h>
+
+// A pool of worker threads for tigrParallelFor. Each thread that joins in owns a
+// slice of the range and works through it a 'grain' at a time. When it runs out,
+// it steals the back half of whichever slice has the most left.
+#define POOL_MAX_THREADS 64
+
+typedef struct {
+    TigrMutex lock;
+    int next, end;
+} PoolSlice;
+
+typedef struct {
+    TigrRangeFunc func;
+    void* ctx;
+    int grain;
+    int numSlices;
+    PoolSlice slices[POOL_MAX_THREADS];
+} PoolJob;
+
+static TigrMutex poolLock = TIGR_MUTEX_INIT;
+static TigrCond poolWake, poolFinished;
+static int poolCondsReady;
+static int poolThreads = 1;  // wanted, counting the calling thread
+static int poolNumWorkers;
+static TigrThread poolWorkers[POOL_MAX_THREADS];
+static PoolJob* poolJob;
+static int poolGeneration, poolActive, poolBusy, poolQuit;
+
+static int poolTake(PoolSlice* slice, int grain, int* lo, int* hi) {
+    int ok = 0;
+    tigrMutexLock(&slice->lock);
+    if (slice->next < slice->end) {
+        *lo = slice->next;
+        *hi = slice->end - slice->next > grain ? slice->next + grain : slice->end;
+        slice->next = *hi;
+        ok = 1;
+    }
+    tigrMutexUnlock(&slice->lock);
+    return ok;
+}
+
+// Moves work from the fullest slice to 'self'. Returns zero if there's none left.
+static int poolSteal(PoolJob* job, int self) {
+    for (;;) {
+        int victim = -1, most = 0, lo, hi;
+
+        for (int i = 0; i < job->numSlices; i++) {
+            PoolSlice* s = &job->slices[i];
+            int left;
+            tigrMutexLock(&s->lock);
+            left = s->end - s->next;
+            tigrMutexUnlock(&s->lock);
+            if (i != self && left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim < 0)
+            return 0;
+
+        // Take the back half, or all of it if that's no more than a grain.
+        tigrMutexLock(&job->slices[victim].lock);
+        lo = job->slices[victim].next;
+        hi = job->slices[victim].end;
+        if (hi - lo > job->grain)
+            lo = hi - (hi - lo) / 2;
+        if (lo < hi)
+            job->slices[victim].end = lo;
+        tigrMutexUnlock(&job->slices[victim].lock);
+
+        // Someone else may have got there first, so look again.
+        if (lo < hi) {
+            tigrMutexLock(&job->slices[self].lock);
+            job->slices[self].next = lo;
+            job->slices[self].end = hi;
+            tigrMutexUnlock(&job->slices[self].lock);
+            return 1;
+        }
+    }
+}
+
+static void poolRun(PoolJob* job, int self) {
+    int lo, hi;
+    for (;;) {
+        if (poolTake(&job->slices[self], job->grain, &lo, &hi))
+            job->func(job->ctx, lo, hi);
+        else if (!poolSteal(job, self))
+            break;
+    }
+}
+
+static void poolWorker(void* arg) {
+    int self = (int)(size_t)arg;
+    int seen = 0;
+
+    tigrMutexLock(&poolLock);
+    for (;;) {
+        PoolJob* job;
+        while (!poolQuit && poolGeneration == seen)
+            tigrCondWait(&poolWake, &poolLock);
+        if (poolQuit)
+            break;
+        seen = poolGeneration;
+        job = poolJob;
+        tigrMutexUnlock(&poolLock);
+
+        if (self < job->numSlices)
+            poolRun(job, self);
+
+        tigrMutexLock(&poolLock);
+        if (--poolActive == 0)
+            tigrCondBroadcast(&poolFinished);
+    }
+    tigrMutexUnlock(&poolLock);
+}
+
+// Stops the workers. Called with poolLock held, and nothing running.
+static void poolStop(void) {
+    int numWorkers = poolNumWorkers;
+
+    poolQuit = 1;
+    tigrCondBroadcast(&poolWake);
+    tigrMutexUnlock(&poolLock);
+    for (int i = 0; i < numWorkers; i++)
+        tigrThreadJoin(poolWorkers[i]);
+    tigrMutexLock(&poolLock);
+    poolQuit = 0;
+    poolNumWorkers = 0;
+}
+
+// Starts any workers that are missing. Called with poolLock held.
+static void poolStart(void) {
+    if (!poolCondsReady) {
+        tigrCondInit(&poolWake);
+        tigrCondInit(&poolFinished);
+        poolCondsReady = 1;
+    }
+    while (poolNumWorkers < poolThreads - 1) {
+        // Worker i takes slice i + 1; the calling thread has slice 0.
+        if (!tigrThreadStart(&poolWorkers[poolNumWorkers], poolWorker, (void*)(size_t)(poolNumWorkers + 1)))
+            break;
+        poolNumWorkers++;
+    }
+}
+
+void tigrSetThreads(int threads) {
+    if (threads <= 0)
+        threads = tigrCpuCount();
+    if (threads > POOL_MAX_THREADS)
+        threads = POOL_MAX_THREADS;
+
+    tigrMutexLock(&poolLock);
+    while (poolBusy)
+        tigrCondWait(&poolFinished, &poolLock);
+    if (poolNumWorkers > threads - 1)
+        poolStop();
+    poolThreads = threads;
+    tigrMutexUnlock(&poolLock);
+}
+
+int tigrGetThreads(void) {
+    int threads;
+    tigrMutexLock(&poolLock);
+    threads = poolThreads;
+    tigrMutexUnlock(&poolLock);
+    return threads;
+}
+
+void tigrParallelFor(int begin, int end, int grain, TigrRangeFunc func, void* ctx) {
+    PoolJob job;
+    int count = end - begin, chunks;
+
+    if (count <= 0)
+        return;
+    if (grain < 1)
+        grain = 1;
+
+    // Small ranges, and calls made while the pool is already busy (including
+    // from inside another tigrParallelFor), just run here.
+    tigrMutexLock(&poolLock);
+    if (poolThreads <= 1 || count <= grain || poolBusy) {
+        tigrMutexUnlock(&poolLock);
+        func(ctx, begin, end);
+        return;
+    }
+    poolStart();
+    if (poolNumWorkers == 0) {
+        tigrMutexUnlock(&poolLock);
+        func(ctx, begin, end);
+        return;
+    }
+    poolBusy = 1;
+
+    // Hand out contiguous slices, one per thread.
+    chunks = (count + grain - 1) / grain;
+    job.func = func;
+    job.ctx = ctx;
+    job.grain = grain;
+    job.numSlices = chunks < poolNumWorkers + 1 ? chunks : poolNumWorkers + 1;
+    for (int i = 0; i < job.numSlices; i++) {
+        tigrMutexInit(&job.slices[i].lock);
+        job.slices[i].next = begin + (int)((long long)chunks * i / job.numSlices) * grain;
+        job.slices[i].end = begin + (int)((long long)chunks * (i + 1) / job.numSlices) * grain;
+        if (job.slices[i].end > end)
+            job.slices[i].end = end;
+    }
+
+    poolJob = &job;
+    poolActive = poolNumWorkers;
+    poolGeneration++;
+    tigrCondBroadcast(&poolWake);
+    tigrMutexUnlock(&poolLock);
+
+    poolRun(&job, 0);
+
+    tigrMutexLock(&poolLock);
+    while (poolActive > 0)
+        tigrCondWait(&poolFinished, &poolLock);
+    poolJob = NULL;
+    poolBusy = 0;
+    tigrCondBroadcast(&poolFinished);
+    tigrMutexUnlock(&poolLock);
+
+    for (int i = 0; i < job.numSlices; i++)
+        tigrMutexDestroy(&job.slices[i].lock);
+}
+
+#undef POOL_MAX_THREADS
+
+//////// End of inlined file: tigr_pool.c ////////
+
 
 //////// End of inlined file: tigr_amalgamated.c ////////
 
@@ -29,6 +29,12 @@ extern "C" {
 #define TIGR_INLINE static inline
 #endif
 
+// Threads.
+// Windows, input and tigrTime belong to the main thread. Everything else can be
+// called from any thread, as long as each bitmap, text box, console or layout is
+// only used by one thread at a time. Fonts can be drawn with from several threads
+// at once, and caches, archives and savers do their own locking.
+
 // Bitmaps ----------------------------------------------------------------
 
 // This struct contains one pixel.
@@ -53,6 +59,7 @@ typedef struct Tigr {
     TPixel *pix;        // pixel data
     void *handle;       // OS window handle, NULL for off-screen bitmaps.
     int blitMode;       // Target bitmap blit mode
+    void *mapping;      // (internal) file mapping holding the pixels, see tigrLoadSnapshot
 } Tigr;
 
 // Creates a new empty window with a given bitmap size.
@@ -230,6 +237,10 @@ typedef struct {
     Tigr *bitmap;
     int numGlyphs;
     TigrGlyph *glyphs;
+    TigrGlyph *fallback;  // drawn for characters the font doesn't have
+    int numPages;
+    TigrGlyph ***pages;   // glyphs by code point, 256 to a page
+    struct TigrFontAtlas *atlas;  // 8-bit copy of the glyphs, for drawing text quickly
 } TigrFont;
 
 typedef enum {
@@ -240,6 +251,8 @@ typedef enum {
 
 // Loads a font from a bitmap font sheet.
 // The loaded font takes ownership of the provided bitmap.
+// Glyphs are copied into an 8-bit atlas for drawing, so later changes to
+// the bitmap won't show up in printed text.
 //
 // Codepages:
 //
@@ -255,6 +268,16 @@ typedef enum {
 //
 TigrFont *tigrLoadFont(Tigr *bitmap, int codepage);
 
+// Saves a font's glyph table, so the font can be loaded again with
+// tigrLoadFontTable without scanning the font sheet. (fileName is UTF-8)
+// On error, returns zero and sets errno.
+int tigrSaveFontTable(TigrFont *font, const char *fileName);
+
+// Loads a font from a font sheet and a glyph table saved by tigrSaveFontTable.
+// Like tigrLoadFont, the font takes ownership of the bitmap.
+// On error, returns NULL and sets errno.
+TigrFont *tigrLoadFontTable(Tigr *bitmap, const char *fileName);
+
 // Frees a font and associated font sheet.
 void tigrFreeFont(TigrFont *font);
 
@@ -264,12 +287,132 @@ void tigrFreeFont(TigrFont *font);
 //  See tigrBlitTint for details.
 void tigrPrint(Tigr *dest, TigrFont *font, int x, int y, TPixel color, const char *text, ...);
 
+// Prints 'length' bytes of UTF-8 text, without any formatting or length limit.
+// Pass -1 as the length for a NUL terminated string.
+void tigrPrintText(Tigr *dest, TigrFont *font, int x, int y, TPixel color, const char *text, int length);
+
 // Returns the width/height of a string.
 int tigrTextWidth(TigrFont *font, const char *text);
 int tigrTextHeight(TigrFont *font, const char *text);
 
-// The built-in font.
-extern TigrFont *tfont;
+// Text that has been laid out once, to be drawn as often as needed.
+typedef struct TigrTextLayout TigrTextLayout;
+
+// Lays out 'length' bytes of UTF-8 text (-1 if it's NUL terminated) for tigrDrawLayout.
+// The font must outlive the layout. On error, returns NULL and sets errno.
+TigrTextLayout *tigrLayoutText(TigrFont *font, const char *text, int length);
+
+// Draws a layout with its top-left corner at x, y. Same as tigrPrintText of the same text.
+void tigrDrawLayout(Tigr *dest, TigrTextLayout *layout, int x, int y, TPixel color);
+
+// Returns the width and height a layout covers when drawn.
+void tigrLayoutSize(TigrTextLayout *layout, int *w, int *h);
+
+void tigrFreeLayout(TigrTextLayout *layout);
+
+// Text alignment for text boxes.
+enum {
+    TIGR_ALIGN_LEFT = 0,
+    TIGR_ALIGN_CENTER = 1,
+    TIGR_ALIGN_RIGHT = 2,
+};
+
+// Word-wrapped text, e.g. for log views and chat panels.
+typedef struct TigrTextBox TigrTextBox;
+
+// Creates an empty text box that wraps lines at 'width' pixels (zero or less to not wrap).
+// The font must outlive the box. On error, returns NULL and sets errno.
+TigrTextBox *tigrTextBoxCreate(TigrFont *font, int width, int align);
+
+// Adds UTF-8 text to the end of a box (length -1 if it's NUL terminated).
+// Only the last paragraph is wrapped again, so appending stays cheap however long the text gets.
+// On error, returns zero and sets errno.
+int tigrTextBoxAppend(TigrTextBox *box, const char *text, int length);
+
+// Changes the wrapping width, and wraps all of the text again.
+// On error, returns zero and sets errno.
+int tigrTextBoxSetWidth(TigrTextBox *box, int width);
+
+// Removes all text from a box.
+void tigrTextBoxClear(TigrTextBox *box);
+
+// Returns the number of wrapped lines, and their total height in pixels.
+int tigrTextBoxLines(TigrTextBox *box);
+int tigrTextBoxHeight(TigrTextBox *box);
+
+// Draws a box with its top-left corner at x, y. Only the lines inside
+// the bitmap's clip rect are drawn, so scrolling through long text is cheap.
+void tigrDrawTextBox(Tigr *dest, TigrTextBox *box, int x, int y, TPixel color);
+
+void tigrTextBoxFree(TigrTextBox *box);
+
+// A grid of character cells, each with its own foreground and background color,
+// for terminal-style output. Only cells that change are drawn again.
+typedef struct TigrConsole TigrConsole;
+
+// Creates a console of cols x rows cells, all spaces in white on black.
+// Cells are as wide as the font's widest ASCII glyph. The font must outlive the console.
+// On error, returns NULL and sets errno.
+TigrConsole *tigrConsoleCreate(TigrFont *font, int cols, int rows);
+
+// Returns the console's size in pixels.
+void tigrConsoleSize(TigrConsole *con, int *w, int *h);
+
+// Sets one cell. Cells outside the console are ignored.
+void tigrConsolePut(TigrConsole *con, int col, int row, int code, TPixel fg, TPixel bg);
+
+// Writes UTF-8 text into cells, starting a new row at each '\n' (length -1 if it's NUL terminated).
+// Returns the column after the last character.
+int tigrConsolePrint(TigrConsole *con, int col, int row, TPixel fg, TPixel bg, const char *text, int length);
+
+// Fills the console with spaces.
+void tigrConsoleClear(TigrConsole *con, TPixel fg, TPixel bg);
+
+// Scrolls the contents up by a number of rows, filling the rows at the bottom with spaces.
+// The next draw moves the pixels already drawn instead of drawing them again.
+void tigrConsoleScroll(TigrConsole *con, int rows, TPixel fg, TPixel bg);
+
+// Draws the cells that have changed since the last draw, with the console's top-left
+// corner at x, y. Cells cut off by the clip rect are drawn again on the next call.
+// The console expects its area of 'dest' to be left alone between draws; if it's
+// drawn somewhere else, or over, everything is drawn again.
+void tigrDrawConsole(Tigr *dest, TigrConsole *con, int x, int y);
+
+// Makes the next tigrDrawConsole draw every cell, e.g. after clearing the bitmap.
+void tigrConsoleInvalidate(TigrConsole *con);
+
+void tigrConsoleFree(TigrConsole *con);
+
+// A font stored as distances from the glyph edges, which can be drawn smoothly at any
+// size. One of these replaces a separate font sheet for each size of text.
+typedef struct TigrSdfFont TigrSdfFont;
+
+// Builds a distance field font from the glyphs of a font, measuring distances up to
+// 'spread' pixels either side of each edge (a few pixels is plenty). Only the bright
+// parts of the glyphs count, so drop shadows are left out. Larger source fonts give
+// better results when scaled up. On error, returns NULL and sets errno.
+TigrSdfFont *tigrCreateSdfFont(TigrFont *font, int spread);
+
+// Saves a distance field font, so it only has to be built once. (fileName is UTF-8)
+// On error, returns zero and sets errno.
+int tigrSaveSdfFont(TigrSdfFont *sdf, const char *fileName);
+
+// Loads a distance field font saved by tigrSaveSdfFont.
+// On error, returns NULL and sets errno.
+TigrSdfFont *tigrLoadSdfFont(const char *fileName);
+
+// Prints UTF-8 text at 'scale' times the size of the original font, with its top-left corner at x, y.
+// (length -1 if it's NUL terminated)
+void tigrPrintSdf(Tigr *dest, TigrSdfFont *sdf, int x, int y, float scale, TPixel color, const char *text, int length);
+
+// Returns the size of text printed with tigrPrintSdf at a scale.
+int tigrSdfTextWidth(TigrSdfFont *sdf, float scale, const char *text);
+int tigrSdfTextHeight(TigrSdfFont *sdf, float scale, const char *text);
+
+void tigrFreeSdfFont(TigrSdfFont *sdf);
+
+// The built-in font. It's loaded the first time it's used, safely from any thread.
+extern TigrFont *const tfont;
 
 
 // User Input -------------------------------------------------------------
@@ -317,6 +460,35 @@ int tigrKeyHeld(Tigr *bmp, int key);
 // Returns the Unicode value of the last key pressed, or 0 if none.
 int tigrReadChar(Tigr *bmp);
 
+// Input events, in the order they happened. Unlike the functions above, which
+// sample once per tigrUpdate, nothing is lost between frames.
+// (Only filled in on Linux/X11 for now; elsewhere tigrPollEvent returns 0)
+typedef enum {
+    TIGR_EVENT_NONE,
+    TIGR_EVENT_KEY_DOWN,    // key
+    TIGR_EVENT_KEY_UP,      // key
+    TIGR_EVENT_CHAR,        // key holds the Unicode character
+    TIGR_EVENT_MOUSE_MOVE,  // x, y
+    TIGR_EVENT_MOUSE_DOWN,  // x, y, button
+    TIGR_EVENT_MOUSE_UP,    // x, y, button
+    TIGR_EVENT_WHEEL,       // x, y, dx, dy
+    TIGR_EVENT_RESIZE,      // x, y hold the new window size
+    TIGR_EVENT_CLOSE
+} TigrEventType;
+
+typedef struct {
+    int type;      // TigrEventType
+    double time;   // seconds, on a clock that never goes backwards
+    int key;       // TKey or ASCII code
+    int x, y;      // position in bitmap pixels
+    int button;    // the bit for the button that changed, as in tigrMouse
+    float dx, dy;  // scroll wheel "notches", as in tigrScrollWheel
+} TigrEvent;
+
+// Takes the oldest queued event for a window; events are queued by tigrUpdate.
+// Returns 0 if there are none left. Only the latest 256 events are kept.
+int tigrPollEvent(Tigr *bmp, TigrEvent *event);
+
 // Show / hide virtual keyboard.
 // (Only available on iOS / Android / Switch)
 void tigrShowKeyboard(int show);
@@ -324,15 +496,195 @@ void tigrShowKeyboard(int show);
 
 // Bitmap I/O -------------------------------------------------------------
 
-// Loads a PNG, from either a file or memory. (fileName is UTF-8)
+// Loads a PNG or QOI image, from either a file or memory. (fileName is UTF-8)
 // On error, returns NULL and sets errno.
 Tigr *tigrLoadImage(const char *fileName);
 Tigr *tigrLoadImageMem(const void *data, int length);
 
+// Reads the size and PNG color type of an image, without decoding it. (fileName is UTF-8)
+// QOI images report RGB (2) or RGBA (6).
+// On error, returns zero and sets errno.
+int tigrImageInfo(const char *fileName, int *w, int *h, int *colorType);
+int tigrImageInfoMem(const void *data, int length, int *w, int *h, int *colorType);
+
+// Decodes an image straight into an existing bitmap, with its top-left corner at dx, dy.
+// Clips, does not blend. (fileName is UTF-8)
+// On error, returns zero and sets errno.
+int tigrLoadImageInto(Tigr *dest, int dx, int dy, const char *fileName);
+int tigrLoadImageMemInto(Tigr *dest, int dx, int dy, const void *data, int length);
+
+// Receives decoded rows from tigrLoadImageRows.
+// 'pix' holds 'rows' rows of 'w' pixels each, starting at row 'y' of the image.
+// Return zero to stop decoding.
+typedef int (*TigrRowsFunc)(void *user, int y, int rows, int w, const TPixel *pix);
+
+// Decodes a PNG a strip of (at most) 'stripRows' rows at a time, instead of
+// into a bitmap. Memory use stays bounded by the strip size no matter how
+// big the image is. (fileName is UTF-8)
+// On error, returns zero and sets errno.
+int tigrLoadImageRows(const char *fileName, int stripRows, TigrRowsFunc func, void *user);
+int tigrLoadImageRowsMem(const void *data, int length, int stripRows, TigrRowsFunc func, void *user);
+
+// A set of images being loaded in the background.
+typedef struct TigrBatch TigrBatch;
+
+// Called from a worker thread as each image in a batch finishes decoding.
+// 'bmp' is NULL if the image failed to load. It still belongs to the batch:
+// don't free it here, take it with tigrBatchWait instead.
+typedef void (*TigrBatchFunc)(void *user, int index, Tigr *bmp);
+
+// Starts decoding a list of PNGs, from either files or memory, in parallel.
+// 'threads' is the number of worker threads to use, or zero for one per CPU core.
+// 'func' may be NULL. Memory blobs must stay valid until the batch is freed.
+// On error, returns NULL and sets errno.
+TigrBatch *tigrLoadImages(const char *const *fileNames, int count, int threads, TigrBatchFunc func, void *user);
+TigrBatch *tigrLoadImagesMem(const void *const *data, const int *lengths, int count, int threads, TigrBatchFunc func, void *user);
+
+// Returns non-zero if image 'index' of a batch has finished decoding.
+int tigrBatchReady(TigrBatch *batch, int index);
+
+// Waits for image 'index' of a batch and returns it, or NULL on error.
+// The returned bitmap belongs to the caller, and is only returned once.
+Tigr *tigrBatchWait(TigrBatch *batch, int index);
+
+// Stops a batch, waits for its workers and frees it.
+// Bitmaps not taken with tigrBatchWait are freed too.
+void tigrBatchFree(TigrBatch *batch);
+
 // Saves a PNG to a file. (fileName is UTF-8)
 // On error, returns zero and sets errno.
 int tigrSaveImage(const char *fileName, Tigr *bmp);
 
+// Saves a PNG with a compression level from 0 (store only) to 9 (smallest, slowest).
+// Level 1 only packs runs of repeated bytes, which is very fast.
+// tigrSaveImage uses level 1, as it always has. Opaque and grey images are saved without
+// the channels they don't need. Large images are compressed in bands on the
+// threads set with tigrSetThreads, as are those from tigrSaveImageFunc/Mem.
+int tigrSaveImageLevel(const char *fileName, Tigr *bmp, int level);
+
+// Saves a large PNG faster by compressing bands of rows on several threads.
+// Pass zero threads to use one per CPU core.
+int tigrSaveImageThreads(const char *fileName, Tigr *bmp, int level, int threads);
+
+// Receives encoded data, in order. Returns non-zero to continue.
+typedef int (*TigrWriteFunc)(void *user, const void *data, int length);
+
+// Saves a PNG through a write callback, without seeking (e.g. to a pipe or socket).
+// On error, returns zero and sets errno (ECANCELED if func returned zero).
+int tigrSaveImageFunc(Tigr *bmp, int level, TigrWriteFunc func, void *user);
+
+// Saves a PNG to memory. Free the result with 'free'.
+// On error, returns NULL and sets errno.
+void *tigrSaveImageMem(Tigr *bmp, int level, int *length);
+
+// Saves a QOI image, which encodes and decodes much faster than PNG.
+// tigrLoadImage and friends recognise QOI files automatically.
+// On error, returns zero/NULL and sets errno.
+int tigrSaveQoi(const char *fileName, Tigr *bmp);
+void *tigrSaveQoiMem(Tigr *bmp, int *length);
+
+// Saves a bitmap's raw pixels as a snapshot, which tigrLoadSnapshot maps straight
+// back into memory. Loading is near-instant and only reads the pages that get used.
+// On error, returns zero and sets errno.
+int tigrSaveSnapshot(const char *fileName, Tigr *bmp);
+
+// Loads a snapshot with its pixels mapped from the file. With copyOnWrite, the bitmap
+// can be drawn to without changing the file; otherwise its pixels are read-only.
+// Free it with tigrFree as usual. On error, returns NULL and sets errno.
+Tigr *tigrLoadSnapshot(const char *fileName, int copyOnWrite);
+
+// Keeps decoded images around, so loading the same one again is nearly free.
+typedef struct TigrCache TigrCache;
+
+typedef struct {
+    int hits, misses, evictions;
+    int images;      // images held in the cache
+    long long bytes; // memory they use
+} TigrCacheStats;
+
+// Creates an image cache. Images nobody is using are freed, least recently
+// used first, to keep the cache within 'budget' bytes.
+TigrCache *tigrCacheCreate(long long budget);
+
+// Loads an image through the cache, keyed by file name (and checked against the
+// file's size and modification time), or by contents for memory blobs, which
+// keeps a copy of the blob to compare against.
+// The bitmap is shared: don't change it, and hand it back with tigrCacheRelease
+// instead of tigrFree. On error, returns NULL and sets errno.
+Tigr *tigrCacheLoad(TigrCache *cache, const char *fileName);
+Tigr *tigrCacheLoadMem(TigrCache *cache, const void *data, int length);
+
+// Releases a bitmap from tigrCacheLoad.
+void tigrCacheRelease(TigrCache *cache, Tigr *bmp);
+
+// Reads the cache's hit/miss/eviction counters and memory use.
+void tigrCacheStats(TigrCache *cache, TigrCacheStats *stats);
+
+// Frees the cache and all of its images.
+void tigrCacheFree(TigrCache *cache);
+
+// Keeps rendered text around, so drawing the same label again is a single blit.
+typedef struct TigrTextCache TigrTextCache;
+
+// Creates a text cache. The least recently drawn labels are freed to keep
+// the cache within 'budget' bytes. On error, returns NULL and sets errno.
+TigrTextCache *tigrTextCacheCreate(long long budget);
+
+// Same as tigrPrintText, but renders each string (per font) only once.
+// Labels are stored untinted, so one entry serves every color.
+void tigrPrintCached(TigrTextCache *cache, Tigr *dest, TigrFont *font, int x, int y, TPixel color, const char *text, int length);
+
+// Reads the cache's hit/miss/eviction counters and memory use ('images' counts labels).
+void tigrTextCacheStats(TigrTextCache *cache, TigrCacheStats *stats);
+
+// Frees the cache. Do this before freeing the fonts it has drawn with.
+void tigrTextCacheFree(TigrTextCache *cache);
+
+// A zip archive of assets, mapped once and indexed by name.
+typedef struct TigrArchive TigrArchive;
+
+// Opens a zip archive. Stored and DEFLATEd entries are supported; zip64 isn't.
+// On error, returns NULL and sets errno.
+TigrArchive *tigrOpenArchive(const char *fileName);
+
+// Reads an entry by its path inside the archive (e.g. "sprites/ship.png").
+// Stored entries are returned without copying; DEFLATEd ones are inflated on demand,
+// checked against the entry's size and CRC-32, and NUL terminated.
+// Hand the data back with tigrArchiveRelease.
+// On error, returns NULL and sets errno.
+const void *tigrArchiveRead(TigrArchive *archive, const char *name, int *length);
+void tigrArchiveRelease(TigrArchive *archive, const void *data);
+
+// Mounts an archive, so tigrReadFile, tigrLoadImage and friends look inside it
+// before the file system. The most recently mounted archive is searched first.
+void tigrMountArchive(TigrArchive *archive);
+void tigrUnmountArchive(TigrArchive *archive);
+
+// Unmounts and closes an archive. Loads already reading from it through the
+// mount, on other threads, finish first.
+void tigrCloseArchive(TigrArchive *archive);
+
+// Saves PNGs on a background thread.
+typedef struct TigrSaver TigrSaver;
+
+// Called from the saver's thread as each image is written.
+// 'ok' is zero if saving failed (errno is set).
+typedef void (*TigrSaverFunc)(void *user, const char *fileName, int ok);
+
+// Starts a background saver that holds at most 'maxPending' images. 'func' may be NULL.
+TigrSaver *tigrSaverCreate(int maxPending, TigrSaverFunc func, void *user);
+
+// Queues a copy of 'bmp' to be saved, so the caller can carry on drawing into it.
+// If the queue is full, waits for room if 'wait' is non-zero, and otherwise
+// returns zero and sets errno to EAGAIN.
+int tigrSaveImageAsync(TigrSaver *saver, const char *fileName, Tigr *bmp, int level, int wait);
+
+// Returns how many images are queued or being saved.
+int tigrSaverPending(TigrSaver *saver);
+
+// Finishes saving everything queued, then frees the saver.
+void tigrSaverFree(TigrSaver *saver);
+
 
 // Helpers ----------------------------------------------------------------
 
@@ -340,6 +692,19 @@ int tigrSaveImage(const char *fileName, Tigr *bmp);
 // or zero on the first call.
 float tigrTime(void);
 
+// Sets how many threads tigr may use for large operations, counting the calling
+// thread. The default is 1, which keeps everything on the calling thread; zero
+// means one per CPU core. Call it while nothing is running in parallel.
+void tigrSetThreads(int threads);
+int tigrGetThreads(void);
+
+// Calls func(ctx, i0, i1) over pieces of the range [begin, end), at most 'grain'
+// long, spread across the threads set with tigrSetThreads. Returns when all the
+// pieces are done. Small ranges, and calls from inside another tigrParallelFor,
+// run straight away on the calling thread.
+typedef void (*TigrRangeFunc)(void *ctx, int begin, int end);
+void tigrParallelFor(int begin, int end, int grain, TigrRangeFunc func, void *ctx);
+
 // Displays an error message and quits. (UTF-8)
 // 'bmp' can be NULL.
 void tigrError(Tigr *bmp, const char *message, ...);
@@ -351,6 +716,12 @@ void tigrError(Tigr *bmp, const char *message, ...);
 // to the end (not included in the length)
 void *tigrReadFile(const char *fileName, int *length);
 
+// Maps an entire file into memory for reading, without copying it. (fileName is UTF-8)
+// Release it with tigrUnmapFile. Platforms without file mapping read the file instead.
+// On error, returns NULL and sets errno.
+const void *tigrMapFile(const char *fileName, int *length);
+void tigrUnmapFile(const void *data, int length);
+
 // Decompresses DEFLATEd zip/zlib data into a buffer.
 // Returns non-zero on success.
 int tigrInflate(void *out, unsigned outlen, const void *in, unsigned inlen);
@@ -358,6 +729,12 @@ int tigrInflate(void *out, unsigned outlen, const void *in, unsigned inlen);
 // Decodes a single UTF8 codepoint and returns the next pointer.
 const char *tigrDecodeUTF8(const char *text, int *cp);
 
+// Decodes up to 'max' codepoints into 'cps', and returns how many were written.
+// Invalid bytes decode to U+FFFD, just as with tigrDecodeUTF8. 'length' is in bytes,
+// or -1 if the text is NUL terminated. If 'next' isn't NULL, it's set to where
+// decoding stopped, so long text can be decoded a piece at a time.
+int tigrDecodeUTF8Array(const char *text, int length, int *cps, int max, const char **next);
+
 // Encodes a single UTF8 codepoint and returns the next pointer.
 char *tigrEncodeUTF8(char *text, int cp);
 